@@ -0,0 +1,28 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <stdexcept>
+#include <vector>
+
+class ComputePipeline {
+private:
+	VkDevice* device;
+
+	VkShaderModule createShaderModule(const std::vector<char>& code);
+
+public:
+	VkPipelineLayout layout;
+	VkPipeline pipeline;
+
+	ComputePipeline();
+	ComputePipeline(VkDevice* device);
+	~ComputePipeline();
+
+	// Push constants, if any, are visible to the compute stage only.
+	void createPipelineLayout(VkDescriptorSetLayout* descriptorLayout, uint32_t pushConstantSize = 0);
+	void createPipeline(std::vector<char> compShaderCode);
+
+	void destroy();
+};
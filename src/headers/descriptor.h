@@ -6,6 +6,7 @@
 #include <stdexcept>
 #include <vector>
 
+#include "descriptorAllocator.h"
 #include "utils.h"
 
 struct DescriptorBinding {
@@ -13,13 +14,15 @@ struct DescriptorBinding {
 	std::vector<VkBuffer> buffers;
 	VkImageView imageView;
 	VkSampler sampler;
+	VkDescriptorBindingFlagsEXT flags;
 
 	DescriptorBinding(
 		VkDescriptorSetLayoutBinding binding,
 		const std::vector<VkBuffer>& buffers = {},
 		VkImageView imageView = VK_NULL_HANDLE,
-		VkSampler sampler = VK_NULL_HANDLE
-	) : binding(binding), buffers(buffers), imageView(imageView), sampler(sampler) {}
+		VkSampler sampler = VK_NULL_HANDLE,
+		VkDescriptorBindingFlagsEXT flags = 0
+	) : binding(binding), buffers(buffers), imageView(imageView), sampler(sampler), flags(flags) {}
 };
 
 class Descriptor {
@@ -28,27 +31,32 @@ private:
 	uint32_t numUniformBuffers;
 	uint32_t numTextureBuffers;
 	uint32_t numInputBuffers;
+	uint32_t numStorageBuffers;
 	uint32_t totalNumBuffers;
 
 	std::vector<DescriptorBinding> bindings;
 
 	void createDescriptorSetLayout();
-	void allocateDescriptorSets();
+	void allocateDescriptorSets(DescriptorAllocator& allocator);
 	void updateDescriptorSets();
+	// Whether some binding may be written while the sets are bound, which the pool and layout have to allow.
+	bool isUpdateAfterBind() const;
 
 public:
-	VkDescriptorPool descriptorPool;
 	std::vector<VkDescriptorSet> descriptorSets;
 	VkDescriptorSetLayout descriptorSetLayout;
 
 	Descriptor();
-	Descriptor(VkDevice *device, uint32_t numUniformBuffers, uint32_t numTextureBuffers, uint32_t numInputBuffers);
+	Descriptor(VkDevice *device, uint32_t numUniformBuffers, uint32_t numTextureBuffers, uint32_t numInputBuffers, uint32_t numStorageBuffers = 0);
 	~Descriptor();
 
-	void create();
+	// The sets come from allocator, which has to allow updates after bind if a binding does.
+	void create(DescriptorAllocator& allocator);
+	// Destroys the layout. The sets go with the pools of the allocator.
 	void destroy();
 
-	void createDescriptorPool(const uint32_t poolSize = 1000);
+	// What one set takes.
+	DescriptorCounts getDescriptorCounts() const;
 
 	void addDescriptorSetLayoutBinding(
 		uint32_t binding, 
@@ -59,4 +67,14 @@ public:
 		VkImageView imageView = VK_NULL_HANDLE,
 		VkSampler sampler = VK_NULL_HANDLE
 	);
+
+	// An array of count combined image samplers, which may stay partly unwritten and be written while the sets
+	// are bound (VK_EXT_descriptor_indexing). Its elements are written with updateImageArrayElement.
+	void addBindlessImageArray(uint32_t binding, VkShaderStageFlags shaderStageFlags, uint32_t count);
+
+	void updateImageArrayElement(uint32_t binding, uint32_t element, VkImageView imageView, VkSampler sampler);
+
+	// Points an image binding of frame's set at another view, e.g. a recreated attachment. The set must not
+	// be in use.
+	void updateImageBinding(uint32_t frame, uint32_t binding, VkImageView imageView, VkSampler sampler = VK_NULL_HANDLE);
 };
\ No newline at end of file
@@ -0,0 +1,129 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// Descriptors by type, e.g. what one set of a layout takes.
+typedef std::map<VkDescriptorType, uint32_t> DescriptorCounts;
+
+struct DescriptorAllocatorStats {
+	uint32_t pools;
+	uint32_t sets;
+	// Descriptors the pools were created for, and those the allocated sets take of them.
+	uint32_t descriptorsReserved;
+	uint32_t descriptorsUsed;
+};
+
+// Hands out descriptor sets from pools it creates when the ones it has are full. A new pool is sized by type
+// for the sets that didn't fit, and at least twice the pool before it, so that only the types sets really
+// use get reserved and few pools end up holding everything. Vulkan 1.0 doesn't report a full pool, so the
+// allocator counts what its pools have left.
+class DescriptorAllocator {
+private:
+	struct Pool {
+		VkDescriptorPool pool;
+		DescriptorCounts capacity;
+		DescriptorCounts used;
+		uint32_t maxSets;
+		uint32_t usedSets;
+	};
+
+	VkDevice* device;
+	VkDescriptorPoolCreateFlags flags;
+	std::vector<Pool> pools;
+	// What the next pool is created for at least.
+	DescriptorCounts nextCapacity;
+	uint32_t nextMaxSets;
+
+	static bool fits(const Pool& pool, const DescriptorCounts& counts, uint32_t numSets);
+	Pool& createPool(const DescriptorCounts& counts, uint32_t numSets);
+
+public:
+	DescriptorAllocator();
+	// flags are given to every pool, e.g. VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT for sets
+	// of layouts that need it.
+	DescriptorAllocator(VkDevice* device, VkDescriptorPoolCreateFlags flags = 0);
+	~DescriptorAllocator();
+
+	void destroy();
+
+	// numSets sets of layout, which take counts descriptors each.
+	std::vector<VkDescriptorSet> allocate(VkDescriptorSetLayout layout, const DescriptorCounts& counts, uint32_t numSets = 1);
+	// Frees every set at once. The pools are kept for the sets allocated next, merged into one when there
+	// are several.
+	void reset();
+
+	DescriptorAllocatorStats getStats() const;
+};
+
+// One descriptor written to a set.
+struct DescriptorWrite {
+	uint32_t binding;
+	VkDescriptorType type;
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	VkDeviceSize range;
+	VkImageView imageView;
+	VkSampler sampler;
+	VkImageLayout imageLayout;
+
+	static DescriptorWrite forBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+	static DescriptorWrite forImage(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler = VK_NULL_HANDLE, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+	bool operator==(const DescriptorWrite& other) const;
+};
+
+struct DescriptorCacheStats {
+	// Since the last resetStats: sets found in the cache, sets allocated and written, and descriptors written.
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t descriptorWrites;
+};
+
+// Sets keyed by their layout and what is bound to them. Asking twice for the same returns the set written
+// the first time, so passes and draws can ask for their sets every time they are recorded and only write
+// them when what they bind changed. The sets come from an allocator of the cache's own, which a reset frees
+// in bulk, e.g. once the resources they bind were recreated and the GPU is idle.
+class DescriptorSetCache {
+private:
+	struct Key {
+		VkDescriptorSetLayout layout;
+		std::vector<DescriptorWrite> writes;
+
+		bool operator==(const Key& other) const;
+	};
+
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	VkDevice* device;
+	DescriptorAllocator allocator;
+	std::unordered_map<Key, VkDescriptorSet, KeyHash> sets;
+	DescriptorCacheStats stats;
+
+public:
+	DescriptorSetCache();
+	DescriptorSetCache(VkDevice* device, VkDescriptorPoolCreateFlags flags = 0);
+	~DescriptorSetCache();
+
+	void destroy();
+
+	// The set of layout with writes bound, which have to cover every binding of the layout.
+	VkDescriptorSet getSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes);
+	// Frees every set. None of them may be in use anymore.
+	void reset();
+	// Forgets the sets that bind buffer, which is about to be destroyed, so that a buffer created later with
+	// the same handle doesn't find them. They may still be in use and stay allocated until the next reset.
+	void forgetBuffer(VkBuffer buffer);
+	void resetStats();
+
+	DescriptorCacheStats getStats() const;
+	DescriptorAllocatorStats getAllocatorStats() const;
+};
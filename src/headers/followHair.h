@@ -0,0 +1,87 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+#include "meshClusters.h"
+#include "strands.h"
+#include "threadPool.h"
+
+// The binding of one card vertex as laid out for followHair.comp (std430).
+struct PackedFollowHairBinding {
+	// xyz: first guide vertex of the bound segment of each guide.
+	glm::uvec4 segments;
+	// xyz: guide weights, w: position inside the segment.
+	glm::vec4 weights;
+	glm::vec4 rest;
+};
+
+// Drives the render card vertices from the simulated guide strands ("follow hair").
+// At load every card vertex is bound to up to 3 nearby guides with barycentric weights and a
+// parametric position along the strands. Each frame the vertex is moved by the weighted displacement
+// of its guides at that position, so the cost of the solver only depends on the number of guides. Its
+// offset from the blended guide point and its normal turn with the blended frames of the guide roots.
+class FollowHair {
+private:
+	uint32_t numVertices;
+
+	// Per card vertex: index of the first guide vertex of the bound segment, one per guide.
+	std::vector<uint32_t> segment0, segment1, segment2;
+	std::vector<float> weight0, weight1, weight2;
+	// Position inside the bound segment. The same for all guides of a vertex.
+	std::vector<float> fraction;
+	std::vector<float> restX, restY, restZ;
+	// Rest offset from the weighted guide point at the bound parameter, and rest normal.
+	std::vector<glm::vec3> restOffsets;
+	std::vector<glm::vec3> restNormals;
+	uint32_t verticesPerStrand;
+
+	// Displacement of every guide vertex from its rest pose, rebuilt every frame.
+	std::vector<float> displacementX, displacementY, displacementZ;
+
+	// Per cluster of the cards, the guides its vertices are bound to: those of cluster c are
+	// clusterGuides[clusterGuideOffsets[c], clusterGuideOffsets[c + 1]). And the longest rest offset of
+	// its vertices.
+	std::vector<uint32_t> clusterGuideOffsets;
+	std::vector<uint32_t> clusterGuides;
+	std::vector<float> clusterReach;
+	// Bounds of every guide, rebuilt by refitClusters.
+	std::vector<glm::vec3> guideLower, guideUpper;
+
+	void deformRange(uint32_t begin, uint32_t end, const glm::mat3* rootRotations, Vertex* out) const;
+
+public:
+	FollowHair();
+	FollowHair(
+		const std::vector<Vertex>& vertices,
+		const GuideStrands& strands,
+		const CardVertexInfo& cardInfo,
+		uint32_t guidesPerVertex,
+		ThreadPool& pool,
+		// Guides the vertices may bind to, all of them if empty.
+		const std::vector<uint32_t>& activeStrands = {}
+	);
+
+	uint32_t size() const;
+
+	std::vector<PackedFollowHairBinding> packBindings() const;
+
+	// Writes the deformed positions into out[i].pos and leaves the other attributes untouched. With
+	// rootRotations, the rotation of every guide root from its rest pose, the offsets from the guides and
+	// out[i].normal are rotated as well. out must hold at least size() vertices.
+	void deform(const GuideStrands& strands, const std::vector<glm::mat3>& rootRotations, Vertex* out, ThreadPool& pool);
+
+	// Finds the guides the vertices of each cluster are bound to, for refitClusters. indices are those the
+	// clusters index into.
+	void bindClusters(const std::vector<uint32_t>& indices, const std::vector<MeshCluster>& clusters);
+
+	// Writes a sphere into out[c].sphere for every bound cluster that holds its vertices wherever deform
+	// puts them for these strands. A vertex is a convex blend of points on its guides plus its rest offset,
+	// turned or not, so the sphere is the one around the bounds of the guides widened by the longest offset.
+	void refitClusters(const GuideStrands& strands, PackedMeshCluster* out, ThreadPool& pool);
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+
+const uint32_t MAX_POINT_ATTRACTORS = 2;
+
+struct PointAttractor {
+	bool enabled = false;
+	glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
+	// Acceleration at distance radius, negative values repel.
+	float strength = 2.0f;
+	// Softens the pull close to the centre, so vertices don't get flung through it.
+	float radius = 0.1f;
+};
+
+// External forcing of the guide strands.
+// Wind is an air velocity field: a mean direction and speed, curl noise turbulence (divergence free,
+// so it swirls without gathering the hair in sinks) and a per-vertex gust jitter. It acts on the hair
+// through drag, which pulls vertex velocities towards the air velocity. Without wind drag pulls towards
+// still air and simply slows the hair down.
+struct ForceFieldSettings {
+	bool windOn = false;
+	glm::vec3 windDirection = glm::vec3(1.0f, 0.0f, 0.0f);
+	float windSpeed = 2.0f;
+	// Speed of the curl noise relative to windSpeed.
+	float turbulence = 0.75f;
+	// Spatial frequency of the curl noise, in waves per unit.
+	float turbulenceFrequency = 6.0f;
+	// How fast the curl noise changes over time.
+	float turbulenceSpeed = 1.5f;
+	// Random per-vertex change of the wind speed, as a fraction of it.
+	float gustJitter = 0.2f;
+
+	// Still air drag without wind.
+	bool dragOn = false;
+	// How fast vertex velocities approach the air velocity, per second.
+	float drag = 1.5f;
+
+	std::array<PointAttractor, MAX_POINT_ATTRACTORS> attractors;
+};
+
+// A contiguous run of strand vertices in structure-of-arrays layout.
+// Acceleration is written, not added, for every vertex in the batch.
+struct ForceFieldBatch {
+	const float* posX;
+	const float* posY;
+	const float* posZ;
+	const float* velX;
+	const float* velY;
+	const float* velZ;
+	float* accX;
+	float* accY;
+	float* accZ;
+	uint32_t count;
+	// Index of the first vertex in the strands, the key of the gust jitter.
+	uint32_t firstVertex;
+};
+
+// True if any field would produce a non-zero acceleration.
+bool hasForceFields(const ForceFieldSettings& settings);
+
+// Evaluates all enabled fields over a batch, one field at a time. Every field is a straight loop over
+// the batch without branches or virtual calls, so the cost is linear in the number of vertices and the
+// compiler can vectorise each loop. randomSeed and randomStep key the gust jitter (see random.h).
+void evaluateForceFields(const ForceFieldSettings& settings, float time, uint32_t randomSeed, uint32_t randomStep, const ForceFieldBatch& batch);
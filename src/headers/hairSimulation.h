@@ -0,0 +1,112 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "strands.h"
+#include "hairVolume.h"
+#include "forceField.h"
+#include "threadPool.h"
+
+struct SimulationSettings {
+	glm::vec3 gravity = glm::vec3(0.0f, 0.0f, -9.81f);
+	// Fraction of the velocity removed over a whole step, which the scheduler runs at a fixed rate.
+	float damping = 0.0396f;
+	// Every step is split into this many substeps. The solver spreads damping and shapeStiffness over them,
+	// so the simulation LOD can change them without making the hair softer or stiffer.
+	uint32_t substeps = 2;
+	uint32_t constraintIterations = 4;
+	// Fraction of the way back to its rest pose relative to the root each vertex is pulled over a whole step,
+	// across every substep and constraint iteration.
+	float shapeStiffness = 0.3366f;
+
+	// What each of substeps substeps keeps of the velocity, which removes damping over the step.
+	float getSubstepVelocityKeep(uint32_t substeps) const;
+	// The pull of every constraint iteration of substeps substeps, which adds up to shapeStiffness over the step.
+	float getIterationShapeStiffness(uint32_t substeps) const;
+
+	// Hair-hair interaction through the voxel grid.
+	bool enableVolume = true;
+	glm::ivec3 volumeResolution = glm::ivec3(32);
+	float volumeFriction = 0.1f;
+	float volumeRepulsion = 0.01f;
+
+	// Wind, drag and attractors.
+	ForceFieldSettings forces;
+
+	// Gives bit-identical results for any number of threads, at the cost of a fixed split of the voxel grid splat.
+	bool deterministic = false;
+	// Seed of random(). Only used as is in deterministic mode, otherwise it is salted per run.
+	uint32_t randomSeed = 0x2545f491u;
+};
+
+// Position based guide strand solver.
+// Each step predicts positions under gravity and the force fields, projects the root pins, segment lengths and rest shape,
+// derives velocities from the corrected positions and finally runs the hair-hair interaction on the voxel grid.
+// Strands are independent until the grid stage, so every stage is split across the thread pool by strand.
+// Only the active strands are stepped, which is how the simulation LOD drops guides.
+class HairSimulation {
+private:
+	ThreadPool* pool;
+	HairVolume volume;
+	// Strands the solver steps, in increasing order. The others keep their last state.
+	std::vector<uint32_t> activeStrands;
+
+	// Predicted positions of the current step.
+	std::vector<float> predX, predY, predZ;
+	// Accelerations from the force fields, rebuilt every substep.
+	std::vector<float> accX, accY, accZ;
+	// Simulated seconds since the last reset, drives the wind turbulence.
+	float time;
+
+	// Per strand: where the root has to be at the end of the next step and how its frame is rotated
+	// from the rest pose. The rest shape constraint is rotated with the root.
+	std::vector<glm::vec3> rootTargets;
+	std::vector<glm::mat3> rootRotations;
+
+	// Substeps since the last reset, one of the keys of random().
+	uint32_t stepIndex;
+	// Mixed into the seed outside of deterministic mode.
+	uint32_t runSalt;
+
+	// rootBlend is the fraction of the remaining way to the root targets the roots move in this substep.
+	void predict(float dt, float rootBlend);
+
+	void solveConstraints();
+
+	void updateVelocities(float dt);
+
+public:
+	GuideStrands strands;
+	SimulationSettings settings;
+
+	HairSimulation();
+	HairSimulation(GuideStrands&& strands, ThreadPool* pool, const SimulationSettings& settings = {});
+
+	void step(float dt);
+
+	// Puts every strand back into its rest pose, carried along by the root frames.
+	void reset();
+
+	// Moves the pinned roots, e.g. with the head. Both hold one entry per strand. The roots reach their
+	// targets at the end of the next step, moving a bit further every substep, and the rest shape is
+	// rotated with them. The frames stay until they are set again.
+	void setRootFrames(const std::vector<glm::vec3>& positions, const std::vector<glm::mat3>& rotations);
+
+	// Strands that were inactive take the deformation of the closest previously active strand,
+	// so that they don't pop when they join in again.
+	void setActiveStrands(const std::vector<uint32_t>& strands);
+
+	const std::vector<uint32_t>& getActiveStrands() const;
+
+	// Uniform random number in [0, 1) for the current substep. It is a hash of the seed, the substep,
+	// the stream (one per stochastic term) and the index (e.g. the vertex), so it doesn't depend on
+	// which thread asks for it or in which order.
+	float random(uint32_t stream, uint32_t index) const;
+
+	uint32_t getRandomSeed() const;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "strands.h"
+#include "threadPool.h"
+
+// Eulerian voxel grid for hair-hair interaction (Petrovic et al. 2005, McAdams et al. 2009).
+// Strand vertices splat their density and velocity into one grid per thread pool partition.
+// The partial grids are summed into the final grid, which the solver samples to apply
+// friction (velocity smoothing) and repulsion (pushing vertices down the density gradient).
+// Float sums depend on how the vertices are split up, so a deterministic splat uses a fixed
+// number of partitions instead of one per thread.
+// All storage is allocated once in the constructor and reused every step.
+class HairVolume {
+private:
+	glm::ivec3 resolution;
+	uint32_t numCells;
+	glm::vec3 origin;
+	glm::vec3 cellSize;
+
+	// One grid per partition with 4 floats per cell: density followed by momentum.
+	std::vector<std::vector<float>> partitionGrids;
+	std::vector<glm::vec3> partitionMin;
+	std::vector<glm::vec3> partitionMax;
+
+	uint32_t cellIndex(int32_t x, int32_t y, int32_t z) const;
+
+	// Returns the cell the position falls in and the trilinear fractions inside it.
+	glm::ivec3 locate(const glm::vec3& position, glm::vec3& fraction) const;
+
+	float sample(const std::vector<float>& field, const glm::vec3& position) const;
+
+	void computeBounds(const GuideStrands& strands, const std::vector<uint32_t>& activeStrands, ThreadPool& pool);
+
+public:
+	// Partitions of a deterministic splat, independent of the size of the thread pool.
+	static constexpr uint32_t DETERMINISTIC_PARTITIONS = 8;
+
+	std::vector<float> density;
+	std::vector<float> velocityX, velocityY, velocityZ;
+
+	HairVolume();
+	HairVolume(glm::ivec3 resolution, uint32_t numPartitions);
+
+	// Scatters every vertex of the active strands into the grid.
+	// A deterministic splat gives the same grid for any number of threads.
+	void splat(const GuideStrands& strands, const std::vector<uint32_t>& activeStrands, ThreadPool& pool, bool deterministic = false);
+
+	// Blends vertex velocities of the active strands towards the grid velocity and pushes them out of dense regions.
+	void apply(GuideStrands& strands, const std::vector<uint32_t>& activeStrands, float friction, float repulsion, float dt, ThreadPool& pool) const;
+
+	float sampleDensity(const glm::vec3& position) const;
+
+	glm::vec3 sampleVelocity(const glm::vec3& position) const;
+
+	glm::vec3 sampleDensityGradient(const glm::vec3& position) const;
+};
@@ -35,6 +35,17 @@
 #include "descriptor.h"
 #include "renderPass.h"
 #include "pipeline.h"
+#include "computePipeline.h"
+#include "threadPool.h"
+#include "hairSimulation.h"
+#include "followHair.h"
+#include "simulationScheduler.h"
+#include "simulationLod.h"
+#include "simulationCache.h"
+#include "rootAttachment.h"
+#include "meshClusters.h"
+#include "uniformArena.h"
+#include "renderGraph.h"
 
 #ifdef NDEBUG
 const bool enableValidationLayers = false;
@@ -46,7 +57,10 @@ const std::vector<const char*> validationLayers = {
 	"VK_LAYER_KHRONOS_validation"
 };
 const std::vector<const char*> deviceExtensions = {
-	VK_KHR_SWAPCHAIN_EXTENSION_NAME
+	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
+	// The bindless texture table.
+	VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
 };
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
@@ -60,6 +74,14 @@ static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
 	return VK_FALSE;
 }
 
+// Pipeline statistics queries of the hair passes, HAIR_QUERY_COUNT per frame in flight.
+enum HairQuery {
+	HAIR_QUERY_PREPASS,
+	HAIR_QUERY_CORE,
+	HAIR_QUERY_TRANSPARENT,
+	HAIR_QUERY_COUNT
+};
+
 struct QueueFamilyIndices {
 	std::optional<uint32_t> graphicsFamily;
 	std::optional<uint32_t> presentFamily;
@@ -85,6 +107,16 @@ struct MeshBuffer {
 	uint32_t count;
 };
 
+// What a swapchain recreation replaced, kept until no frame in flight reads it anymore.
+struct RetiredSwapChain {
+	std::vector<VkSwapchainKHR> swapChains;
+	std::vector<VulkanImage> images;
+	// Views only, their images belong to the swapchain.
+	std::vector<VulkanImage> swapChainViews;
+	std::vector<VkFramebuffer> framebuffers;
+	std::vector<VkDeviceMemory> memory;
+};
+
 class Main {
 public:
 	Main(GLFWwindow* window,
@@ -92,6 +124,7 @@ public:
 		std::unordered_map<std::string, std::vector<char>>&& shaders,
 		std::unordered_map<std::string,
 		std::pair<std::vector<Vertex>, std::vector<uint32_t>>>&& models,
+		std::unordered_map<std::string, std::vector<MeshCluster>>&& meshClusters,
 		std::unordered_map<std::string, Image>&& textures = {},
 		//CubeMap&& envMap = {}
 		HDRImage&& envMap = {});
@@ -120,13 +153,17 @@ private:
 	VkQueue presentQueue;
 
 	VkSwapchainKHR swapChain;
-	std::vector<VkFramebuffer> swapChainFramebuffers;
 	uint32_t imageCount;
+	// Per frame: what recreations replaced while it was the last one submitted, freed once its fence was
+	// waited on again.
+	std::vector<RetiredSwapChain> retiredSwapChains;
 
 	VkCommandPool commandPool;
 
 	std::unordered_map<std::string, std::vector<char>> shaders;
 	std::unordered_map<std::string, std::pair<std::vector<Vertex>, std::vector<uint32_t>>> models;
+	// Meshlets of the culled models, whose index buffers are grouped by them.
+	std::unordered_map<std::string, std::vector<MeshCluster>> meshClusters;
 	std::unordered_map<std::string, Image> textures;
 	// CubeMap envMap;
 	HDRImage envMap;
@@ -134,12 +171,38 @@ private:
 	std::unordered_map<std::string, MeshBuffer> vertices;
 	std::unordered_map<std::string, MeshBuffer> indices;
 
-	std::vector<VkBuffer> uniformBuffers;
-	std::vector<VkDeviceMemory> uniformBuffersMemory;
-	std::vector<void*> uniformBuffersMapped;
+	// Uniforms of every pass, bound through BIND_UBO with a dynamic offset.
+	UniformArena uniformArena;
+	// Offset of the camera uniforms of the render pass being recorded.
+	uint32_t passUniformOffset;
+
+	// The hair is deformed on the CPU every frame, so it gets one persistently mapped vertex buffer
+	// per frame in flight instead of an entry in vertices.
+	std::vector<MeshBuffer> hairVertexBuffers;
+	std::vector<void*> hairVertexBuffersMapped;
+
+	// Pools of the descriptor sets that live as long as the renderer. Update-after-bind sets need pools of
+	// their own.
+	DescriptorAllocator descriptorAllocator;
+	DescriptorAllocator bindlessDescriptorAllocator;
+	// Per frame: sets of passes and draws, asked for while recording and freed in bulk once the frame's
+	// fence was waited on.
+	std::vector<DescriptorSetCache> frameDescriptorCaches;
+	// Per frame: whether its global set and cached sets still point at attachments a recreation replaced.
+	std::vector<bool> frameAttachmentsStale;
 
 	Descriptor descriptor;
 
+	// Bindless textures
+	// Set SET_BINDLESS: the materials and one array with every texture, so that new textures and materials
+	// don't need new bindings or layouts.
+	Descriptor bindlessDescriptor;
+	MeshBuffer materialBuffer;
+	// Where each of textureImages sits in the array.
+	std::unordered_map<std::string, uint32_t> textureIndices;
+	// Size of the array, MAX_BINDLESS_TEXTURES or what the device allows.
+	uint32_t bindlessTextureCapacity;
+
 	// Command buffers will be automatically freed when their command pool is destroyed, so we don't need explicit cleanup.
 	std::vector<VkCommandBuffer> commandBuffers;
 	std::vector<VkSemaphore> imageAvailableSemaphores;
@@ -156,6 +219,8 @@ private:
 	VkSampler textureSampler;
 	uint32_t textureMipLevels;
 	VkSampleCountFlagBits msaaSamples;
+	// What msaaSamples was picked for, the UI may ask for another.
+	int msaaSampleCap;
 
 	std::vector<VulkanImage> swapChainImageViews;
 	std::unordered_map<std::string, VulkanImage> textureImages;
@@ -164,8 +229,14 @@ private:
 	VulkanImage offscreenColorImage;
 	VulkanImage weightedColorImage;
 	VulkanImage weightedRevealImage;
-	// Given that we use multisampling for images before this step, we need to downsample it before blitting the result to the swapchain
+	// With MSAA, the render passes resolve the offscreen color into it before the UI pass copies it to the swapchain.
+	// Not created without MSAA, the offscreen color is single sampled already.
 	VulkanImage downsampleImage;
+	// The offscreen images above only live within a frame, the frame graph packs them into these.
+	std::vector<VkDeviceMemory> transientImageMemory;
+
+	// Passes of the frame being recorded and the barriers between them, declared anew every frame.
+	RenderGraph frameGraph;
 
 	// TODO: EnvMap
 	// STORAGE cubemaps: VulkanImage envMapStorageImage;
@@ -175,23 +246,261 @@ private:
 	RenderPass opaqueObjectsRenderPass;
 	VkFramebuffer opaqueObjectsFramebuffer;
 	Pipeline opaqueObjectsPipeline;
+	// The same pass resolving into downsampleImage at its end, for frames without transparent objects.
+	// It has a single subpass, so the opaque pipelines work with it too.
+	RenderPass opaqueResolveRenderPass;
+	VkFramebuffer opaqueResolveFramebuffer;
 
 	// Opaque Hair
 	RenderPass opaqueHairRenderPass;
 	Pipeline opaqueHairPipeline;
+	// In transparency mode, the depth prepass of the cards' opaque core and its shading, both drawn in the
+	// opaque objects pass.
+	Pipeline hairPrepassPipeline;
+	Pipeline hairCorePipeline;
+	// Counts the fragments the hair passes shade, when the device supports it.
+	bool hairStatisticsSupported;
+	VkQueryPool hairQueryPool;
+	// GPU time of the frames, from timestamps at the start and end of their command buffers where the
+	// graphics queue writes them. timestampPeriod is in nanoseconds.
+	bool gpuTimingSupported;
+	float timestampPeriod;
+	VkQueryPool timestampQueryPool;
 
 	// Transparent Objects
 	RenderPass transparentObjectsRenderPass;
 	VkFramebuffer transparentObjectsFramebuffer;
 	Pipeline weightedColorPipeline;
 	Pipeline weightedRevealPipeline;
-
-	// UI
+	// Draws the strands in place of the cards in the weighted color subpass.
+	Pipeline strandPipeline;
+
+	// Linked list OIT, in the same render pass: the color subpass appends the fragments of the cards or
+	// strands to per pixel lists, and the composite subpass sorts and blends them. Only created when the
+	// device has fragmentStoresAndAtomics.
+	bool linkedListOitSupported;
+	Pipeline linkedListColorPipeline;
+	Pipeline linkedListStrandPipeline;
+	Pipeline oitResolvePipeline;
+	VkDescriptorSetLayout oitSetLayout;
+	// Per pixel, the head of its list. Transient, like the offscreen images.
+	VulkanImage oitHeadImage;
+	// The nodes every list takes from, sized to the window once the mode is picked. Its count is the
+	// capacity in nodes.
+	MeshBuffer oitNodeBuffer;
+	// Per frame: the pools replaced while it was recorded, freed once its fence was waited on again.
+	std::vector<std::vector<MeshBuffer>> retiredOitNodeBuffers;
+	// Per frame: the nodes the frame asked for and the fragments the resolve left out, host visible.
+	std::vector<MeshBuffer> oitCounterBuffers;
+	std::vector<void*> oitCounterBuffersMapped;
+
+	// Moment-based OIT, in a render pass of its own: the cards or strands are drawn once to sum the moments
+	// of their depths, once more to sum their colors weighted by what the moments say reaches the camera,
+	// and a last subpass composites the sum. Built for momentCount moments of 16 or 32 bit floats, and
+	// rebuilt when the UI asks for others.
+	int momentCount;
+	bool momentSinglePrecision;
+	bool momentSinglePrecisionSupported;
+	RenderPass momentObjectsRenderPass;
+	VkFramebuffer momentObjectsFramebuffer;
+	Pipeline momentGenerateColorPipeline;
+	Pipeline momentGenerateStrandPipeline;
+	Pipeline momentResolveColorPipeline;
+	Pipeline momentResolveStrandPipeline;
+	Pipeline momentCompositePipeline;
+	VkDescriptorSetLayout momentSetLayout;
+	// Transient, and like the weighted images they never leave the render pass. The absorbance, the first
+	// four moments, the ones past them with more than four, and the weighted sum of the colors.
+	VulkanImage momentZerothImage;
+	VulkanImage momentImage;
+	VulkanImage momentExtraImage;
+	VulkanImage momentAccumImage;
+
+	// Reduced resolution transparency, in WBOIT mode: the opaque depth is downsampled, the hair is drawn into
+	// smaller weighted images against it, and an upsample guided by the full resolution depth composites them.
+	// The images are allocated for MAX_TRANSPARENT_SCALE, a frame draws into transparentScale of them.
+	float transparentScale;
+	RenderPass transparentDepthDownsampleRenderPass;
+	VkFramebuffer transparentDepthDownsampleFramebuffer;
+	RenderPass lowResTransparentRenderPass;
+	VkFramebuffer lowResTransparentFramebuffer;
+	RenderPass transparentUpsampleRenderPass;
+	VkFramebuffer transparentUpsampleFramebuffer;
+	Pipeline transparentDepthDownsamplePipeline;
+	Pipeline lowResWeightedColorPipeline;
+	Pipeline lowResStrandPipeline;
+	Pipeline transparentUpsamplePipeline;
+	VkDescriptorSetLayout transparentDownsampleSetLayout;
+	VkDescriptorSetLayout transparentUpsampleSetLayout;
+	VulkanImage lowResDepthImage;
+	VulkanImage lowResWeightedColorImage;
+	VulkanImage lowResWeightedRevealImage;
+
+	// UI, drawn over the frame the present pipeline copies into the swapchain image first.
 	RenderPass uiRenderPass;
 	std::vector<VkFramebuffer> uiFramebuffers;
+	Pipeline presentPipeline;
+	// Its one binding is the present source, the set is taken from the frame's descriptor cache.
+	VkDescriptorSetLayout presentSetLayout;
 
 	uint32_t currentFrame;
 
+	// Simulation
+	ThreadPool threadPool;
+	HairSimulation hairSimulation;
+	// One binding per simulation LOD level, level 0 binds to every guide.
+	std::vector<FollowHair> followHairLods;
+	SimulationLod simulationLod;
+	uint32_t simulationLodLevel;
+	SimulationScheduler simulationScheduler;
+	double lastFrameTime;
+
+	// Simulation cache
+	SimulationCacheWriter cacheWriter;
+	SimulationCacheReader cacheReader;
+	// The cached frame being played, only the positions are used.
+	GuideStrands playbackStrands;
+	float playbackTime;
+
+	// Head animation
+	// Guide roots glued to the head mesh, they follow headTransform.
+	RootAttachment rootAttachment;
+	// Rigid motion of the head at the end of the last dispatched steps.
+	glm::mat4 headTransform;
+	// Motion of the head the shown hair was simulated towards, the head is drawn with it.
+	glm::mat4 renderHeadTransform;
+	glm::vec3 headPivot;
+	// Simulated seconds the head has been animated for.
+	float headAnimationTime;
+
+	// Strand rendering
+	// Guide positions the strand pipeline pulls from, one host visible buffer per frame.
+	std::vector<MeshBuffer> strandRenderBuffers;
+	std::vector<void*> strandRenderBuffersMapped;
+	// Guides in the strand buffer of the frame being recorded.
+	uint32_t strandRenderGuides;
+	// Spacing of the guide roots, children spread over about that much.
+	float strandChildRadius;
+	// Average colour of the hair albedo texture, in linear space.
+	glm::vec3 strandColor;
+	// Per frame: the strands that survived the LOD, and the indirect draw whose instance count is their number.
+	std::vector<MeshBuffer> strandVisibleBuffers;
+	std::vector<MeshBuffer> strandDrawBuffers;
+	std::vector<void*> strandDrawBuffersMapped;
+	Descriptor strandCullDescriptor;
+	ComputePipeline strandCullPipeline;
+
+	// GPU simulation
+	// Whether the strand state currently lives on the GPU.
+	bool gpuSimulationActive;
+	// Fixed steps the GPU runs in the frame being recorded.
+	uint32_t gpuSimulationSteps;
+	MeshBuffer strandPositionBuffer;
+	MeshBuffer strandVelocityBuffer;
+	MeshBuffer strandRestBuffer;
+	MeshBuffer followHairBuffer;
+	// Device local copy of the hair vertices that followHair.comp writes in place.
+	MeshBuffer gpuHairVertexBuffer;
+	Descriptor computeDescriptor;
+	ComputePipeline strandSimulationPipeline;
+	ComputePipeline followHairPipeline;
+
+	// Mesh culling
+	// Per frame: the clusters of every culled mesh, one mesh after the other. Host visible, the hair's are
+	// refit every frame.
+	std::vector<MeshBuffer> meshClusterBuffers;
+	std::vector<void*> meshClusterBuffersMapped;
+	// The hair clusters around the rest pose, in the frame of the head and widened by as far as the hair
+	// can swing. Used while the GPU simulates.
+	std::vector<PackedMeshCluster> restHairClusters;
+	std::unordered_map<std::string, MeshClusterRange> meshClusterRanges;
+	// Per frame: a draw count per mesh, then as many draws as there are clusters for each character of the
+	// largest crowd. Its count is the number of draws.
+	std::vector<MeshBuffer> meshDrawBuffers;
+	std::vector<void*> meshDrawBuffersMapped;
+	// Per frame: the MeshCullView, host visible.
+	std::vector<MeshBuffer> meshCullViewBuffers;
+	std::vector<void*> meshCullViewBuffersMapped;
+	Descriptor meshCullDescriptor;
+	ComputePipeline meshCullPipeline;
+	// Null when the device lacks VK_KHR_draw_indirect_count.
+	PFN_vkCmdDrawIndexedIndirectCountKHR cmdDrawIndexedIndirectCount;
+	bool multiDrawIndirectSupported;
+	bool drawIndirectFirstInstanceSupported;
+
+	// Crowd
+	// Per frame: one CharacterInstance per character, host visible.
+	std::vector<MeshBuffer> characterInstanceBuffers;
+	std::vector<void*> characterInstanceBuffersMapped;
+	// Crowd size and spacing each frame's buffer was last filled for, it is only rewritten when they change.
+	std::vector<std::pair<uint32_t, float>> characterInstanceSettings;
+
+	void initSimulation();
+
+	// Picks the LOD level from the projected hair size and switches the solver and follow hair to it.
+	void updateSimulationLod();
+
+	// Opens and closes the cache writer and reader when recording or playback is switched in the UI.
+	void updateSimulationCache();
+
+	// Decodes the cached frame for the playback clock into playbackStrands.
+	void playSimulationCache(float frameSeconds);
+
+	// Records the same shot with every cache flag combination and reports the write and read throughput.
+	void benchmarkSimulationCache();
+
+	// Advances the head animation by simulated seconds and moves the guide roots along.
+	void updateHeadAnimation(float seconds);
+
+	void createSimulationBuffers();
+
+	void createComputeDescriptor();
+
+	void createComputePipelines();
+
+	void uploadStrandState(const GuideStrands& strands);
+
+	void downloadStrandState(GuideStrands& strands);
+
+	// dt and the damping and stiffness of one of substeps substeps of a fixed step.
+	SimulationPushConstants getSimulationPushConstants(float dt, uint32_t substeps);
+
+	// Runs the fixed steps of this frame and rebuilds the hair vertices on the GPU.
+	void recordHairSimulationPass(VkCommandBuffer commandBuffer, uint32_t numSteps);
+
+	// Runs the same steps with the CPU and the GPU solver from the rest pose and reports the largest difference.
+	void checkSimulationParity();
+
+	// Runs the same steps in deterministic mode with different thread counts and compares the state hashes.
+	// Also reports what deterministic mode costs over the fast mode.
+	void checkSimulationDeterminism();
+
+	VkBuffer getHairVertexBuffer();
+
+	// Splits the drawn meshes into clusters and creates the buffers of the cull pass.
+	void createMeshClusters();
+
+	void createMeshCullDescriptor();
+
+	bool isMeshCullingActive() const;
+
+	// Culls the clusters of every mesh and character against the camera of this frame.
+	void recordMeshCullPass(VkCommandBuffer commandBuffer);
+
+	// Where the draws of a mesh start in the draw buffer, those of the first character first.
+	uint32_t getFirstMeshDraw(const MeshClusterRange& range) const;
+
+	// Draws the bound index buffer of the mesh for every character, whole or the clusters that survived
+	// the cull pass.
+	void recordIndexedDraw(VkCommandBuffer commandBuffer, const std::string& name);
+
+	uint32_t getCharacterCount() const;
+
+	void createCharacterInstanceBuffers();
+
+	// Lays out the crowd into the instance buffer of the frame, if its settings changed since it was last filled.
+	void updateCharacterInstanceBuffer(uint32_t currentImage);
+
 	void initVulkan();
 
 	void cleanUpVulkan();
@@ -226,6 +535,13 @@ private:
 
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
 
+	bool isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName);
+
+	// Whether the device can index a partially bound array of samplers per fragment, and write it while bound.
+	bool supportsBindlessTextures(VkPhysicalDevice device);
+
+	uint32_t getBindlessTextureCapacity();
+
 	SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice device);
 
 	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& availableFormats);
@@ -238,8 +554,6 @@ private:
 
 	void createSwapchainImageViews();
 
-	void createSwapchainFramebuffers();
-
 	void createCommandPool();
 
 	void createCommandBuffers();
@@ -254,14 +568,31 @@ private:
 
 	void drawFrame(ImGuiIO& io);
 
+	// Destroys what depends on the swapchain's size, once the device is idle. The swapchain itself stays.
 	void cleanupSwapChain();
 
-	void recreateSwapChain();
+	// Hands what depends on the swapchain's size over to the retired resources of frame.
+	void retireSwapChain(uint32_t frame);
+
+	void freeRetiredSwapChain(uint32_t frame);
+
+	// Without waiting for the device: what the frames in flight may still read is retired into retireFrame,
+	// the frame submitted last.
+	void recreateSwapChain(uint32_t retireFrame);
 
 	uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
 
+	bool hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+
 	void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
 
+	// Copies data into / out of a device local buffer through a staging buffer.
+	void writeBuffer(VkBuffer buffer, const void* data, VkDeviceSize size);
+
+	void readBuffer(VkBuffer buffer, void* data, VkDeviceSize size);
+
+	MeshBuffer createStorageBuffer(const void* data, VkDeviceSize size, uint32_t count, VkBufferUsageFlags usage = 0);
+
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);	
 
 	MeshBuffer createVertexBuffer(std::vector<Vertex> vertices);
@@ -270,16 +601,55 @@ private:
 
 	void createVertexAndIndexBuffers();
 
-	void createUniformBuffers();
+	void createHairVertexBuffers();
+
+	void createStrandRenderBuffers();
+
+	// Packs the guides the solver currently steps into the strand buffer of the frame.
+	void updateStrandRenderBuffer(uint32_t currentImage);
+
+	// The GPU solver's positions go straight into the strand buffer of the frame.
+	void recordStrandRenderCopy(VkCommandBuffer commandBuffer);
+
+	bool isStrandRendererActive() const;
+
+	StrandPushConstants getStrandPushConstants();
 
-	void updateUniformBuffer(uint32_t currentImage);
+	void createStrandCullDescriptor();
+
+	// Picks the strands to draw and writes the indirect draw of the transparent pass.
+	void recordStrandCullPass(VkCommandBuffer commandBuffer);
+
+	void updateHairVertexBuffer(uint32_t currentImage);
+
+	void createUniformArena();
+
+	UniformBufferObject getCameraUniforms() const;
+
+	// Takes the camera uniforms of the render pass about to be recorded from the uniform arena.
+	void allocatePassUniforms();
+
+	// Binds the global descriptor set with the uniforms of the pass being recorded, and the bindless one.
+	void bindGlobalDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineLayout layout);
+
+	void createDescriptorAllocators();
+
+	// Sums up the descriptor allocators and the frame's descriptor cache for the UI.
+	void updateDescriptorStats();
 
 	void createDescriptor();
 
+	// Points the bindings of the size-dependent images at their current views, in the global set of frame,
+	// and drops the frame's cached sets. The frame must not be in flight.
+	void updateAttachmentDescriptors(uint32_t frame);
+
 	VulkanImage createTextureImage(int texWidth, int texHeight, stbi_uc* pixels);
 
 	void createTextureImages();
 
+	// Puts every texture into the bindless table and uploads the materials that index it.
+	void createBindlessDescriptor();
+
 	void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height, uint32_t layers = 1);
 
 	void createSampler(VkSampler* sampler, float mipLevels, bool useNearestFilter = false, bool isEnvMap = false);
@@ -292,6 +662,7 @@ private:
 
 	void generateMipmaps(VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLevels);
 
+	// Up to the cap the UI asks for.
 	VkSampleCountFlagBits getMaxUsableSampleCount();
 
 	// Functions added for IBL
@@ -313,10 +684,20 @@ private:
 
 	void createFramebuffers();
 
-	void createImageResource(VulkanImage* image, VkFormat format, VkSampleCountFlagBits samples, VkImageUsageFlags usage, VkImageAspectFlags aspectFlags);
+	// Creates the image only, allocateTransientImages gives it memory and a view. Its size is the window's
+	// scaled by scale, rounded up.
+	void createTransientImage(VulkanImage* image, VkFormat format, VkSampleCountFlagBits samples, VkImageUsageFlags usage, VkImageAspectFlags aspectFlags, float scale = 1.0f);
 
 	void createOffscreenImageResources();
 
+	// Binds the transient images to as few allocations as the lifetimes in the frame graph allow.
+	void allocateTransientImages();
+
+	// Declares the passes of a frame presenting to swapchain image imageIndex, and what each reads and writes.
+	// When planning, every draw pass that may run is declared with its attachments only, which is all the
+	// transient memory plan needs and all that exists before the buffers are created.
+	void declareFrameGraph(uint32_t imageIndex, bool planning);
+
 	void transitionImage(
 		VulkanImage image, 
 		VkImageLayout newLayout, 
@@ -324,29 +705,125 @@ private:
 		VkImageSubresourceRange range = { 0 }
 	);
 
+	// The passes that draw into the offscreen attachments, made for msaaSamples.
 	void createRenderPasses();
 
+	void destroyRenderPasses();
+
+	// Made for the swapchain's format, so rebuilt when a recreated swapchain changes it.
+	void createUIRenderPass();
+
 	void createOpaqueObjectsFramebuffer();
 
 	void createTransparentObjectsFramebuffer();
 
+	// The single sampled image a frame ends up in, which the UI pass copies to the swapchain.
+	VulkanImage& getPresentSourceImage();
+
 	void createOpaqueObjectsPipeline(std::vector<char>vertShaderCode, std::vector<char>fragShaderCode);
 
 	void createWeightedColorPipeline(std::vector<char>vertShaderCode, std::vector<char>fragShaderCode);
 
 	void createWeightedRevealPipeline(std::vector<char>vertShaderCode, std::vector<char>fragShaderCode);
 
+	// The graphics pipelines of createRenderPasses' passes.
 	void createPipelines();
 
+	void destroyPipelines();
+
+	void createPresentPipeline();
+
 	void recordOpaqueObjectsRenderPass(VkCommandBuffer commandBuffer);
 
 	void recordTransparentObjectsRenderPass(VkCommandBuffer commandBuffer);
 
-	void recordSwapchainBlit(VkCommandBuffer commandBuffer, uint32_t imageIndex);
+	bool isLinkedListOitActive() const;
+
+	void createOitSetLayout();
+
+	void createOitCounterBuffers();
+
+	// (Re)creates the node pool when the window or the nodes per pixel asked for changed, without waiting
+	// for the device.
+	void updateOitNodeBuffer();
+
+	// Hands the pool over to the retired ones of frame.
+	void retireOitNodeBuffer(uint32_t frame);
+
+	void freeRetiredOitNodeBuffers(uint32_t frame);
+
+	// Reads back what the linked lists of the frame took last time, and clears the heads and counters.
+	void recordOitClearPass(VkCommandBuffer commandBuffer);
+
+	bool isHairCoreActive() const;
+
+	void createHairQueryPool();
+
+	// Count the fragment shader invocations in between into query, if the device counts them.
+	void beginHairQuery(VkCommandBuffer commandBuffer, HairQuery query);
+	void endHairQuery(VkCommandBuffer commandBuffer, HairQuery query);
+
+	// Reads back what the hair passes of the frame shaded last time.
+	void readHairStatistics();
+
+	void createTimestampQueryPool();
+
+	// Reads back the GPU time the frame took last time into uiState.gpuFrameMs. Without timestamps, frameSeconds
+	// stands in for it.
+	void readFrameTimestamps(float frameSeconds);
+
+	bool isReducedTransparencyActive() const;
+
+	// Sets transparentScale for the frame about to be recorded, moving it towards the GPU time budget in
+	// dynamic mode.
+	void updateTransparentScale();
+
+	// The part of the reduced resolution images the frame draws.
+	VkExtent2D getReducedTransparencyExtent() const;
+
+	void createReducedTransparencySetLayouts();
+
+	void createReducedTransparencyRenderPasses();
+
+	void createReducedTransparencyFramebuffers();
+
+	void recordTransparentDepthDownsamplePass(VkCommandBuffer commandBuffer);
+
+	void recordLowResTransparentObjectsRenderPass(VkCommandBuffer commandBuffer);
+
+	void recordTransparentUpsamplePass(VkCommandBuffer commandBuffer);
+
+	// Draws the transparent hair with cardPipeline, or ribbonPipeline when the strands are drawn, and extraSet
+	// as the third set if there is one.
+	void recordTransparentHairDraw(VkCommandBuffer commandBuffer, const Pipeline& cardPipeline, const Pipeline& ribbonPipeline, VkDescriptorSet extraSet);
+
+	bool isMomentOitActive() const;
+
+	void createMomentSetLayout();
+
+	// For momentCount and momentSinglePrecision, like the moment images.
+	void createMomentObjectsRenderPass();
+
+	// Compiles the hair shaders for the moments the first time they are asked for.
+	void createMomentPipelines();
+
+	void destroyMomentPipelines();
+
+	void createMomentObjectsFramebuffer();
+
+	void recordMomentObjectsRenderPass(VkCommandBuffer commandBuffer);
+
+	// Rebuilds the moment attachments, and everything made for them, for the moments the UI asks for.
+	void applyMomentOitSettings();
+
+	// Rebuilds the offscreen attachments, render passes and graphics pipelines for the sample cap the UI asks for.
+	void applyMsaaSettings();
 
 	void createUIFramebuffers();
 
 	void createUI();
 
+	void createPresentSetLayout();
+
 	void recordUIRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex);
 };
\ No newline at end of file
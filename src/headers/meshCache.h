@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "meshClusters.h"
+
+// A mesh cache file holds a model together with its meshlets, so that starting up needs neither the
+// model loader nor the meshlet builder:
+//   MeshCacheHeader
+//   vertices (numVertices * Vertex)
+//   indices (numIndices * uint32), grouped by meshlet
+//   meshlets (numClusters * MeshCluster)
+// The size and modification time of the model it was built from tell whether it is still up to date.
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t numVertices;
+	uint32_t numIndices;
+	uint32_t numClusters;
+	uint32_t maxVertices;
+	uint32_t maxTriangles;
+	// Layout guards, the records are stored as they are in memory.
+	uint32_t vertexSize;
+	uint32_t clusterSize;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(MeshCacheHeader) == 56, "The mesh cache header must not have padding.");
+
+// Reads the cache at path into mesh. Returns false, leaving mesh untouched, if there is no cache, or if
+// it is damaged, was built from another version of sourcePath or with other meshlet limits.
+bool readMeshCache(
+	const std::string& path,
+	const std::string& sourcePath,
+	uint32_t maxVertices,
+	uint32_t maxTriangles,
+	ClusteredMesh& mesh
+);
+
+// Returns false if the cache couldn't be written, the mesh is still fine to use then.
+bool writeMeshCache(
+	const std::string& path,
+	const std::string& sourcePath,
+	uint32_t maxVertices,
+	uint32_t maxTriangles,
+	const ClusteredMesh& mesh
+);
@@ -0,0 +1,89 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+// A run of triangles of an index buffer that is culled and drawn as one indexed draw.
+struct MeshCluster {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	// Distinct vertices the triangles use.
+	uint32_t vertexCount;
+	// Bounding sphere of the cluster's vertices.
+	glm::vec3 centre;
+	float radius;
+	// Cone of the face normals (counter clockwise winding). Every triangle faces away from a camera at p
+	// when dot(normalize(coneApex - p), coneAxis) >= coneCutoff, and from an orthographic camera looking
+	// along d when dot(d, coneAxis) >= coneCutoff. Clusters whose normals spread too far have a cutoff
+	// above 1, so they are never culled that way.
+	glm::vec3 coneApex;
+	glm::vec3 coneAxis;
+	float coneCutoff;
+};
+
+// A cluster as laid out for meshCull.comp (std430).
+struct PackedMeshCluster {
+	// xyz: centre, w: radius.
+	glm::vec4 sphere;
+	// xyz: cone apex, w: cone cutoff.
+	glm::vec4 coneApex;
+	glm::vec4 coneAxis;
+	// x: first index, y: index count.
+	glm::uvec4 draw;
+};
+
+// Where the clusters of one mesh sit in the cluster buffer and in the draw buffer.
+struct MeshClusterRange {
+	uint32_t firstCluster;
+	uint32_t numClusters;
+	// Index of the mesh's draw count.
+	uint32_t slot;
+};
+
+// A mesh whose index buffer is grouped by meshlet, each meshlet being one cluster.
+struct ClusteredMesh {
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshCluster> clusters;
+};
+
+// Splits the triangles into meshlets of at most maxVertices distinct vertices and maxTriangles triangles.
+// Meshlets grow over shared vertices from a seed, taking the triangle that adds the fewest vertices and
+// then the one closest to the meshlet. Seeds and the final meshlet order follow a Morton curve, so
+// neighbouring meshlets are neighbours in space. Triangles keep their winding, vertices are not moved.
+ClusteredMesh buildMeshlets(
+	std::vector<Vertex> vertices,
+	const std::vector<uint32_t>& indices,
+	uint32_t maxVertices,
+	uint32_t maxTriangles
+);
+
+// Whether the meshlets stay within their limits, cover the index buffer back to back, and hold every
+// triangle of sourceIndices exactly once, with its winding.
+bool checkMeshletCoverage(
+	const std::vector<uint32_t>& sourceIndices,
+	const ClusteredMesh& mesh,
+	uint32_t maxVertices,
+	uint32_t maxTriangles
+);
+
+// Bounding sphere and normal cone of the triangles in indices[firstIndex, firstIndex + indexCount).
+MeshCluster computeClusterBounds(
+	const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices,
+	uint32_t firstIndex,
+	uint32_t indexCount
+);
+
+PackedMeshCluster packMeshCluster(const MeshCluster& cluster);
+
+// Planes of the view frustum of clipFromModel in model space, with inward normals of unit length:
+// left, right, bottom, top, near, far. Clip depth runs from 0 to 1.
+std::array<glm::vec4, 6> computeFrustumPlanes(const glm::mat4& clipFromModel);
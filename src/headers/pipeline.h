@@ -25,8 +25,15 @@ public:
 	Pipeline(VkDevice* device, RenderPass renderPass);
 	~Pipeline();
 
-	void createPipelineLayout(VkDescriptorSetLayout* descriptorLayout);
-	// This pipeline creation assumes dynamic viewport and scissor.
+	// The descriptor set layouts are those of sets 0, 1, ... A push constant range of pushConstantSize bytes
+	// is added for pushConstantStages if the size isn't 0.
+	void createPipelineLayout(
+		const std::vector<VkDescriptorSetLayout>& descriptorLayouts,
+		uint32_t pushConstantSize = 0,
+		VkShaderStageFlags pushConstantStages = VK_SHADER_STAGE_VERTEX_BIT
+	);
+	// This pipeline creation assumes dynamic viewport and scissor. Without sampleShading the fragment shader
+	// runs once per pixel and primitive, however many samples it covers.
 	void createPipeline(
 		std::vector<char>vertShaderCode, 
 		std::vector<char>fragShaderCode,
@@ -35,7 +42,8 @@ public:
 		VkSampleCountFlagBits msaaSamples,
 		VkPipelineDepthStencilStateCreateInfo depthStencil,
 		std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments,
-		uint32_t subpassIndex
+		uint32_t subpassIndex,
+		bool sampleShading = true
 	);
 
 	void destroy();
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+// Stateless random numbers for the simulation. A value is a hash of its keys (seed, step, stream
+// and index), so it doesn't depend on which thread computes it or in which order, and loops over
+// it vectorise since there is no generator state to carry from one element to the next.
+
+// Integer hash with good avalanche (Chris Wellons' lowbias32).
+inline uint32_t mixBits(uint32_t h) {
+	h ^= h >> 16;
+	h *= 0x7feb352du;
+	h ^= h >> 15;
+	h *= 0x846ca68bu;
+	h ^= h >> 16;
+	return h;
+}
+
+// Uniform in [0, 1).
+inline float hashUniform(uint32_t seed, uint32_t step, uint32_t stream, uint32_t index) {
+	const uint32_t h = mixBits(seed ^ mixBits(step ^ mixBits(stream ^ mixBits(index))));
+	// The top 24 bits fit a float exactly.
+	return static_cast<float>(h >> 8) * (1.0f / 16777216.0f);
+}
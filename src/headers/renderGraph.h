@@ -0,0 +1,205 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "vulkanImage.h"
+
+// How a pass touches a resource. Each usage stands for the stages that touch it, the accesses of a
+// read and of a write, and the layout an image has to be in meanwhile.
+enum class ResourceUsage {
+	ColorAttachment,
+	DepthAttachment,
+	TransferSource,
+	TransferDestination,
+	ComputeStorage,
+	VertexShaderStorage,
+	VertexInput,
+	IndirectCommand,
+	// Read through a sampler in a fragment shader.
+	FragmentShaderSampled,
+	// Storage images and buffers a fragment shader reads or writes.
+	FragmentShaderStorage,
+	// Only as the output usage of a swapchain image.
+	Present,
+	// Only as the output usage of a buffer the host reads once the frame's fence signaled.
+	HostRead
+};
+
+typedef uint32_t RenderGraphResource;
+typedef uint32_t RenderGraphPass;
+
+// Transient images whose lifetimes don't overlap share a slot, one allocation as large as its largest image.
+struct TransientMemorySlot {
+	VkDeviceSize size;
+	VkDeviceSize alignment;
+	uint32_t memoryTypeBits;
+	// Its images are all transient attachments, which lazily allocated memory can back. They never share a
+	// slot with other images, so that the others don't keep them from it.
+	bool isLazilyAllocatable;
+};
+
+// A transient image and the slot it is bound to, at offset 0.
+struct TransientImageBinding {
+	std::string name;
+	VulkanImage* image;
+	uint32_t slot;
+	VkDeviceSize size;
+};
+
+struct TransientMemoryPlan {
+	std::vector<TransientMemorySlot> slots;
+	std::vector<TransientImageBinding> images;
+	// Bytes the images would take in allocations of their own.
+	VkDeviceSize unaliasedSize;
+	VkDeviceSize aliasedSize;
+};
+
+// A frame declared as passes and the resources they read and write. Compiling it drops the passes that
+// nothing needs, and derives the barriers between the others: one batched vkCmdPipelineBarrier before a
+// pass, with just the stages, accesses and layout changes its uses call for. The passes themselves only
+// record their commands.
+//
+// The frame is declared anew every frame, the graph remembers how the frames before left each resource.
+// Transient images live within a frame, start it undefined, and may share memory.
+class RenderGraph {
+private:
+	struct ResourceState {
+		VkImageLayout layout;
+		// The last write, which uses after it wait on.
+		VkPipelineStageFlags writeStages;
+		VkAccessFlags writeAccesses;
+		// Stages that read since the last write, which the next write or layout change waits on.
+		VkPipelineStageFlags readStages;
+		// Who the last write was made visible to already.
+		VkPipelineStageFlags visibleStages;
+		VkAccessFlags visibleAccesses;
+	};
+
+	struct Resource {
+		std::string name;
+		bool isImage;
+		bool isTransient;
+		// Null for images known only by handle.
+		VulkanImage* image;
+		VkImage vkImage;
+		VkImageAspectFlags aspects;
+		VkBuffer buffer;
+		// For images known only by handle, whose content is thrown away at the start of every frame:
+		// the stages the frame has to wait on before touching them.
+		VkPipelineStageFlags availableStages;
+		bool isOutput;
+		ResourceUsage outputUsage;
+	};
+
+	struct Use {
+		RenderGraphResource resource;
+		ResourceUsage usage;
+		bool isWrite;
+	};
+
+	// Everything a pass does to one resource, its uses merged.
+	struct Access {
+		VkPipelineStageFlags stages;
+		VkAccessFlags reads;
+		VkAccessFlags writes;
+		VkImageLayout layout;
+	};
+
+	struct Pass {
+		std::string name;
+		std::function<void(VkCommandBuffer)> record;
+		std::vector<Use> uses;
+		bool hasSideEffects;
+		bool isCulled;
+	};
+
+	struct BarrierBatch {
+		VkPipelineStageFlags srcStages;
+		VkPipelineStageFlags dstStages;
+		// One global memory barrier covers every buffer of the batch.
+		VkAccessFlags srcAccesses;
+		VkAccessFlags dstAccesses;
+		std::vector<RenderGraphResource> buffers;
+		std::vector<VkImageMemoryBarrier> imageBarriers;
+		std::vector<RenderGraphResource> images;
+	};
+
+	VkDevice* device;
+	std::vector<Resource> resources;
+	std::vector<Pass> passes;
+	bool isCompiled;
+
+	// Compiled: the barriers before every pass and at the end of the frame, where the resources end up,
+	// and the first and last pass that uses each of them, -1 when none does.
+	std::vector<BarrierBatch> passBarriers;
+	BarrierBatch finalBarriers;
+	std::vector<ResourceState> finalStates;
+	std::vector<ResourceState> finalSlotStates;
+	std::vector<std::pair<int, int>> lifetimes;
+
+	// Carried across frames: the states the last executed frame left, by Vulkan handle, and those of the
+	// memory slots of the transient images.
+	std::unordered_map<uint64_t, ResourceState> retainedStates;
+	std::unordered_map<uint64_t, uint32_t> transientSlots;
+	std::vector<ResourceState> slotStates;
+
+	static Access getAccess(ResourceUsage usage, bool isWrite);
+
+	RenderGraphResource addResource(Resource resource);
+	void addUse(RenderGraphPass pass, RenderGraphResource resource, ResourceUsage usage, bool isWrite);
+	void cullPasses();
+	ResourceState getInitialState(const Resource& resource, const std::vector<ResourceState>& slots) const;
+	void transition(BarrierBatch& batch, RenderGraphResource resource, ResourceState& state, const Access& access);
+	void recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) const;
+	void dumpBarriers(std::ostream& out, const BarrierBatch& batch) const;
+
+public:
+	RenderGraph();
+	RenderGraph(VkDevice* device);
+	~RenderGraph();
+
+	// Drops the declared frame, keeping what the executed frames left behind.
+	void reset();
+
+	// An image whose content outlives the frame. Its layout is taken from and written back to image.
+	RenderGraphResource importImage(const std::string& name, VulkanImage* image);
+	// An image owned elsewhere, like a swapchain image, whose content starts every frame undefined once
+	// availableStages are done with it.
+	RenderGraphResource importImage(const std::string& name, VkImage image, VkImageAspectFlags aspects, VkPipelineStageFlags availableStages);
+	// An image whose content only lives within the frame.
+	RenderGraphResource addTransientImage(const std::string& name, VulkanImage* image);
+	RenderGraphResource importBuffer(const std::string& name, VkBuffer buffer);
+
+	// Passes run in the order they are added.
+	RenderGraphPass addPass(const std::string& name, std::function<void(VkCommandBuffer)> record);
+	void read(RenderGraphPass pass, RenderGraphResource resource, ResourceUsage usage);
+	void write(RenderGraphPass pass, RenderGraphResource resource, ResourceUsage usage);
+	// Keeps the pass even when nothing in the frame reads what it writes, e.g. state for the next frames.
+	void setSideEffects(RenderGraphPass pass);
+	// What the resource has to hold at the end of the frame, in the layout of usage.
+	void setOutput(RenderGraphResource resource, ResourceUsage usage);
+
+	// Culls the passes that don't lead to an output or side effect, and derives the barriers of the others.
+	void compile();
+	// Records the passes that were kept, each after its barriers, and remembers where the resources end up.
+	void execute(VkCommandBuffer commandBuffer);
+
+	// Packs the transient images of the compiled frame into as few allocations as their lifetimes allow.
+	TransientMemoryPlan planTransientMemory() const;
+	// Tells the graph which images were bound to the same memory, so that the first image to use a slot
+	// in a frame waits for the one before it.
+	void setTransientSlots(const TransientMemoryPlan& plan);
+
+	// The compiled schedule: passes in order, culled ones included, the barriers before each, and the
+	// lifetimes and memory slots of the transient images.
+	void dumpSchedule(std::ostream& out) const;
+};
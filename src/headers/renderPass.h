@@ -11,7 +11,9 @@
 enum AttachmentType {
 	COLOR,
 	DEPTH,
-	INPUT
+	INPUT,
+	// Single sampled targets the color attachments are resolved into, in the order of the color attachments.
+	RESOLVE
 };
 
 // The first argument is the index of the attachment in renderPassAttachments,
@@ -25,6 +27,7 @@ private:
 	std::vector<std::vector<VkAttachmentReference>> subpassColorRefs;
 	std::vector<std::vector<VkAttachmentReference>> subpassInputRefs;
 	std::vector<std::vector<VkAttachmentReference>> subpassDepthRefs;
+	std::vector<std::vector<VkAttachmentReference>> subpassResolveRefs;
 	std::vector<VkSubpassDescription> subpasses;
 	std::vector<VkSubpassDependency> subpassDependencies;
 
@@ -0,0 +1,60 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+#include "strands.h"
+#include "threadPool.h"
+
+// Attaches the root of every guide strand to the closest triangle of the head mesh.
+// Each root stores its triangle, the barycentric coordinates of the closest point on it and the offset
+// from that point in the frame of the triangle. Every frame the roots are rebuilt from the moved
+// triangles: the frame (tangent, bitangent, normal) from the triangle edges, the position from the
+// barycentrics and the offset.
+// Everything needed for that is copied out of the mesh at load, so updates never touch the models and
+// the head mesh never has to be uploaded again.
+class RootAttachment {
+private:
+	// Per root: triangle of the head index buffer, its vertex indices and the barycentrics of the root.
+	std::vector<uint32_t> triangles;
+	std::vector<glm::uvec3> corners;
+	std::vector<glm::vec3> barycentrics;
+	std::vector<glm::vec3> localOffsets;
+	// Rest positions of the three corners, so that rigid updates don't need the head vertices.
+	std::vector<glm::vec3> restCorners;
+	// Transposed rest frames, which turn a current frame into a rotation from the rest pose.
+	std::vector<glm::mat3> inverseRestFrames;
+
+	// Root position and frame from the three corners of its triangle.
+	void evaluate(uint32_t root, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2);
+
+public:
+	// Per root, valid after update(): the position and the rotation from the rest pose.
+	std::vector<glm::vec3> positions;
+	std::vector<glm::mat3> rotations;
+
+	RootAttachment();
+	RootAttachment(
+		const std::vector<Vertex>& headVertices,
+		const std::vector<uint32_t>& headIndices,
+		const GuideStrands& strands,
+		ThreadPool& pool
+	);
+
+	uint32_t size() const;
+
+	uint32_t getTriangle(uint32_t root) const;
+
+	glm::vec3 getBarycentric(uint32_t root) const;
+
+	// The head moves rigidly with transform, which must not scale.
+	void update(const glm::mat4& transform, ThreadPool& pool);
+
+	// The head is deformed, e.g. skinned. headPositions holds every head vertex in the order of the mesh.
+	void update(const std::vector<glm::vec3>& headPositions, ThreadPool& pool);
+};
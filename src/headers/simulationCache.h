@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "strands.h"
+
+enum SimulationCacheFlags : uint32_t {
+	// Displacements are stored as 16 bit values inside the bounds of their frame.
+	SIMULATION_CACHE_QUANTIZED = 1u << 0,
+	// Frames are byte shuffled and LZ4 block compressed. Quantized frames are delta coded first.
+	SIMULATION_CACHE_COMPRESSED = 1u << 1
+};
+
+// A simulation cache file is made of chunks:
+//   SimulationCacheHeader
+//   rest positions (numVertices * 3 floats, SoA)
+//   one chunk per frame: SimulationCacheFrameHeader + payload
+//   index table (numFrames * SimulationCacheIndexEntry), at header.indexOffset
+// A frame payload holds the displacement of every guide vertex from its rest position as three planes
+// (x, y and z), so the roots and the stiff parts of the strands turn into long runs of zeros.
+struct SimulationCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t numStrands;
+	uint32_t verticesPerStrand;
+	uint32_t numFrames;
+	uint32_t flags;
+	float frameDt;
+	uint32_t reserved;
+	uint64_t indexOffset;
+};
+
+struct SimulationCacheFrameHeader {
+	// Range of the displacements, only used by quantized caches.
+	float boundsMin[3];
+	float boundsMax[3];
+	// Size of the decoded payload.
+	uint32_t rawSize;
+	// Size of the payload in the file. Equal to rawSize if compression didn't pay off for this frame.
+	uint32_t storedSize;
+};
+
+struct SimulationCacheIndexEntry {
+	// Offset of the frame chunk from the start of the file.
+	uint64_t offset;
+	// Size of the whole chunk, header included.
+	uint64_t size;
+};
+
+static_assert(sizeof(SimulationCacheHeader) == 40, "The cache header must not have padding.");
+static_assert(sizeof(SimulationCacheFrameHeader) == 32, "The frame header must not have padding.");
+static_assert(sizeof(SimulationCacheIndexEntry) == 16, "The index entry must not have padding.");
+
+// Streams guide strand states into a simulation cache file, one frame per call to writeFrame().
+// The index table and the final header are written by close().
+class SimulationCacheWriter {
+private:
+	std::ofstream file;
+	SimulationCacheHeader header;
+	std::vector<SimulationCacheIndexEntry> index;
+	std::vector<float> restPositions;
+	uint64_t offset;
+
+	// Reused between frames.
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> shuffled;
+	std::vector<uint8_t> compressed;
+
+public:
+	SimulationCacheWriter();
+	~SimulationCacheWriter();
+
+	SimulationCacheWriter(const SimulationCacheWriter&) = delete;
+	SimulationCacheWriter& operator=(const SimulationCacheWriter&) = delete;
+
+	// Takes the layout and the rest pose from strands. flags is a combination of SimulationCacheFlags.
+	void open(const std::string& path, const GuideStrands& strands, float frameDt, uint32_t flags);
+
+	// Doesn't throw, write errors are reported by close(). That way it can run on the simulation worker.
+	void writeFrame(const GuideStrands& strands);
+
+	void close();
+
+	bool isOpen() const;
+
+	uint32_t getNumFrames() const;
+
+	// Bytes written so far, headers included.
+	uint64_t getFileSize() const;
+};
+
+// Reads a simulation cache through a memory mapping of the whole file.
+// Any frame can be decoded directly through the index table, so seeking costs the same as playing.
+class SimulationCacheReader {
+private:
+	const uint8_t* data;
+	uint64_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#else
+	int fileDescriptor;
+#endif
+
+	SimulationCacheHeader header;
+	std::vector<SimulationCacheIndexEntry> index;
+	std::vector<float> restPositions;
+
+	// Reused between frames.
+	std::vector<uint8_t> raw;
+	std::vector<uint8_t> shuffled;
+
+	void map(const std::string& path);
+	void unmap();
+
+public:
+	SimulationCacheReader();
+	~SimulationCacheReader();
+
+	SimulationCacheReader(const SimulationCacheReader&) = delete;
+	SimulationCacheReader& operator=(const SimulationCacheReader&) = delete;
+
+	void open(const std::string& path);
+	void close();
+
+	bool isOpen() const;
+
+	uint32_t getNumFrames() const;
+	uint32_t getNumStrands() const;
+	uint32_t getVerticesPerStrand() const;
+	uint32_t getFlags() const;
+	float getFrameDt() const;
+	uint64_t getFileSize() const;
+
+	// Writes the positions of the frame into strands, which must have the layout of the cache.
+	// Velocities and the rest of strands are left untouched.
+	void readFrame(uint32_t frame, GuideStrands& strands);
+};
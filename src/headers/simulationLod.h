@@ -0,0 +1,50 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "strands.h"
+
+struct SimulationLodLevel {
+	// Smallest projected hair size, in pixels, that still uses this level.
+	float minScreenSize;
+	// Every strandStride-th guide strand is simulated.
+	uint32_t strandStride;
+	uint32_t substeps;
+};
+
+// Picks a simulation level of detail from how large the hair is on screen.
+// Levels go from the most to the least detailed. A level is only left once the screen size is
+// outside of its range by more than the hysteresis fraction, so the hair doesn't pop back and forth
+// when it sits right at a threshold.
+class SimulationLod {
+private:
+	std::vector<SimulationLodLevel> levels;
+	float hysteresis;
+	uint32_t currentLevel;
+	float screenSize;
+
+public:
+	SimulationLod();
+	SimulationLod(const std::vector<SimulationLodLevel>& levels, float hysteresis = 0.15f);
+
+	// Projects the bounds of the strands with viewProj and returns the larger side of the
+	// covered screen rectangle in pixels.
+	static float computeScreenSize(const GuideStrands& strands, const glm::mat4& viewProj, glm::vec2 viewportSize);
+
+	// Returns the level to use for the given screen size.
+	uint32_t update(float screenSize);
+
+	uint32_t getLevel() const;
+
+	float getScreenSize() const;
+
+	const std::vector<SimulationLodLevel>& getLevels() const;
+
+	// The guide strands simulated at the given level.
+	std::vector<uint32_t> selectStrands(uint32_t level, uint32_t numStrands) const;
+};
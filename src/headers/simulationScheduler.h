@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "strands.h"
+#include "hairSimulation.h"
+
+// Steps a HairSimulation with a fixed timestep, independent of the render frame rate.
+// Frame time goes into an accumulator that is drained in whole steps (at most maxStepsPerFrame per frame,
+// the rest of a long frame is dropped). The steps run on a worker thread one frame ahead of rendering:
+// a frame shows the result of the job dispatched in the previous frame, interpolated between the last
+// two simulated states by the time left in the accumulator.
+//
+// The simulation belongs to the worker between dispatch() and the next sync(), so anything else that
+// touches it must happen after sync().
+class SimulationScheduler {
+private:
+	HairSimulation* simulation;
+	float fixedDt;
+	uint32_t maxStepsPerFrame;
+	float accumulator;
+	// Interpolation factor of the state the pending job will produce.
+	float pendingAlpha;
+	float jobAlpha;
+
+	// Positions before and after the last step, written by the worker.
+	std::vector<float> previousX, previousY, previousZ;
+	std::vector<float> currentX, currentY, currentZ;
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable jobCondition;
+	std::condition_variable doneCondition;
+	bool hasJob;
+	bool stopping;
+	uint32_t jobSteps;
+	// What the last job threw, rethrown by sync() on the calling thread.
+	std::exception_ptr jobError;
+
+	// Runs on the worker after every step.
+	std::function<void(const GuideStrands&)> stepCallback;
+
+	void workerLoop();
+
+	void runJob(uint32_t steps);
+
+	void snapshot(std::vector<float>& x, std::vector<float>& y, std::vector<float>& z) const;
+
+public:
+	// The interpolated state to render, valid after sync().
+	GuideStrands renderStrands;
+
+	SimulationScheduler();
+	~SimulationScheduler();
+
+	SimulationScheduler(const SimulationScheduler&) = delete;
+	SimulationScheduler& operator=(const SimulationScheduler&) = delete;
+
+	void create(HairSimulation* simulation, float fixedDt, uint32_t maxStepsPerFrame);
+	void destroy();
+
+	// Adds the frame time to the accumulator and returns the number of fixed steps to run for it.
+	uint32_t advanceClock(float frameSeconds);
+
+	// Waits for the job of the previous frame and interpolates its result into renderStrands. Rethrows
+	// what the job threw, if anything.
+	void sync();
+
+	// Runs the steps on the worker thread and returns immediately.
+	void dispatch(uint32_t steps);
+
+	// Takes the current simulation state as both interpolation ends, e.g. after it was changed from outside.
+	void resetState();
+
+	float getFixedDt() const;
+
+	// Sees the simulation after every fixed step, e.g. to record it. Pass nullptr to remove it.
+	// It runs on the worker thread, and like the simulation it may only be changed after sync().
+	void setStepCallback(std::function<void(const GuideStrands&)> callback);
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+// Simulated guide strands in structure-of-arrays layout.
+// Every strand has the same number of vertices, so vertex i of strand s lives at
+// s * verticesPerStrand + i. Vertex 0 is the root.
+struct GuideStrands {
+	uint32_t numStrands;
+	uint32_t verticesPerStrand;
+
+	std::vector<float> posX, posY, posZ;
+	std::vector<float> velX, velY, velZ;
+	// 0 for pinned vertices (the roots).
+	std::vector<float> invMass;
+	// Rest length of the segment between vertex i - 1 and i. Unused for roots.
+	std::vector<float> restLength;
+	std::vector<glm::vec3> restPositions;
+
+	GuideStrands();
+	GuideStrands(uint32_t numStrands, uint32_t verticesPerStrand);
+
+	uint32_t numVertices() const;
+
+	glm::vec3 position(uint32_t index) const;
+
+	void setPosition(uint32_t index, const glm::vec3& position);
+
+	// FNV-1a hash of the bits of the positions and velocities, to compare states exactly.
+	uint64_t hash() const;
+};
+
+// Where each card vertex sits relative to the guide built from its card.
+struct CardVertexInfo {
+	// Guide strand built from the vertex's card, -1 if the card was skipped.
+	std::vector<int32_t> strand;
+	// Position along the card from the root (0) to the tip (1). Undefined if the card was skipped.
+	std::vector<float> parameter;
+};
+
+// Builds one guide strand per hair card of a card mesh.
+// Cards are the connected components of the index buffer. The v texture coordinate runs along a card,
+// and the end closer to rootAnchor (usually the centre of the head) becomes the root.
+// If cardInfo is given, it receives one entry per input vertex.
+GuideStrands buildGuideStrands(
+	const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices,
+	const glm::vec3& rootAnchor,
+	uint32_t verticesPerStrand = 16,
+	CardVertexInfo* cardInfo = nullptr
+);
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads that the CPU simulation stages share.
+// The calling thread also takes part in the work, so a pool of size 1 runs everything inline.
+class ThreadPool {
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	// Serialises run() calls coming from different threads.
+	std::mutex runMutex;
+	std::condition_variable wakeCondition;
+	std::condition_variable doneCondition;
+	uint64_t generation;
+	uint32_t pendingWorkers;
+	bool stopping;
+
+	const std::function<void(uint32_t)>* job;
+	uint32_t numChunks;
+	std::atomic<uint32_t> nextChunk;
+
+	void workerLoop();
+	void runChunks();
+
+public:
+	ThreadPool();
+	ThreadPool(uint32_t numThreads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Number of threads including the caller.
+	uint32_t size() const;
+
+	// Runs fn(chunk) for every chunk in [0, numChunks) and blocks until all of them are done.
+	void run(uint32_t numChunks, const std::function<void(uint32_t)>& fn);
+
+	// Splits [0, count) into size() contiguous partitions and runs fn(begin, end, partition).
+	// Partitions never share an index, so per-partition scratch data needs no locking.
+	void parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t, uint32_t)>& fn);
+
+	// Same, but with a fixed number of partitions no matter how many threads the pool has.
+	// The partition boundaries only depend on count and numPartitions, so per-partition results
+	// reduced in partition order come out bit-identical on any machine.
+	void parallelFor(uint32_t count, uint32_t numPartitions, const std::function<void(uint32_t, uint32_t, uint32_t)>& fn);
+};
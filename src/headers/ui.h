@@ -16,6 +16,8 @@
 class UI {
 private:
 	VkDevice* device;
+	// Kept for setRenderPass, which initializes the Vulkan backend again.
+	ImGui_ImplVulkan_InitInfo initInfo;
 
 public:
 	VkDescriptorPool imguiPool;
@@ -37,6 +39,12 @@ public:
 
 	void destroy();
 
+	// For a recreated swapchain, whose minimum image count may differ.
+	void setMinImageCount(uint32_t minImageCount);
+
+	// For a recreated UI render pass. Its pipeline is destroyed at once, so the device has to be idle.
+	void setRenderPass(VkRenderPass renderPass);
+
 	ImGuiIO& getIO();
 
 	void drawNewFrame(UIState &state);
@@ -0,0 +1,55 @@
+#pragma once
+
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <stdexcept>
+
+// One persistently mapped uniform buffer cut into a slice per frame in flight. Passes and draws take
+// what they need from the slice of the frame being recorded and bind it with a dynamic offset, so
+// any number of them share the same descriptor set. A slice is refilled only after the fence of its
+// frame was waited on.
+class UniformArena {
+private:
+	VkDevice* device;
+	VkDeviceMemory memory;
+	uint8_t* mapped;
+	VkDeviceSize frameSize;
+	uint32_t numFrames;
+	// minUniformBufferOffsetAlignment, every allocation starts on a multiple of it.
+	VkDeviceSize alignment;
+	// Next free byte and end of the slice being filled, from the start of the buffer.
+	VkDeviceSize cursor;
+	VkDeviceSize frameBegin;
+	VkDeviceSize frameEnd;
+	VkDeviceSize peakUsage;
+
+public:
+	VkBuffer buffer;
+
+	UniformArena();
+	// buffer must be host visible and coherent and hold numFrames slices of frameSize bytes, with
+	// frameSize a multiple of alignment. The arena maps it and owns it from now on.
+	UniformArena(VkDevice* device, VkBuffer buffer, VkDeviceMemory memory, VkDeviceSize frameSize, uint32_t numFrames, VkDeviceSize alignment);
+	~UniformArena();
+
+	void destroy();
+
+	// Starts filling the slice of frame from its beginning.
+	void beginFrame(uint32_t frame);
+
+	// Copies size bytes into the slice and returns the dynamic offset to bind them with.
+	uint32_t allocate(const void* data, VkDeviceSize size);
+
+	template <typename T>
+	uint32_t allocate(const T& value) {
+		return allocate(&value, sizeof(T));
+	}
+
+	// Bytes taken from the slice being filled, alignment included.
+	VkDeviceSize getFrameUsage() const;
+	// Most bytes any frame took so far.
+	VkDeviceSize getPeakUsage() const;
+	VkDeviceSize getFrameSize() const;
+};
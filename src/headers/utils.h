@@ -15,9 +15,39 @@
 
 #include "bindings.inc"
 #include "vertex.h"
+#include "forceField.h"
+#include "meshClusters.h"
+#include "threadPool.h"
 
 /* Constants */
 const int MAX_FRAMES_IN_FLIGHT = 2;
+const float SIMULATION_TIMESTEP = 1.0f / 60.0f;
+// Frames that would need more steps than this drop the rest of their time.
+const uint32_t MAX_SIMULATION_STEPS_PER_FRAME = 4;
+const uint32_t GUIDE_VERTICES_PER_STRAND = 16;
+const uint32_t GUIDES_PER_HAIR_VERTEX = 3;
+// Upper end of the strands per guide slider, the visible strand list is sized for it.
+const uint32_t MAX_STRANDS_PER_GUIDE = 64;
+// Limits of the meshlets the culled meshes are split into.
+const uint32_t MESHLET_MAX_VERTICES = 64;
+const uint32_t MESHLET_MAX_TRIANGLES = 124;
+// Appended to a model path for its mesh cache.
+const std::string MESH_CACHE_EXTENSION = ".meshcache";
+// Slice of the uniform arena each frame in flight gets.
+const VkDeviceSize UNIFORM_ARENA_FRAME_SIZE = 64 * 1024;
+// Upper end of the crowd size slider, the instance buffers are sized for it.
+const uint32_t MAX_CHARACTER_INSTANCES = 256;
+// Bytes of a linked list OIT node, a uvec4 in the shaders.
+const VkDeviceSize OIT_NODE_SIZE = 16;
+// Upper end of the nodes per pixel slider, the node pool is sized by it.
+const int MAX_OIT_NODES_PER_PIXEL = 16;
+// Share of the window's width and height the reduced resolution transparent hair is drawn at, at the least
+// and at the most. Its images are allocated for the most.
+const float MIN_TRANSPARENT_SCALE = 0.25f;
+const float MAX_TRANSPARENT_SCALE = 0.5f;
+const std::string SIMULATION_CACHE_PATH = "hair.simcache";
+// Fixed steps simulated for the cache benchmark.
+const uint32_t SIMULATION_CACHE_BENCHMARK_FRAMES = 240;
 
 /* Types and Structs */
 typedef unsigned char stbi_uc;
@@ -25,7 +55,26 @@ typedef std::array<float*, 6> CubeMapData;
 
 enum Shader {
 	VERTEX,
-	FRAGMENT
+	FRAGMENT,
+	COMPUTE
+};
+
+// How the transparent hair is composited.
+enum OitMode {
+	OIT_WEIGHTED_BLENDED,
+	// Per pixel lists of the fragments, sorted by the composite subpass.
+	OIT_LINKED_LIST,
+	// Power moments of the fragment depths, which the colors are weighted by in a second draw.
+	OIT_MOMENTS
+};
+
+// The resolution the weighted blended hair is drawn at.
+enum TransparentResolution {
+	TRANSPARENT_FULL,
+	TRANSPARENT_HALF,
+	TRANSPARENT_QUARTER,
+	// Between the two, scaled to keep the GPU time of a frame within a budget.
+	TRANSPARENT_DYNAMIC
 };
 
 struct Image {
@@ -50,14 +99,230 @@ struct CubeMap {
 };
 
 struct UniformBufferObject {
-	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
 	alignas(16) glm::vec3 cameraPos;
+	// Alpha from which the hair cards are drawn as opaque core, packed right after cameraPos in std140.
+	float hairCoreAlpha;
+};
+
+// Model matrix of a mesh draw, read by main.vert.
+struct MeshPushConstants {
+	alignas(16) glm::mat4 model;
+};
+
+// Read by the depth downsample and the upsample of the reduced resolution transparency.
+struct TransparentScalePushConstants {
+	// The part of the reduced resolution images drawn, from their top left corner.
+	glm::ivec2 extent;
+	// Its size relative to the window.
+	float scale;
+};
+
+// One character of the crowd, read by the mesh shaders through gl_InstanceIndex.
+struct CharacterInstance {
+	// Places the whole character, on top of the model matrix of each mesh.
+	alignas(16) glm::mat4 model;
+	// Multiply the albedo of the hair and of the head. The alpha channels are unused.
+	alignas(16) glm::vec4 hairColor;
+	alignas(16) glm::vec4 skinColor;
+	// x: material of the head, y: of the hair.
+	alignas(16) glm::uvec4 materials;
+};
+
+// Indices into the bindless texture table, NO_TEXTURE for maps a material lacks. Read by the mesh shaders.
+struct Material {
+	uint32_t albedo;
+	uint32_t normal;
+	uint32_t direction;
+	uint32_t ao;
+	uint32_t depth;
+	uint32_t root;
+	uint32_t flow;
+	uint32_t id;
+};
+
+// Read by strand.vert and strand.frag.
+struct StrandPushConstants {
+	// rgb: hair colour, a: opacity of a strand.
+	alignas(16) glm::vec4 color;
+	uint32_t verticesPerStrand;
+	// Instances per guide, the guide itself included.
+	uint32_t childrenPerGuide;
+	float rootWidth;
+	float tipWidth;
+	float childRadius;
+	float viewportHeight;
+};
+
+// Read by strandCull.comp.
+struct StrandCullPushConstants {
+	alignas(16) glm::mat4 viewProj;
+	uint32_t verticesPerStrand;
+	uint32_t childrenPerGuide;
+	uint32_t numGuides;
+	float rootWidth;
+	// Pixels per model unit at clip w 1, from the camera zoom and the viewport height.
+	float pixelsPerUnit;
+	// Strands at least this many pixels wide are all drawn.
+	float fullDetailPixels;
+	float minKeepFraction;
+	// How far the children and their ribbons reach past the guide, for the frustum test.
+	float margin;
+};
+
+// Read by meshCull.comp, one per frame. What the clusters of every mesh and character are tested against,
+// in world space.
+struct MeshCullView {
+	// xyz: inward normal, w: distance. Left, right, bottom, top, near, far.
+	alignas(16) glm::vec4 frustumPlanes[6];
+	// xyz: camera position, or its view direction under an orthographic projection.
+	alignas(16) glm::vec4 camera;
+};
+
+// Read by meshCull.comp, per mesh.
+struct MeshCullPushConstants {
+	// Takes the clusters to the character, whose transform goes on top.
+	alignas(16) glm::mat4 model;
+	uint32_t firstCluster;
+	uint32_t numClusters;
+	// First of the draws of the mesh, it has as many per character as it has clusters.
+	uint32_t firstDraw;
+	uint32_t slot;
+	uint32_t flags;
+};
+
+// Shared by the strand simulation and follow hair compute shaders.
+struct SimulationPushConstants {
+	// xyz: gravity, w: damping of a substep.
+	alignas(16) glm::vec4 gravity;
+	float dt;
+	// Of a constraint iteration.
+	float shapeStiffness;
+	uint32_t numStrands;
+	uint32_t verticesPerStrand;
+	uint32_t constraintIterations;
+	uint32_t numHairVertices;
+	// Size of a Vertex in floats, since std430 would pad the struct differently.
+	uint32_t vertexStride;
 };
 
 struct UIState {
-	bool transparencyOn;
+	// The most samples per pixel the offscreen attachments get, even if the GPU offers more. Their memory grows
+	// with every sample, 1 turns MSAA off. Changing it rebuilds the attachments and what draws into them.
+	int msaaSampleCap = 4;
+	// Written by the renderer for display: the samples the attachments got, and the memory they take.
+	uint32_t msaaSamples = 0;
+	uint32_t transientImageKiB = 0;
+	bool transparencyOn = true;
+	// An OitMode.
+	int oitMode = OIT_WEIGHTED_BLENDED;
+	// Written by the renderer: whether the device can write storage from fragment shaders.
+	bool linkedListOitSupported = false;
+	// Nodes the linked list pool holds at least per pixel of the window.
+	int oitNodesPerPixel = 4;
+	// Written by the UI: whether the nodes per pixel slider is being dragged. The pool is resized once it is let go.
+	bool oitNodesPerPixelEditing = false;
+	// Written by the renderer for display: what the linked lists of a recent frame took of the pool, the
+	// fragments that didn't fit in it, and those beyond the most the resolve sorts in a pixel.
+	uint32_t oitNodesUsed = 0;
+	uint32_t oitNodeCapacity = 0;
+	uint32_t oitNodesDropped = 0;
+	uint32_t oitFragmentsTruncated = 0;
+	// Moments per sample in moment OIT mode, 4, 6 or 8, and whether they are 32 bit floats rather than 16 bit.
+	int momentCount = 4;
+	bool momentSinglePrecision = false;
+	// Written by the renderer: whether the device blends 32 bit float attachments.
+	bool momentSinglePrecisionSupported = false;
+	// Written by the renderer for display: what the attachments of moment OIT take per pixel.
+	uint32_t momentBytesPerPixel = 0;
+	// Draws the hair cards where their alpha reaches hairCoreAlpha as opaque, after a depth prepass, so that
+	// only the translucent fringe in front of them goes through the OIT pass. Off by default, since it changes
+	// how the hair looks.
+	bool hairOpaqueCoreOn = false;
+	float hairCoreAlpha = 0.9f;
+	// Written by the renderer: whether the device counts fragment shader invocations.
+	bool hairStatisticsSupported = false;
+	// Written by the renderer for display: fragment shader invocations of the hair in a recent frame, in the
+	// depth prepass, the opaque core and the OIT pass. And in the OIT pass the last time it drew all the hair.
+	uint32_t hairPrepassFragments = 0;
+	uint32_t hairCoreFragments = 0;
+	uint32_t hairTransparentFragments = 0;
+	uint32_t hairUnsplitFragments = 0;
+	// A TransparentResolution, for WBOIT mode.
+	int transparentResolution = TRANSPARENT_FULL;
+	// GPU time of a frame the dynamic resolution aims for, in milliseconds.
+	float transparentBudgetMs = 16.0f;
+	// Written by the renderer for display: GPU time of a recent frame, and the share of the window's width and
+	// height the transparent hair was drawn at.
+	float gpuFrameMs = 0.0f;
+	float transparentScale = MAX_TRANSPARENT_SCALE;
+	bool simulationOn = true;
+	bool hairVolumeOn = true;
+	bool gpuSimulationOn = false;
+	// Set for one frame when the parity check button is pressed.
+	bool checkGpuParity = false;
+	// Largest distance between a GPU and a CPU vertex the parity check passes, in the units of the model.
+	float gpuParityTolerance = 1e-3f;
+	// Written by the renderer for display: the outcome of the last parity check.
+	bool gpuParityChecked = false;
+	bool gpuParityPassed = false;
+	float gpuParityError = 0.0f;
+	bool simulationLodOn = true;
+	// Written by the renderer for display.
+	uint32_t simulationLodLevel = 0;
+	float hairScreenSize = 0.0f;
+	bool recordCacheOn = false;
+	bool playCacheOn = false;
+	// Only read when a recording starts.
+	bool cacheQuantizeOn = true;
+	bool cacheCompressOn = true;
+	// Set for one frame when the benchmark button is pressed.
+	bool benchmarkCache = false;
+	// Written by the renderer for display.
+	uint32_t cachedFrames = 0;
+	bool deterministicOn = false;
+	// Set for one frame when the determinism check button is pressed.
+	bool checkDeterminism = false;
+	ForceFieldSettings forces;
+	bool headAnimationOn = false;
+	// Draws the simulated strands as ribbons instead of the hair cards.
+	bool strandRendererOn = false;
+	int strandsPerGuide = 16;
+	float strandRootWidth = 0.0006f;
+	float strandTipWidth = 0.00015f;
+	float strandOpacity = 0.6f;
+	// Thins out strands narrower than strandLodPixels on screen.
+	bool strandLodOn = true;
+	float strandLodPixels = 1.0f;
+	float strandLodMinFraction = 0.1f;
+	// Written by the renderer for display.
+	uint32_t strandsDrawn = 0;
+	uint32_t strandInstances = 0;
+	// Kept by the LOD, but past the end of the visible strand list. Only a large crowd gets there.
+	uint32_t strandsDropped = 0;
+	// Culls mesh clusters on the GPU and draws the rest indirectly.
+	bool gpuCullingOn = true;
+	// Written by the renderer for display.
+	uint32_t clustersDrawn = 0;
+	uint32_t clustersTotal = 0;
+	// Characters drawn, the first one is the simulated one at the origin and the rest copy its hair.
+	int crowdSize = 1;
+	float crowdSpacing = 0.6f;
+	// Written by the renderer for display.
+	uint32_t uniformBytesUsed = 0;
+	uint32_t uniformBytesPeak = 0;
+	// Written by the renderer for display: the pools of every descriptor allocator, and what the frame's
+	// descriptor cache did this frame.
+	uint32_t descriptorPools = 0;
+	uint32_t descriptorSets = 0;
+	uint32_t descriptorsReserved = 0;
+	uint32_t descriptorsUsed = 0;
+	uint32_t descriptorCacheHits = 0;
+	uint32_t descriptorCacheMisses = 0;
+	uint32_t descriptorWrites = 0;
+	// Set for one frame when the dump button is pressed.
+	bool dumpFrameGraph = false;
 };
 
 /* Functions */
@@ -70,7 +335,8 @@ std::vector<uint32_t> compileShaderToSPV(const std::string& shaderCode, shaderc_
 // Function to write SPIR-V binary to a file
 void writeSPVToFile(const std::vector<uint32_t>& spirvCode, const std::string& outputFilePath);
 
-std::string compileShader(const std::string path, const std::string shaderName, const Shader type);
+// Every name in defines is defined before the shader body, which lets one source build several variants.
+std::string compileShader(const std::string path, const std::string shaderName, const Shader type, const std::vector<std::string>& defines = {});
 
 std::vector<char> readFile(const std::string& filename);
 
@@ -85,4 +351,8 @@ std::pair<std::vector<Vertex>, std::vector<uint32_t>> loadObj(const std::string&
 
 std::pair<std::vector<Vertex>, std::vector<uint32_t>> loadGltf(const std::string& modelPath);
 
-std::pair<std::vector<Vertex>, std::vector<uint32_t>> loadModel(const std::string& modelPath);
\ No newline at end of file
+std::pair<std::vector<Vertex>, std::vector<uint32_t>> loadModel(const std::string& modelPath);
+
+// Loads the models split into meshlets, one model per pool thread. Each comes from its mesh cache when that is
+// up to date, and is otherwise loaded, split and written back to it.
+std::vector<ClusteredMesh> loadClusteredModels(const std::vector<std::string>& modelPaths, ThreadPool& pool);
\ No newline at end of file
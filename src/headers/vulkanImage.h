@@ -162,7 +162,11 @@ public:
 	void destroySwapchainView();
 	void createImage();
 	void bindMemory(const VkDeviceSize allocationSize, const uint32_t memoryTypeIndex);
+	// Binds memory owned elsewhere, which other images may share. destroy() leaves it alone.
+	void bindMemory(VkDeviceMemory sharedMemory, const VkDeviceSize offset);
 	void createView();
+	VkImageUsageFlags getUsage() const;
+	VkSampleCountFlagBits getSamples() const;
 	// From NVIDIA (nvpro_core)
 	void transitionLayout(
 		VkCommandBuffer commandBuffer, 
@@ -1,12 +1,24 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Texture indices of a material, NO_TEXTURE for maps it lacks.
+struct Material {
+    uint albedo;
+    uint normal;
+    uint direction;
+    uint ao;
+    uint depth;
+    uint root;
+    uint flow;
+    uint id;
+};
+
+layout(std430, set = SET_BINDLESS, binding = BIND_MATERIALS) readonly buffer Materials {
+    Material materials[];
+};
 
-layout(binding = BIND_HAIR_ALBEDO) uniform sampler2D texAlbedo;
-layout(binding = BIND_HAIR_NORMAL) uniform sampler2D texNormal;
-layout(binding = BIND_HAIR_DIRECTION) uniform sampler2D texDirection;
-layout(binding = BIND_HAIR_AO) uniform sampler2D texAo;
-layout(binding = BIND_HAIR_DEPTH) uniform sampler2D texDepth;
-layout(binding = BIND_HAIR_ROOT) uniform sampler2D texRoot;
-layout(binding = BIND_HAIR_FLOW) uniform sampler2D texFlow;
+// Every texture, indexed through the materials. Characters of one draw may use different ones.
+layout(set = SET_BINDLESS, binding = BIND_TEXTURES) uniform sampler2D textures[];
 
 struct VertexAttributes {
     vec4 position;
@@ -17,7 +29,30 @@ struct VertexAttributes {
     float depth;
 };
 
+struct CharacterInstance {
+    mat4 model;
+    // rgb: multiplies the hair albedo.
+    vec4 hairColor;
+    // rgb: multiplies the head albedo.
+    vec4 skinColor;
+    // x: material of the head, y: of the hair.
+    uvec4 materials;
+};
+
+// One per character, indexed by gl_InstanceIndex.
+layout(std430, binding = BIND_CHARACTER_INSTANCES) readonly buffer CharacterInstances {
+    CharacterInstance characters[];
+};
+
 layout(location = 0) in VertexAttributes inVertexAttributes;
+layout(location = 6) flat in uint inInstance;
+
+// The hair material of the fragment's character, set first thing in main.
+Material material;
+
+vec4 sampleMap(uint map, vec2 uv) {
+    return texture(textures[nonuniformEXT(map)], uv);
+}
 
 layout(location = 0) out vec4 outColor;
 
@@ -138,14 +173,14 @@ vec2 parallaxMapping(vec2 texCoords, vec3 viewDir)
   
     // get initial values
     vec2  currentTexCoords     = texCoords;
-    float currentDepthMapValue = texture(texDepth, currentTexCoords).r;
+    float currentDepthMapValue = sampleMap(material.depth, currentTexCoords).r;
   
     while(currentLayerDepth < currentDepthMapValue)
     {
         // shift texture coordinates along direction of P
         currentTexCoords -= deltaTexCoords;
         // get depthmap value at current texture coordinates
-        currentDepthMapValue = texture(texDepth, currentTexCoords).r;  
+        currentDepthMapValue = sampleMap(material.depth, currentTexCoords).r;  
         // get depth of next layer
         currentLayerDepth += layerDepth;  
     }
@@ -155,7 +190,7 @@ vec2 parallaxMapping(vec2 texCoords, vec3 viewDir)
 
     // get depth after and before collision for linear interpolation
     float afterDepth  = currentDepthMapValue - currentLayerDepth;
-    float beforeDepth = texture(texDepth, prevTexCoords).r - currentLayerDepth + layerDepth;
+    float beforeDepth = sampleMap(material.depth, prevTexCoords).r - currentLayerDepth + layerDepth;
  
     // interpolation of texture coordinates
     float weight = afterDepth / (afterDepth - beforeDepth);
@@ -236,28 +271,31 @@ vec3 shadeHair(vec3 tangent, vec3 normal, vec2 texCoords, vec3 wo, vec3 wi, vec3
 }
 
 void main() {
+    material = materials[characters[inInstance].materials.y];
+
     // Read from textures
     vec3 wo = normalize(inVertexAttributes.cameraPosition - inVertexAttributes.position.xyz);
 
-    float depth = texture(texDepth, inVertexAttributes.texCoord).r;
+    float depth = sampleMap(material.depth, inVertexAttributes.texCoord).r;
     vec2 texCoords = parallaxMapping(inVertexAttributes.texCoord, wo);
     if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0) {
         discard;
     }
 
-    vec4 albedo = texture(texAlbedo, texCoords);
+    vec4 albedo = sampleMap(material.albedo, texCoords);
+    albedo.rgb *= characters[inInstance].hairColor.rgb;
     // Alpha cutoff
 	// if (albedo.a < 0.01) {
 	// 	discard;
 	// }
 
-    vec3 normal = texture(texNormal, texCoords).xyz;
+    vec3 normal = sampleMap(material.normal, texCoords).xyz;
 	normal = normalize(normal * 2.0 - 1.0);
 	normal = normalize(computeTBN(normal) * normal);
-    vec2 dirXY = texture(texDirection  , texCoords).rb * 2.0 - 1.0;
+    vec2 dirXY = sampleMap(material.direction, texCoords).rb * 2.0 - 1.0;
     vec3 tangent = normalize(vec3(dirXY, sqrt(max(1.0 - dot(dirXY,dirXY), 0.0))));
-	float ao = texture(texAo, texCoords).r;	
-	float root = texture(texRoot, texCoords).r;
+	float ao = sampleMap(material.ao, texCoords).r;	
+	float root = sampleMap(material.root, texCoords).r;
 
     // Shade  
     vec3 hairCol = vec3(0.0f);
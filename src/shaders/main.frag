@@ -1,6 +1,24 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Texture indices of a material, NO_TEXTURE for maps it lacks.
+struct Material {
+    uint albedo;
+    uint normal;
+    uint direction;
+    uint ao;
+    uint depth;
+    uint root;
+    uint flow;
+    uint id;
+};
+
+layout(std430, set = SET_BINDLESS, binding = BIND_MATERIALS) readonly buffer Materials {
+    Material materials[];
+};
 
-layout(binding = BIND_HEAD_ALBEDO) uniform sampler2D albedo;
+// Every texture, indexed through the materials. Characters of one draw may use different ones.
+layout(set = SET_BINDLESS, binding = BIND_TEXTURES) uniform sampler2D textures[];
 
 struct VertexAttributes {
     vec4 position;
@@ -11,7 +29,23 @@ struct VertexAttributes {
     float depth;
 };
 
+struct CharacterInstance {
+    mat4 model;
+    // rgb: multiplies the hair albedo.
+    vec4 hairColor;
+    // rgb: multiplies the head albedo.
+    vec4 skinColor;
+    // x: material of the head, y: of the hair.
+    uvec4 materials;
+};
+
+// One per character, indexed by gl_InstanceIndex.
+layout(std430, binding = BIND_CHARACTER_INSTANCES) readonly buffer CharacterInstances {
+    CharacterInstance characters[];
+};
+
 layout(location = 0) in VertexAttributes inVertexAttributes;
+layout(location = 6) flat in uint inInstance;
 
 layout(location = 0) out vec4 outColor;
 
@@ -69,7 +103,9 @@ float distributionGGX(vec3 N, vec3 H, float a)
 }
 
 void main() {
-    vec4 albedo = texture(albedo, inVertexAttributes.texCoord);
+    const Material material = materials[characters[inInstance].materials.x];
+    vec4 albedo = texture(textures[nonuniformEXT(material.albedo)], inVertexAttributes.texCoord);
+    albedo.rgb *= characters[inInstance].skinColor.rgb;
     float metallic = 1.0;
     float roughness = 0.25;
     float ao = 1.0;
@@ -6,12 +6,31 @@
 // layout(location = 2) in vec3 inColor;
 // Binding slots defined in bindings.inc
 layout(binding = BIND_UBO) uniform UniformBufferObject {
-    mat4 model;
     mat4 view;
     mat4 proj;
     vec3 cameraPos;
 } ubo;
 
+struct CharacterInstance {
+    mat4 model;
+    // rgb: multiplies the hair albedo.
+    vec4 hairColor;
+    // rgb: multiplies the head albedo.
+    vec4 skinColor;
+    // x: material of the head, y: of the hair.
+    uvec4 materials;
+};
+
+// One per character, indexed by gl_InstanceIndex.
+layout(std430, binding = BIND_CHARACTER_INSTANCES) readonly buffer CharacterInstances {
+    CharacterInstance characters[];
+};
+
+// Per draw, so that moving a mesh doesn't touch its vertices. Must not scale.
+layout(push_constant) uniform MeshPushConstants {
+    mat4 model;
+} mesh;
+
 layout(location = BIND_VERTEX_POSITION) in vec4 inPosition;
 layout(location = BIND_VERTEX_NORMAL) in vec4 inNormal;
 layout(location = BIND_VERTEX_TEXCOORD) in vec2 inTexCoord;
@@ -27,13 +46,19 @@ struct VertexAttributes {
 };
 
 layout(location = 0) out VertexAttributes outVertexAttributes;
+// Right after the six locations of the attributes.
+layout(location = 6) flat out uint outInstance;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * inPosition;
-    outVertexAttributes.position = inPosition;
-    outVertexAttributes.normal = inNormal;
+    // The character transform goes on top of the mesh's own, and is rigid as well.
+    const mat4 model = characters[gl_InstanceIndex].model * mesh.model;
+    const vec4 worldPosition = model * inPosition;
+    gl_Position = ubo.proj * ubo.view * worldPosition;
+    outVertexAttributes.position = worldPosition;
+    outVertexAttributes.normal = vec4(mat3(model) * inNormal.xyz, inNormal.w);
     outVertexAttributes.color = inColor;
     outVertexAttributes.texCoord = inTexCoord;
     outVertexAttributes.cameraPosition = ubo.cameraPos;
-    outVertexAttributes.depth = (ubo.view * inPosition).z;
+    outVertexAttributes.depth = (ubo.view * worldPosition).z;
+    outInstance = gl_InstanceIndex;
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 450
+#extension GL_KHR_vulkan_glsl : enable
+
+// Moment-based OIT: the resolve subpass summed the colors weighted by what reaches the camera of each, this
+// normalizes them and lets through what the absorbance of all of them leaves of the opaque color.
+#ifdef SINGLE_SAMPLE
+layout(input_attachment_index = 0, set = SET_MOMENTS, binding = BIND_MOMENTS_ZEROTH) uniform subpassInput zerothMoment;
+layout(input_attachment_index = 1, set = SET_MOMENTS, binding = BIND_MOMENTS_ACCUM) uniform subpassInput accumulated;
+#else
+layout(input_attachment_index = 0, set = SET_MOMENTS, binding = BIND_MOMENTS_ZEROTH) uniform subpassInputMS zerothMoment;
+layout(input_attachment_index = 1, set = SET_MOMENTS, binding = BIND_MOMENTS_ACCUM) uniform subpassInputMS accumulated;
+#endif
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+#ifdef SINGLE_SAMPLE
+	const float b0 = subpassLoad(zerothMoment).r;
+	const vec4 accum = subpassLoad(accumulated);
+#else
+	const float b0 = subpassLoad(zerothMoment, gl_SampleID).r;
+	const vec4 accum = subpassLoad(accumulated, gl_SampleID);
+#endif
+	if (b0 < 1e-5) {
+		discard;
+	}
+
+	// Blend function: ONE_MINUS_SRC_ALPHA, SRC_ALPHA, as for WBOIT.
+	outColor = vec4(accum.rgb / max(accum.a, 1e-5), exp(-b0));
+}
\ No newline at end of file
@@ -0,0 +1,225 @@
+// Moment-based OIT, after Münstermann et al., "Moment-Based Order-Independent Transparency" (2018).
+// The generate subpass sums per sample the absorbance -ln(1 - alpha) of every transparent fragment, and
+// NUM_MOMENTS power moments of the fragment depths weighted by it. The resolve subpass draws the same
+// fragments again, reconstructs from the moments what the fragments in front let through, and sums the
+// colors weighted by that. NUM_MOMENTS is 4, 6 or 8, the host picks MOMENT_BIAS for it and for the
+// precision of the attachments.
+
+// The depth the moments are taken of, -1 at the near plane and 1 at the far one.
+float momentDepth() {
+    return 2.0 * gl_FragCoord.z - 1.0;
+}
+
+#ifdef OIT_MOMENTS_GENERATE
+layout(location = 0) out float outZerothMoment;
+layout(location = 1) out vec4 outMoments;
+#if NUM_MOMENTS > 4
+// Only .xy lands with six moments, the attachment has two channels then.
+layout(location = 2) out vec4 outExtraMoments;
+#endif
+
+void generateMoments(float alpha) {
+    // An opaque fragment would absorb infinitely.
+    const float absorbance = -log(1.0 - min(alpha, 0.9999));
+    const float z = momentDepth();
+    const float z2 = z * z;
+    const vec4 powers = vec4(z, z2, z2 * z, z2 * z2);
+
+    // Blend function for all of them: ONE, ONE
+    outZerothMoment = absorbance;
+    outMoments = absorbance * powers;
+#if NUM_MOMENTS > 4
+    outExtraMoments = absorbance * powers.w * powers;
+#endif
+}
+#endif
+
+#ifdef OIT_MOMENTS_RESOLVE
+// Without MSAA the attachments have a single sample, which subpassInputMS can't read.
+#ifdef SINGLE_SAMPLE
+layout(input_attachment_index = 0, set = SET_MOMENTS, binding = BIND_MOMENTS_ZEROTH) uniform subpassInput zerothMoment;
+layout(input_attachment_index = 1, set = SET_MOMENTS, binding = BIND_MOMENTS) uniform subpassInput moments;
+#if NUM_MOMENTS > 4
+layout(input_attachment_index = 2, set = SET_MOMENTS, binding = BIND_MOMENTS_EXTRA) uniform subpassInput extraMoments;
+#endif
+#else
+layout(input_attachment_index = 0, set = SET_MOMENTS, binding = BIND_MOMENTS_ZEROTH) uniform subpassInputMS zerothMoment;
+layout(input_attachment_index = 1, set = SET_MOMENTS, binding = BIND_MOMENTS) uniform subpassInputMS moments;
+#if NUM_MOMENTS > 4
+layout(input_attachment_index = 2, set = SET_MOMENTS, binding = BIND_MOMENTS_EXTRA) uniform subpassInputMS extraMoments;
+#endif
+#endif
+
+layout(location = 0) out vec4 outColor;
+
+const int MOMENT_DEGREE = NUM_MOMENTS / 2;
+
+// Moments of a fixed depth distribution. The stored moments are pulled towards them by MOMENT_BIAS, which
+// keeps the reconstruction stable where rounding left them barely valid.
+#if NUM_MOMENTS == 4
+const float momentBiasVector[NUM_MOMENTS] = float[](0.0, 0.375, 0.0, 0.375);
+#elif NUM_MOMENTS == 6
+const float momentBiasVector[NUM_MOMENTS] = float[](0.0, 0.48, 0.0, 0.451, 0.0, 0.45);
+#else
+const float momentBiasVector[NUM_MOMENTS] = float[](0.0, 0.75, 0.0, 0.67666667, 0.0, 0.63, 0.0, 0.60030303);
+#endif
+
+// How much of the absorbance at the fragment's own depth counts as in front of it.
+const float momentOverestimation = 0.25;
+
+// What the fragments in front of depth z let through, from the absorbance b0 of all of them and their
+// moments b. The moments are matched by the fewest depths that explain them, the roots of the kernel
+// polynomial, and the absorbance is counted from those in front of z.
+float momentTransmittance(float b0, float b[NUM_MOMENTS], float z) {
+    if (b0 < 1e-5) {
+        return 1.0;
+    }
+
+    // Normalized by the absorbance and biased, the zeroth moment in front.
+    float m[NUM_MOMENTS + 1];
+    m[0] = 1.0;
+    for (int i = 0; i < NUM_MOMENTS; i++) {
+        m[i + 1] = mix(b[i] / b0, momentBiasVector[i], MOMENT_BIAS);
+    }
+
+    // LDL^T factorization of the Hankel matrix, which has m[i + j] in row i and column j.
+    float L[MOMENT_DEGREE + 1][MOMENT_DEGREE + 1];
+    float D[MOMENT_DEGREE + 1];
+    for (int j = 0; j <= MOMENT_DEGREE; j++) {
+        D[j] = m[2 * j];
+        for (int k = 0; k < j; k++) {
+            D[j] -= L[j][k] * L[j][k] * D[k];
+        }
+        for (int i = j + 1; i <= MOMENT_DEGREE; i++) {
+            float sum = m[i + j];
+            for (int k = 0; k < j; k++) {
+                sum -= L[i][k] * L[j][k] * D[k];
+            }
+            L[i][j] = sum / D[j];
+        }
+    }
+
+    // The kernel polynomial c solves the matrix against the powers of z.
+    float c[MOMENT_DEGREE + 1];
+    float power = 1.0;
+    for (int i = 0; i <= MOMENT_DEGREE; i++) {
+        c[i] = power;
+        power *= z;
+        for (int k = 0; k < i; k++) {
+            c[i] -= L[i][k] * c[k];
+        }
+    }
+    for (int i = 0; i <= MOMENT_DEGREE; i++) {
+        c[i] /= D[i];
+    }
+    for (int i = MOMENT_DEGREE; i >= 0; i--) {
+        for (int k = i + 1; k <= MOMENT_DEGREE; k++) {
+            c[i] -= L[k][i] * c[k];
+        }
+    }
+
+    // Its roots are real, which lets Laguerre's method find them from anywhere. Each one is divided out
+    // before looking for the next.
+    float depths[MOMENT_DEGREE + 1];
+    depths[0] = z;
+    for (int n = MOMENT_DEGREE; n > 1; n--) {
+        float x = z;
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float p = c[n];
+            float dp = 0.0;
+            float ddp = 0.0;
+            for (int i = n - 1; i >= 0; i--) {
+                ddp = ddp * x + 2.0 * dp;
+                dp = dp * x + p;
+                p = p * x + c[i];
+            }
+            if (p == 0.0) {
+                break;
+            }
+            const float g = dp / p;
+            const float h = g * g - ddp / p;
+            const float s = sqrt(max(float(n - 1) * (float(n) * h - g * g), 0.0));
+            const float denominator = abs(g + s) > abs(g - s) ? g + s : g - s;
+            if (denominator == 0.0) {
+                break;
+            }
+            x -= float(n) / denominator;
+        }
+        depths[n] = x;
+
+        float remainder = c[n];
+        for (int i = n - 1; i >= 0; i--) {
+            const float coefficient = c[i];
+            c[i] = remainder;
+            remainder = coefficient + remainder * x;
+        }
+    }
+    depths[1] = -c[0] / c[1];
+
+    // The polynomial through the weight of each depth: all of it in front of z, none behind, and the
+    // overestimation at z itself. Divided differences first, then the Newton form multiplied out.
+    float f[MOMENT_DEGREE + 1];
+    f[0] = momentOverestimation;
+    for (int k = 1; k <= MOMENT_DEGREE; k++) {
+        f[k] = depths[k] < z ? 1.0 : 0.0;
+    }
+    for (int j = 1; j <= MOMENT_DEGREE; j++) {
+        for (int i = MOMENT_DEGREE; i >= j; i--) {
+            f[i] = (f[i] - f[i - 1]) / (depths[i] - depths[i - j]);
+        }
+    }
+    float polynomial[MOMENT_DEGREE + 1];
+    polynomial[0] = f[MOMENT_DEGREE];
+    for (int i = 1; i <= MOMENT_DEGREE; i++) {
+        polynomial[i] = 0.0;
+    }
+    for (int k = MOMENT_DEGREE - 1; k >= 0; k--) {
+        for (int i = MOMENT_DEGREE; i > 0; i--) {
+            polynomial[i] = polynomial[i - 1] - depths[k] * polynomial[i];
+        }
+        polynomial[0] = f[k] - depths[k] * polynomial[0];
+    }
+
+    // Applied to the moments, it is the share of the absorbance in front of z.
+    float absorbance = 0.0;
+    for (int k = 0; k <= MOMENT_DEGREE; k++) {
+        absorbance += polynomial[k] * m[k];
+    }
+    return clamp(exp(-b0 * absorbance), 0.0, 1.0);
+}
+
+void resolveMoments(vec4 color) {
+    // The pipeline shades once per pixel, so every fragment takes the moments of the first sample.
+#ifdef SINGLE_SAMPLE
+    const float b0 = subpassLoad(zerothMoment).r;
+    const vec4 first = subpassLoad(moments);
+#if NUM_MOMENTS > 4
+    const vec4 extra = subpassLoad(extraMoments);
+#endif
+#else
+    const float b0 = subpassLoad(zerothMoment, 0).r;
+    const vec4 first = subpassLoad(moments, 0);
+#if NUM_MOMENTS > 4
+    const vec4 extra = subpassLoad(extraMoments, 0);
+#endif
+#endif
+
+    float b[NUM_MOMENTS];
+    b[0] = first.x;
+    b[1] = first.y;
+    b[2] = first.z;
+    b[3] = first.w;
+#if NUM_MOMENTS > 4
+    b[4] = extra.x;
+    b[5] = extra.y;
+#endif
+#if NUM_MOMENTS > 6
+    b[6] = extra.z;
+    b[7] = extra.w;
+#endif
+
+    // Premultiplied, the alpha sums up what the composite normalizes the color by.
+    // Blend function: ONE, ONE
+    outColor = color * momentTransmittance(b0, b, momentDepth());
+}
+#endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#version 450
+
+// Linked list OIT: the color subpass appended every transparent fragment to the list of its pixel, this
+// sorts each list and composites it front to back over the opaque color.
+layout(set = SET_OIT, binding = BIND_OIT_HEADS, r32ui) uniform readonly uimage2D heads;
+// x, y: premultiplied colour as half floats, z: depth, w: next node.
+layout(std430, set = SET_OIT, binding = BIND_OIT_NODES) readonly buffer Nodes {
+    uvec4 nodes[];
+};
+layout(std430, set = SET_OIT, binding = BIND_OIT_COUNTERS) buffer Counters {
+    uint allocatedNodes;
+    uint truncatedFragments;
+};
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+    // The nearest fragments of the pixel and their nodes.
+    float depths[OIT_MAX_SORTED_FRAGMENTS];
+    uint sorted[OIT_MAX_SORTED_FRAGMENTS];
+    uint count = 0u;
+    uint truncated = 0u;
+
+    uint node = imageLoad(heads, ivec2(gl_FragCoord.xy)).r;
+    while (node != OIT_LIST_END) {
+        const uvec4 fragment = nodes[node];
+        const float depth = uintBitsToFloat(fragment.z);
+        if (count < OIT_MAX_SORTED_FRAGMENTS) {
+            depths[count] = depth;
+            sorted[count] = node;
+            count++;
+        }
+        else {
+            // Too many to sort, the farthest one is left out.
+            truncated++;
+            uint farthest = 0u;
+            for (uint i = 1u; i < OIT_MAX_SORTED_FRAGMENTS; i++) {
+                if (depths[i] > depths[farthest]) {
+                    farthest = i;
+                }
+            }
+            if (depth < depths[farthest]) {
+                depths[farthest] = depth;
+                sorted[farthest] = node;
+            }
+        }
+        node = fragment.w;
+    }
+
+    if (truncated > 0u) {
+        atomicAdd(truncatedFragments, truncated);
+    }
+    if (count == 0u) {
+        discard;
+    }
+
+    // Insertion sort, nearest first. The lists are short.
+    for (uint i = 1u; i < count; i++) {
+        const float depth = depths[i];
+        const uint index = sorted[i];
+        uint j = i;
+        while (j > 0u && depths[j - 1u] > depth) {
+            depths[j] = depths[j - 1u];
+            sorted[j] = sorted[j - 1u];
+            j--;
+        }
+        depths[j] = depth;
+        sorted[j] = index;
+    }
+
+    vec3 color = vec3(0.0);
+    float transmittance = 1.0;
+    for (uint i = 0u; i < count; i++) {
+        const uvec4 fragment = nodes[sorted[i]];
+        const vec4 premultiplied = vec4(unpackHalf2x16(fragment.x), unpackHalf2x16(fragment.y));
+        color += transmittance * premultiplied.rgb;
+        transmittance *= 1.0 - premultiplied.a;
+    }
+
+    // Blend function: ONE, ONE_MINUS_SRC_ALPHA
+    outColor = vec4(color, 1.0 - transmittance);
+}
\ No newline at end of file
@@ -0,0 +1,13 @@
+#version 450
+#extension GL_KHR_vulkan_glsl : enable
+
+// Copies the resolved frame into the swapchain image, under the UI. Both have the size of the window,
+// so every fragment fetches the texel it covers.
+layout(set = 0, binding = BIND_PRESENT_SOURCE) uniform sampler2D presentSource;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+	outColor = texelFetch(presentSource, ivec2(gl_FragCoord.xy), 0);
+}
\ No newline at end of file
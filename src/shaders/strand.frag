@@ -0,0 +1,165 @@
+#version 450
+
+layout(push_constant) uniform StrandPushConstants {
+    vec4 color;
+    uint verticesPerStrand;
+    uint childrenPerGuide;
+    float rootWidth;
+    float tipWidth;
+    float childRadius;
+    float viewportHeight;
+} strand;
+
+struct StrandAttributes {
+    vec3 position;
+    vec3 tangent;
+    vec3 normal;
+    vec3 cameraPosition;
+    float along;
+    float coverage;
+    float depth;
+};
+
+layout(location = 0) in StrandAttributes inStrandAttributes;
+layout(location = 7) flat in uint inCharacter;
+
+struct CharacterInstance {
+    mat4 model;
+    // rgb: multiplies the hair colour.
+    vec4 hairColor;
+    vec4 skinColor;
+    uvec4 materials;
+};
+
+layout(std430, binding = BIND_CHARACTER_INSTANCES) readonly buffer CharacterInstances {
+    CharacterInstance characters[];
+};
+
+#if defined(OIT_LINKED_LIST)
+// The depth test runs before the shader, or fragments behind the opaque objects would be appended too.
+layout(early_fragment_tests) in;
+
+// Per pixel, the node appended last. Every node links to the one appended there before it.
+layout(set = SET_OIT, binding = BIND_OIT_HEADS, r32ui) uniform coherent uimage2D heads;
+// As on the cards. x, y: premultiplied colour as half floats, z: depth, w: next node.
+layout(std430, set = SET_OIT, binding = BIND_OIT_NODES) buffer Nodes {
+    uvec4 nodes[];
+};
+layout(std430, set = SET_OIT, binding = BIND_OIT_COUNTERS) buffer Counters {
+    uint allocatedNodes;
+    uint truncatedFragments;
+};
+
+void appendFragment(vec4 color) {
+    const uint node = atomicAdd(allocatedNodes, 1u);
+    // The pool is full and the fragment is dropped. The count goes on, so the host sees by how much.
+    if (node >= uint(nodes.length())) {
+        return;
+    }
+    const uint next = imageAtomicExchange(heads, ivec2(gl_FragCoord.xy), node);
+    nodes[node] = uvec4(packHalf2x16(color.rg), packHalf2x16(color.ba), floatBitsToUint(gl_FragCoord.z), next);
+}
+#elif defined(OIT_MOMENTS_GENERATE) || defined(OIT_MOMENTS_RESOLVE)
+#include "momentOit.glsl"
+#else
+layout(location = 0) out vec4 outColor;
+layout(location = 1) out float outReveal;
+#endif
+
+// Hair shading, as on the cards.
+const float primaryShift = 0.3f;
+const float secondaryShift = -0.3f;
+const float specExp1 = 20;
+const float specExp2 = 60;
+
+// WBOIT parameter
+const float distanceWeightExp = -10.0f;
+
+// Point lights
+const vec3 light_pos[4] = vec3[](vec3(-10, 10, 10),
+                                 vec3(10, 10, 10),
+                                 vec3(-10, -10, 10),
+                                 vec3(10, -10, 10));
+
+const vec3 light_col[4] = vec3[](vec3(300.f, 300.f, 300.f),
+                                vec3(300.f, 300.f, 300.f),
+                                vec3(300.f, 300.f, 300.f),
+                                vec3(300.f, 300.f, 300.f));
+
+vec3 shiftTangent(vec3 tangent, vec3 normal,float shift) {
+    vec3 shiftedTangent = tangent + shift * normal;
+    return normalize(shiftedTangent);
+}
+
+float strandSpecular(vec3 tangent, vec3 viewDir, vec3 lightDir, float exponent) {
+    vec3 halfVector = normalize(viewDir + lightDir);
+    float dotTH = dot(tangent, halfVector);
+    float sinTH = sqrt(1.0 - dotTH * dotTH);
+    float disAtten = smoothstep(-1.0, 0.0, dotTH);
+    return disAtten * pow(sinTH, exponent);
+}
+
+float luminance(vec3 c) {
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 computeSpecColor1(vec3 baseCol) {
+    float Y   = luminance(baseCol);
+    float amt = mix(0.55, 0.25, Y);
+    return mix(baseCol, vec3(1.0), amt);
+}
+
+vec3 computeSpecColor2(vec3 baseCol) {
+    float Y   = luminance(baseCol);
+    float amt = mix(0.85, 0.45, Y);
+    return mix(baseCol, vec3(1.0), amt);
+}
+
+// Kajiya-Kay: the diffuse term follows the sine between the strand and the light, the two specular
+// lobes are the shifted strandSpecular highlights of the cards.
+vec3 shadeStrand(vec3 tangent, vec3 normal, vec3 wo, vec3 wi, vec3 baseCol, vec3 lightCol) {
+    vec3 t1 = shiftTangent(tangent, normal, primaryShift);
+    vec3 t2 = shiftTangent(tangent, normal, secondaryShift);
+
+    float dotTL = dot(tangent, wi);
+    float sinTL = sqrt(max(1.0 - dotTL * dotTL, 0.0));
+    vec3 diff = mix(0.25, 1.0, sinTL) * baseCol;
+
+    vec3 spec = computeSpecColor1(baseCol) * strandSpecular(t1, wo, wi, specExp1);
+    spec += computeSpecColor2(baseCol) * strandSpecular(t2, wo, wi, specExp2);
+
+    return (diff + spec) * baseCol * lightCol;
+}
+
+void main() {
+    vec3 tangent = normalize(inStrandAttributes.tangent);
+    vec3 normal = normalize(inStrandAttributes.normal);
+    vec3 wo = normalize(inStrandAttributes.cameraPosition - inStrandAttributes.position);
+
+    // Tinted per character, like the albedo of the cards.
+    const vec3 baseCol = strand.color.rgb * characters[inCharacter].hairColor.rgb;
+    vec3 hairCol = vec3(0.0f);
+    for (int i = 0; i < light_pos.length(); i++) {
+        hairCol += shadeStrand(tangent, normal, wo, normalize(light_pos[i] - inStrandAttributes.position), baseCol, light_col[i] / 100.0f);
+    }
+    hairCol /= float(light_pos.length());
+    // Darker near the root, where the cards have their root map.
+    hairCol *= mix(0.5, 1.0, smoothstep(0.0, 0.3, inStrandAttributes.along));
+
+    const float alpha = strand.color.a * inStrandAttributes.coverage;
+    vec4 color = vec4(hairCol * alpha, alpha);
+#if defined(OIT_LINKED_LIST)
+    appendFragment(color);
+#elif defined(OIT_MOMENTS_GENERATE)
+    generateMoments(color.a);
+#elif defined(OIT_MOMENTS_RESOLVE)
+    resolveMoments(color);
+#else
+    // WBOIT output, weighted like the cards.
+    const float z = -inStrandAttributes.depth;
+    const float weight = pow(abs(z), distanceWeightExp);
+
+    outColor = color * weight;
+    outReveal = color.a;
+#endif
+}
@@ -0,0 +1,146 @@
+#version 450
+#extension GL_KHR_vulkan_glsl : enable
+// Expands guide strands into camera facing ribbons, without any vertex input.
+// Every instance is one strand and every 6 vertices one segment of it (two triangles). The points of the
+// strand are pulled from the strand buffer. Besides the guide itself, each guide grows children: copies
+// pushed sideways by a fixed random offset, so that a few thousand guides look like a full head of hair.
+// Instances go through the visible strand list strandCull.comp compacted, which drops strands from afar,
+// for every character of the crowd.
+// Binding slots defined in bindings.inc
+layout(binding = BIND_UBO) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 cameraPos;
+} ubo;
+
+// xyz: position. verticesPerStrand points per guide, one guide after the other.
+layout(std430, binding = BIND_STRAND_RENDER) readonly buffer StrandPositions {
+    vec4 strandPositions[];
+};
+
+// x: strand instance, y: width scale as a half float in the low bits, character in the high ones.
+layout(std430, binding = BIND_STRAND_VISIBLE) readonly buffer VisibleStrands {
+    uvec2 visibleStrands[];
+};
+
+struct CharacterInstance {
+    mat4 model;
+    // rgb: multiplies the hair colour.
+    vec4 hairColor;
+    vec4 skinColor;
+    uvec4 materials;
+};
+
+layout(std430, binding = BIND_CHARACTER_INSTANCES) readonly buffer CharacterInstances {
+    CharacterInstance characters[];
+};
+
+layout(push_constant) uniform StrandPushConstants {
+    // rgb: hair colour, a: opacity of a strand.
+    vec4 color;
+    uint verticesPerStrand;
+    // Instances per guide, the guide itself included.
+    uint childrenPerGuide;
+    // Width in model units, tapering from the root to the tip.
+    float rootWidth;
+    float tipWidth;
+    // How far children spread around their guide.
+    float childRadius;
+    float viewportHeight;
+} strand;
+
+struct StrandAttributes {
+    vec3 position;
+    vec3 tangent;
+    vec3 normal;
+    vec3 cameraPosition;
+    // 0 at the root, 1 at the tip.
+    float along;
+    // Fraction of the drawn width the strand really covers.
+    float coverage;
+    float depth;
+};
+
+layout(location = 0) out StrandAttributes outStrandAttributes;
+// Right after the seven locations of the attributes.
+layout(location = 7) flat out uint outCharacter;
+
+// x: end of the segment, y: side of the ribbon, for the 6 vertices of the two triangles.
+const ivec2 corners[6] = ivec2[](ivec2(0, -1), ivec2(0, 1), ivec2(1, -1),
+                                 ivec2(1, -1), ivec2(0, 1), ivec2(1, 1));
+
+// Placed by the character's transform, which is rigid.
+vec3 strandPoint(mat4 model, uint guide, uint i) {
+    return (model * vec4(strandPositions[guide * strand.verticesPerStrand + i].xyz, 1.0)).xyz;
+}
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+float random01(uint x) {
+    return float(hash(x) >> 8) / 16777216.0;
+}
+
+void main() {
+    // The crowd asked for more strands than the list holds, the rest collapse to a point.
+    if (gl_InstanceIndex >= visibleStrands.length()) {
+        gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    const uint n = strand.verticesPerStrand;
+    const uvec2 visibleStrand = visibleStrands[gl_InstanceIndex];
+    const uint character = visibleStrand.y >> 16u;
+    const mat4 model = characters[character].model;
+    const uint instance = visibleStrand.x;
+    const uint guide = instance / strand.childrenPerGuide;
+    const uint child = instance % strand.childrenPerGuide;
+    const ivec2 corner = corners[gl_VertexIndex % 6];
+    const uint i = uint(gl_VertexIndex / 6 + corner.x);
+    const float along = float(i) / float(n - 1);
+
+    vec3 p = strandPoint(model, guide, i);
+    // Central differences inside the strand, one sided at its ends.
+    const vec3 tangent = normalize(strandPoint(model, guide, min(i + 1u, n - 1u)) - strandPoint(model, guide, max(i, 1u) - 1u));
+
+    if (child != 0u) {
+        // Across the guide only, so that children keep its length. They clump a little towards the tip.
+        const uint key = instance * 3u;
+        vec3 offset = vec3(random01(key), random01(key + 1u), random01(key + 2u)) * 2.0 - 1.0;
+        offset -= tangent * dot(offset, tangent);
+        p += offset * strand.childRadius * mix(1.0, 0.6, along);
+    }
+
+    const vec3 toCamera = ubo.cameraPos - p;
+    vec3 side = cross(tangent, toCamera);
+    // Looking straight down the strand, any direction across it will do.
+    if (dot(side, side) < 1e-12) {
+        side = cross(tangent, abs(tangent.z) < 0.9 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0));
+    }
+    side = normalize(side);
+
+    // Ribbons narrower than a pixel would flicker, so they are drawn a pixel wide and fade instead.
+    // Strands thinned out by the LOD come widened to cover for the dropped ones.
+    const float width = mix(strand.rootWidth, strand.tipWidth, along) * unpackHalf2x16(visibleStrand.y).x;
+    // Clip w is 1 under the orthographic zoom and the view depth under a perspective projection.
+    const float clipW = (ubo.proj * ubo.view * vec4(p, 1.0)).w;
+    const float pixelWidth = 2.0 * clipW / (abs(ubo.proj[1][1]) * strand.viewportHeight);
+    const float drawnWidth = max(width, pixelWidth);
+
+    const vec4 position = vec4(p + side * (0.5 * drawnWidth * float(corner.y)), 1.0);
+    gl_Position = ubo.proj * ubo.view * position;
+    outStrandAttributes.position = position.xyz;
+    outStrandAttributes.tangent = tangent;
+    outStrandAttributes.normal = cross(side, tangent);
+    outStrandAttributes.cameraPosition = ubo.cameraPos;
+    outStrandAttributes.along = along;
+    outStrandAttributes.coverage = width / drawnWidth;
+    outStrandAttributes.depth = (ubo.view * position).z;
+    outCharacter = character;
+}
@@ -0,0 +1,39 @@
+#version 450
+#extension GL_KHR_vulkan_glsl : enable
+
+// Reduced resolution transparency: the opaque depth the hair is tested against at the reduced resolution.
+// Each texel takes the farthest depth it covers, so that an opaque edge through it doesn't hide the hair
+// beside the edge. The upsample weighs the texels by how well their depth matches each full resolution
+// sample, which keeps the hair from spreading over the nearer side.
+#ifdef SINGLE_SAMPLE
+layout(set = 0, binding = BIND_FULL_DEPTH) uniform sampler2D fullDepth;
+#else
+layout(set = 0, binding = BIND_FULL_DEPTH) uniform sampler2DMS fullDepth;
+#endif
+
+// The part of the reduced resolution images drawn this frame, and its size relative to the window.
+layout(push_constant) uniform TransparentScale {
+    ivec2 extent;
+    float scale;
+} transparentScale;
+
+void main()
+{
+#ifdef SINGLE_SAMPLE
+    const ivec2 size = textureSize(fullDepth, 0);
+#else
+    const ivec2 size = textureSize(fullDepth);
+#endif
+    // The pixels of the window the texel covers.
+    const ivec2 first = ivec2((gl_FragCoord.xy - 0.5) / transparentScale.scale);
+    const ivec2 last = min(ivec2(ceil((gl_FragCoord.xy + 0.5) / transparentScale.scale)) - 1, size - 1);
+
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; y++) {
+        for (int x = first.x; x <= last.x; x++) {
+            // The first sample, or the level, stands for the pixel. The upsample compares every sample itself.
+            depth = max(depth, texelFetch(fullDepth, ivec2(x, y), 0).r);
+        }
+    }
+    gl_FragDepth = depth;
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#version 450
+#extension GL_KHR_vulkan_glsl : enable
+
+// Reduced resolution transparency: the weighted sums of the hair, drawn at a reduced resolution, composited
+// over the opaque color at full resolution. Each sample blends the four texels around it, bilinearly and by
+// how close the opaque depth each texel was drawn against is to its own, so that the hair stays on its side
+// of opaque edges.
+#ifdef SINGLE_SAMPLE
+layout(set = 0, binding = BIND_FULL_DEPTH) uniform sampler2D fullDepth;
+#else
+layout(set = 0, binding = BIND_FULL_DEPTH) uniform sampler2DMS fullDepth;
+#endif
+layout(set = 0, binding = BIND_LOW_RES_DEPTH) uniform sampler2D lowResDepth;
+layout(set = 0, binding = BIND_LOW_RES_COLOR) uniform sampler2D lowResColor;
+layout(set = 0, binding = BIND_LOW_RES_REVEAL) uniform sampler2D lowResReveal;
+
+// The part of the reduced resolution images drawn this frame, and its size relative to the window.
+layout(push_constant) uniform TransparentScale {
+    ivec2 extent;
+    float scale;
+} transparentScale;
+
+layout(location = 0) out vec4 outColor;
+
+void main()
+{
+#ifdef SINGLE_SAMPLE
+    const float depth = texelFetch(fullDepth, ivec2(gl_FragCoord.xy), 0).r;
+#else
+    const float depth = texelFetch(fullDepth, ivec2(gl_FragCoord.xy), gl_SampleID).r;
+#endif
+
+    // The texel centers below and left of the sample, and how far it is towards the next ones.
+    const vec2 position = gl_FragCoord.xy * transparentScale.scale - 0.5;
+    const ivec2 first = ivec2(floor(position));
+    const vec2 fraction = position - vec2(first);
+
+    vec4 accum = vec4(0.0);
+    float reveal = 0.0;
+    float totalWeight = 0.0;
+    for (int i = 0; i < 4; i++) {
+        const ivec2 offset = ivec2(i & 1, i >> 1);
+        const ivec2 texel = clamp(first + offset, ivec2(0), transparentScale.extent - 1);
+        const vec2 bilinear = mix(1.0 - fraction, fraction, vec2(offset));
+        // A texel drawn against another surface than the sample's counts for little.
+        const float weight = bilinear.x * bilinear.y / (1e-4 + abs(texelFetch(lowResDepth, texel, 0).r - depth));
+        accum += weight * texelFetch(lowResColor, texel, 0);
+        reveal += weight * texelFetch(lowResReveal, texel, 0).r;
+        totalWeight += weight;
+    }
+    accum /= totalWeight;
+    reveal /= totalWeight;
+
+    // Blend function: ONE_MINUS_SRC_ALPHA, SRC_ALPHA, as for the full resolution composite.
+    outColor = vec4(accum.rgb / max(accum.a, 1e-5), reveal);
+}
\ No newline at end of file
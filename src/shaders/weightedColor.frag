@@ -1,12 +1,24 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Texture indices of a material, NO_TEXTURE for maps it lacks.
+struct Material {
+    uint albedo;
+    uint normal;
+    uint direction;
+    uint ao;
+    uint depth;
+    uint root;
+    uint flow;
+    uint id;
+};
+
+layout(std430, set = SET_BINDLESS, binding = BIND_MATERIALS) readonly buffer Materials {
+    Material materials[];
+};
 
-layout(binding = BIND_HAIR_ALBEDO) uniform sampler2D texAlbedo;
-layout(binding = BIND_HAIR_NORMAL) uniform sampler2D texNormal;
-layout(binding = BIND_HAIR_DIRECTION) uniform sampler2D texDirection;
-layout(binding = BIND_HAIR_AO) uniform sampler2D texAo;
-layout(binding = BIND_HAIR_DEPTH) uniform sampler2D texDepth;
-layout(binding = BIND_HAIR_ROOT) uniform sampler2D texRoot;
-layout(binding = BIND_HAIR_FLOW) uniform sampler2D texFlow;
+// Every texture, indexed through the materials. Characters of one draw may use different ones.
+layout(set = SET_BINDLESS, binding = BIND_TEXTURES) uniform sampler2D textures[];
 
 struct VertexAttributes {
     vec4 position;
@@ -17,10 +29,75 @@ struct VertexAttributes {
     float depth;
 };
 
+struct CharacterInstance {
+    mat4 model;
+    // rgb: multiplies the hair albedo.
+    vec4 hairColor;
+    // rgb: multiplies the head albedo.
+    vec4 skinColor;
+    // x: material of the head, y: of the hair.
+    uvec4 materials;
+};
+
+// One per character, indexed by gl_InstanceIndex.
+layout(std430, binding = BIND_CHARACTER_INSTANCES) readonly buffer CharacterInstances {
+    CharacterInstance characters[];
+};
+
 layout(location = 0) in VertexAttributes inVertexAttributes;
+layout(location = 6) flat in uint inInstance;
+
+// The hair material of the fragment's character, set first thing in main.
+Material material;
+
+vec4 sampleMap(uint map, vec2 uv) {
+    return texture(textures[nonuniformEXT(map)], uv);
+}
+
+#if defined(HAIR_DEPTH_PREPASS)
+// Writes only the depth of the opaque core of the cards, where their alpha reaches ubo.hairCoreAlpha.
+layout(binding = BIND_UBO) uniform UniformBufferObject {
+    mat4 view;
+    mat4 proj;
+    vec3 cameraPos;
+    float hairCoreAlpha;
+} ubo;
+#elif defined(HAIR_OPAQUE_CORE)
+// The prepass left the depth of the nearest core fragment, the ones behind it fail the equal test before
+// they are shaded.
+layout(early_fragment_tests) in;
+
+layout(location = 0) out vec4 outColor;
+#elif defined(OIT_LINKED_LIST)
+// The depth test runs before the shader, or fragments behind the opaque objects would be appended too.
+layout(early_fragment_tests) in;
+
+// Per pixel, the node appended last. Every node links to the one appended there before it.
+layout(set = SET_OIT, binding = BIND_OIT_HEADS, r32ui) uniform coherent uimage2D heads;
+// x, y: premultiplied colour as half floats, z: depth, w: next node.
+layout(std430, set = SET_OIT, binding = BIND_OIT_NODES) buffer Nodes {
+    uvec4 nodes[];
+};
+layout(std430, set = SET_OIT, binding = BIND_OIT_COUNTERS) buffer Counters {
+    uint allocatedNodes;
+    uint truncatedFragments;
+};
 
+void appendFragment(vec4 color) {
+    const uint node = atomicAdd(allocatedNodes, 1u);
+    // The pool is full and the fragment is dropped. The count goes on, so the host sees by how much.
+    if (node >= uint(nodes.length())) {
+        return;
+    }
+    const uint next = imageAtomicExchange(heads, ivec2(gl_FragCoord.xy), node);
+    nodes[node] = uvec4(packHalf2x16(color.rg), packHalf2x16(color.ba), floatBitsToUint(gl_FragCoord.z), next);
+}
+#elif defined(OIT_MOMENTS_GENERATE) || defined(OIT_MOMENTS_RESOLVE)
+#include "momentOit.glsl"
+#else
 layout(location = 0) out vec4 outColor;
 layout(location = 1) out float outReveal;
+#endif
 
 // Parallax mapping 
 const float heightScale = 0.005; 
@@ -139,14 +216,14 @@ vec2 parallaxMapping(vec2 texCoords, vec3 viewDir)
   
     // get initial values
     vec2  currentTexCoords     = texCoords;
-    float currentDepthMapValue = texture(texDepth, currentTexCoords).r;
+    float currentDepthMapValue = sampleMap(material.depth, currentTexCoords).r;
   
     while(currentLayerDepth < currentDepthMapValue)
     {
         // shift texture coordinates along direction of P
         currentTexCoords -= deltaTexCoords;
         // get depthmap value at current texture coordinates
-        currentDepthMapValue = texture(texDepth, currentTexCoords).r;  
+        currentDepthMapValue = sampleMap(material.depth, currentTexCoords).r;  
         // get depth of next layer
         currentLayerDepth += layerDepth;  
     }
@@ -156,7 +233,7 @@ vec2 parallaxMapping(vec2 texCoords, vec3 viewDir)
 
     // get depth after and before collision for linear interpolation
     float afterDepth  = currentDepthMapValue - currentLayerDepth;
-    float beforeDepth = texture(texDepth, prevTexCoords).r - currentLayerDepth + layerDepth;
+    float beforeDepth = sampleMap(material.depth, prevTexCoords).r - currentLayerDepth + layerDepth;
  
     // interpolation of texture coordinates
     float weight = afterDepth / (afterDepth - beforeDepth);
@@ -236,24 +313,43 @@ vec3 shadeHair(vec3 tangent, vec3 normal, vec2 texCoords, vec3 wo, vec3 wi, vec3
     return result;        
 }
 
+#ifdef HAIR_DEPTH_PREPASS
 void main() {
+    material = materials[characters[inInstance].materials.y];
+
+    // Without the parallax offset, a cheap test the core and the fringe only have to agree with through the
+    // depth it leaves.
+    if (sampleMap(material.albedo, inVertexAttributes.texCoord).a < ubo.hairCoreAlpha) {
+        discard;
+    }
+}
+#else
+void main() {
+    material = materials[characters[inInstance].materials.y];
+
     // Read from textures
     vec3 wo = normalize(inVertexAttributes.cameraPosition - inVertexAttributes.position.xyz);
 
-    float depth = texture(texDepth, inVertexAttributes.texCoord).r;
+    float depth = sampleMap(material.depth, inVertexAttributes.texCoord).r;
     vec2 texCoords = parallaxMapping(inVertexAttributes.texCoord, wo);
     if(texCoords.x > 1.0 || texCoords.y > 1.0 || texCoords.x < 0.0 || texCoords.y < 0.0) {
+#ifdef HAIR_OPAQUE_CORE
+        // The prepass wrote the depth here, a hole would show the background through the hair.
+        texCoords = clamp(texCoords, 0.0, 1.0);
+#else
         discard;
+#endif
     }
 
-    vec4 albedo = texture(texAlbedo, texCoords);
-    vec3 normal = texture(texNormal, texCoords).xyz;
+    vec4 albedo = sampleMap(material.albedo, texCoords);
+    albedo.rgb *= characters[inInstance].hairColor.rgb;
+    vec3 normal = sampleMap(material.normal, texCoords).xyz;
 	normal = normalize(normal * 2.0 - 1.0);
 	normal = normalize(computeTBN(normal) * normal);
-    vec2 dirXY = texture(texDirection  , texCoords).rb * 2.0 - 1.0;
+    vec2 dirXY = sampleMap(material.direction, texCoords).rb * 2.0 - 1.0;
     vec3 tangent = normalize(vec3(dirXY, sqrt(max(1.0 - dot(dirXY,dirXY), 0.0))));
-	float ao = texture(texAo, texCoords).r;	
-	float root = texture(texRoot, texCoords).r;
+	float ao = sampleMap(material.ao, texCoords).r;	
+	float root = sampleMap(material.root, texCoords).r;
 
     // Shade  
     vec3 hairCol = vec3(0.0f);
@@ -262,9 +358,21 @@ void main() {
     }
     hairCol /= float(light_pos.length());
 
+	vec4 color = vec4(hairCol * albedo.a, albedo.a);
+#if defined(HAIR_OPAQUE_CORE)
+    // The translucent fringe in front is blended over it by the OIT pass.
+    outColor = vec4(hairCol, 1.0);
+#elif defined(OIT_LINKED_LIST)
+    // Sorted and composited by the resolve subpass.
+    appendFragment(color);
+#elif defined(OIT_MOMENTS_GENERATE)
+    // Only the alpha counts, the compiler leaves out the shading.
+    generateMoments(color.a);
+#elif defined(OIT_MOMENTS_RESOLVE)
+    resolveMoments(color);
+#else
     // WBOIT output
     const float z = -inVertexAttributes.depth;
-	vec4 color = vec4(hairCol * albedo.a, albedo.a);
     float distWeight = pow(abs(z), distanceWeightExp);
 	float alphaWeight = min(1.0, max(max(color.r, color.g), max(color.b, color.a)) * 40.0 + 0.01);
 	alphaWeight *= alphaWeight;
@@ -278,4 +386,6 @@ void main() {
 
 	// GL blend function: GL_ZERO, GL_ONE_MINUS_SRC_ALPHA
 	outReveal = color.a;
-}
\ No newline at end of file
+#endif
+}
+#endif
\ No newline at end of file
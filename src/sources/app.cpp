@@ -99,7 +99,30 @@ int main() {
 	std::string opaqueFragShaderPath = compileShader("shaders/main.frag", "mainFrag", Shader::FRAGMENT);
 	std::string weightedColorShaderPath = compileShader("shaders/weightedColor.frag", "weightedColor", Shader::FRAGMENT);
 	std::string weightedRevealShaderPath = compileShader("shaders/weightedReveal.frag", "weightedReveal", Shader::FRAGMENT);
+	std::string weightedRevealSingleSampleShaderPath = compileShader("shaders/weightedReveal.frag", "weightedRevealSingleSample", Shader::FRAGMENT, { "SINGLE_SAMPLE" });
+	std::string presentShaderPath = compileShader("shaders/present.frag", "present", Shader::FRAGMENT);
 	std::string opaqueHairShaderPath = compileShader("shaders/hair.frag", "opaqueHair", Shader::FRAGMENT);
+	// The opaque core of the transparent hair: its depth prepass and its shading.
+	std::string hairPrepassShaderPath = compileShader("shaders/weightedColor.frag", "hairPrepass", Shader::FRAGMENT, { "HAIR_DEPTH_PREPASS" });
+	std::string hairCoreShaderPath = compileShader("shaders/weightedColor.frag", "hairCore", Shader::FRAGMENT, { "HAIR_OPAQUE_CORE" });
+	std::string strandVertShaderPath = compileShader("shaders/strand.vert", "strandVert", Shader::VERTEX);
+	std::string strandFragShaderPath = compileShader("shaders/strand.frag", "strandFrag", Shader::FRAGMENT);
+	// Linked list OIT: the hair shaders appending their fragments instead, and the pass sorting them.
+	std::string linkedListColorShaderPath = compileShader("shaders/weightedColor.frag", "linkedListColor", Shader::FRAGMENT, { "OIT_LINKED_LIST" });
+	std::string linkedListStrandShaderPath = compileShader("shaders/strand.frag", "linkedListStrand", Shader::FRAGMENT, { "OIT_LINKED_LIST" });
+	std::string oitResolveShaderPath = compileShader("shaders/oitResolve.frag", "oitResolve", Shader::FRAGMENT);
+	// Moment OIT: the composite only, the hair shaders depend on the moments picked at runtime.
+	std::string momentCompositeShaderPath = compileShader("shaders/momentComposite.frag", "momentComposite", Shader::FRAGMENT);
+	std::string momentCompositeSingleSampleShaderPath = compileShader("shaders/momentComposite.frag", "momentCompositeSingleSample", Shader::FRAGMENT, { "SINGLE_SAMPLE" });
+	// Reduced resolution transparency: the depth the hair is tested against, and the composite.
+	std::string transparentDepthDownsampleShaderPath = compileShader("shaders/transparentDepthDownsample.frag", "transparentDepthDownsample", Shader::FRAGMENT);
+	std::string transparentDepthDownsampleSingleSampleShaderPath = compileShader("shaders/transparentDepthDownsample.frag", "transparentDepthDownsampleSingleSample", Shader::FRAGMENT, { "SINGLE_SAMPLE" });
+	std::string transparentUpsampleShaderPath = compileShader("shaders/transparentUpsample.frag", "transparentUpsample", Shader::FRAGMENT);
+	std::string transparentUpsampleSingleSampleShaderPath = compileShader("shaders/transparentUpsample.frag", "transparentUpsampleSingleSample", Shader::FRAGMENT, { "SINGLE_SAMPLE" });
+	std::string strandSimulationShaderPath = compileShader("shaders/strandSimulation.comp", "strandSimulation", Shader::COMPUTE);
+	std::string followHairShaderPath = compileShader("shaders/followHair.comp", "followHair", Shader::COMPUTE);
+	std::string strandCullShaderPath = compileShader("shaders/strandCull.comp", "strandCull", Shader::COMPUTE);
+	std::string meshCullShaderPath = compileShader("shaders/meshCull.comp", "meshCull", Shader::COMPUTE);
 
 	std::unordered_map<std::string, std::vector<char>> shaders = {
 		{"vertShader", readFile(vertShaderPath)},
@@ -107,28 +130,64 @@ int main() {
 		{"opaqueFragShader", readFile(opaqueFragShaderPath)},
 		{"weightedColorFragShader", readFile(weightedColorShaderPath)},
 		{"weightedRevealFragShader", readFile(weightedRevealShaderPath)},
-		{"opaqueHairFragShader", readFile(opaqueHairShaderPath)}
+		{"weightedRevealSingleSampleFragShader", readFile(weightedRevealSingleSampleShaderPath)},
+		{"presentFragShader", readFile(presentShaderPath)},
+		{"opaqueHairFragShader", readFile(opaqueHairShaderPath)},
+		{"hairPrepassFragShader", readFile(hairPrepassShaderPath)},
+		{"hairCoreFragShader", readFile(hairCoreShaderPath)},
+		{"strandVertShader", readFile(strandVertShaderPath)},
+		{"strandFragShader", readFile(strandFragShaderPath)},
+		{"linkedListColorFragShader", readFile(linkedListColorShaderPath)},
+		{"linkedListStrandFragShader", readFile(linkedListStrandShaderPath)},
+		{"oitResolveFragShader", readFile(oitResolveShaderPath)},
+		{"momentCompositeFragShader", readFile(momentCompositeShaderPath)},
+		{"momentCompositeSingleSampleFragShader", readFile(momentCompositeSingleSampleShaderPath)},
+		{"transparentDepthDownsampleFragShader", readFile(transparentDepthDownsampleShaderPath)},
+		{"transparentDepthDownsampleSingleSampleFragShader", readFile(transparentDepthDownsampleSingleSampleShaderPath)},
+		{"transparentUpsampleFragShader", readFile(transparentUpsampleShaderPath)},
+		{"transparentUpsampleSingleSampleFragShader", readFile(transparentUpsampleSingleSampleShaderPath)},
+		{"strandSimulationCompShader", readFile(strandSimulationShaderPath)},
+		{"followHairCompShader", readFile(followHairShaderPath)},
+		{"strandCullCompShader", readFile(strandCullShaderPath)},
+		{"meshCullCompShader", readFile(meshCullShaderPath)}
 	};
 
+	// The culled meshes come split into meshlets, built in parallel or read from their mesh caches.
+	std::vector<ClusteredMesh> clusteredModels;
+	{
+		ThreadPool loadPool;
+		clusteredModels = loadClusteredModels({
+			"assets/models/obj/ponytail/character.obj",
+			"assets/models/obj/ponytail/hair.obj"
+		}, loadPool);
+	}
+	ClusteredMesh& head = clusteredModels[0];
+	ClusteredMesh& hair = clusteredModels[1];
+
 	std::unordered_map<std::string, std::pair<std::vector<Vertex>, std::vector<uint32_t>>> models = {
-		{"head", loadModel("assets/models/obj/ponytail/character.obj")},
-		{"hair", loadModel("assets/models/obj/ponytail/hair.obj")},
+		{"head", { std::move(head.vertices), std::move(head.indices) }},
+		{"hair", { std::move(hair.vertices), std::move(hair.indices) }},
 		{"cube", Cube().getMesh()}
 	};
 
+	std::unordered_map<std::string, std::vector<MeshCluster>> meshClusters = {
+		{"head", std::move(head.clusters)},
+		{"hair", std::move(hair.clusters)}
+	};
+
 	std::unordered_map<std::string, Image> textures = {
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HEAD_ALBEDO), loadImage("assets/textures/ponytail/Head BaseColor.png")},
+		{"head_albedo", loadImage("assets/textures/ponytail/Head BaseColor.png")},
 
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_ALBEDO), loadImage("assets/textures/ponytail/T_Hair_Basecolor.png")},
-		//{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_ALBEDO), loadImage("assets/textures/ponytail/T_Hair_Random Color.png")},
+		{"hair_albedo", loadImage("assets/textures/ponytail/T_Hair_Basecolor.png")},
+		//{"hair_albedo", loadImage("assets/textures/ponytail/T_Hair_Random Color.png")},
 		
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_NORMAL), loadImage("assets/textures/ponytail/T_Hair_Normal.png")},
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_DIRECTION), loadImage("assets/textures/ponytail/T_Hair_Directional.png")},
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_AO), loadImage("assets/textures/ponytail/T_Hair_AO.png")},
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_DEPTH), loadImage("assets/textures/ponytail/T_Hair_Depth.png")},
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_FLOW), loadImage("assets/textures/ponytail/T_Hair_Flow.png")},
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_ROOT), loadImage("assets/textures/ponytail/T_Hair_Root.png")},
-		{std::to_string(SET_GLOBAL) + "_" + std::to_string(BIND_HAIR_ID), loadImage("assets/textures/ponytail/T_Hair_ID.png")}
+		{"hair_normal", loadImage("assets/textures/ponytail/T_Hair_Normal.png")},
+		{"hair_direction", loadImage("assets/textures/ponytail/T_Hair_Directional.png")},
+		{"hair_ao", loadImage("assets/textures/ponytail/T_Hair_AO.png")},
+		{"hair_depth", loadImage("assets/textures/ponytail/T_Hair_Depth.png")},
+		{"hair_flow", loadImage("assets/textures/ponytail/T_Hair_Flow.png")},
+		{"hair_root", loadImage("assets/textures/ponytail/T_Hair_Root.png")},
+		{"hair_id", loadImage("assets/textures/ponytail/T_Hair_ID.png")}
 	};
 
 	//CubeMap flattenedEnvMap = loadFlattenedEnvMap("assets/envMaps/christmas_photo_studio_01_4k_hstrip.hdr");
@@ -140,6 +199,7 @@ int main() {
 		app.camera,
 		std::move(shaders),
 		std::move(models),
+		std::move(meshClusters),
 		std::move(textures),
 		std::move(envMap)
 	);
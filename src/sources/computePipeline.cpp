@@ -0,0 +1,74 @@
+#include "computePipeline.h"
+
+ComputePipeline::ComputePipeline() : device(nullptr), layout(VK_NULL_HANDLE), pipeline(VK_NULL_HANDLE) {}
+
+ComputePipeline::ComputePipeline(VkDevice* device) : device(device), layout(VK_NULL_HANDLE), pipeline(VK_NULL_HANDLE) {}
+
+ComputePipeline::~ComputePipeline() {}
+
+void ComputePipeline::destroy() {
+	if (layout != VK_NULL_HANDLE) {
+		vkDestroyPipelineLayout(*device, layout, nullptr);
+		layout = VK_NULL_HANDLE;
+	}
+
+	if (pipeline != VK_NULL_HANDLE) {
+		vkDestroyPipeline(*device, pipeline, nullptr);
+		pipeline = VK_NULL_HANDLE;
+	}
+}
+
+void ComputePipeline::createPipelineLayout(VkDescriptorSetLayout* descriptorLayout, uint32_t pushConstantSize) {
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = pushConstantSize;
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = descriptorLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantSize > 0 ? &pushConstantRange : nullptr;
+
+	if (vkCreatePipelineLayout(*device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create compute pipeline layout!");
+	}
+}
+
+VkShaderModule ComputePipeline::createShaderModule(const std::vector<char>& code) {
+	VkShaderModuleCreateInfo createInfo{};
+	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+	createInfo.codeSize = code.size();
+	createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+	VkShaderModule shaderModule;
+	if (vkCreateShaderModule(*device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create shader module!");
+	}
+
+	return shaderModule;
+}
+
+void ComputePipeline::createPipeline(std::vector<char> compShaderCode) {
+	VkShaderModule compShaderModule = createShaderModule(compShaderCode);
+
+	VkPipelineShaderStageCreateInfo compShaderStageInfo{};
+	compShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	compShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	compShaderStageInfo.module = compShaderModule;
+	compShaderStageInfo.pName = "main";
+
+	VkComputePipelineCreateInfo pipelineInfo{};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage = compShaderStageInfo;
+	pipelineInfo.layout = layout;
+	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineInfo.basePipelineIndex = -1;
+
+	if (vkCreateComputePipelines(*device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to create compute pipeline!");
+	}
+
+	vkDestroyShaderModule(*device, compShaderModule, nullptr);
+}
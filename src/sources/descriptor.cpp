@@ -1,47 +1,47 @@
 #include "descriptor.h"
 
+#include <algorithm>
+#include <string>
+
 Descriptor::Descriptor() : 
 	device(nullptr),
 	numUniformBuffers(0),
 	numTextureBuffers(0),
 	numInputBuffers(0),
+	numStorageBuffers(0),
 	totalNumBuffers(0) {}
 
 Descriptor::Descriptor(
 	VkDevice* device, 
 	uint32_t numUniformBuffers, 
 	uint32_t numTextureBuffers, 
-	uint32_t numInputBuffers
+	uint32_t numInputBuffers,
+	uint32_t numStorageBuffers
 ): 
 	device(device), 
 	numUniformBuffers(numUniformBuffers), 
 	numTextureBuffers(numTextureBuffers), 
-	numInputBuffers(numInputBuffers) {
-	totalNumBuffers = numUniformBuffers + numTextureBuffers + numInputBuffers;
+	numInputBuffers(numInputBuffers),
+	numStorageBuffers(numStorageBuffers) {
+	totalNumBuffers = numUniformBuffers + numTextureBuffers + numInputBuffers + numStorageBuffers;
 }
 
 Descriptor::~Descriptor() {}
 
-void Descriptor::create() {
-	createDescriptorPool();
+void Descriptor::create(DescriptorAllocator& allocator) {
 	createDescriptorSetLayout();
-	allocateDescriptorSets();
+	allocateDescriptorSets(allocator);
 	updateDescriptorSets();
 }
 
 void Descriptor::destroy() {
-	if (descriptorPool == VK_NULL_HANDLE && descriptorSetLayout == VK_NULL_HANDLE) {
+	if (descriptorSetLayout == VK_NULL_HANDLE) {
 		return;
 	}
 
-	// No need to free individual sets C destroying the pool does it.
+	// No need to free individual sets C destroying the allocator's pools does it.
 	descriptorSets.clear();
 
-	if (descriptorPool != VK_NULL_HANDLE) {
-		vkDestroyDescriptorPool(*device, descriptorPool, nullptr);
-		descriptorPool = VK_NULL_HANDLE;
-	}
-
 	if (descriptorSetLayout != VK_NULL_HANDLE) {
 		vkDestroyDescriptorSetLayout(*device, descriptorSetLayout, nullptr);
 		descriptorSetLayout = VK_NULL_HANDLE;
@@ -69,6 +69,25 @@ void Descriptor::addDescriptorSetLayoutBinding(
 	bindings.push_back(descriptorBinding);
 }
 
+void Descriptor::addBindlessImageArray(uint32_t binding, VkShaderStageFlags shaderStageFlags, uint32_t count) {
+	VkDescriptorSetLayoutBinding layoutBinding{};
+	layoutBinding.binding = binding;
+	layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	layoutBinding.descriptorCount = count;
+	layoutBinding.stageFlags = shaderStageFlags;
+	layoutBinding.pImmutableSamplers = nullptr;
+
+	const VkDescriptorBindingFlagsEXT flags =
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT;
+	bindings.push_back(DescriptorBinding(layoutBinding, {}, VK_NULL_HANDLE, VK_NULL_HANDLE, flags));
+}
+
+bool Descriptor::isUpdateAfterBind() const {
+	return std::any_of(bindings.begin(), bindings.end(),
+		[](const DescriptorBinding& b) { return (b.flags & VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT) != 0; });
+}
+
 void Descriptor::createDescriptorSetLayout() {
 	if (bindings.size() != totalNumBuffers) {
 		throw std::runtime_error("Descriptor set layout bindings do not match the total number of buffers. Are you sure you have set the number of each type of buffers correctly?");
@@ -78,54 +97,40 @@ void Descriptor::createDescriptorSetLayout() {
 	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
 	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
 	std::vector<VkDescriptorSetLayoutBinding> bindings;
+	std::vector<VkDescriptorBindingFlagsEXT> bindingFlags;
 	for (const auto& binding : this->bindings) {
 		bindings.push_back(binding.binding);
+		bindingFlags.push_back(binding.flags);
 	}
 	layoutInfo.pBindings = bindings.data();
 
+	// Only chained when some binding has flags, so that plain sets don't need VK_EXT_descriptor_indexing.
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsInfo.bindingCount = static_cast<uint32_t>(bindingFlags.size());
+	bindingFlagsInfo.pBindingFlags = bindingFlags.data();
+	if (std::any_of(bindingFlags.begin(), bindingFlags.end(), [](VkDescriptorBindingFlagsEXT flags) { return flags != 0; })) {
+		layoutInfo.pNext = &bindingFlagsInfo;
+	}
+	if (isUpdateAfterBind()) {
+		layoutInfo.flags |= VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	}
+
 	if (vkCreateDescriptorSetLayout(*device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS) {
 		throw std::runtime_error("Failed to create descriptor set layout!");
 	}
 }
 
-void Descriptor::createDescriptorPool(const uint32_t poolSize) {
-	VkDescriptorPoolSize poolSizes[] = {
-		{ VK_DESCRIPTOR_TYPE_SAMPLER,                poolSize },
-		{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, poolSize },
-		{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,          poolSize },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,          poolSize },
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER,   poolSize },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER,   poolSize },
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,         poolSize },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,         poolSize },
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, poolSize },
-		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, poolSize },
-		{ VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT,       poolSize }
-	};
-
-	VkDescriptorPoolCreateInfo poolInfo{};
-	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = static_cast<uint32_t>(std::size(poolSizes));
-	poolInfo.pPoolSizes = poolSizes;
-	poolInfo.maxSets = static_cast<uint32_t>(poolSize);
-
-	if (vkCreateDescriptorPool(*device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create descriptor pool!");
+DescriptorCounts Descriptor::getDescriptorCounts() const {
+	DescriptorCounts counts;
+	for (const auto& b : bindings) {
+		counts[b.binding.descriptorType] += b.binding.descriptorCount;
 	}
+	return counts;
 }
 
-void Descriptor::allocateDescriptorSets() {
-	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
-	allocInfo.pSetLayouts = layouts.data();
-
-	descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-	if (vkAllocateDescriptorSets(*device, &allocInfo, descriptorSets.data()) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to allocate descriptor sets!");
-	}
+void Descriptor::allocateDescriptorSets(DescriptorAllocator& allocator) {
+	descriptorSets = allocator.allocate(descriptorSetLayout, getDescriptorCounts(), MAX_FRAMES_IN_FLIGHT);
 }
 
 void Descriptor::updateDescriptorSets() {
@@ -134,11 +139,17 @@ void Descriptor::updateDescriptorSets() {
 	std::vector<VkDescriptorImageInfo>  imageInfos;
 
 	writes.reserve(MAX_FRAMES_IN_FLIGHT * bindings.size());
-	bufferInfos.reserve(MAX_FRAMES_IN_FLIGHT * numUniformBuffers);
+	// Reserve up front, the writes keep pointers into these vectors.
+	bufferInfos.reserve(MAX_FRAMES_IN_FLIGHT * (numUniformBuffers + numStorageBuffers));
 	imageInfos.reserve(MAX_FRAMES_IN_FLIGHT * (numTextureBuffers + numInputBuffers));
 
 	for (size_t frame = 0; frame < MAX_FRAMES_IN_FLIGHT; ++frame) {
 		for (auto& b : bindings) {
+			// Arrays are written element by element.
+			if (b.binding.descriptorCount > 1) {
+				continue;
+			}
+
 			VkWriteDescriptorSet w{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
 			w.dstSet = descriptorSets[frame];
 			w.dstBinding = b.binding.binding;
@@ -156,6 +167,26 @@ void Descriptor::updateDescriptorSets() {
 				w.pBufferInfo = &info;
 				break;
 			}
+			case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC: {
+				bufferInfos.emplace_back();
+				auto& info = bufferInfos.back();
+				// One buffer for every frame, the dynamic offset picks the frame's part of it.
+				info.buffer = b.buffers.size() == 1 ? b.buffers[0] : b.buffers[frame];
+				info.offset = 0;
+				info.range = sizeof(UniformBufferObject);
+				w.pBufferInfo = &info;
+				break;
+			}
+			case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: {
+				bufferInfos.emplace_back();
+				auto& info = bufferInfos.back();
+				// Buffers shared by all frames can be given once.
+				info.buffer = b.buffers.size() == 1 ? b.buffers[0] : b.buffers[frame];
+				info.offset = 0;
+				info.range = VK_WHOLE_SIZE;
+				w.pBufferInfo = &info;
+				break;
+			}
 			case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
 			case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: {
 				imageInfos.emplace_back();
@@ -177,4 +208,58 @@ void Descriptor::updateDescriptorSets() {
 	vkUpdateDescriptorSets(*device,
 		static_cast<uint32_t>(writes.size()), writes.data(),
 		0, nullptr);
+}
+
+void Descriptor::updateImageArrayElement(uint32_t binding, uint32_t element, VkImageView imageView, VkSampler sampler) {
+	auto it = std::find_if(bindings.begin(), bindings.end(),
+		[binding](const DescriptorBinding& b) { return b.binding.binding == binding; });
+	if (it == bindings.end() || element >= it->binding.descriptorCount) {
+		throw std::runtime_error("No element " + std::to_string(element) + " in descriptor binding " + std::to_string(binding) + ".");
+	}
+
+	VkDescriptorImageInfo info{};
+	info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	info.imageView = imageView;
+	info.sampler = sampler;
+
+	std::vector<VkWriteDescriptorSet> writes;
+	for (VkDescriptorSet set : descriptorSets) {
+		VkWriteDescriptorSet w{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		w.dstSet = set;
+		w.dstBinding = binding;
+		w.dstArrayElement = element;
+		w.descriptorType = it->binding.descriptorType;
+		w.descriptorCount = 1;
+		w.pImageInfo = &info;
+		writes.push_back(w);
+	}
+
+	vkUpdateDescriptorSets(*device,
+		static_cast<uint32_t>(writes.size()), writes.data(),
+		0, nullptr);
+}
+
+void Descriptor::updateImageBinding(uint32_t frame, uint32_t binding, VkImageView imageView, VkSampler sampler) {
+	auto it = std::find_if(bindings.begin(), bindings.end(),
+		[binding](const DescriptorBinding& b) { return b.binding.binding == binding; });
+	if (it == bindings.end()) {
+		throw std::runtime_error("No descriptor binding " + std::to_string(binding) + " to update.");
+	}
+	it->imageView = imageView;
+	it->sampler = sampler;
+
+	VkDescriptorImageInfo info{};
+	info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	info.imageView = imageView;
+	info.sampler = sampler;
+
+	VkWriteDescriptorSet w{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+	w.dstSet = descriptorSets[frame];
+	w.dstBinding = binding;
+	w.dstArrayElement = 0;
+	w.descriptorType = it->binding.descriptorType;
+	w.descriptorCount = 1;
+	w.pImageInfo = &info;
+
+	vkUpdateDescriptorSets(*device, 1, &w, 0, nullptr);
 }
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "descriptorAllocator.h"
+
+#include <algorithm>
+#include <functional>
+
+DescriptorAllocator::DescriptorAllocator() :
+	device(nullptr),
+	flags(0),
+	nextMaxSets(0) {}
+
+DescriptorAllocator::DescriptorAllocator(VkDevice* device, VkDescriptorPoolCreateFlags flags) :
+	device(device),
+	flags(flags),
+	nextMaxSets(0) {}
+
+DescriptorAllocator::~DescriptorAllocator() {}
+
+void DescriptorAllocator::destroy() {
+	for (const Pool& pool : pools) {
+		vkDestroyDescriptorPool(*device, pool.pool, nullptr);
+	}
+	pools.clear();
+	nextCapacity.clear();
+	nextMaxSets = 0;
+}
+
+bool DescriptorAllocator::fits(const Pool& pool, const DescriptorCounts& counts, uint32_t numSets) {
+	if (pool.usedSets + numSets > pool.maxSets) {
+		return false;
+	}
+	for (const auto& [type, count] : counts) {
+		const auto capacity = pool.capacity.find(type);
+		const auto used = pool.used.find(type);
+		const uint32_t left = (capacity == pool.capacity.end() ? 0 : capacity->second) - (used == pool.used.end() ? 0 : used->second);
+		if (count * numSets > left) {
+			return false;
+		}
+	}
+	return true;
+}
+
+DescriptorAllocator::Pool& DescriptorAllocator::createPool(const DescriptorCounts& counts, uint32_t numSets) {
+	Pool pool{};
+	pool.capacity = nextCapacity;
+	for (const auto& [type, count] : counts) {
+		pool.capacity[type] = std::max(pool.capacity[type], count * numSets);
+	}
+	pool.maxSets = std::max(nextMaxSets, numSets);
+
+	std::vector<VkDescriptorPoolSize> poolSizes;
+	for (const auto& [type, count] : pool.capacity) {
+		if (count > 0) {
+			poolSizes.push_back({ type, count });
+		}
+	}
+
+	VkDescriptorPoolCreateInfo poolInfo{};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = flags;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = pool.maxSets;
+
+	if (vkCreateDescriptorPool(*device, &poolInfo, nullptr, &pool.pool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create descriptor pool!");
+	}
+
+	for (const auto& [type, count] : pool.capacity) {
+		nextCapacity[type] = 2 * count;
+	}
+	nextMaxSets = 2 * pool.maxSets;
+
+	pools.push_back(pool);
+	return pools.back();
+}
+
+std::vector<VkDescriptorSet> DescriptorAllocator::allocate(VkDescriptorSetLayout layout, const DescriptorCounts& counts, uint32_t numSets) {
+	auto it = std::find_if(pools.begin(), pools.end(),
+		[&](const Pool& pool) { return fits(pool, counts, numSets); });
+	Pool& pool = it != pools.end() ? *it : createPool(counts, numSets);
+
+	std::vector<VkDescriptorSetLayout> layouts(numSets, layout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = pool.pool;
+	allocInfo.descriptorSetCount = numSets;
+	allocInfo.pSetLayouts = layouts.data();
+
+	std::vector<VkDescriptorSet> sets(numSets);
+	if (vkAllocateDescriptorSets(*device, &allocInfo, sets.data()) != VK_SUCCESS) {
+		throw std::runtime_error("failed to allocate descriptor sets!");
+	}
+
+	for (const auto& [type, count] : counts) {
+		pool.used[type] += count * numSets;
+	}
+	pool.usedSets += numSets;
+	return sets;
+}
+
+void DescriptorAllocator::reset() {
+	if (pools.size() <= 1) {
+		for (Pool& pool : pools) {
+			vkResetDescriptorPool(*device, pool.pool, 0);
+			pool.used.clear();
+			pool.usedSets = 0;
+		}
+		return;
+	}
+
+	// The sets outgrew the first pool, one pool as large as all of them together holds them from now on.
+	DescriptorCounts capacity;
+	uint32_t maxSets = 0;
+	for (const Pool& pool : pools) {
+		for (const auto& [type, count] : pool.capacity) {
+			capacity[type] += count;
+		}
+		maxSets += pool.maxSets;
+		vkDestroyDescriptorPool(*device, pool.pool, nullptr);
+	}
+	pools.clear();
+	nextCapacity = capacity;
+	nextMaxSets = maxSets;
+	createPool({}, 0);
+}
+
+DescriptorAllocatorStats DescriptorAllocator::getStats() const {
+	DescriptorAllocatorStats stats{};
+	stats.pools = static_cast<uint32_t>(pools.size());
+	for (const Pool& pool : pools) {
+		stats.sets += pool.usedSets;
+		for (const auto& [type, count] : pool.capacity) {
+			stats.descriptorsReserved += count;
+		}
+		for (const auto& [type, count] : pool.used) {
+			stats.descriptorsUsed += count;
+		}
+	}
+	return stats;
+}
+
+DescriptorWrite DescriptorWrite::forBuffer(uint32_t binding, VkDescriptorType type, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+	DescriptorWrite write{};
+	write.binding = binding;
+	write.type = type;
+	write.buffer = buffer;
+	write.offset = offset;
+	write.range = range;
+	return write;
+}
+
+DescriptorWrite DescriptorWrite::forImage(uint32_t binding, VkDescriptorType type, VkImageView imageView, VkSampler sampler, VkImageLayout imageLayout) {
+	DescriptorWrite write{};
+	write.binding = binding;
+	write.type = type;
+	write.imageView = imageView;
+	write.sampler = sampler;
+	write.imageLayout = imageLayout;
+	return write;
+}
+
+bool DescriptorWrite::operator==(const DescriptorWrite& other) const {
+	return binding == other.binding && type == other.type &&
+		buffer == other.buffer && offset == other.offset && range == other.range &&
+		imageView == other.imageView && sampler == other.sampler && imageLayout == other.imageLayout;
+}
+
+bool DescriptorSetCache::Key::operator==(const Key& other) const {
+	return layout == other.layout && writes == other.writes;
+}
+
+size_t DescriptorSetCache::KeyHash::operator()(const Key& key) const {
+	size_t hash = std::hash<VkDescriptorSetLayout>{}(key.layout);
+	auto combine = [&hash](size_t value) {
+		hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+	};
+	for (const DescriptorWrite& write : key.writes) {
+		combine(std::hash<uint32_t>{}(write.binding));
+		combine(std::hash<VkBuffer>{}(write.buffer));
+		combine(std::hash<VkDeviceSize>{}(write.offset));
+		combine(std::hash<VkImageView>{}(write.imageView));
+		combine(std::hash<VkSampler>{}(write.sampler));
+	}
+	return hash;
+}
+
+DescriptorSetCache::DescriptorSetCache() :
+	device(nullptr),
+	stats{} {}
+
+DescriptorSetCache::DescriptorSetCache(VkDevice* device, VkDescriptorPoolCreateFlags flags) :
+	device(device),
+	allocator(device, flags),
+	stats{} {}
+
+DescriptorSetCache::~DescriptorSetCache() {}
+
+void DescriptorSetCache::destroy() {
+	sets.clear();
+	allocator.destroy();
+}
+
+VkDescriptorSet DescriptorSetCache::getSet(VkDescriptorSetLayout layout, const std::vector<DescriptorWrite>& writes) {
+	Key key{ layout, writes };
+	const auto cached = sets.find(key);
+	if (cached != sets.end()) {
+		stats.hits++;
+		return cached->second;
+	}
+
+	DescriptorCounts counts;
+	for (const DescriptorWrite& write : writes) {
+		counts[write.type]++;
+	}
+	const VkDescriptorSet set = allocator.allocate(layout, counts).front();
+
+	// Reserve up front, the writes keep pointers into these vectors.
+	std::vector<VkWriteDescriptorSet> vkWrites;
+	std::vector<VkDescriptorBufferInfo> bufferInfos;
+	std::vector<VkDescriptorImageInfo> imageInfos;
+	bufferInfos.reserve(writes.size());
+	imageInfos.reserve(writes.size());
+	for (const DescriptorWrite& write : writes) {
+		VkWriteDescriptorSet w{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET };
+		w.dstSet = set;
+		w.dstBinding = write.binding;
+		w.dstArrayElement = 0;
+		w.descriptorType = write.type;
+		w.descriptorCount = 1;
+		if (write.imageView != VK_NULL_HANDLE || write.sampler != VK_NULL_HANDLE) {
+			imageInfos.push_back({ write.sampler, write.imageView, write.imageLayout });
+			w.pImageInfo = &imageInfos.back();
+		}
+		else {
+			bufferInfos.push_back({ write.buffer, write.offset, write.range });
+			w.pBufferInfo = &bufferInfos.back();
+		}
+		vkWrites.push_back(w);
+	}
+	vkUpdateDescriptorSets(*device, static_cast<uint32_t>(vkWrites.size()), vkWrites.data(), 0, nullptr);
+
+	stats.misses++;
+	stats.descriptorWrites += static_cast<uint32_t>(vkWrites.size());
+	sets.emplace(std::move(key), set);
+	return set;
+}
+
+void DescriptorSetCache::reset() {
+	sets.clear();
+	allocator.reset();
+	stats = {};
+}
+
+void DescriptorSetCache::forgetBuffer(VkBuffer buffer) {
+	for (auto it = sets.begin(); it != sets.end();) {
+		const bool binds = std::any_of(it->first.writes.begin(), it->first.writes.end(), [&](const DescriptorWrite& write) {
+			return write.buffer == buffer;
+		});
+		if (binds) {
+			it = sets.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+void DescriptorSetCache::resetStats() {
+	stats = {};
+}
+
+DescriptorCacheStats DescriptorSetCache::getStats() const {
+	return stats;
+}
+
+DescriptorAllocatorStats DescriptorSetCache::getAllocatorStats() const {
+	return allocator.getStats();
+}
@@ -0,0 +1,395 @@
+#include "followHair.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FOLLOW_HAIR_SSE
+#include <emmintrin.h>
+#endif
+
+FollowHair::FollowHair() :
+	numVertices(0),
+	verticesPerStrand(0) {}
+
+FollowHair::FollowHair(
+	const std::vector<Vertex>& vertices,
+	const GuideStrands& strands,
+	const CardVertexInfo& cardInfo,
+	uint32_t guidesPerVertex,
+	ThreadPool& pool,
+	const std::vector<uint32_t>& activeStrands
+) :
+	numVertices(static_cast<uint32_t>(vertices.size())),
+	verticesPerStrand(strands.verticesPerStrand) {
+	if (cardInfo.strand.size() != vertices.size() || cardInfo.parameter.size() != vertices.size()) {
+		throw std::runtime_error("The card info doesn't match the card vertices.");
+	}
+	if (strands.numStrands == 0 || strands.verticesPerStrand < 2) {
+		throw std::runtime_error("Follow hair needs at least one guide strand.");
+	}
+
+	std::vector<uint32_t> candidates = activeStrands;
+	if (candidates.empty()) {
+		candidates.resize(strands.numStrands);
+		for (uint32_t s = 0; s < strands.numStrands; s++) {
+			candidates[s] = s;
+		}
+	}
+	std::vector<uint8_t> isCandidate(strands.numStrands, 0);
+	for (uint32_t s : candidates) {
+		isCandidate[s] = 1;
+	}
+
+	const uint32_t n = strands.verticesPerStrand;
+	const uint32_t maxGuides = std::min(std::clamp(guidesPerVertex, 1u, 3u), static_cast<uint32_t>(candidates.size()));
+
+	segment0.resize(numVertices);
+	segment1.resize(numVertices);
+	segment2.resize(numVertices);
+	weight0.resize(numVertices);
+	weight1.resize(numVertices);
+	weight2.resize(numVertices);
+	fraction.resize(numVertices);
+	restX.resize(numVertices);
+	restY.resize(numVertices);
+	restZ.resize(numVertices);
+	restOffsets.resize(numVertices);
+	restNormals.resize(numVertices);
+
+	displacementX.resize(strands.numVertices());
+	displacementY.resize(strands.numVertices());
+	displacementZ.resize(strands.numVertices());
+
+	pool.parallelFor(numVertices, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t v = begin; v < end; v++) {
+			const glm::vec3 p(vertices[v].pos);
+			restX[v] = p.x;
+			restY[v] = p.y;
+			restZ[v] = p.z;
+
+			// Vertices of skipped cards take the parameter of the closest guide vertex.
+			const int32_t cardStrand = cardInfo.strand[v];
+			float t = cardInfo.parameter[v];
+			if (cardStrand < 0) {
+				float best = std::numeric_limits<float>::max();
+				for (uint32_t s : candidates) {
+					for (uint32_t i = s * n; i < (s + 1) * n; i++) {
+						const float d = glm::length(strands.restPositions[i] - p);
+						if (d < best) {
+							best = d;
+							t = static_cast<float>(i % n) / static_cast<float>(n - 1);
+						}
+					}
+				}
+			}
+			// The card's own guide only counts if it may be bound to.
+			const int32_t ownStrand = (cardStrand >= 0 && isCandidate[cardStrand]) ? cardStrand : -1;
+
+			const float x = glm::clamp(t, 0.0f, 1.0f) * static_cast<float>(n - 1);
+			const uint32_t s0 = std::min(static_cast<uint32_t>(x), n - 2);
+			const float f = x - static_cast<float>(s0);
+			fraction[v] = f;
+
+			auto guidePoint = [&](uint32_t strand) {
+				const uint32_t i = strand * n + s0;
+				return glm::mix(strands.restPositions[i], strands.restPositions[i + 1], f);
+			};
+
+			// Keep the closest guides at the same parameter. The card's own guide always comes first.
+			uint32_t guides[3] = { 0, 0, 0 };
+			float distances[3] = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
+			uint32_t found = 0;
+			if (ownStrand >= 0) {
+				guides[0] = static_cast<uint32_t>(ownStrand);
+				distances[0] = -1.0f;
+				found = 1;
+			}
+			for (uint32_t s : candidates) {
+				if (static_cast<int32_t>(s) == ownStrand) {
+					continue;
+				}
+				const float d = glm::length(guidePoint(s) - p);
+				if (found == maxGuides && d >= distances[maxGuides - 1]) {
+					continue;
+				}
+
+				uint32_t slot = std::min(found, maxGuides - 1);
+				while (slot > 0 && distances[slot - 1] > d) {
+					guides[slot] = guides[slot - 1];
+					distances[slot] = distances[slot - 1];
+					slot--;
+				}
+				guides[slot] = s;
+				distances[slot] = d;
+				found = std::min(found + 1, maxGuides);
+			}
+
+			glm::vec3 points[3];
+			for (uint32_t k = 0; k < found; k++) {
+				points[k] = guidePoint(guides[k]);
+				distances[k] = glm::length(points[k] - p);
+			}
+
+			// Barycentric weights of the vertex projected onto the guides, falling back to inverse distance
+			// weights if the projection lands outside of them.
+			float weights[3] = { 1.0f, 0.0f, 0.0f };
+			bool inside = false;
+			if (found == 2) {
+				const glm::vec3 e = points[1] - points[0];
+				const float lengthSquared = glm::dot(e, e);
+				if (lengthSquared > 1e-12f) {
+					const float u = glm::dot(p - points[0], e) / lengthSquared;
+					if (u >= 0.0f && u <= 1.0f) {
+						weights[0] = 1.0f - u;
+						weights[1] = u;
+						inside = true;
+					}
+				}
+			}
+			else if (found == 3) {
+				const glm::vec3 e0 = points[1] - points[0];
+				const glm::vec3 e1 = points[2] - points[0];
+				const glm::vec3 e2 = p - points[0];
+				const float d00 = glm::dot(e0, e0);
+				const float d01 = glm::dot(e0, e1);
+				const float d11 = glm::dot(e1, e1);
+				const float d20 = glm::dot(e2, e0);
+				const float d21 = glm::dot(e2, e1);
+				const float denominator = d00 * d11 - d01 * d01;
+				if (std::abs(denominator) > 1e-12f) {
+					const float b1 = (d11 * d20 - d01 * d21) / denominator;
+					const float b2 = (d00 * d21 - d01 * d20) / denominator;
+					const float b0 = 1.0f - b1 - b2;
+					if (b0 >= 0.0f && b1 >= 0.0f && b2 >= 0.0f) {
+						weights[0] = b0;
+						weights[1] = b1;
+						weights[2] = b2;
+						inside = true;
+					}
+				}
+			}
+			if (found > 1 && !inside) {
+				float sum = 0.0f;
+				for (uint32_t k = 0; k < found; k++) {
+					weights[k] = 1.0f / (distances[k] + 1e-4f);
+					sum += weights[k];
+				}
+				for (uint32_t k = 0; k < found; k++) {
+					weights[k] /= sum;
+				}
+			}
+
+			// Unused slots point at the first guide with zero weight so that the kernel never branches.
+			for (uint32_t k = found; k < 3; k++) {
+				guides[k] = guides[0];
+				weights[k] = 0.0f;
+			}
+
+			glm::vec3 blended(0.0f);
+			for (uint32_t k = 0; k < found; k++) {
+				blended += weights[k] * points[k];
+			}
+			restOffsets[v] = p - blended;
+			restNormals[v] = glm::vec3(vertices[v].normal);
+
+			segment0[v] = guides[0] * n + s0;
+			segment1[v] = guides[1] * n + s0;
+			segment2[v] = guides[2] * n + s0;
+			weight0[v] = weights[0];
+			weight1[v] = weights[1];
+			weight2[v] = weights[2];
+		}
+	});
+}
+
+uint32_t FollowHair::size() const {
+	return numVertices;
+}
+
+std::vector<PackedFollowHairBinding> FollowHair::packBindings() const {
+	std::vector<PackedFollowHairBinding> packed(numVertices);
+	for (uint32_t v = 0; v < numVertices; v++) {
+		packed[v].segments = glm::uvec4(segment0[v], segment1[v], segment2[v], 0);
+		packed[v].weights = glm::vec4(weight0[v], weight1[v], weight2[v], fraction[v]);
+		packed[v].rest = glm::vec4(restX[v], restY[v], restZ[v], 1.0f);
+	}
+	return packed;
+}
+
+void FollowHair::deform(const GuideStrands& strands, const std::vector<glm::mat3>& rootRotations, Vertex* out, ThreadPool& pool) {
+	if (numVertices == 0) {
+		return;
+	}
+	if (displacementX.size() != strands.numVertices()) {
+		throw std::runtime_error("The guide strands don't match the ones follow hair was bound to.");
+	}
+	if (!rootRotations.empty() && rootRotations.size() != strands.numStrands) {
+		throw std::runtime_error("The root rotations don't match the guide strands.");
+	}
+
+	pool.parallelFor(strands.numVertices(), [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t i = begin; i < end; i++) {
+			displacementX[i] = strands.posX[i] - strands.restPositions[i].x;
+			displacementY[i] = strands.posY[i] - strands.restPositions[i].y;
+			displacementZ[i] = strands.posZ[i] - strands.restPositions[i].z;
+		}
+	});
+
+	const glm::mat3* rotations = rootRotations.empty() ? nullptr : rootRotations.data();
+	pool.parallelFor(numVertices, [&](uint32_t begin, uint32_t end, uint32_t) {
+		deformRange(begin, end, rotations, out);
+	});
+}
+
+void FollowHair::bindClusters(const std::vector<uint32_t>& indices, const std::vector<MeshCluster>& clusters) {
+	clusterGuideOffsets.assign(1, 0);
+	clusterGuides.clear();
+	clusterReach.clear();
+
+	std::vector<uint32_t> guides;
+	for (const MeshCluster& cluster : clusters) {
+		guides.clear();
+		float reach = 0.0f;
+		for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i++) {
+			const uint32_t v = indices[i];
+			if (v >= numVertices) {
+				throw std::runtime_error("The clusters use vertices follow hair wasn't bound to.");
+			}
+			// Unused slots repeat the first guide, so they add nothing.
+			guides.insert(guides.end(), { segment0[v] / verticesPerStrand, segment1[v] / verticesPerStrand, segment2[v] / verticesPerStrand });
+			reach = std::max(reach, glm::length(restOffsets[v]));
+		}
+		std::sort(guides.begin(), guides.end());
+		guides.erase(std::unique(guides.begin(), guides.end()), guides.end());
+
+		clusterGuides.insert(clusterGuides.end(), guides.begin(), guides.end());
+		clusterGuideOffsets.push_back(static_cast<uint32_t>(clusterGuides.size()));
+		clusterReach.push_back(reach);
+	}
+}
+
+void FollowHair::refitClusters(const GuideStrands& strands, PackedMeshCluster* out, ThreadPool& pool) {
+	const uint32_t numClusters = static_cast<uint32_t>(clusterReach.size());
+	if (numClusters == 0) {
+		return;
+	}
+	if (displacementX.size() != strands.numVertices()) {
+		throw std::runtime_error("The guide strands don't match the ones follow hair was bound to.");
+	}
+
+	const uint32_t n = strands.verticesPerStrand;
+	guideLower.resize(strands.numStrands);
+	guideUpper.resize(strands.numStrands);
+	pool.parallelFor(strands.numStrands, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t s = begin; s < end; s++) {
+			glm::vec3 lower(std::numeric_limits<float>::max());
+			glm::vec3 upper(-std::numeric_limits<float>::max());
+			for (uint32_t i = s * n; i < (s + 1) * n; i++) {
+				const glm::vec3 p = strands.position(i);
+				lower = glm::min(lower, p);
+				upper = glm::max(upper, p);
+			}
+			guideLower[s] = lower;
+			guideUpper[s] = upper;
+		}
+	});
+
+	pool.parallelFor(numClusters, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t c = begin; c < end; c++) {
+			glm::vec3 lower(std::numeric_limits<float>::max());
+			glm::vec3 upper(-std::numeric_limits<float>::max());
+			for (uint32_t k = clusterGuideOffsets[c]; k < clusterGuideOffsets[c + 1]; k++) {
+				lower = glm::min(lower, guideLower[clusterGuides[k]]);
+				upper = glm::max(upper, guideUpper[clusterGuides[k]]);
+			}
+			out[c].sphere = glm::vec4(0.5f * (lower + upper), 0.5f * glm::length(upper - lower) + clusterReach[c]);
+		}
+	});
+}
+
+#ifdef FOLLOW_HAIR_SSE
+static inline __m128 gather(const float* values, const uint32_t* indices, uint32_t offset) {
+	return _mm_setr_ps(values[indices[0] + offset], values[indices[1] + offset], values[indices[2] + offset], values[indices[3] + offset]);
+}
+
+// Interpolates the displacement of 3 guides inside their segments and blends them, 4 vertices at a time.
+static inline __m128 blend(
+	const float* displacement,
+	const uint32_t* s0, const uint32_t* s1, const uint32_t* s2,
+	__m128 w0, __m128 w1, __m128 w2,
+	__m128 f, __m128 rest
+) {
+	const __m128 a0 = gather(displacement, s0, 0);
+	const __m128 a1 = gather(displacement, s1, 0);
+	const __m128 a2 = gather(displacement, s2, 0);
+	const __m128 d0 = _mm_add_ps(a0, _mm_mul_ps(_mm_sub_ps(gather(displacement, s0, 1), a0), f));
+	const __m128 d1 = _mm_add_ps(a1, _mm_mul_ps(_mm_sub_ps(gather(displacement, s1, 1), a1), f));
+	const __m128 d2 = _mm_add_ps(a2, _mm_mul_ps(_mm_sub_ps(gather(displacement, s2, 1), a2), f));
+	return _mm_add_ps(rest, _mm_add_ps(_mm_mul_ps(d0, w0), _mm_add_ps(_mm_mul_ps(d1, w1), _mm_mul_ps(d2, w2))));
+}
+#endif
+
+void FollowHair::deformRange(uint32_t begin, uint32_t end, const glm::mat3* rootRotations, Vertex* out) const {
+	uint32_t v = begin;
+
+#ifdef FOLLOW_HAIR_SSE
+	alignas(16) float x[4], y[4], z[4];
+	for (; v + 4 <= end; v += 4) {
+		const uint32_t* s0 = &segment0[v];
+		const uint32_t* s1 = &segment1[v];
+		const uint32_t* s2 = &segment2[v];
+		const __m128 w0 = _mm_loadu_ps(&weight0[v]);
+		const __m128 w1 = _mm_loadu_ps(&weight1[v]);
+		const __m128 w2 = _mm_loadu_ps(&weight2[v]);
+		const __m128 f = _mm_loadu_ps(&fraction[v]);
+
+		_mm_store_ps(x, blend(displacementX.data(), s0, s1, s2, w0, w1, w2, f, _mm_loadu_ps(&restX[v])));
+		_mm_store_ps(y, blend(displacementY.data(), s0, s1, s2, w0, w1, w2, f, _mm_loadu_ps(&restY[v])));
+		_mm_store_ps(z, blend(displacementZ.data(), s0, s1, s2, w0, w1, w2, f, _mm_loadu_ps(&restZ[v])));
+
+		for (uint32_t k = 0; k < 4; k++) {
+			out[v + k].pos = glm::vec4(x[k], y[k], z[k], 1.0f);
+		}
+	}
+#endif
+
+	for (; v < end; v++) {
+		const float f = fraction[v];
+		auto blendScalar = [&](const std::vector<float>& displacement, float rest) {
+			const float d0 = displacement[segment0[v]] + (displacement[segment0[v] + 1] - displacement[segment0[v]]) * f;
+			const float d1 = displacement[segment1[v]] + (displacement[segment1[v] + 1] - displacement[segment1[v]]) * f;
+			const float d2 = displacement[segment2[v]] + (displacement[segment2[v] + 1] - displacement[segment2[v]]) * f;
+			return rest + d0 * weight0[v] + d1 * weight1[v] + d2 * weight2[v];
+		};
+
+		out[v].pos = glm::vec4(
+			blendScalar(displacementX, restX[v]),
+			blendScalar(displacementY, restY[v]),
+			blendScalar(displacementZ, restZ[v]),
+			1.0f
+		);
+	}
+
+	if (rootRotations == nullptr) {
+		return;
+	}
+	// The displacement above moves the card with its guides, this turns it with them. The blend of the
+	// guide frames is close to a rotation for guides next to each other, the normal is renormalized.
+	for (v = begin; v < end; v++) {
+		const glm::mat3 rotation =
+			weight0[v] * rootRotations[segment0[v] / verticesPerStrand] +
+			weight1[v] * rootRotations[segment1[v] / verticesPerStrand] +
+			weight2[v] * rootRotations[segment2[v] / verticesPerStrand];
+		const glm::vec3 turn = rotation * restOffsets[v] - restOffsets[v];
+		out[v].pos += glm::vec4(turn, 0.0f);
+
+		const glm::vec3 normal = rotation * restNormals[v];
+		const float length = glm::length(normal);
+		if (length > 1e-6f) {
+			out[v].normal = glm::vec4(normal / length, out[v].normal.w);
+		}
+	}
+}
@@ -0,0 +1,110 @@
+#include "forceField.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "random.h"
+
+// Stream of the gust jitter in hashUniform().
+static const uint32_t GUST_RANDOM_STREAM = 1;
+
+bool hasForceFields(const ForceFieldSettings& settings) {
+	if (settings.windOn || settings.dragOn) {
+		return true;
+	}
+	return std::any_of(settings.attractors.begin(), settings.attractors.end(), [](const PointAttractor& attractor) {
+		return attractor.enabled && attractor.strength != 0.0f;
+	});
+}
+
+// Adds amplitude * curl(psi) for one octave of the vector potential
+//   psi = (sin(Y) cos(Z), sin(Z) cos(X), sin(X) cos(Y)) with X = f (x - offset.x) + phase.x, ...
+// The curl is written out analytically (it is an Arnold-Beltrami-Childress flow) and scaled by 1 / f,
+// so octaves of different frequencies have comparable speeds. Six sines and cosines per vertex.
+static void addCurlNoiseOctave(
+	const float* __restrict posX, const float* __restrict posY, const float* __restrict posZ,
+	float* __restrict airX, float* __restrict airY, float* __restrict airZ,
+	uint32_t count, glm::vec3 offset, float frequency, glm::vec3 phase, float amplitude) {
+	const float f = frequency;
+	for (uint32_t i = 0; i < count; i++) {
+		const float x = f * (posX[i] - offset.x) + phase.x;
+		const float y = f * (posY[i] - offset.y) + phase.y;
+		const float z = f * (posZ[i] - offset.z) + phase.z;
+		const float sinX = std::sin(x), cosX = std::cos(x);
+		const float sinY = std::sin(y), cosY = std::cos(y);
+		const float sinZ = std::sin(z), cosZ = std::cos(z);
+
+		airX[i] -= amplitude * (sinX * sinY + cosZ * cosX);
+		airY[i] -= amplitude * (sinY * sinZ + cosX * cosY);
+		airZ[i] -= amplitude * (sinZ * sinX + cosY * cosZ);
+	}
+}
+
+void evaluateForceFields(const ForceFieldSettings& settings, float time, uint32_t randomSeed, uint32_t randomStep, const ForceFieldBatch& batch) {
+	float* __restrict accX = batch.accX;
+	float* __restrict accY = batch.accY;
+	float* __restrict accZ = batch.accZ;
+	const uint32_t count = batch.count;
+
+	std::fill(accX, accX + count, 0.0f);
+	std::fill(accY, accY + count, 0.0f);
+	std::fill(accZ, accZ + count, 0.0f);
+
+	if (settings.windOn || settings.dragOn) {
+		// The air velocity goes into the acceleration arrays first and is turned into drag below.
+		if (settings.windOn) {
+			const float length = glm::length(settings.windDirection);
+			const glm::vec3 direction = length > 1e-6f ? settings.windDirection / length : glm::vec3(0.0f);
+			const glm::vec3 mean = direction * settings.windSpeed;
+
+			// Gusts scale the mean wind per vertex and substep.
+			for (uint32_t i = 0; i < count; i++) {
+				const float gust = 1.0f + settings.gustJitter * (2.0f * hashUniform(randomSeed, randomStep, GUST_RANDOM_STREAM, batch.firstVertex + i) - 1.0f);
+				accX[i] = mean.x * gust;
+				accY[i] = mean.y * gust;
+				accZ[i] = mean.z * gust;
+			}
+
+			if (settings.turbulence > 0.0f) {
+				// The noise drifts with the wind, plus its own change over time.
+				const float amplitude = settings.turbulence * settings.windSpeed;
+				const float phase = settings.turbulenceSpeed * time;
+				const glm::vec3 drift = mean * time;
+				const float f = settings.turbulenceFrequency;
+				// Two octaves with phases moving at different rates, so the pattern doesn't just scroll.
+				addCurlNoiseOctave(batch.posX, batch.posY, batch.posZ, accX, accY, accZ, count, drift, f,
+					glm::vec3(phase, 1.7f + 0.8f * phase, 4.1f - 0.6f * phase), amplitude * 0.67f);
+				addCurlNoiseOctave(batch.posX, batch.posY, batch.posZ, accX, accY, accZ, count, drift, f * 2.13f,
+					glm::vec3(3.9f - 0.7f * phase, 1.3f * phase, 0.4f + phase), amplitude * 0.33f);
+			}
+		}
+
+		const float drag = settings.drag;
+		for (uint32_t i = 0; i < count; i++) {
+			accX[i] = drag * (accX[i] - batch.velX[i]);
+			accY[i] = drag * (accY[i] - batch.velY[i]);
+			accZ[i] = drag * (accZ[i] - batch.velZ[i]);
+		}
+	}
+
+	for (const PointAttractor& attractor : settings.attractors) {
+		if (!attractor.enabled || attractor.strength == 0.0f) {
+			continue;
+		}
+
+		// Softened inverse square pull, normalised so that it equals strength at distance radius.
+		const float radius2 = std::max(attractor.radius * attractor.radius, 1e-8f);
+		const float scale = attractor.strength * 2.0f * std::sqrt(2.0f) * radius2;
+		const glm::vec3 centre = attractor.position;
+		for (uint32_t i = 0; i < count; i++) {
+			const float dx = centre.x - batch.posX[i];
+			const float dy = centre.y - batch.posY[i];
+			const float dz = centre.z - batch.posZ[i];
+			const float d2 = dx * dx + dy * dy + dz * dz + radius2;
+			const float k = scale / (d2 * std::sqrt(d2));
+			accX[i] += k * dx;
+			accY[i] += k * dy;
+			accZ[i] += k * dz;
+		}
+	}
+}
@@ -0,0 +1,284 @@
+#include "hairSimulation.h"
+#include "random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+float SimulationSettings::getSubstepVelocityKeep(uint32_t substeps) const {
+	return std::pow(1.0f - damping, 1.0f / static_cast<float>(std::max(substeps, 1u)));
+}
+
+float SimulationSettings::getIterationShapeStiffness(uint32_t substeps) const {
+	const uint32_t iterations = std::max(substeps, 1u) * std::max(constraintIterations, 1u);
+	return 1.0f - std::pow(1.0f - shapeStiffness, 1.0f / static_cast<float>(iterations));
+}
+
+HairSimulation::HairSimulation() :
+	pool(nullptr),
+	time(0.0f),
+	stepIndex(0),
+	runSalt(0) {}
+
+HairSimulation::HairSimulation(GuideStrands&& strands, ThreadPool* pool, const SimulationSettings& settings) :
+	pool(pool),
+	time(0.0f),
+	stepIndex(0),
+	runSalt(std::random_device{}()),
+	strands(std::move(strands)),
+	settings(settings) {
+	volume = HairVolume(settings.volumeResolution, pool->size());
+
+	const uint32_t numVertices = this->strands.numVertices();
+	predX.resize(numVertices);
+	predY.resize(numVertices);
+	predZ.resize(numVertices);
+	accX.resize(numVertices);
+	accY.resize(numVertices);
+	accZ.resize(numVertices);
+
+	activeStrands.resize(this->strands.numStrands);
+	rootTargets.resize(this->strands.numStrands);
+	rootRotations.assign(this->strands.numStrands, glm::mat3(1.0f));
+	for (uint32_t s = 0; s < this->strands.numStrands; s++) {
+		activeStrands[s] = s;
+		rootTargets[s] = this->strands.restPositions[s * this->strands.verticesPerStrand];
+	}
+}
+
+void HairSimulation::step(float dt) {
+	if (pool == nullptr || activeStrands.empty() || dt <= 0.0f) {
+		return;
+	}
+
+	const uint32_t substeps = std::max(settings.substeps, 1u);
+	const float substepDt = dt / static_cast<float>(substeps);
+	for (uint32_t i = 0; i < substeps; i++) {
+		predict(substepDt, 1.0f / static_cast<float>(substeps - i));
+		solveConstraints();
+		updateVelocities(substepDt);
+
+		if (settings.enableVolume) {
+			volume.splat(strands, activeStrands, *pool, settings.deterministic);
+			volume.apply(strands, activeStrands, settings.volumeFriction, settings.volumeRepulsion, substepDt, *pool);
+		}
+		stepIndex++;
+		time += substepDt;
+	}
+}
+
+float HairSimulation::random(uint32_t stream, uint32_t index) const {
+	return hashUniform(getRandomSeed(), stepIndex, stream, index);
+}
+
+uint32_t HairSimulation::getRandomSeed() const {
+	return settings.deterministic ? settings.randomSeed : settings.randomSeed ^ runSalt;
+}
+
+void HairSimulation::setActiveStrands(const std::vector<uint32_t>& strands) {
+	std::vector<uint8_t> wasActive(this->strands.numStrands, 0);
+	for (uint32_t s : activeStrands) {
+		wasActive[s] = 1;
+	}
+
+	const uint32_t n = this->strands.verticesPerStrand;
+	for (uint32_t s : strands) {
+		if (wasActive[s] || activeStrands.empty()) {
+			continue;
+		}
+
+		uint32_t closest = activeStrands.front();
+		float best = std::numeric_limits<float>::max();
+		for (uint32_t r : activeStrands) {
+			const float d = glm::length(this->strands.restPositions[r * n] - this->strands.restPositions[s * n]);
+			if (d < best) {
+				best = d;
+				closest = r;
+			}
+		}
+
+		// The displacement is taken and applied in the root frames, so it also works while the head moves.
+		const glm::vec3 sourceRoot = this->strands.position(closest * n);
+		const glm::mat3 toSourceRest = glm::transpose(rootRotations[closest]);
+		for (uint32_t i = 0; i < n; i++) {
+			const uint32_t target = s * n + i;
+			const uint32_t source = closest * n + i;
+			const glm::vec3 targetRest = this->strands.restPositions[target] - this->strands.restPositions[s * n];
+			// Roots stay pinned to their frame.
+			if (this->strands.invMass[target] == 0.0f) {
+				this->strands.setPosition(target, rootTargets[s] + rootRotations[s] * targetRest);
+				continue;
+			}
+			const glm::vec3 sourceRest = this->strands.restPositions[source] - this->strands.restPositions[closest * n];
+			const glm::vec3 displacement = toSourceRest * (this->strands.position(source) - sourceRoot) - sourceRest;
+			this->strands.setPosition(target, rootTargets[s] + rootRotations[s] * (targetRest + displacement));
+			this->strands.velX[target] = this->strands.velX[source];
+			this->strands.velY[target] = this->strands.velY[source];
+			this->strands.velZ[target] = this->strands.velZ[source];
+		}
+	}
+
+	activeStrands = strands;
+}
+
+const std::vector<uint32_t>& HairSimulation::getActiveStrands() const {
+	return activeStrands;
+}
+
+void HairSimulation::reset() {
+	const uint32_t n = strands.verticesPerStrand;
+	for (uint32_t i = 0; i < strands.numVertices(); i++) {
+		const uint32_t s = i / n;
+		strands.setPosition(i, rootTargets[s] + rootRotations[s] * (strands.restPositions[i] - strands.restPositions[s * n]));
+	}
+	std::fill(strands.velX.begin(), strands.velX.end(), 0.0f);
+	std::fill(strands.velY.begin(), strands.velY.end(), 0.0f);
+	std::fill(strands.velZ.begin(), strands.velZ.end(), 0.0f);
+	stepIndex = 0;
+	time = 0.0f;
+}
+
+void HairSimulation::setRootFrames(const std::vector<glm::vec3>& positions, const std::vector<glm::mat3>& rotations) {
+	if (positions.size() != strands.numStrands || rotations.size() != strands.numStrands) {
+		throw std::runtime_error("The root frames don't match the guide strands.");
+	}
+	rootTargets = positions;
+	rootRotations = rotations;
+}
+
+void HairSimulation::predict(float dt, float rootBlend) {
+	const glm::vec3 gravityStep = settings.gravity * dt;
+	const float keep = settings.getSubstepVelocityKeep(settings.substeps);
+	const uint32_t n = strands.verticesPerStrand;
+	const bool forced = hasForceFields(settings.forces);
+	const uint32_t seed = getRandomSeed();
+
+	pool->parallelFor(static_cast<uint32_t>(activeStrands.size()), [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t k = begin; k < end; k++) {
+			const uint32_t root = activeStrands[k] * n;
+
+			// A strand is a contiguous run of vertices, so it makes one batch for the force fields.
+			if (forced) {
+				ForceFieldBatch batch{
+					&strands.posX[root], &strands.posY[root], &strands.posZ[root],
+					&strands.velX[root], &strands.velY[root], &strands.velZ[root],
+					&accX[root], &accY[root], &accZ[root],
+					n, root
+				};
+				evaluateForceFields(settings.forces, time, seed, stepIndex, batch);
+			}
+
+			// The root moves towards its target, the other pinned vertices stay where they are.
+			// Moving the root by the same share of the remaining way every substep lands it on the target
+			// at the end of the step, with its velocity following from the move.
+			const glm::vec3 target = rootTargets[activeStrands[k]];
+			if (strands.invMass[root] == 0.0f) {
+				predX[root] = strands.posX[root] + (target.x - strands.posX[root]) * rootBlend;
+				predY[root] = strands.posY[root] + (target.y - strands.posY[root]) * rootBlend;
+				predZ[root] = strands.posZ[root] + (target.z - strands.posZ[root]) * rootBlend;
+			}
+
+			for (uint32_t i = root; i < root + n; i++) {
+				if (strands.invMass[i] == 0.0f) {
+					if (i != root) {
+						predX[i] = strands.posX[i];
+						predY[i] = strands.posY[i];
+						predZ[i] = strands.posZ[i];
+					}
+					continue;
+				}
+
+				float vx = strands.velX[i] + gravityStep.x;
+				float vy = strands.velY[i] + gravityStep.y;
+				float vz = strands.velZ[i] + gravityStep.z;
+				if (forced) {
+					vx += accX[i] * dt;
+					vy += accY[i] * dt;
+					vz += accZ[i] * dt;
+				}
+				vx *= keep;
+				vy *= keep;
+				vz *= keep;
+				predX[i] = strands.posX[i] + vx * dt;
+				predY[i] = strands.posY[i] + vy * dt;
+				predZ[i] = strands.posZ[i] + vz * dt;
+			}
+		}
+	});
+}
+
+void HairSimulation::solveConstraints() {
+	const uint32_t n = strands.verticesPerStrand;
+	const float stiffness = settings.getIterationShapeStiffness(settings.substeps);
+
+	pool->parallelFor(static_cast<uint32_t>(activeStrands.size()), [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t k = begin; k < end; k++) {
+			const uint32_t root = activeStrands[k] * n;
+
+			for (uint32_t iteration = 0; iteration < settings.constraintIterations; iteration++) {
+				// Segment lengths, Gauss-Seidel from the root towards the tip.
+				for (uint32_t i = root + 1; i < root + n; i++) {
+					const float w0 = strands.invMass[i - 1];
+					const float w1 = strands.invMass[i];
+					const float w = w0 + w1;
+					if (w == 0.0f) {
+						continue;
+					}
+
+					const glm::vec3 p0(predX[i - 1], predY[i - 1], predZ[i - 1]);
+					const glm::vec3 p1(predX[i], predY[i], predZ[i]);
+					const glm::vec3 d = p1 - p0;
+					const float length = glm::length(d);
+					if (length < 1e-8f) {
+						continue;
+					}
+
+					const glm::vec3 correction = d * ((length - strands.restLength[i]) / (length * w));
+					const glm::vec3 q0 = p0 + correction * w0;
+					const glm::vec3 q1 = p1 - correction * w1;
+					predX[i - 1] = q0.x;
+					predY[i - 1] = q0.y;
+					predZ[i - 1] = q0.z;
+					predX[i] = q1.x;
+					predY[i] = q1.y;
+					predZ[i] = q1.z;
+				}
+
+				// Rest shape relative to the root and its frame, which keeps the strands from folding up.
+				const glm::vec3 rootPosition(predX[root], predY[root], predZ[root]);
+				const glm::mat3& rootRotation = rootRotations[activeStrands[k]];
+				for (uint32_t i = root + 1; i < root + n; i++) {
+					if (strands.invMass[i] == 0.0f) {
+						continue;
+					}
+
+					const glm::vec3 target = rootPosition + rootRotation * (strands.restPositions[i] - strands.restPositions[root]);
+					predX[i] += (target.x - predX[i]) * stiffness;
+					predY[i] += (target.y - predY[i]) * stiffness;
+					predZ[i] += (target.z - predZ[i]) * stiffness;
+				}
+			}
+		}
+	});
+}
+
+void HairSimulation::updateVelocities(float dt) {
+	const float invDt = 1.0f / dt;
+	const uint32_t n = strands.verticesPerStrand;
+
+	pool->parallelFor(static_cast<uint32_t>(activeStrands.size()), [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t k = begin; k < end; k++) {
+			const uint32_t root = activeStrands[k] * n;
+			for (uint32_t i = root; i < root + n; i++) {
+				strands.velX[i] = (predX[i] - strands.posX[i]) * invDt;
+				strands.velY[i] = (predY[i] - strands.posY[i]) * invDt;
+				strands.velZ[i] = (predZ[i] - strands.posZ[i]) * invDt;
+				strands.posX[i] = predX[i];
+				strands.posY[i] = predY[i];
+				strands.posZ[i] = predZ[i];
+			}
+		}
+	});
+}
@@ -0,0 +1,206 @@
+#include "hairVolume.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+HairVolume::HairVolume() :
+	resolution(0),
+	numCells(0),
+	origin(0.0f),
+	cellSize(1.0f) {}
+
+HairVolume::HairVolume(glm::ivec3 resolution, uint32_t numPartitions) :
+	resolution(glm::max(resolution, glm::ivec3(2))),
+	origin(0.0f),
+	cellSize(1.0f) {
+	numCells = static_cast<uint32_t>(this->resolution.x * this->resolution.y * this->resolution.z);
+
+	partitionGrids.resize(std::max(numPartitions, DETERMINISTIC_PARTITIONS));
+	for (auto& grid : partitionGrids) {
+		grid.assign(static_cast<size_t>(numCells) * 4, 0.0f);
+	}
+	partitionMin.resize(partitionGrids.size());
+	partitionMax.resize(partitionGrids.size());
+
+	density.assign(numCells, 0.0f);
+	velocityX.assign(numCells, 0.0f);
+	velocityY.assign(numCells, 0.0f);
+	velocityZ.assign(numCells, 0.0f);
+}
+
+// Maps the k-th vertex of the active strands to its index in the strands.
+static inline uint32_t activeVertex(const std::vector<uint32_t>& activeStrands, uint32_t verticesPerStrand, uint32_t k) {
+	return activeStrands[k / verticesPerStrand] * verticesPerStrand + k % verticesPerStrand;
+}
+
+uint32_t HairVolume::cellIndex(int32_t x, int32_t y, int32_t z) const {
+	return static_cast<uint32_t>((z * resolution.y + y) * resolution.x + x);
+}
+
+glm::ivec3 HairVolume::locate(const glm::vec3& position, glm::vec3& fraction) const {
+	const glm::vec3 g = (position - origin) / cellSize;
+	glm::ivec3 cell(
+		glm::clamp(static_cast<int32_t>(std::floor(g.x)), 0, resolution.x - 2),
+		glm::clamp(static_cast<int32_t>(std::floor(g.y)), 0, resolution.y - 2),
+		glm::clamp(static_cast<int32_t>(std::floor(g.z)), 0, resolution.z - 2)
+	);
+	fraction = glm::clamp(g - glm::vec3(cell), 0.0f, 1.0f);
+	return cell;
+}
+
+void HairVolume::computeBounds(const GuideStrands& strands, const std::vector<uint32_t>& activeStrands, ThreadPool& pool) {
+	const uint32_t n = strands.verticesPerStrand;
+	const uint32_t numVertices = static_cast<uint32_t>(activeStrands.size()) * n;
+
+	pool.parallelFor(numVertices, [&](uint32_t begin, uint32_t end, uint32_t partition) {
+		glm::vec3 lo(std::numeric_limits<float>::max());
+		glm::vec3 hi(-std::numeric_limits<float>::max());
+		for (uint32_t k = begin; k < end; k++) {
+			const glm::vec3 p = strands.position(activeVertex(activeStrands, n, k));
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		partitionMin[partition] = lo;
+		partitionMax[partition] = hi;
+	});
+
+	glm::vec3 lo(std::numeric_limits<float>::max());
+	glm::vec3 hi(-std::numeric_limits<float>::max());
+	for (uint32_t i = 0; i < pool.size(); i++) {
+		lo = glm::min(lo, partitionMin[i]);
+		hi = glm::max(hi, partitionMax[i]);
+	}
+
+	// Pad the bounds so that vertices on the boundary still have neighbours on both sides.
+	const glm::vec3 extent = hi - lo;
+	const float padding = 0.05f * std::max(extent.x, std::max(extent.y, extent.z)) + 1e-3f;
+	origin = lo - glm::vec3(padding);
+	cellSize = glm::max((extent + glm::vec3(2.0f * padding)) / glm::vec3(resolution - glm::ivec3(1)), glm::vec3(1e-4f));
+}
+
+void HairVolume::splat(const GuideStrands& strands, const std::vector<uint32_t>& activeStrands, ThreadPool& pool, bool deterministic) {
+	const uint32_t n = strands.verticesPerStrand;
+	const uint32_t numVertices = static_cast<uint32_t>(activeStrands.size()) * n;
+	if (numCells == 0 || numVertices == 0) {
+		return;
+	}
+
+	const uint32_t numPartitions = deterministic ? DETERMINISTIC_PARTITIONS : pool.size();
+	if (partitionGrids.size() < numPartitions) {
+		throw std::runtime_error("The hair volume has fewer partition grids than the thread pool has partitions.");
+	}
+
+	// Min and max don't depend on the order, so the bounds are the same in both modes.
+	computeBounds(strands, activeStrands, pool);
+
+	// Scatter into the per-partition grids. Partitions never share a grid, so no atomics are needed.
+	pool.parallelFor(numVertices, numPartitions, [&](uint32_t begin, uint32_t end, uint32_t partition) {
+		std::vector<float>& grid = partitionGrids[partition];
+		std::fill(grid.begin(), grid.end(), 0.0f);
+
+		for (uint32_t k = begin; k < end; k++) {
+			const uint32_t i = activeVertex(activeStrands, n, k);
+			glm::vec3 f;
+			const glm::ivec3 c = locate(strands.position(i), f);
+			const glm::vec3 v(strands.velX[i], strands.velY[i], strands.velZ[i]);
+
+			for (int32_t corner = 0; corner < 8; corner++) {
+				const int32_t dx = corner & 1;
+				const int32_t dy = (corner >> 1) & 1;
+				const int32_t dz = (corner >> 2) & 1;
+				const float w = (dx ? f.x : 1.0f - f.x) * (dy ? f.y : 1.0f - f.y) * (dz ? f.z : 1.0f - f.z);
+
+				float* cell = &grid[static_cast<size_t>(cellIndex(c.x + dx, c.y + dy, c.z + dz)) * 4];
+				cell[0] += w;
+				cell[1] += w * v.x;
+				cell[2] += w * v.y;
+				cell[3] += w * v.z;
+			}
+		}
+	});
+
+	// Reduce the partial grids, always in partition order. Partitions that got no vertices still hold zeros.
+	pool.parallelFor(numCells, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t c = begin; c < end; c++) {
+			float d = 0.0f;
+			glm::vec3 momentum(0.0f);
+			for (uint32_t p = 0; p < numPartitions; p++) {
+				const float* cell = &partitionGrids[p][static_cast<size_t>(c) * 4];
+				d += cell[0];
+				momentum += glm::vec3(cell[1], cell[2], cell[3]);
+			}
+
+			const glm::vec3 v = d > 1e-6f ? momentum / d : glm::vec3(0.0f);
+			density[c] = d;
+			velocityX[c] = v.x;
+			velocityY[c] = v.y;
+			velocityZ[c] = v.z;
+		}
+	});
+}
+
+void HairVolume::apply(GuideStrands& strands, const std::vector<uint32_t>& activeStrands, float friction, float repulsion, float dt, ThreadPool& pool) const {
+	if (numCells == 0) {
+		return;
+	}
+
+	const uint32_t n = strands.verticesPerStrand;
+	pool.parallelFor(static_cast<uint32_t>(activeStrands.size()) * n, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t k = begin; k < end; k++) {
+			const uint32_t i = activeVertex(activeStrands, n, k);
+			if (strands.invMass[i] == 0.0f) {
+				continue;
+			}
+
+			const glm::vec3 p = strands.position(i);
+			glm::vec3 v(strands.velX[i], strands.velY[i], strands.velZ[i]);
+
+			// Friction: strands moving through a region drag each other along.
+			v = glm::mix(v, sampleVelocity(p), friction);
+			// Repulsion: push away from dense regions to keep the volume of the hair.
+			v -= sampleDensityGradient(p) * (repulsion * dt);
+
+			strands.velX[i] = v.x;
+			strands.velY[i] = v.y;
+			strands.velZ[i] = v.z;
+		}
+	});
+}
+
+float HairVolume::sample(const std::vector<float>& field, const glm::vec3& position) const {
+	glm::vec3 f;
+	const glm::ivec3 c = locate(position, f);
+
+	const float c00 = glm::mix(field[cellIndex(c.x, c.y, c.z)], field[cellIndex(c.x + 1, c.y, c.z)], f.x);
+	const float c10 = glm::mix(field[cellIndex(c.x, c.y + 1, c.z)], field[cellIndex(c.x + 1, c.y + 1, c.z)], f.x);
+	const float c01 = glm::mix(field[cellIndex(c.x, c.y, c.z + 1)], field[cellIndex(c.x + 1, c.y, c.z + 1)], f.x);
+	const float c11 = glm::mix(field[cellIndex(c.x, c.y + 1, c.z + 1)], field[cellIndex(c.x + 1, c.y + 1, c.z + 1)], f.x);
+
+	return glm::mix(glm::mix(c00, c10, f.y), glm::mix(c01, c11, f.y), f.z);
+}
+
+float HairVolume::sampleDensity(const glm::vec3& position) const {
+	return sample(density, position);
+}
+
+glm::vec3 HairVolume::sampleVelocity(const glm::vec3& position) const {
+	return glm::vec3(
+		sample(velocityX, position),
+		sample(velocityY, position),
+		sample(velocityZ, position)
+	);
+}
+
+glm::vec3 HairVolume::sampleDensityGradient(const glm::vec3& position) const {
+	const glm::vec3 dx(cellSize.x, 0.0f, 0.0f);
+	const glm::vec3 dy(0.0f, cellSize.y, 0.0f);
+	const glm::vec3 dz(0.0f, 0.0f, cellSize.z);
+
+	return glm::vec3(
+		(sampleDensity(position + dx) - sampleDensity(position - dx)) / (2.0f * cellSize.x),
+		(sampleDensity(position + dy) - sampleDensity(position - dy)) / (2.0f * cellSize.y),
+		(sampleDensity(position + dz) - sampleDensity(position - dz)) / (2.0f * cellSize.z)
+	);
+}
@@ -1,5 +1,6 @@
 ﻿#include "main.h"
 #include "vertex.h"
+#include "random.h"
 
 #include <stb_image.h>
 
@@ -8,6 +9,7 @@ Main::Main(GLFWwindow* window,
 	std::unordered_map<std::string, std::vector<char>>&& shaders,
 	std::unordered_map<std::string,
 	std::pair<std::vector<Vertex>, std::vector<uint32_t>>>&& models,
+	std::unordered_map<std::string, std::vector<MeshCluster>>&& meshClusters,
 	std::unordered_map<std::string, Image>&& textures,
 	/*CubeMap&& envMap*/
 	HDRImage&& envMap
@@ -16,18 +18,51 @@ Main::Main(GLFWwindow* window,
 	camera(camera),
 	shaders(shaders),
 	models(models),
+	meshClusters(meshClusters),
 	textures(textures),
 	envMap(envMap),
 	physicalDevice(VK_NULL_HANDLE),
+	swapChain(VK_NULL_HANDLE),
 	msaaSamples(VK_SAMPLE_COUNT_1_BIT),
-	currentFrame(0)
+	msaaSampleCap(1),
+	currentFrame(0),
+	passUniformOffset(0),
+	simulationLodLevel(0),
+	lastFrameTime(0.0),
+	playbackTime(0.0f),
+	headTransform(1.0f),
+	renderHeadTransform(1.0f),
+	headPivot(0.0f),
+	headAnimationTime(0.0f),
+	strandRenderGuides(0),
+	strandChildRadius(0.0f),
+	strandColor(0.5f),
+	gpuSimulationActive(false),
+	gpuSimulationSteps(0),
+	cmdDrawIndexedIndirectCount(nullptr),
+	multiDrawIndirectSupported(false),
+	drawIndirectFirstInstanceSupported(false),
+	linkedListOitSupported(false),
+	oitNodeBuffer{ VK_NULL_HANDLE, VK_NULL_HANDLE, 0 },
+	momentCount(4),
+	momentSinglePrecision(false),
+	momentSinglePrecisionSupported(false),
+	hairStatisticsSupported(false),
+	hairQueryPool(VK_NULL_HANDLE),
+	gpuTimingSupported(false),
+	timestampPeriod(0.0f),
+	timestampQueryPool(VK_NULL_HANDLE),
+	transparentScale(MAX_TRANSPARENT_SCALE)
 {
+	initSimulation();
 	initVulkan();
 	// Must be called after vulkan is fully initalised.
 	ui = UI(&device);
-	uiState = {
-		true // transparency on
-	};
+	// The rest keeps the defaults in UIState. These depend on the device or the simulation.
+	uiState.linkedListOitSupported = linkedListOitSupported;
+	uiState.momentSinglePrecisionSupported = momentSinglePrecisionSupported;
+	uiState.hairStatisticsSupported = hairStatisticsSupported;
+	uiState.forces = hairSimulation.settings.forces;
 }
 
 Main::~Main() {
@@ -49,9 +84,8 @@ Main::~Main() {
 	vertices.clear();
 	indices.clear();
 
-	uniformBuffers.clear();
-	uniformBuffersMemory.clear();
-	uniformBuffersMapped.clear();
+	hairVertexBuffers.clear();
+	hairVertexBuffersMapped.clear();
 	commandBuffers.clear();
 	imageAvailableSemaphores.clear();
 	renderFinishedSemaphores.clear();
@@ -61,6 +95,261 @@ Main::~Main() {
 	textureImages.clear();
 }
 
+void Main::initSimulation() {
+	// The end of each hair card closest to the centre of the head is treated as the root.
+	const auto& headVertices = models.at("head").first;
+	glm::vec3 headCentre(0.0f);
+	for (const auto& vertex : headVertices) {
+		headCentre += glm::vec3(vertex.pos);
+	}
+	if (!headVertices.empty()) {
+		headCentre /= static_cast<float>(headVertices.size());
+	}
+
+	const auto& hair = models.at("hair");
+	CardVertexInfo cardInfo;
+	hairSimulation = HairSimulation(
+		buildGuideStrands(hair.first, hair.second, headCentre, GUIDE_VERTICES_PER_STRAND, &cardInfo),
+		&threadPool
+	);
+
+	// Levels from the most to the least detailed: { min screen size in pixels, strand stride, substeps }.
+	simulationLod = SimulationLod({
+		{ 400.0f, 1, 2 },
+		{ 150.0f, 2, 1 },
+		{ 0.0f, 4, 1 }
+	});
+	hairSimulation.settings.substeps = simulationLod.getLevels()[0].substeps;
+
+	// Start the attractors off on either side of the hair.
+	glm::vec3 hairMin(std::numeric_limits<float>::max());
+	glm::vec3 hairMax(-std::numeric_limits<float>::max());
+	for (const auto& vertex : hair.first) {
+		hairMin = glm::min(hairMin, glm::vec3(vertex.pos));
+		hairMax = glm::max(hairMax, glm::vec3(vertex.pos));
+	}
+	const glm::vec3 hairCentre = 0.5f * (hairMin + hairMax);
+	const float hairWidth = hairMax.x - hairMin.x;
+	hairSimulation.settings.forces.attractors[0].position = hairCentre + glm::vec3(hairWidth, 0.0f, 0.0f);
+	hairSimulation.settings.forces.attractors[1].position = hairCentre - glm::vec3(hairWidth, 0.0f, 0.0f);
+
+	// The roots are glued to the head once here, from then on they only need the head's motion.
+	rootAttachment = RootAttachment(headVertices, models.at("head").second, hairSimulation.strands, threadPool);
+	headPivot = headCentre;
+	float maxRootError = 0.0f;
+	for (uint32_t s = 0; s < rootAttachment.size(); s++) {
+		const glm::vec3 root = hairSimulation.strands.restPositions[s * hairSimulation.strands.verticesPerStrand];
+		maxRootError = std::max(maxRootError, glm::length(rootAttachment.positions[s] - root));
+	}
+	std::cout << "Attached " << rootAttachment.size() << " guide roots to the head, max rest error " << maxRootError << "\n";
+
+	// Bind the follow hair once per level, so that switching levels doesn't stall.
+	followHairLods.clear();
+	for (uint32_t level = 0; level < simulationLod.getLevels().size(); level++) {
+		followHairLods.emplace_back(
+			hair.first,
+			hairSimulation.strands,
+			cardInfo,
+			GUIDES_PER_HAIR_VERTEX,
+			threadPool,
+			simulationLod.selectStrands(level, hairSimulation.strands.numStrands)
+		);
+	}
+	std::cout << "Built " << hairSimulation.strands.numStrands << " guide strands from " << hair.first.size() << " hair vertices.\n";
+
+	// hairSimulation must not be reassigned from here on, the scheduler's worker holds on to it.
+	simulationScheduler.create(&hairSimulation, SIMULATION_TIMESTEP, MAX_SIMULATION_STEPS_PER_FRAME);
+}
+
+void Main::updateSimulationLod() {
+	uint32_t level = 0;
+	// The GPU simulates every guide, so the LOD only applies to the CPU solver.
+	// A recording stores every guide, so it has to simulate all of them.
+	if (uiState.simulationLodOn && !uiState.gpuSimulationOn && !uiState.recordCacheOn) {
+		const float screenSize = SimulationLod::computeScreenSize(
+			simulationScheduler.renderStrands,
+			camera->proj * camera->view,
+			glm::vec2(swapChainExtent.width, swapChainExtent.height)
+		);
+		level = simulationLod.update(screenSize);
+	}
+	uiState.simulationLodLevel = level;
+	uiState.hairScreenSize = simulationLod.getScreenSize();
+
+	if (level == simulationLodLevel) {
+		return;
+	}
+
+	hairSimulation.setActiveStrands(simulationLod.selectStrands(level, hairSimulation.strands.numStrands));
+	hairSimulation.settings.substeps = simulationLod.getLevels()[level].substeps;
+	// Strands that joined in were moved, so there is nothing to interpolate from.
+	simulationScheduler.resetState();
+	simulationLodLevel = level;
+}
+
+void Main::updateHeadAnimation(float seconds) {
+	headAnimationTime += seconds;
+
+	// A slow turn with a faster nod on top, around the centre of the head (z is up).
+	const float t = headAnimationTime;
+	const float turn = 0.5f * std::sin(6.2831853f * 0.25f * t);
+	const float nod = 0.2f * std::sin(6.2831853f * 0.5f * t);
+	headTransform = glm::translate(glm::mat4(1.0f), headPivot)
+		* glm::rotate(glm::mat4(1.0f), turn, glm::vec3(0.0f, 0.0f, 1.0f))
+		* glm::rotate(glm::mat4(1.0f), nod, glm::vec3(1.0f, 0.0f, 0.0f))
+		* glm::translate(glm::mat4(1.0f), -headPivot);
+
+	rootAttachment.update(headTransform, threadPool);
+	hairSimulation.setRootFrames(rootAttachment.positions, rootAttachment.rotations);
+}
+
+void Main::updateSimulationCache() {
+	// The cache stores what the CPU solver computes and playback feeds the CPU follow hair.
+	if (gpuSimulationActive) {
+		uiState.recordCacheOn = false;
+		uiState.playCacheOn = false;
+	}
+	if (uiState.playCacheOn) {
+		uiState.recordCacheOn = false;
+	}
+
+	if (uiState.recordCacheOn != cacheWriter.isOpen()) {
+		if (uiState.recordCacheOn) {
+			uint32_t flags = 0;
+			if (uiState.cacheQuantizeOn) {
+				flags |= SIMULATION_CACHE_QUANTIZED;
+			}
+			if (uiState.cacheCompressOn) {
+				flags |= SIMULATION_CACHE_COMPRESSED;
+			}
+
+			try {
+				cacheWriter.open(SIMULATION_CACHE_PATH, hairSimulation.strands, simulationScheduler.getFixedDt(), flags);
+				// Every fixed step becomes a frame, written on the worker while the next frame is recorded.
+				simulationScheduler.setStepCallback([this](const GuideStrands& strands) {
+					cacheWriter.writeFrame(strands);
+				});
+			}
+			catch (const std::exception& e) {
+				std::cout << e.what() << "\n";
+				uiState.recordCacheOn = false;
+			}
+		}
+		else {
+			simulationScheduler.setStepCallback(nullptr);
+			const uint32_t numFrames = cacheWriter.getNumFrames();
+			const uint64_t fileSize = cacheWriter.getFileSize();
+			try {
+				cacheWriter.close();
+				std::cout << "Recorded " << numFrames << " frames (" << fileSize / 1024 << " KiB) to " << SIMULATION_CACHE_PATH << ".\n";
+			}
+			catch (const std::exception& e) {
+				std::cout << e.what() << "\n";
+			}
+		}
+	}
+
+	if (uiState.playCacheOn != cacheReader.isOpen()) {
+		if (uiState.playCacheOn) {
+			try {
+				cacheReader.open(SIMULATION_CACHE_PATH);
+				if (cacheReader.getNumStrands() != hairSimulation.strands.numStrands ||
+					cacheReader.getVerticesPerStrand() != hairSimulation.strands.verticesPerStrand) {
+					cacheReader.close();
+					throw std::runtime_error("simulation cache was recorded for different guide strands!");
+				}
+				playbackStrands = hairSimulation.strands;
+				playbackTime = 0.0f;
+			}
+			catch (const std::exception& e) {
+				std::cout << e.what() << "\n";
+				uiState.playCacheOn = false;
+			}
+		}
+		else {
+			cacheReader.close();
+		}
+	}
+
+	if (cacheWriter.isOpen()) {
+		uiState.cachedFrames = cacheWriter.getNumFrames();
+	}
+	else if (cacheReader.isOpen()) {
+		uiState.cachedFrames = cacheReader.getNumFrames();
+	}
+}
+
+void Main::playSimulationCache(float frameSeconds) {
+	const uint32_t numFrames = cacheReader.getNumFrames();
+	const float duration = numFrames * cacheReader.getFrameDt();
+	playbackTime = std::fmod(playbackTime + frameSeconds, duration);
+
+	const uint32_t frame = std::min(static_cast<uint32_t>(playbackTime / cacheReader.getFrameDt()), numFrames - 1);
+	cacheReader.readFrame(frame, playbackStrands);
+}
+
+void Main::benchmarkSimulationCache() {
+	const std::string path = SIMULATION_CACHE_PATH + ".benchmark";
+
+	// Simulate the shot up front, so that only the cache is timed.
+	HairSimulation shot = hairSimulation;
+	shot.setActiveStrands(simulationLod.selectStrands(0, shot.strands.numStrands));
+	shot.reset();
+	std::vector<GuideStrands> frames;
+	frames.reserve(SIMULATION_CACHE_BENCHMARK_FRAMES);
+	for (uint32_t i = 0; i < SIMULATION_CACHE_BENCHMARK_FRAMES; i++) {
+		shot.step(SIMULATION_TIMESTEP);
+		frames.push_back(shot.strands);
+	}
+
+	// Throughput is measured in decoded position data, the same for every flag combination.
+	const double frameMegabytes = shot.strands.numVertices() * 3.0 * sizeof(float) / (1024.0 * 1024.0);
+	const double totalMegabytes = frameMegabytes * frames.size();
+
+	std::cout << "Simulation cache benchmark, " << frames.size() << " frames of " << shot.strands.numVertices() << " guide vertices:\n";
+	for (uint32_t flags = 0; flags <= (SIMULATION_CACHE_QUANTIZED | SIMULATION_CACHE_COMPRESSED); flags++) {
+		try {
+			SimulationCacheWriter writer;
+			const double writeStart = glfwGetTime();
+			writer.open(path, shot.strands, SIMULATION_TIMESTEP, flags);
+			for (const GuideStrands& frame : frames) {
+				writer.writeFrame(frame);
+			}
+			const uint64_t fileSize = writer.getFileSize();
+			writer.close();
+			const double writeSeconds = glfwGetTime() - writeStart;
+
+			SimulationCacheReader reader;
+			reader.open(path);
+			GuideStrands decoded = shot.strands;
+			float maxError = 0.0f;
+			double readSeconds = 0.0;
+			for (uint32_t i = 0; i < reader.getNumFrames(); i++) {
+				const double readStart = glfwGetTime();
+				reader.readFrame(i, decoded);
+				readSeconds += glfwGetTime() - readStart;
+
+				for (uint32_t v = 0; v < decoded.numVertices(); v++) {
+					maxError = std::max(maxError, glm::length(decoded.position(v) - frames[i].position(v)));
+				}
+			}
+			reader.close();
+
+			std::cout << "  " << ((flags & SIMULATION_CACHE_QUANTIZED) ? "quantized" : "float    ")
+				<< ((flags & SIMULATION_CACHE_COMPRESSED) ? " + lz4" : "      ")
+				<< ": " << fileSize / 1024 << " KiB (" << 100.0 * fileSize / (totalMegabytes * 1024.0 * 1024.0) << "%)"
+				<< ", write " << totalMegabytes / std::max(writeSeconds, 1e-9) << " MB/s"
+				<< ", read " << totalMegabytes / std::max(readSeconds, 1e-9) << " MB/s"
+				<< ", max error " << maxError << "\n";
+		}
+		catch (const std::exception& e) {
+			std::cout << "  " << e.what() << "\n";
+		}
+	}
+
+	std::filesystem::remove(path);
+}
+
 void Main::initVulkan() {
 	createInstance();
 	setupDebugMessenger();
@@ -79,20 +368,41 @@ void Main::initVulkan() {
 	createSampler(&envMapSampler, 1.0f);*/
 	createEnvMapImage(envMap);
 	createSampler(&envMapSampler, envMapMipLevels, false, true);
-	createUniformBuffers();
-
+	createUniformArena();
+	createStrandRenderBuffers();
+	createCharacterInstanceBuffers();
+	createOitCounterBuffers();
+	createHairQueryPool();
+	createTimestampQueryPool();
+
+	createDescriptorAllocators();
 	createDescriptor();
+	createBindlessDescriptor();
+	createPresentSetLayout();
+	createOitSetLayout();
+	createMomentSetLayout();
+	createReducedTransparencySetLayouts();
 	createRenderPasses();
+	createUIRenderPass();
 	createPipelines();
+	createPresentPipeline();
 
 	createFramebuffers();
 	createVertexAndIndexBuffers();
+	createMeshClusters();
+	createHairVertexBuffers();
+	createSimulationBuffers();
+	createComputeDescriptor();
+	createStrandCullDescriptor();
+	createMeshCullDescriptor();
+	createComputePipelines();
 	createCommandBuffers();
 	createSyncObjects();
 }
 
 void Main::mainLoop() {
 	createUI();
+	lastFrameTime = glfwGetTime();
 
 	while (!glfwWindowShouldClose(window)) {
 		glfwPollEvents();
@@ -103,8 +413,14 @@ void Main::mainLoop() {
 }
 
 void Main::cleanUpVulkan() {
+	simulationScheduler.destroy();
 	vkDeviceWaitIdle(device);
 	cleanupSwapChain();
+	vkDestroySwapchainKHR(device, swapChain, nullptr);
+	descriptor.destroy();
+	bindlessDescriptor.destroy();
+	vkDestroyDescriptorSetLayout(device, presentSetLayout, nullptr);
+	ui.destroy();
 	ImGui::DestroyContext();
 
 	vkDestroySampler(device, textureSampler, nullptr);
@@ -115,28 +431,85 @@ void Main::cleanUpVulkan() {
 	vkDestroySampler(device, envMapSampler, nullptr);
 	envMapImage.destroy();
 
-	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-		vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-	}
+	uniformArena.destroy();
+
+	vkDestroyBuffer(device, materialBuffer.buffer, nullptr);
+	vkFreeMemory(device, materialBuffer.memory, nullptr);
 
 	for (auto& pair : vertices) {
 		vkDestroyBuffer(device, pair.second.buffer, nullptr);
 		vkFreeMemory(device, pair.second.memory, nullptr);
 	}
 
+	for (auto& hairVertexBuffer : hairVertexBuffers) {
+		vkDestroyBuffer(device, hairVertexBuffer.buffer, nullptr);
+		vkFreeMemory(device, hairVertexBuffer.memory, nullptr);
+	}
+
+	for (auto& strandRenderBuffer : strandRenderBuffers) {
+		vkDestroyBuffer(device, strandRenderBuffer.buffer, nullptr);
+		vkFreeMemory(device, strandRenderBuffer.memory, nullptr);
+	}
+
+	for (auto* buffers : { &strandVisibleBuffers, &strandDrawBuffers }) {
+		for (auto& buffer : *buffers) {
+			vkDestroyBuffer(device, buffer.buffer, nullptr);
+			vkFreeMemory(device, buffer.memory, nullptr);
+		}
+	}
+
+	for (MeshBuffer* buffer : { &strandPositionBuffer, &strandVelocityBuffer, &strandRestBuffer, &followHairBuffer, &gpuHairVertexBuffer }) {
+		vkDestroyBuffer(device, buffer->buffer, nullptr);
+		vkFreeMemory(device, buffer->memory, nullptr);
+	}
+
+	computeDescriptor.destroy();
+	strandSimulationPipeline.destroy();
+	followHairPipeline.destroy();
+	strandCullDescriptor.destroy();
+	strandCullPipeline.destroy();
+
+	for (auto* buffers : { &meshClusterBuffers, &meshDrawBuffers, &meshCullViewBuffers }) {
+		for (auto& buffer : *buffers) {
+			vkDestroyBuffer(device, buffer.buffer, nullptr);
+			vkFreeMemory(device, buffer.memory, nullptr);
+		}
+	}
+	meshCullDescriptor.destroy();
+	descriptorAllocator.destroy();
+	bindlessDescriptorAllocator.destroy();
+	for (DescriptorSetCache& cache : frameDescriptorCaches) {
+		cache.destroy();
+	}
+	meshCullPipeline.destroy();
+
+	for (auto& characterInstanceBuffer : characterInstanceBuffers) {
+		vkDestroyBuffer(device, characterInstanceBuffer.buffer, nullptr);
+		vkFreeMemory(device, characterInstanceBuffer.memory, nullptr);
+	}
+
 	for (auto& pair : indices) {
 		vkDestroyBuffer(device, pair.second.buffer, nullptr);
 		vkFreeMemory(device, pair.second.memory, nullptr);
 	}
 
-	opaqueObjectsPipeline.destroy();
-	opaqueObjectsRenderPass.destroy();
-	opaqueHairPipeline.destroy();
-	opaqueHairRenderPass.destroy();
-	weightedColorPipeline.destroy();
-	weightedRevealPipeline.destroy();
-	transparentObjectsRenderPass.destroy();
+	destroyPipelines();
+	destroyRenderPasses();
+	if (hairStatisticsSupported) {
+		vkDestroyQueryPool(device, hairQueryPool, nullptr);
+	}
+	if (gpuTimingSupported) {
+		vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+	}
+	vkDestroyDescriptorSetLayout(device, oitSetLayout, nullptr);
+	for (auto& oitCounterBuffer : oitCounterBuffers) {
+		vkDestroyBuffer(device, oitCounterBuffer.buffer, nullptr);
+		vkFreeMemory(device, oitCounterBuffer.memory, nullptr);
+	}
+	vkDestroyDescriptorSetLayout(device, momentSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, transparentDownsampleSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(device, transparentUpsampleSetLayout, nullptr);
+	presentPipeline.destroy();
 	uiRenderPass.destroy();
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
@@ -226,6 +599,8 @@ std::vector<const char*> Main::getRequiredExtensions() {
 	glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
 
 	std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+	// Queries the descriptor indexing features and limits of the devices.
+	extensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 
 	if (enableValidationLayers) {
 		extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
@@ -298,7 +673,9 @@ void Main::pickPhysicalDevice() {
 	// Check if the best candidate is suitable at all
 	if (candidates.rbegin()->first > 0) {
 		physicalDevice = candidates.rbegin()->second;
+		msaaSampleCap = uiState.msaaSampleCap;
 		msaaSamples = getMaxUsableSampleCount();
+		bindlessTextureCapacity = getBindlessTextureCapacity();
 	}
 	else {
 		throw std::runtime_error("failed to find a suitable GPU!");
@@ -342,6 +719,11 @@ int Main::rateDeviceSuitability(VkPhysicalDevice device) {
 		return 0;
 	}
 
+	if (!supportsBindlessTextures(device)) {
+		std::cout << "Bindless textures not supported on device: " << deviceProperties.deviceName << std::endl;
+		return 0;
+	}
+
 	bool swapChainAdequate = false;
 	SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
 	swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
@@ -365,7 +747,8 @@ QueueFamilyIndices Main::findQueueFamilies(VkPhysicalDevice device) {
 	int i = 0;
 	for (const auto& queueFamily : queueFamilies) {
 		// Check if the queue family supports drawing commands.
-		if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+		// The hair simulation is dispatched on the same queue, so it needs compute as well.
+		if ((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
 			indices.graphicsFamily = i;
 		}
 
@@ -416,13 +799,63 @@ void Main::createLogicalDevice() {
 	deviceFeatures.sampleRateShading = VK_TRUE;
 	deviceFeatures.independentBlend = VK_TRUE;
 
+	// The culled meshes are drawn with one indirect draw per cluster, which needs multiDrawIndirect,
+	// and with the draw count written by the GPU where VK_KHR_draw_indirect_count is available.
+	VkPhysicalDeviceFeatures supportedFeatures;
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+	multiDrawIndirectSupported = supportedFeatures.multiDrawIndirect == VK_TRUE;
+	// In a crowd, each draw starts at the instance of the character its cluster was kept for.
+	deviceFeatures.drawIndirectFirstInstance = supportedFeatures.drawIndirectFirstInstance;
+	drawIndirectFirstInstanceSupported = supportedFeatures.drawIndirectFirstInstance == VK_TRUE;
+	// Linked list OIT appends the transparent fragments to storage buffers from the fragment shader.
+	deviceFeatures.fragmentStoresAndAtomics = supportedFeatures.fragmentStoresAndAtomics;
+	linkedListOitSupported = supportedFeatures.fragmentStoresAndAtomics == VK_TRUE;
+	// The UI shows the fragments the hair passes shade, counted by pipeline statistics queries.
+	deviceFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+	hairStatisticsSupported = supportedFeatures.pipelineStatisticsQuery == VK_TRUE;
+	// The dynamic resolution of the transparent hair follows the GPU time of the frames, where the graphics
+	// queue can time them.
+	{
+		uint32_t queueFamilyCount = 0;
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+		std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+		VkPhysicalDeviceProperties properties;
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		gpuTimingSupported = queueFamilies[indices.graphicsFamily.value()].timestampValidBits > 0 && properties.limits.timestampPeriod > 0.0f;
+		timestampPeriod = properties.limits.timestampPeriod;
+	}
+	// Moment OIT sums its moments by blending, which not every device does for 32 bit floats.
+	momentSinglePrecisionSupported = true;
+	for (VkFormat format : { VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT }) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+		momentSinglePrecisionSupported &= (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BLEND_BIT) != 0;
+	}
+
+	std::vector<const char*> extensions = deviceExtensions;
+	const bool drawIndirectCountSupported = isDeviceExtensionSupported(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	if (drawIndirectCountSupported) {
+		extensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+	}
+
+	// The bindless texture table is indexed per fragment, partially bound, and written while bound.
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures{};
+	descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	descriptorIndexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+	descriptorIndexingFeatures.runtimeDescriptorArray = VK_TRUE;
+
 	VkDeviceCreateInfo createInfo{};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	createInfo.pNext = &descriptorIndexingFeatures;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 	createInfo.pEnabledFeatures = &deviceFeatures;
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-	createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 	// enabledLayerCount and ppEnabledLayerNames fields of VkDeviceCreateInfo are ignored by up-to-date implementations. 
 	// However, it is still a good idea to set them anyway to be compatible with older implementations.
 	if (enableValidationLayers) {
@@ -440,6 +873,11 @@ void Main::createLogicalDevice() {
 
 	vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+	frameGraph = RenderGraph(&device);
+
+	if (drawIndirectCountSupported) {
+		cmdDrawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+	}
 }
 
 bool Main::checkDeviceExtensionSupport(VkPhysicalDevice device) {
@@ -458,6 +896,59 @@ bool Main::checkDeviceExtensionSupport(VkPhysicalDevice device) {
 	return requiredExtensions.empty();
 }
 
+bool Main::supportsBindlessTextures(VkPhysicalDevice device) {
+	auto getFeatures2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2KHR"));
+	if (getFeatures2 == nullptr) {
+		return false;
+	}
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT descriptorIndexingFeatures{};
+	descriptorIndexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+	VkPhysicalDeviceFeatures2KHR features{};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+	features.pNext = &descriptorIndexingFeatures;
+	getFeatures2(device, &features);
+
+	return descriptorIndexingFeatures.shaderSampledImageArrayNonUniformIndexing &&
+		descriptorIndexingFeatures.descriptorBindingSampledImageUpdateAfterBind &&
+		descriptorIndexingFeatures.descriptorBindingPartiallyBound &&
+		descriptorIndexingFeatures.runtimeDescriptorArray;
+}
+
+uint32_t Main::getBindlessTextureCapacity() {
+	auto getProperties2 = reinterpret_cast<PFN_vkGetPhysicalDeviceProperties2KHR>(vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2KHR"));
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT descriptorIndexingProperties{};
+	descriptorIndexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+	VkPhysicalDeviceProperties2KHR properties{};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2_KHR;
+	properties.pNext = &descriptorIndexingProperties;
+	getProperties2(physicalDevice, &properties);
+
+	// Every element is a sampler and a sampled image, and only the fragment stage reads them.
+	return std::min({
+		static_cast<uint32_t>(MAX_BINDLESS_TEXTURES),
+		descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		descriptorIndexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+		descriptorIndexingProperties.maxDescriptorSetUpdateAfterBindSampledImages
+	});
+}
+
+bool Main::isDeviceExtensionSupported(VkPhysicalDevice device, const char* extensionName) {
+	uint32_t extensionCount;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
+
+	for (const auto& extension : availableExtensions) {
+		if (strcmp(extension.extensionName, extensionName) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
 SwapChainSupportDetails Main::querySwapChainSupport(VkPhysicalDevice device) {
 	SwapChainSupportDetails details;
 
@@ -561,6 +1052,9 @@ void Main::createSwapChain() {
 	createInfo.preTransform = swapChainSupport.capabilities.currentTransform;
 	createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
 	createInfo.clipped = VK_TRUE;
+	// Handing over the old swapchain lets the driver reuse its resources, and lets images already
+	// acquired from it still be presented. recreateSwapChain retires it.
+	createInfo.oldSwapchain = swapChain;
 
 	if (vkCreateSwapchainKHR(device, &createInfo, nullptr, &swapChain) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create swap chain!");
@@ -590,20 +1084,53 @@ void Main::createSwapchainImageViews() {
 	}
 }
 
+void Main::createDescriptorAllocators() {
+	descriptorAllocator = DescriptorAllocator(&device);
+	bindlessDescriptorAllocator = DescriptorAllocator(&device, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT);
+	frameDescriptorCaches.clear();
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		frameDescriptorCaches.push_back(DescriptorSetCache(&device));
+	}
+	frameAttachmentsStale.assign(MAX_FRAMES_IN_FLIGHT, false);
+}
+
+void Main::updateDescriptorStats() {
+	std::vector<DescriptorAllocatorStats> allocators = { descriptorAllocator.getStats(), bindlessDescriptorAllocator.getStats() };
+	for (const DescriptorSetCache& cache : frameDescriptorCaches) {
+		allocators.push_back(cache.getAllocatorStats());
+	}
+	uiState.descriptorPools = 0;
+	uiState.descriptorSets = 0;
+	uiState.descriptorsReserved = 0;
+	uiState.descriptorsUsed = 0;
+	for (const DescriptorAllocatorStats& stats : allocators) {
+		uiState.descriptorPools += stats.pools;
+		uiState.descriptorSets += stats.sets;
+		uiState.descriptorsReserved += stats.descriptorsReserved;
+		uiState.descriptorsUsed += stats.descriptorsUsed;
+	}
+
+	const DescriptorCacheStats cacheStats = frameDescriptorCaches[currentFrame].getStats();
+	uiState.descriptorCacheHits = cacheStats.hits;
+	uiState.descriptorCacheMisses = cacheStats.misses;
+	uiState.descriptorWrites = cacheStats.descriptorWrites;
+}
+
 void Main::createDescriptor() {
 	descriptor = Descriptor(
 		&device,
 		1, // numUniformBuffers
-		textureImages.size(), // numTextureBuffers: numTextures + 1 for envMap
-		2 // numInputBuffers
+		0, // numTextureBuffers: textures are in bindlessDescriptor
+		2, // numInputBuffers
+		3 // numStorageBuffers
 	);
 
 	// Add descriptor bindings.
 	descriptor.addDescriptorSetLayoutBinding(
 		BIND_UBO,
-		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
 		VK_SHADER_STAGE_VERTEX_BIT,
-		uniformBuffers
+		{ uniformArena.buffer }
 	);
 	descriptor.addDescriptorSetLayoutBinding(
 		BIND_WBOIT_COLOR,
@@ -620,17 +1147,38 @@ void Main::createDescriptor() {
 		weightedRevealImage.view
 	);
 
-	for (auto& pair : textureImages) {
-		auto tmp = pair.first.substr(pair.first.find('_') + 1);
-		descriptor.addDescriptorSetLayoutBinding(
-			static_cast<uint32_t>(std::stoul(tmp)),
-			VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			VK_SHADER_STAGE_FRAGMENT_BIT,
-			{},
-			pair.second.view,
-			textureSampler
-		);
+	std::vector<VkBuffer> strandBuffers;
+	for (const auto& strandRenderBuffer : strandRenderBuffers) {
+		strandBuffers.push_back(strandRenderBuffer.buffer);
+	}
+	descriptor.addDescriptorSetLayoutBinding(
+		BIND_STRAND_RENDER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_VERTEX_BIT,
+		strandBuffers
+	);
+
+	std::vector<VkBuffer> visibleBuffers;
+	for (const auto& strandVisibleBuffer : strandVisibleBuffers) {
+		visibleBuffers.push_back(strandVisibleBuffer.buffer);
+	}
+	descriptor.addDescriptorSetLayoutBinding(
+		BIND_STRAND_VISIBLE,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_VERTEX_BIT,
+		visibleBuffers
+	);
+
+	std::vector<VkBuffer> instanceBuffers;
+	for (const auto& characterInstanceBuffer : characterInstanceBuffers) {
+		instanceBuffers.push_back(characterInstanceBuffer.buffer);
 	}
+	descriptor.addDescriptorSetLayoutBinding(
+		BIND_CHARACTER_INSTANCES,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT,
+		instanceBuffers
+	);
 
 	//descriptor.addDescriptorSetLayoutBinding(
 	//	BIND_ENV_MAP,
@@ -641,16 +1189,85 @@ void Main::createDescriptor() {
 	//	envMapSampler
 	//);
 
-	descriptor.create();
+	descriptor.create(descriptorAllocator);
+}
+
+void Main::createBindlessDescriptor() {
+	if (textureImages.size() > bindlessTextureCapacity) {
+		throw std::runtime_error("The device fits " + std::to_string(bindlessTextureCapacity) + " textures in the bindless table, not " + std::to_string(textureImages.size()) + ".");
+	}
+
+	// In name order, so that the indices don't depend on the map.
+	std::vector<std::string> names;
+	for (const auto& pair : textureImages) {
+		names.push_back(pair.first);
+	}
+	std::sort(names.begin(), names.end());
+	textureIndices.clear();
+	for (uint32_t i = 0; i < names.size(); i++) {
+		textureIndices[names[i]] = i;
+	}
+
+	auto textureIndex = [this](const std::string& name) {
+		const auto it = textureIndices.find(name);
+		return it == textureIndices.end() ? NO_TEXTURE : it->second;
+	};
+	std::vector<Material> materials(2);
+	materials[MATERIAL_HEAD] = {
+		textureIndex("head_albedo"),
+		NO_TEXTURE, NO_TEXTURE, NO_TEXTURE, NO_TEXTURE, NO_TEXTURE, NO_TEXTURE, NO_TEXTURE
+	};
+	materials[MATERIAL_HAIR] = {
+		textureIndex("hair_albedo"),
+		textureIndex("hair_normal"),
+		textureIndex("hair_direction"),
+		textureIndex("hair_ao"),
+		textureIndex("hair_depth"),
+		textureIndex("hair_root"),
+		textureIndex("hair_flow"),
+		textureIndex("hair_id")
+	};
+	materialBuffer = createStorageBuffer(materials.data(), sizeof(Material) * materials.size(), static_cast<uint32_t>(materials.size()));
+
+	bindlessDescriptor = Descriptor(
+		&device,
+		0, // numUniformBuffers
+		1, // numTextureBuffers: the texture array
+		0, // numInputBuffers
+		1 // numStorageBuffers
+	);
+	bindlessDescriptor.addDescriptorSetLayoutBinding(
+		BIND_MATERIALS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_FRAGMENT_BIT,
+		{ materialBuffer.buffer }
+	);
+	bindlessDescriptor.addBindlessImageArray(BIND_TEXTURES, VK_SHADER_STAGE_FRAGMENT_BIT, bindlessTextureCapacity);
+	bindlessDescriptor.create(bindlessDescriptorAllocator);
+
+	for (const auto& name : names) {
+		bindlessDescriptor.updateImageArrayElement(BIND_TEXTURES, textureIndices[name], textureImages[name].view, textureSampler);
+	}
+}
+
+void Main::updateAttachmentDescriptors(uint32_t frame) {
+	descriptor.updateImageBinding(frame, BIND_WBOIT_COLOR, weightedColorImage.view);
+	descriptor.updateImageBinding(frame, BIND_WBOIT_REVEAL, weightedRevealImage.view);
+	// The cached sets point at the old views, and a new view could get the handle of an old one.
+	frameDescriptorCaches[frame].reset();
+	frameAttachmentsStale[frame] = false;
 }
 
 void Main::createPipelines() {
+	// Every graphics pipeline sees both sets, so that binding them once fits all of them.
+	const std::vector<VkDescriptorSetLayout> setLayouts = { descriptor.descriptorSetLayout, bindlessDescriptor.descriptorSetLayout };
+
 	/* opaqueObjectsPipeline */
 	opaqueObjectsPipeline = Pipeline(
 		&device,
 		opaqueObjectsRenderPass
 	);
-	opaqueObjectsPipeline.createPipelineLayout(&descriptor.descriptorSetLayout);
+	opaqueObjectsPipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
 	
 	VkPipelineRasterizationStateCreateInfo opaqueRasterizer{};
 	opaqueRasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -706,7 +1323,7 @@ void Main::createPipelines() {
 		&device,
 		transparentObjectsRenderPass
 	);
-	weightedColorPipeline.createPipelineLayout(&descriptor.descriptorSetLayout);
+	weightedColorPipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
 
 	VkPipelineRasterizationStateCreateInfo weightedColorRasterizer = opaqueRasterizer;
 	weightedColorRasterizer.cullMode = VK_CULL_MODE_NONE;
@@ -744,12 +1361,32 @@ void Main::createPipelines() {
 		0
 	);
 
+	/* strandPipeline */
+	strandPipeline = Pipeline(
+		&device,
+		transparentObjectsRenderPass
+	);
+	strandPipeline.createPipelineLayout(setLayouts, sizeof(StrandPushConstants), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	// The ribbons are built from the strand buffer, so there is no vertex input.
+	strandPipeline.createPipeline(
+		shaders["strandVertShader"],
+		shaders["strandFragShader"],
+		true,
+		weightedColorRasterizer,
+		msaaSamples,
+		weightedColorDepthStencil,
+		{ weightedColorBlendAttachment0, weightedColorBlendAttachment1 },
+		0
+	);
+
 	/* weightedRevealPipeline */
 	weightedRevealPipeline = Pipeline(
 		&device,
 		transparentObjectsRenderPass
 	);
-	weightedRevealPipeline.createPipelineLayout(&descriptor.descriptorSetLayout);
+	// The fullscreen triangle doesn't read the model matrix, but the push constant range has to match the
+	// other layouts for the descriptor set bound in the opaque pass to stay valid.
+	weightedRevealPipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
 	VkPipelineColorBlendAttachmentState weightedRevealColorBlendAttachment{};
 	weightedRevealColorBlendAttachment.colorWriteMask = colorFlags;
 	weightedRevealColorBlendAttachment.blendEnable = VK_TRUE;
@@ -761,7 +1398,7 @@ void Main::createPipelines() {
 	weightedRevealColorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
 	weightedRevealPipeline.createPipeline(
 		shaders["triangleShader"], 
-		shaders["weightedRevealFragShader"],
+		shaders[msaaSamples != VK_SAMPLE_COUNT_1_BIT ? "weightedRevealFragShader" : "weightedRevealSingleSampleFragShader"],
 		true,
 		weightedColorRasterizer,
 		msaaSamples,
@@ -770,12 +1407,87 @@ void Main::createPipelines() {
 		1
 	);
 
+	if (linkedListOitSupported) {
+		// The lists are a third set, behind the ones all graphics pipelines share.
+		const std::vector<VkDescriptorSetLayout> oitSetLayouts = { descriptor.descriptorSetLayout, bindlessDescriptor.descriptorSetLayout, oitSetLayout };
+
+		// The fragments go to the lists, the weighted attachments are left alone. Once per pixel, not per
+		// sample, or every sample would append the fragment again.
+		VkPipelineColorBlendAttachmentState linkedListBlendAttachment{};
+		linkedListBlendAttachment.colorWriteMask = 0;
+		linkedListBlendAttachment.blendEnable = VK_FALSE;
+
+		/* linkedListColorPipeline */
+		linkedListColorPipeline = Pipeline(
+			&device,
+			transparentObjectsRenderPass
+		);
+		linkedListColorPipeline.createPipelineLayout(oitSetLayouts, sizeof(MeshPushConstants));
+		linkedListColorPipeline.createPipeline(
+			shaders["vertShader"],
+			shaders["linkedListColorFragShader"],
+			false,
+			weightedColorRasterizer,
+			msaaSamples,
+			weightedColorDepthStencil,
+			{ linkedListBlendAttachment, linkedListBlendAttachment },
+			0,
+			false
+		);
+
+		/* linkedListStrandPipeline */
+		linkedListStrandPipeline = Pipeline(
+			&device,
+			transparentObjectsRenderPass
+		);
+		linkedListStrandPipeline.createPipelineLayout(oitSetLayouts, sizeof(StrandPushConstants), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+		linkedListStrandPipeline.createPipeline(
+			shaders["strandVertShader"],
+			shaders["linkedListStrandFragShader"],
+			true,
+			weightedColorRasterizer,
+			msaaSamples,
+			weightedColorDepthStencil,
+			{ linkedListBlendAttachment, linkedListBlendAttachment },
+			0,
+			false
+		);
+
+		/* oitResolvePipeline */
+		oitResolvePipeline = Pipeline(
+			&device,
+			transparentObjectsRenderPass
+		);
+		oitResolvePipeline.createPipelineLayout(oitSetLayouts, sizeof(MeshPushConstants));
+		// The sorted fragments come premultiplied, what they let through of the opaque color is 1 - alpha.
+		VkPipelineColorBlendAttachmentState oitResolveBlendAttachment{};
+		oitResolveBlendAttachment.colorWriteMask = colorFlags;
+		oitResolveBlendAttachment.blendEnable = VK_TRUE;
+		oitResolveBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		oitResolveBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		oitResolveBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+		oitResolveBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+		oitResolveBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+		oitResolveBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+		oitResolvePipeline.createPipeline(
+			shaders["triangleShader"],
+			shaders["oitResolveFragShader"],
+			true,
+			weightedColorRasterizer,
+			msaaSamples,
+			weightedColorDepthStencil,
+			{ oitResolveBlendAttachment },
+			1,
+			false
+		);
+	}
+
 	/* opaqueHairPipeline */
 	opaqueHairPipeline = Pipeline(
 		&device,
 		opaqueHairRenderPass
 	);
-	opaqueHairPipeline.createPipelineLayout(&descriptor.descriptorSetLayout);
+	opaqueHairPipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
 	opaqueHairPipeline.createPipeline(
 		shaders["vertShader"],
 		shaders["opaqueHairFragShader"],
@@ -786,72 +1498,249 @@ void Main::createPipelines() {
 		{ opaqueColorBlendAttachment },
 		0
 	);
-}
-
-void Main::createOpaqueObjectsFramebuffer() {
-	std::array<VkImageView, 2> attachments = { offscreenColorImage.view, depthImage.view };
-	VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
-	framebufferInfo.renderPass = opaqueObjectsRenderPass.renderPass;
-	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-	framebufferInfo.pAttachments = attachments.data();
-	framebufferInfo.width = offscreenColorImage.width;
-	framebufferInfo.height = offscreenColorImage.height;
-	framebufferInfo.layers = 1;
 
-	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &opaqueObjectsFramebuffer) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create opaque objects framebuffer!");
-	}
-}
+	// The opaque core of the hair cards in transparency mode, drawn in the opaque pass. Both pipelines
+	// run once per pixel: the prepass only tests the alpha, and the edges of the core lie under the fringe.
+	/* hairPrepassPipeline */
+	hairPrepassPipeline = Pipeline(
+		&device,
+		opaqueObjectsRenderPass
+	);
+	hairPrepassPipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
+	VkPipelineColorBlendAttachmentState hairPrepassBlendAttachment{};
+	hairPrepassBlendAttachment.colorWriteMask = 0;
+	hairPrepassBlendAttachment.blendEnable = VK_FALSE;
+	hairPrepassPipeline.createPipeline(
+		shaders["vertShader"],
+		shaders["hairPrepassFragShader"],
+		false,
+		weightedColorRasterizer,
+		msaaSamples,
+		opaqueDepthStencil,
+		{ hairPrepassBlendAttachment },
+		0,
+		false
+	);
 
-void Main::createTransparentObjectsFramebuffer() {
-	std::array<VkImageView, 4> attachments = { weightedColorImage.view, weightedRevealImage.view, offscreenColorImage.view, depthImage.view };
+	/* hairCorePipeline */
+	hairCorePipeline = Pipeline(
+		&device,
+		opaqueObjectsRenderPass
+	);
+	hairCorePipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
+	// Only the nearest core fragment of a sample has the depth the prepass left.
+	VkPipelineDepthStencilStateCreateInfo hairCoreDepthStencil = opaqueDepthStencil;
+	hairCoreDepthStencil.depthWriteEnable = VK_FALSE;
+	hairCoreDepthStencil.depthCompareOp = VK_COMPARE_OP_EQUAL;
+	hairCorePipeline.createPipeline(
+		shaders["vertShader"],
+		shaders["hairCoreFragShader"],
+		false,
+		weightedColorRasterizer,
+		msaaSamples,
+		hairCoreDepthStencil,
+		{ opaqueColorBlendAttachment },
+		0,
+		false
+	);
 
-	VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
-	framebufferInfo.renderPass = transparentObjectsRenderPass.renderPass;
-	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-	framebufferInfo.pAttachments = attachments.data();
-	framebufferInfo.width = weightedColorImage.width;
-	framebufferInfo.height = weightedColorImage.height;
-	framebufferInfo.layers = 1;
+	// Full-screen passes cover every pixel without testing depth.
+	VkPipelineDepthStencilStateCreateInfo presentDepthStencil = opaqueDepthStencil;
+	presentDepthStencil.depthTestEnable = VK_FALSE;
+	presentDepthStencil.depthWriteEnable = VK_FALSE;
 
-	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &transparentObjectsFramebuffer) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create transparent objects framebuffer!");
-	}
-}
+	// Reduced resolution transparency. The hair is drawn as in the color subpass, into single sample images.
+	/* lowResWeightedColorPipeline */
+	lowResWeightedColorPipeline = Pipeline(
+		&device,
+		lowResTransparentRenderPass
+	);
+	lowResWeightedColorPipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
+	lowResWeightedColorPipeline.createPipeline(
+		shaders["vertShader"],
+		shaders["weightedColorFragShader"],
+		false,
+		weightedColorRasterizer,
+		VK_SAMPLE_COUNT_1_BIT,
+		weightedColorDepthStencil,
+		{ weightedColorBlendAttachment0, weightedColorBlendAttachment1 },
+		0
+	);
 
-void Main::createSwapchainFramebuffers() {
-	// Create swapchain frame buffers.
-	swapChainFramebuffers.resize(swapChainImageViews.size());
-	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-		std::array<VkImageView, 4> attachments = {
-			// The order here needs to match the attachment order in transparentObjectsRenderPass
-			weightedColorImage.view,
-			weightedRevealImage.view,
-			offscreenColorImage.view,
-			depthImage.view
-		};
+	/* lowResStrandPipeline */
+	lowResStrandPipeline = Pipeline(
+		&device,
+		lowResTransparentRenderPass
+	);
+	lowResStrandPipeline.createPipelineLayout(setLayouts, sizeof(StrandPushConstants), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	lowResStrandPipeline.createPipeline(
+		shaders["strandVertShader"],
+		shaders["strandFragShader"],
+		true,
+		weightedColorRasterizer,
+		VK_SAMPLE_COUNT_1_BIT,
+		weightedColorDepthStencil,
+		{ weightedColorBlendAttachment0, weightedColorBlendAttachment1 },
+		0
+	);
+
+	/* transparentDepthDownsamplePipeline */
+	transparentDepthDownsamplePipeline = Pipeline(
+		&device,
+		transparentDepthDownsampleRenderPass
+	);
+	transparentDepthDownsamplePipeline.createPipelineLayout({ transparentDownsampleSetLayout }, sizeof(TransparentScalePushConstants), VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Every texel drawn is written, whatever was there before.
+	VkPipelineDepthStencilStateCreateInfo transparentDepthDownsampleDepthStencil = opaqueDepthStencil;
+	transparentDepthDownsampleDepthStencil.depthCompareOp = VK_COMPARE_OP_ALWAYS;
+	transparentDepthDownsamplePipeline.createPipeline(
+		shaders["triangleShader"],
+		shaders[msaaSamples != VK_SAMPLE_COUNT_1_BIT ? "transparentDepthDownsampleFragShader" : "transparentDepthDownsampleSingleSampleFragShader"],
+		true,
+		weightedColorRasterizer,
+		VK_SAMPLE_COUNT_1_BIT,
+		transparentDepthDownsampleDepthStencil,
+		{},
+		0,
+		false
+	);
+
+	/* transparentUpsamplePipeline */
+	transparentUpsamplePipeline = Pipeline(
+		&device,
+		transparentUpsampleRenderPass
+	);
+	transparentUpsamplePipeline.createPipelineLayout({ transparentUpsampleSetLayout }, sizeof(TransparentScalePushConstants), VK_SHADER_STAGE_FRAGMENT_BIT);
+	// Composited like the full resolution weighted sums, once per sample against the depth of each.
+	transparentUpsamplePipeline.createPipeline(
+		shaders["triangleShader"],
+		shaders[msaaSamples != VK_SAMPLE_COUNT_1_BIT ? "transparentUpsampleFragShader" : "transparentUpsampleSingleSampleFragShader"],
+		true,
+		weightedColorRasterizer,
+		msaaSamples,
+		presentDepthStencil,
+		{ weightedRevealColorBlendAttachment },
+		0
+	);
+
+	createMomentPipelines();
+}
+
+void Main::destroyPipelines() {
+	opaqueObjectsPipeline.destroy();
+	opaqueHairPipeline.destroy();
+	hairPrepassPipeline.destroy();
+	hairCorePipeline.destroy();
+	weightedColorPipeline.destroy();
+	strandPipeline.destroy();
+	weightedRevealPipeline.destroy();
+	if (linkedListOitSupported) {
+		linkedListColorPipeline.destroy();
+		linkedListStrandPipeline.destroy();
+		oitResolvePipeline.destroy();
+	}
+	destroyMomentPipelines();
+	transparentDepthDownsamplePipeline.destroy();
+	lowResWeightedColorPipeline.destroy();
+	lowResStrandPipeline.destroy();
+	transparentUpsamplePipeline.destroy();
+}
+
+void Main::createPresentPipeline() {
+	presentPipeline = Pipeline(
+		&device,
+		uiRenderPass
+	);
+	presentPipeline.createPipelineLayout({ presentSetLayout });
+
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.depthClampEnable = VK_FALSE;
+	rasterizer.rasterizerDiscardEnable = VK_FALSE;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+	rasterizer.depthBiasEnable = VK_FALSE;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_FALSE;
+	depthStencil.depthWriteEnable = VK_FALSE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.depthBoundsTestEnable = VK_FALSE;
+	depthStencil.minDepthBounds = 0.0f;
+	depthStencil.maxDepthBounds = 1.0f;
+	depthStencil.stencilTestEnable = VK_FALSE;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	presentPipeline.createPipeline(
+		shaders["triangleShader"],
+		shaders["presentFragShader"],
+		true,
+		rasterizer,
+		VK_SAMPLE_COUNT_1_BIT,
+		depthStencil,
+		{ colorBlendAttachment },
+		0
+	);
+}
+
+void Main::createOpaqueObjectsFramebuffer() {
+	std::array<VkImageView, 2> attachments = { offscreenColorImage.view, depthImage.view };
+	VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	framebufferInfo.renderPass = opaqueObjectsRenderPass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = offscreenColorImage.width;
+	framebufferInfo.height = offscreenColorImage.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &opaqueObjectsFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create opaque objects framebuffer!");
+	}
 
-		VkFramebufferCreateInfo framebufferInfo{};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		// TODO: Note that you should use the render pass whose subpass writes directly to the swapchain image view.
-		// So this might be transparentObjectRenderPass
-		framebufferInfo.renderPass = transparentObjectsRenderPass.renderPass;
-		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-		framebufferInfo.pAttachments = attachments.data();
-		framebufferInfo.width = swapChainExtent.width;
-		framebufferInfo.height = swapChainExtent.height;
-		framebufferInfo.layers = 1;
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		std::array<VkImageView, 3> resolveAttachments = { offscreenColorImage.view, depthImage.view, downsampleImage.view };
+		framebufferInfo.renderPass = opaqueResolveRenderPass.renderPass;
+		framebufferInfo.attachmentCount = static_cast<uint32_t>(resolveAttachments.size());
+		framebufferInfo.pAttachments = resolveAttachments.data();
 
-		if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapChainFramebuffers[i]) != VK_SUCCESS) {
-			throw std::runtime_error("Failed to create swapchain framebuffers!");
+		if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &opaqueResolveFramebuffer) != VK_SUCCESS) {
+			throw std::runtime_error("failed to create opaque resolve framebuffer!");
 		}
-	}	
+	}
+}
+
+VulkanImage& Main::getPresentSourceImage() {
+	return msaaSamples != VK_SAMPLE_COUNT_1_BIT ? downsampleImage : offscreenColorImage;
+}
+
+void Main::createTransparentObjectsFramebuffer() {
+	std::vector<VkImageView> attachments = { weightedColorImage.view, weightedRevealImage.view, offscreenColorImage.view, depthImage.view };
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		attachments.push_back(downsampleImage.view);
+	}
+
+	VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	framebufferInfo.renderPass = transparentObjectsRenderPass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = weightedColorImage.width;
+	framebufferInfo.height = weightedColorImage.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &transparentObjectsFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transparent objects framebuffer!");
+	}
 }
 
 void Main::recordDrawForMesh(VkCommandBuffer cmd, const std::string& name, Pipeline &pipeline) {
-	const VkBuffer vbuf = vertices.at(name).buffer;
+	const VkBuffer vbuf = (name == "hair") ? getHairVertexBuffer() : vertices.at(name).buffer;
 	const VkBuffer ibuf = indices.at(name).buffer;
-	const uint32_t indexCnt = static_cast<uint32_t>(indices.at(name).count);
 
 	const VkDeviceSize offset = 0;
 
@@ -867,20 +1756,43 @@ void Main::recordDrawForMesh(VkCommandBuffer cmd, const std::string& name, Pipel
 		0, 1,
 		&descriptor.descriptorSets[currentFrame],
 		0, nullptr);*/
-	vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS,
-		pipeline.layout,
-		0, 1,
-		&descriptor.descriptorSets[currentFrame],
-		0, nullptr);
+	bindGlobalDescriptorSet(cmd, pipeline.layout);
+
+	// The head moves as a whole, the hair vertices are already where the simulation put them.
+	MeshPushConstants constants{};
+	constants.model = (name == "head") ? renderHeadTransform : glm::mat4(1.0f);
+	vkCmdPushConstants(cmd, pipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
 
-	vkCmdDrawIndexed(cmd, indexCnt, 1, 0, 0, 0);
+	recordIndexedDraw(cmd, name);
+}
+
+void Main::recordIndexedDraw(VkCommandBuffer commandBuffer, const std::string& name) {
+	const auto range = meshClusterRanges.find(name);
+	if (!isMeshCullingActive() || range == meshClusterRanges.end()) {
+		// One draw for the whole crowd, the shaders pick each character's transform and colours by instance.
+		vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.at(name).count), getCharacterCount(), 0, 0, 0);
+		return;
+	}
+
+	const VkBuffer drawBuffer = meshDrawBuffers[currentFrame].buffer;
+	const VkDeviceSize countOffset = sizeof(uint32_t) * range->second.slot;
+	const VkDeviceSize drawOffset = sizeof(uint32_t) * MAX_CULLED_MESHES + sizeof(VkDrawIndexedIndirectCommand) * getFirstMeshDraw(range->second);
+	const uint32_t maxDraws = range->second.numClusters * getCharacterCount();
+	if (cmdDrawIndexedIndirectCount != nullptr) {
+		cmdDrawIndexedIndirectCount(commandBuffer, drawBuffer, drawOffset, drawBuffer, countOffset, maxDraws, sizeof(VkDrawIndexedIndirectCommand));
+	}
+	else {
+		// The draws past the count were zeroed, so they draw nothing.
+		vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, drawOffset, maxDraws, sizeof(VkDrawIndexedIndirectCommand));
+	}
 }
 
 void Main::createFramebuffers() {
-	createSwapchainFramebuffers();
 	createUIFramebuffers();
 	createOpaqueObjectsFramebuffer();
 	createTransparentObjectsFramebuffer();
+	createMomentObjectsFramebuffer();
+	createReducedTransparencyFramebuffers();
 }
 
 void Main::createCommandPool() {
@@ -944,12 +1856,13 @@ void Main::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
 }
 
 void Main::recordOpaqueObjectsRenderPass(VkCommandBuffer commandBuffer) {
-	offscreenColorImage.transitionLayout(commandBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
-	
-	// Set up the render pass
+	allocatePassUniforms();
+
+	// Set up the render pass, which resolves the frame when no transparent pass follows.
+	const bool resolve = msaaSamples != VK_SAMPLE_COUNT_1_BIT && !uiState.transparencyOn;
 	VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
-	renderPassInfo.renderPass = opaqueObjectsRenderPass.renderPass;
-	renderPassInfo.framebuffer = opaqueObjectsFramebuffer;
+	renderPassInfo.renderPass = resolve ? opaqueResolveRenderPass.renderPass : opaqueObjectsRenderPass.renderPass;
+	renderPassInfo.framebuffer = resolve ? opaqueResolveFramebuffer : opaqueObjectsFramebuffer;
 
 	renderPassInfo.renderArea.offset = { 0, 0 };
 	renderPassInfo.renderArea.extent.width = offscreenColorImage.width;
@@ -980,6 +1893,15 @@ void Main::recordOpaqueObjectsRenderPass(VkCommandBuffer commandBuffer) {
 
 	if (uiState.transparencyOn) {
 		recordDrawForMesh(commandBuffer, "head", opaqueObjectsPipeline);
+		if (isHairCoreActive()) {
+			// The depth of the core first, then its shading where it is the nearest.
+			beginHairQuery(commandBuffer, HAIR_QUERY_PREPASS);
+			recordDrawForMesh(commandBuffer, "hair", hairPrepassPipeline);
+			endHairQuery(commandBuffer, HAIR_QUERY_PREPASS);
+			beginHairQuery(commandBuffer, HAIR_QUERY_CORE);
+			recordDrawForMesh(commandBuffer, "hair", hairCorePipeline);
+			endHairQuery(commandBuffer, HAIR_QUERY_CORE);
+		}
 	}
 	else {
 		recordDrawForMesh(commandBuffer, "head", opaqueObjectsPipeline);
@@ -990,7 +1912,7 @@ void Main::recordOpaqueObjectsRenderPass(VkCommandBuffer commandBuffer) {
 }
 
 void Main::recordTransparentObjectsRenderPass(VkCommandBuffer commandBuffer) {
-	offscreenColorImage.transitionLayout(commandBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	allocatePassUniforms();
 
 	VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
 	renderPassInfo.renderPass = transparentObjectsRenderPass.renderPass;
@@ -1007,12 +1929,6 @@ void Main::recordTransparentObjectsRenderPass(VkCommandBuffer commandBuffer) {
 	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
 	// COLOR PASS
-	// Bind the vertex and index buffers
-	VkBuffer vertexBuffers[] = { vertices["hair"].buffer };
-	VkDeviceSize offsets[] = { 0 };
-	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(commandBuffer, indices["hair"].buffer, 0, VK_INDEX_TYPE_UINT32);
-
 	// We need to do this because we've set the viewport and scissor to be dynamic.
 	VkViewport viewport{};
 	viewport.x = 0.0f;
@@ -1028,269 +1944,1713 @@ void Main::recordTransparentObjectsRenderPass(VkCommandBuffer commandBuffer) {
 	scissor.extent = swapChainExtent;
 	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-	// Computes the weighted sum and reveal factor.
-	/*vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, weightedColorPipeline);*/
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, weightedColorPipeline.pipeline);
-	// Draw all objects
-	vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices["hair"].count), 1, 0, 0, 0);
+	// In linked list mode the same draws append to the lists, which every pipeline of the pass binds as its third set.
+	const bool linkedList = isLinkedListOitActive();
+	VkDescriptorSet oitSet = VK_NULL_HANDLE;
+	if (linkedList) {
+		oitSet = frameDescriptorCaches[currentFrame].getSet(oitSetLayout, {
+			DescriptorWrite::forImage(BIND_OIT_HEADS, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, oitHeadImage.view, VK_NULL_HANDLE, VK_IMAGE_LAYOUT_GENERAL),
+			DescriptorWrite::forBuffer(BIND_OIT_NODES, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, oitNodeBuffer.buffer),
+			DescriptorWrite::forBuffer(BIND_OIT_COUNTERS, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, oitCounterBuffers[currentFrame].buffer)
+		});
+	}
+	// Computes the weighted sum and reveal factor, or appends to the lists.
+	beginHairQuery(commandBuffer, HAIR_QUERY_TRANSPARENT);
+	recordTransparentHairDraw(commandBuffer,
+		linkedList ? linkedListColorPipeline : weightedColorPipeline,
+		linkedList ? linkedListStrandPipeline : strandPipeline,
+		oitSet);
+	endHairQuery(commandBuffer, HAIR_QUERY_TRANSPARENT);
 	
 	// Move to the next subpass
 	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
 	// COMPOSITE PASS
-	// Averages out the summed colors (in some sense) to get the final transparent color.
+	// Averages out the summed colors (in some sense) to get the final transparent color,
+	// or sorts and blends the lists.
 	/*vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, weightedRevealPipeline);*/
-	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, weightedRevealPipeline.pipeline);
+	const Pipeline& compositePipeline = linkedList ? oitResolvePipeline : weightedRevealPipeline;
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline.pipeline);
+	// Rebound in case the strand layout disturbed it.
+	bindGlobalDescriptorSet(commandBuffer, compositePipeline.layout);
+	if (linkedList) {
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, compositePipeline.layout, SET_OIT, 1, &oitSet, 0, nullptr);
+	}
 	// Draw a full-screen triangle
 	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
 	
 	vkCmdEndRenderPass(commandBuffer);
 }
 
-void Main::recordSwapchainBlit(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-	assert(offscreenColorImage.currentLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL);
-	assert(offscreenColorImage.currentAccesses == (VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT));
-	offscreenColorImage.transitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT);
-
-	// So far we only handle multi-sampling
-	if (msaaSamples != 1) {
-		downsampleImage.transitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT);
-		
-		// Resolve the MSAA image m_colorImage to m_downsampleImage
-		VkImageResolve resolveRegion = { 0 };  
-		resolveRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		resolveRegion.srcSubresource.layerCount = 1;
-		resolveRegion.dstSubresource = resolveRegion.srcSubresource;
-		resolveRegion.extent = { offscreenColorImage.width, offscreenColorImage.height, 1 };
-
-		vkCmdResolveImage(commandBuffer, offscreenColorImage.image, offscreenColorImage.currentLayout, downsampleImage.image, downsampleImage.currentLayout, 1, &resolveRegion);                      
-
-		downsampleImage.transitionLayout(commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT);
-	}
-	else {
-		throw std::runtime_error("Not handled yet.");
-	}
-
-	// Blit the downsampled image to the swapchain
-	VkImageBlit blitRegion = { 0 };
-	blitRegion.srcOffsets[1].x = downsampleImage.width;
-	blitRegion.srcOffsets[1].y = downsampleImage.height;
-	blitRegion.srcOffsets[1].z = 1;
-	blitRegion.dstOffsets[1].x = swapChainExtent.width;
-	blitRegion.dstOffsets[1].y = swapChainExtent.height;
-	blitRegion.dstOffsets[1].z = 1;
-	blitRegion.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	blitRegion.dstSubresource.layerCount = 1;
-	blitRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	blitRegion.srcSubresource.layerCount = 1;
-
-	cmdImageTransition(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	vkCmdBlitImage(commandBuffer, downsampleImage.image, downsampleImage.currentLayout, swapChainImages[imageIndex], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blitRegion, VK_FILTER_NEAREST);                 
-	cmdImageTransition(commandBuffer, swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-	
-	offscreenColorImage.transitionLayout(commandBuffer, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+bool Main::isLinkedListOitActive() const {
+	return linkedListOitSupported && uiState.transparencyOn && uiState.oitMode == OIT_LINKED_LIST;
 }
 
-void Main::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-	VkCommandBufferBeginInfo beginInfo{};
-	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-	beginInfo.flags = 0; 
-	beginInfo.pInheritanceInfo = nullptr; 
-
-	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
-		throw std::runtime_error("failed to begin recording command buffer!");
+void Main::createOitSetLayout() {
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings{};
+	bindings[0].binding = BIND_OIT_HEADS;
+	bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	bindings[1].binding = BIND_OIT_NODES;
+	bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	bindings[2].binding = BIND_OIT_COUNTERS;
+	bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	for (VkDescriptorSetLayoutBinding& binding : bindings) {
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	}
 
-	// TODO: Draw envmap and everything related
-	
-	// Draw opaque objects.
-	recordOpaqueObjectsRenderPass(commandBuffer);
-	// Draw transparent objects.
-	if (uiState.transparencyOn) {
-		recordTransparentObjectsRenderPass(commandBuffer);
-	}
-	// Blit to swapchain.
-	recordSwapchainBlit(commandBuffer, imageIndex);
-	// Draw UI.
-	recordUIRenderPass(commandBuffer, imageIndex);
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
 
-	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
-		throw std::runtime_error("Failed to record command buffer!");
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &oitSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the oit descriptor set layout!");
 	}
 }
 
-void Main::createSyncObjects() {
-	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-
-	VkSemaphoreCreateInfo semaphoreInfo{};
-	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-
-	VkFenceCreateInfo fenceInfo{};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+void Main::createOitCounterBuffers() {
+	const VkDeviceSize size = 2 * sizeof(uint32_t);
+	oitCounterBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	oitCounterBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	retiredOitNodeBuffers.resize(MAX_FRAMES_IN_FLIGHT);
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-			vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
-
-			throw std::runtime_error("failed to create synchronization objects for a frame!");
-		}
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		// Host visible, so the CPU reads back how far the lists got.
+		createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		oitCounterBuffers[i] = MeshBuffer(buffer, memory, 2);
+
+		vkMapMemory(device, memory, 0, size, 0, &oitCounterBuffersMapped[i]);
+		memset(oitCounterBuffersMapped[i], 0, (size_t)size);
 	}
 }
 
-void Main::drawFrame(ImGuiIO& io) {
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
-
-	uint32_t imageIndex;
-	VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-
-	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-		recreateSwapChain();
+void Main::updateOitNodeBuffer() {
+	// Resized once the slider is let go rather than on every step of the drag.
+	if (oitNodeBuffer.buffer != VK_NULL_HANDLE && uiState.oitNodesPerPixelEditing) {
 		return;
 	}
-	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-		throw std::runtime_error("failed to acquire swap chain image!");
-	}
-
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
-	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-
-	ui.drawNewFrame(uiState);
 
-	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+	// As many nodes as asked for per pixel, as far as one storage buffer binding reaches.
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	const VkDeviceSize pixels = static_cast<VkDeviceSize>(swapChainExtent.width) * swapChainExtent.height;
+	const VkDeviceSize maxNodes = properties.limits.maxStorageBufferRange / OIT_NODE_SIZE;
+	const VkDeviceSize wanted = std::min(pixels * static_cast<VkDeviceSize>(uiState.oitNodesPerPixel), maxNodes);
+	const VkDeviceSize current = oitNodeBuffer.count;
+	// Grows at least twofold so a few steps up reallocate once, and only shrinks when less than half is
+	// asked for. The window changing size drops the pool anyway.
+	if (oitNodeBuffer.buffer != VK_NULL_HANDLE && wanted <= current && wanted * 2 > current) {
+		return;
+	}
+	const uint32_t capacity = static_cast<uint32_t>(wanted > current ? std::min(std::max(wanted, current * 2), maxNodes) : wanted);
 
-	updateUniformBuffer(currentFrame);
+	// The other frame in flight may still append to the old pool, it is freed once this frame comes round again.
+	retireOitNodeBuffer(currentFrame);
 
-	VkSubmitInfo submitInfo{};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	createBuffer(capacity * OIT_NODE_SIZE, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+	oitNodeBuffer = MeshBuffer(buffer, memory, capacity);
+	std::cout << "OIT node pool: " << capacity << " nodes, " << capacity * OIT_NODE_SIZE / (1024 * 1024) << " MiB.\n";
+}
 
-	// Each entry in the waitStages array corresponds to the semaphore with the same index in pWaitSemaphores
-	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
-	
-	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
+void Main::retireOitNodeBuffer(uint32_t frame) {
+	if (oitNodeBuffer.buffer == VK_NULL_HANDLE) {
+		return;
+	}
+	// The lists' sets are cached across frames.
+	for (DescriptorSetCache& cache : frameDescriptorCaches) {
+		cache.forgetBuffer(oitNodeBuffer.buffer);
+	}
+	retiredOitNodeBuffers[frame].push_back(oitNodeBuffer);
+	oitNodeBuffer = MeshBuffer(VK_NULL_HANDLE, VK_NULL_HANDLE, 0);
+}
 
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
-		throw std::runtime_error("failed to submit draw command buffer!");
+void Main::freeRetiredOitNodeBuffers(uint32_t frame) {
+	for (const MeshBuffer& retired : retiredOitNodeBuffers[frame]) {
+		vkDestroyBuffer(device, retired.buffer, nullptr);
+		vkFreeMemory(device, retired.memory, nullptr);
 	}
+	retiredOitNodeBuffers[frame].clear();
+}
 
-	VkPresentInfoKHR presentInfo{};
-	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-	presentInfo.waitSemaphoreCount = 1;
-	presentInfo.pWaitSemaphores = signalSemaphores;
+void Main::recordOitClearPass(VkCommandBuffer commandBuffer) {
+	// The fence of this frame was waited on, so the lists it recorded last time are complete. The count goes
+	// past the capacity by the nodes that didn't fit.
+	uint32_t* counters = static_cast<uint32_t*>(oitCounterBuffersMapped[currentFrame]);
+	uiState.oitNodeCapacity = oitNodeBuffer.count;
+	uiState.oitNodesUsed = std::min(counters[0], oitNodeBuffer.count);
+	uiState.oitNodesDropped = counters[0] - uiState.oitNodesUsed;
+	uiState.oitFragmentsTruncated = counters[1];
+
+	VkClearColorValue listEnd{};
+	listEnd.uint32[0] = OIT_LIST_END;
+	VkImageSubresourceRange range{};
+	range.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	range.levelCount = 1;
+	range.layerCount = 1;
+	vkCmdClearColorImage(commandBuffer, oitHeadImage.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &listEnd, 1, &range);
+	vkCmdFillBuffer(commandBuffer, oitCounterBuffers[currentFrame].buffer, 0, VK_WHOLE_SIZE, 0);
+}
 
-	VkSwapchainKHR swapChains[] = { swapChain };
-	presentInfo.swapchainCount = 1;
-	presentInfo.pSwapchains = swapChains;
-	presentInfo.pImageIndices = &imageIndex;
-	presentInfo.pResults = nullptr;
+bool Main::isHairCoreActive() const {
+	// The strands have no alpha map to cut a core from.
+	return uiState.transparencyOn && uiState.hairOpaqueCoreOn && !isStrandRendererActive();
+}
 
-	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+void Main::createHairQueryPool() {
+	if (!hairStatisticsSupported) {
+		return;
+	}
 
-	ui.updateWindows();
+	VkQueryPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	poolInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+	poolInfo.queryCount = HAIR_QUERY_COUNT * MAX_FRAMES_IN_FLIGHT;
+	poolInfo.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || camera->resized) {
-		camera->resized = false;
-		recreateSwapChain();
-	}
-	else if (result != VK_SUCCESS) {
-		throw std::runtime_error("failed to present swap chain image!");
+	if (vkCreateQueryPool(device, &poolInfo, nullptr, &hairQueryPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the hair query pool!");
 	}
 
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	// Read back before the first frames ran them, which only works once they were reset.
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	vkCmdResetQueryPool(commandBuffer, hairQueryPool, 0, poolInfo.queryCount);
+	endSingleTimeCommands(commandBuffer);
 }
 
-void Main::cleanupSwapChain() {
-	offscreenColorImage.destroy();
-	depthImage.destroy();
-	weightedColorImage.destroy();
-	weightedRevealImage.destroy();
-	downsampleImage.destroy();
-	ui.destroy();
-
-	// Destroy framebuffers.
-	for (VkFramebuffer fb : uiFramebuffers) {
-		vkDestroyFramebuffer(device, fb, nullptr);
+void Main::beginHairQuery(VkCommandBuffer commandBuffer, HairQuery query) {
+	if (hairStatisticsSupported) {
+		vkCmdBeginQuery(commandBuffer, hairQueryPool, currentFrame * HAIR_QUERY_COUNT + query, 0);
 	}
-	uiFramebuffers.clear();
-
-	for (size_t i = 0; i < swapChainFramebuffers.size(); i++) {
-		vkDestroyFramebuffer(device, swapChainFramebuffers[i], nullptr);
-	}
-	vkDestroyFramebuffer(device, opaqueObjectsFramebuffer, nullptr);
-	vkDestroyFramebuffer(device, transparentObjectsFramebuffer, nullptr);
+}
 
-	for (size_t i = 0; i < swapChainImageViews.size(); i++) {
-		swapChainImageViews[i].destroySwapchainView();
+void Main::endHairQuery(VkCommandBuffer commandBuffer, HairQuery query) {
+	if (hairStatisticsSupported) {
+		vkCmdEndQuery(commandBuffer, hairQueryPool, currentFrame * HAIR_QUERY_COUNT + query);
 	}
-
-	vkDestroySwapchainKHR(device, swapChain, nullptr);
-
-	descriptor.destroy();
 }
 
-void Main::recreateSwapChain() {
-	int width = 0, height = 0;
-	glfwGetFramebufferSize(window, &width, &height);
-	while (width == 0 || height == 0) {
-		glfwGetFramebufferSize(window, &width, &height);
-		glfwWaitEvents();
+void Main::readHairStatistics() {
+	if (!hairStatisticsSupported) {
+		return;
 	}
 
-	vkDeviceWaitIdle(device);
+	// The fence of this frame was waited on. Each count is followed by whether the frame ran its query, those
+	// it didn't run read as zero.
+	std::array<uint32_t, HAIR_QUERY_COUNT * 2> results{};
+	vkGetQueryPoolResults(device, hairQueryPool, currentFrame * HAIR_QUERY_COUNT, HAIR_QUERY_COUNT, sizeof(results), results.data(), 2 * sizeof(uint32_t), VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	auto invocations = [&](HairQuery query) {
+		return results[2 * query + 1] != 0 ? results[2 * query] : 0u;
+	};
+	uiState.hairPrepassFragments = invocations(HAIR_QUERY_PREPASS);
+	uiState.hairCoreFragments = invocations(HAIR_QUERY_CORE);
+	uiState.hairTransparentFragments = invocations(HAIR_QUERY_TRANSPARENT);
+	// Kept from the frames without the core, to compare with while it is on.
+	const bool ranTransparent = results[2 * HAIR_QUERY_TRANSPARENT + 1] != 0;
+	const bool ranCore = results[2 * HAIR_QUERY_CORE + 1] != 0;
+	if (ranTransparent && !ranCore && !isStrandRendererActive()) {
+		uiState.hairUnsplitFragments = uiState.hairTransparentFragments;
+	}
+}
 
-	cleanupSwapChain();
+void Main::recordTransparentHairDraw(VkCommandBuffer commandBuffer, const Pipeline& cardPipeline, const Pipeline& ribbonPipeline, VkDescriptorSet extraSet) {
+	// SET_OIT in linked list mode and SET_MOMENTS in moment mode, the third set either way.
+	static_assert(SET_OIT == SET_MOMENTS, "the OIT modes bind their sets at the same index");
+	auto bindSets = [&](const Pipeline& pipeline) {
+		bindGlobalDescriptorSet(commandBuffer, pipeline.layout);
+		if (extraSet != VK_NULL_HANDLE) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout, SET_OIT, 1, &extraSet, 0, nullptr);
+		}
+	};
 
-	createSwapChain();
-	createSwapchainImageViews();
-	createOffscreenImageResources();
-	createFramebuffers();
-	createDescriptor();
-	createUI();
-}
+	if (isStrandRendererActive()) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ribbonPipeline.pipeline);
+		// Its push constants differ from the other layouts, so the set bound in the opaque pass doesn't carry over.
+		bindSets(ribbonPipeline);
 
-uint32_t Main::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
-	VkPhysicalDeviceMemoryProperties memProperties;
-	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+		const StrandPushConstants constants = getStrandPushConstants();
+		vkCmdPushConstants(commandBuffer, ribbonPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(StrandPushConstants), &constants);
 
-	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-			return i;
-		}
+		// Two triangles per segment, one instance per visible strand. The cull pass wrote the instance count.
+		vkCmdDrawIndirect(commandBuffer, strandDrawBuffers[currentFrame].buffer, 0, 1, sizeof(VkDrawIndirectCommand));
+	}
+	else {
+		// Bind the vertex and index buffers
+		VkBuffer vertexBuffers[] = { getHairVertexBuffer() };
+		VkDeviceSize offsets[] = { 0 };
+		vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+		vkCmdBindIndexBuffer(commandBuffer, indices["hair"].buffer, 0, VK_INDEX_TYPE_UINT32);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, cardPipeline.pipeline);
+		bindSets(cardPipeline);
+		MeshPushConstants constants{};
+		constants.model = glm::mat4(1.0f);
+		vkCmdPushConstants(commandBuffer, cardPipeline.layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(MeshPushConstants), &constants);
+		// Draw all objects
+		recordIndexedDraw(commandBuffer, "hair");
 	}
+}
 
-	throw std::runtime_error("Failed to find suitable memory type!");
+bool Main::isMomentOitActive() const {
+	return uiState.transparencyOn && uiState.oitMode == OIT_MOMENTS;
 }
 
-void Main::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+void Main::createMomentSetLayout() {
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+	bindings[0].binding = BIND_MOMENTS_ZEROTH;
+	bindings[1].binding = BIND_MOMENTS;
+	bindings[2].binding = BIND_MOMENTS_EXTRA;
+	bindings[3].binding = BIND_MOMENTS_ACCUM;
+	for (VkDescriptorSetLayoutBinding& binding : bindings) {
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
 
-	VkBufferCopy copyRegion{};
-	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
 
-	endSingleTimeCommands(commandBuffer);
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &momentSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the moment descriptor set layout!");
+	}
 }
 
-void Main::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
-	VkBufferCreateInfo bufferInfo{};
-	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-	bufferInfo.size = size;
-	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+void Main::createMomentObjectsRenderPass() {
+	const bool resolving = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+	// The extra moments shift the attachments after them by one.
+	const uint32_t momentAttachments = momentCount > 4 ? 3 : 2;
+	const uint32_t accumAttachment = momentAttachments;
+	const uint32_t colorAttachment = momentAttachments + 1;
+	const uint32_t depthAttachment = momentAttachments + 2;
+	const uint32_t resolveAttachment = momentAttachments + 3;
 
-	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
-		throw std::runtime_error("failed to create buffer!");
-	}
+	momentObjectsRenderPass = RenderPass(&device);
+	// Add attachments
+	{
+		// The absorbance and the moments, summed by the generate subpass and read by the other two.
+		std::vector<VulkanImage*> momentImages = { &momentZerothImage, &momentImage };
+		if (momentCount > 4) {
+			momentImages.push_back(&momentExtraImage);
+		}
+		for (VulkanImage* image : momentImages) {
+			momentObjectsRenderPass.addAttachment(
+				image->format,
+				msaaSamples,
+				VK_ATTACHMENT_LOAD_OP_CLEAR,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+			);
+		}
+		// accumAttachment, the weighted colors the composite subpass reads.
+		momentObjectsRenderPass.addAttachment(
+			momentAccumImage.format,
+			msaaSamples,
+			VK_ATTACHMENT_LOAD_OP_CLEAR,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+		);
+		// colorAttachment
+		momentObjectsRenderPass.addAttachment(
+			offscreenColorImage.format,
+			msaaSamples,
+			VK_ATTACHMENT_LOAD_OP_LOAD,
+			resolving ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+		);
+		// depthAttachment, tested against by both draws of the hair.
+		momentObjectsRenderPass.addAttachment(
+			depthImage.format,
+			msaaSamples,
+			VK_ATTACHMENT_LOAD_OP_LOAD,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		);
+		if (resolving) {
+			// resolveAttachment
+			momentObjectsRenderPass.addAttachment(
+				downsampleImage.format,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_STORE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+			);
+		}
+	}
+
+	// Add subpasses
+	{
+		// Subpass 0, generating the moments.
+		AttachmentUsageMap generateUsageMap;
+		for (uint32_t i = 0; i < momentAttachments; i++) {
+			generateUsageMap.push_back({ i, AttachmentType::COLOR });
+		}
+		generateUsageMap.push_back({ depthAttachment, AttachmentType::DEPTH });
+		momentObjectsRenderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, generateUsageMap);
+
+		// Subpass 1, summing the colors weighted by the transmittance the moments give.
+		AttachmentUsageMap resolveUsageMap;
+		for (uint32_t i = 0; i < momentAttachments; i++) {
+			resolveUsageMap.push_back({ i, AttachmentType::INPUT });
+		}
+		resolveUsageMap.push_back({ accumAttachment, AttachmentType::COLOR });
+		resolveUsageMap.push_back({ depthAttachment, AttachmentType::DEPTH });
+		momentObjectsRenderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, resolveUsageMap);
+
+		// Subpass 2, compositing over the opaque color and resolving it as it ends.
+		AttachmentUsageMap compositeUsageMap = {
+			{0, AttachmentType::INPUT},
+			{accumAttachment, AttachmentType::INPUT},
+			{colorAttachment, AttachmentType::COLOR}
+		};
+		if (resolving) {
+			compositeUsageMap.push_back({ resolveAttachment, AttachmentType::RESOLVE });
+		}
+		momentObjectsRenderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, compositeUsageMap);
+	}
+
+	// Add dependencies
+	{
+		std::vector<VkSubpassDependency> subpassDependencies(4);
+		subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+		subpassDependencies[0].dstSubpass = 0;
+		subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		subpassDependencies[0].srcAccessMask = 0;
+		subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		// Each subpass reads what the one before it summed, in the same sample.
+		for (uint32_t i = 1; i <= 2; i++) {
+			subpassDependencies[i].srcSubpass = i - 1;
+			subpassDependencies[i].dstSubpass = i;
+			subpassDependencies[i].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+			subpassDependencies[i].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			subpassDependencies[i].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+			subpassDependencies[i].dstAccessMask = VK_ACCESS_INPUT_ATTACHMENT_READ_BIT;
+			subpassDependencies[i].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+		}
+
+		subpassDependencies[3].srcSubpass = 2;
+		subpassDependencies[3].dstSubpass = VK_SUBPASS_EXTERNAL;
+		subpassDependencies[3].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+		subpassDependencies[3].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		subpassDependencies[3].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		subpassDependencies[3].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		momentObjectsRenderPass.createRenderPass(subpassDependencies);
+	}
+}
+
+void Main::createMomentPipelines() {
+	// Pulls the moments towards those of a fixed distribution, which keeps the reconstruction stable where
+	// rounding left them barely valid. Half floats round far more, and every further pair of moments is
+	// more sensitive to it.
+	const char* biases[2][3] = {
+		{ "5e-4", "5e-3", "5e-2" },
+		{ "5e-7", "5e-6", "5e-5" }
+	};
+	// The single sample variants read their attachments as plain subpass inputs.
+	const std::string variant = std::to_string(momentCount) + (momentSinglePrecision ? "x32" : "x16") + (msaaSamples == VK_SAMPLE_COUNT_1_BIT ? "s" : "");
+	std::vector<std::string> defines = {
+		"NUM_MOMENTS " + std::to_string(momentCount),
+		std::string("MOMENT_BIAS ") + biases[momentSinglePrecision ? 1 : 0][(momentCount - 4) / 2]
+	};
+	if (msaaSamples == VK_SAMPLE_COUNT_1_BIT) {
+		defines.push_back("SINGLE_SAMPLE");
+	}
+	// Compiled the first time a moment count and precision are picked, there are too many of them to
+	// compile all up front.
+	auto momentShader = [&](const std::string& path, const std::string& name, const std::string& stage) {
+		const std::string key = name + variant;
+		if (shaders.find(key) == shaders.end()) {
+			std::vector<std::string> stageDefines = defines;
+			stageDefines.push_back(stage);
+			shaders[key] = readFile(compileShader(path, key, Shader::FRAGMENT, stageDefines));
+		}
+		return shaders[key];
+	};
+
+	// As for the weighted pipelines: both sides of the cards, tested against the opaque depth but not writing it.
+	VkPipelineRasterizationStateCreateInfo rasterizer{};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	VkPipelineDepthStencilStateCreateInfo depthStencil{};
+	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+	depthStencil.depthTestEnable = VK_TRUE;
+	depthStencil.depthWriteEnable = VK_FALSE;
+	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	depthStencil.minDepthBounds = 0.0f;
+	depthStencil.maxDepthBounds = 1.0f;
+
+	const VkColorComponentFlags colorFlags = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	// The moments and the weighted colors are plain sums.
+	VkPipelineColorBlendAttachmentState additiveBlendAttachment{};
+	additiveBlendAttachment.colorWriteMask = colorFlags;
+	additiveBlendAttachment.blendEnable = VK_TRUE;
+	additiveBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	additiveBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+	additiveBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	additiveBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	additiveBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+	additiveBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	const std::vector<VkPipelineColorBlendAttachmentState> generateBlendAttachments(momentCount > 4 ? 3 : 2, additiveBlendAttachment);
+
+	const std::vector<VkDescriptorSetLayout> setLayouts = { descriptor.descriptorSetLayout, bindlessDescriptor.descriptorSetLayout };
+	// The attachments are a third set for the subpasses reading them.
+	const std::vector<VkDescriptorSetLayout> momentSetLayouts = { descriptor.descriptorSetLayout, bindlessDescriptor.descriptorSetLayout, momentSetLayout };
+
+	// The hair is shaded once per pixel in both draws. The moments cover the whole pixel anyway, and the
+	// resolve would shade every sample again otherwise.
+	/* momentGenerateColorPipeline */
+	momentGenerateColorPipeline = Pipeline(&device, momentObjectsRenderPass);
+	momentGenerateColorPipeline.createPipelineLayout(setLayouts, sizeof(MeshPushConstants));
+	momentGenerateColorPipeline.createPipeline(
+		shaders["vertShader"],
+		momentShader("shaders/weightedColor.frag", "momentGenerateColor", "OIT_MOMENTS_GENERATE"),
+		false,
+		rasterizer,
+		msaaSamples,
+		depthStencil,
+		generateBlendAttachments,
+		0,
+		false
+	);
+
+	/* momentGenerateStrandPipeline */
+	momentGenerateStrandPipeline = Pipeline(&device, momentObjectsRenderPass);
+	momentGenerateStrandPipeline.createPipelineLayout(setLayouts, sizeof(StrandPushConstants), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	momentGenerateStrandPipeline.createPipeline(
+		shaders["strandVertShader"],
+		momentShader("shaders/strand.frag", "momentGenerateStrand", "OIT_MOMENTS_GENERATE"),
+		true,
+		rasterizer,
+		msaaSamples,
+		depthStencil,
+		generateBlendAttachments,
+		0,
+		false
+	);
+
+	/* momentResolveColorPipeline */
+	momentResolveColorPipeline = Pipeline(&device, momentObjectsRenderPass);
+	momentResolveColorPipeline.createPipelineLayout(momentSetLayouts, sizeof(MeshPushConstants));
+	momentResolveColorPipeline.createPipeline(
+		shaders["vertShader"],
+		momentShader("shaders/weightedColor.frag", "momentResolveColor", "OIT_MOMENTS_RESOLVE"),
+		false,
+		rasterizer,
+		msaaSamples,
+		depthStencil,
+		{ additiveBlendAttachment },
+		1,
+		false
+	);
+
+	/* momentResolveStrandPipeline */
+	momentResolveStrandPipeline = Pipeline(&device, momentObjectsRenderPass);
+	momentResolveStrandPipeline.createPipelineLayout(momentSetLayouts, sizeof(StrandPushConstants), VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT);
+	momentResolveStrandPipeline.createPipeline(
+		shaders["strandVertShader"],
+		momentShader("shaders/strand.frag", "momentResolveStrand", "OIT_MOMENTS_RESOLVE"),
+		true,
+		rasterizer,
+		msaaSamples,
+		depthStencil,
+		{ additiveBlendAttachment },
+		1,
+		false
+	);
+
+	/* momentCompositePipeline */
+	momentCompositePipeline = Pipeline(&device, momentObjectsRenderPass);
+	momentCompositePipeline.createPipelineLayout(momentSetLayouts, sizeof(MeshPushConstants));
+	// Normalized color and transmittance, blended like the WBOIT composite.
+	VkPipelineColorBlendAttachmentState compositeBlendAttachment{};
+	compositeBlendAttachment.colorWriteMask = colorFlags;
+	compositeBlendAttachment.blendEnable = VK_TRUE;
+	compositeBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	compositeBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	compositeBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+	compositeBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+	compositeBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+	compositeBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+	momentCompositePipeline.createPipeline(
+		shaders["triangleShader"],
+		shaders[msaaSamples != VK_SAMPLE_COUNT_1_BIT ? "momentCompositeFragShader" : "momentCompositeSingleSampleFragShader"],
+		true,
+		rasterizer,
+		msaaSamples,
+		depthStencil,
+		{ compositeBlendAttachment },
+		2
+	);
+}
+
+void Main::destroyMomentPipelines() {
+	momentGenerateColorPipeline.destroy();
+	momentGenerateStrandPipeline.destroy();
+	momentResolveColorPipeline.destroy();
+	momentResolveStrandPipeline.destroy();
+	momentCompositePipeline.destroy();
+}
+
+void Main::createMomentObjectsFramebuffer() {
+	std::vector<VkImageView> attachments = { momentZerothImage.view, momentImage.view };
+	if (momentCount > 4) {
+		attachments.push_back(momentExtraImage.view);
+	}
+	attachments.push_back(momentAccumImage.view);
+	attachments.push_back(offscreenColorImage.view);
+	attachments.push_back(depthImage.view);
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		attachments.push_back(downsampleImage.view);
+	}
+
+	VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	framebufferInfo.renderPass = momentObjectsRenderPass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+	framebufferInfo.pAttachments = attachments.data();
+	framebufferInfo.width = momentImage.width;
+	framebufferInfo.height = momentImage.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &momentObjectsFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create moment objects framebuffer!");
+	}
+}
+
+void Main::recordMomentObjectsRenderPass(VkCommandBuffer commandBuffer) {
+	allocatePassUniforms();
+
+	// The absorbance and the moments, and four half floats of weighted color, for every sample.
+	const uint32_t channelBytes = momentSinglePrecision ? 4 : 2;
+	uiState.momentBytesPerPixel = ((1 + momentCount) * channelBytes + 4 * 2) * static_cast<uint32_t>(msaaSamples);
+
+	VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	renderPassInfo.renderPass = momentObjectsRenderPass.renderPass;
+	renderPassInfo.framebuffer = momentObjectsFramebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent.width = momentImage.width;
+	renderPassInfo.renderArea.extent.height = momentImage.height;
+	// The sums start at zero, up to the weighted color. The attachments after it are loaded.
+	std::vector<VkClearValue> clearValues(momentCount > 4 ? 4 : 3);
+	for (VkClearValue& clearValue : clearValues) {
+		clearValue.color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	}
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(swapChainExtent.width);
+	viewport.height = static_cast<float>(swapChainExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	const VkDescriptorSet momentSet = frameDescriptorCaches[currentFrame].getSet(momentSetLayout, {
+		DescriptorWrite::forImage(BIND_MOMENTS_ZEROTH, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, momentZerothImage.view),
+		DescriptorWrite::forImage(BIND_MOMENTS, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, momentImage.view),
+		// Not read with four moments, but the set covers every binding.
+		DescriptorWrite::forImage(BIND_MOMENTS_EXTRA, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, momentCount > 4 ? momentExtraImage.view : momentImage.view),
+		DescriptorWrite::forImage(BIND_MOMENTS_ACCUM, VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, momentAccumImage.view)
+	});
+
+	// GENERATE PASS: the absorbance and moments of the hair.
+	recordTransparentHairDraw(commandBuffer, momentGenerateColorPipeline, momentGenerateStrandPipeline, VK_NULL_HANDLE);
+
+	// RESOLVE PASS: the hair again, weighted by what reaches the camera of it.
+	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+	// Counted as the OIT pass, the generate draw doesn't shade the hair.
+	beginHairQuery(commandBuffer, HAIR_QUERY_TRANSPARENT);
+	recordTransparentHairDraw(commandBuffer, momentResolveColorPipeline, momentResolveStrandPipeline, momentSet);
+	endHairQuery(commandBuffer, HAIR_QUERY_TRANSPARENT);
+
+	// COMPOSITE PASS
+	vkCmdNextSubpass(commandBuffer, VK_SUBPASS_CONTENTS_INLINE);
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, momentCompositePipeline.pipeline);
+	bindGlobalDescriptorSet(commandBuffer, momentCompositePipeline.layout);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, momentCompositePipeline.layout, SET_MOMENTS, 1, &momentSet, 0, nullptr);
+	// Draw a full-screen triangle
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void Main::applyMomentOitSettings() {
+	vkDeviceWaitIdle(device);
+
+	// The attachments change in number and format, and with them the transient memory plan and every
+	// framebuffer. The rest of the swapchain resources are rebuilt as on a resize.
+	cleanupSwapChain();
+	destroyMomentPipelines();
+	momentObjectsRenderPass.destroy();
+
+	momentCount = uiState.momentCount;
+	momentSinglePrecision = uiState.momentSinglePrecision && momentSinglePrecisionSupported;
+	uiState.momentSinglePrecision = momentSinglePrecision;
+	std::cout << "Moment OIT: " << momentCount << " moments, " << (momentSinglePrecision ? 32 : 16) << " bit.\n";
+
+	createSwapchainImageViews();
+	createOffscreenImageResources();
+	createMomentObjectsRenderPass();
+	createMomentPipelines();
+	createFramebuffers();
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		updateAttachmentDescriptors(i);
+	}
+}
+
+void Main::applyMsaaSettings() {
+	vkDeviceWaitIdle(device);
+
+	// Every attachment drawn into per sample changes, and with it the render passes, the pipelines built
+	// against them and the shaders that read the samples.
+	cleanupSwapChain();
+	destroyPipelines();
+	destroyRenderPasses();
+
+	msaaSampleCap = uiState.msaaSampleCap;
+	msaaSamples = getMaxUsableSampleCount();
+	std::cout << "MSAA: " << msaaSamples << " samples (cap " << msaaSampleCap << ").\n";
+
+	createSwapchainImageViews();
+	createOffscreenImageResources();
+	createRenderPasses();
+	createPipelines();
+	createFramebuffers();
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		updateAttachmentDescriptors(i);
+	}
+}
+
+void Main::createTimestampQueryPool() {
+	if (!gpuTimingSupported) {
+		return;
+	}
+
+	VkQueryPoolCreateInfo poolInfo = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO };
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = 2 * MAX_FRAMES_IN_FLIGHT;
+
+	if (vkCreateQueryPool(device, &poolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the timestamp query pool!");
+	}
+
+	// Read back before the first frames wrote them, like the hair queries.
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	vkCmdResetQueryPool(commandBuffer, timestampQueryPool, 0, poolInfo.queryCount);
+	endSingleTimeCommands(commandBuffer);
+}
+
+void Main::readFrameTimestamps(float frameSeconds) {
+	if (!gpuTimingSupported) {
+		// The time between frames, which the GPU bounds whenever it is the bottleneck.
+		uiState.gpuFrameMs = frameSeconds * 1000.0f;
+		return;
+	}
+
+	// The fence of this frame was waited on. Each timestamp is followed by whether it was written.
+	std::array<uint64_t, 4> results{};
+	vkGetQueryPoolResults(device, timestampQueryPool, currentFrame * 2, 2, sizeof(results), results.data(), 2 * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+	if (results[1] != 0 && results[3] != 0) {
+		uiState.gpuFrameMs = static_cast<float>(static_cast<double>(results[2] - results[0]) * timestampPeriod * 1e-6);
+	}
+}
+
+bool Main::isReducedTransparencyActive() const {
+	return uiState.transparencyOn && uiState.oitMode == OIT_WEIGHTED_BLENDED && uiState.transparentResolution != TRANSPARENT_FULL;
+}
+
+void Main::updateTransparentScale() {
+	switch (uiState.transparentResolution) {
+	case TRANSPARENT_HALF:
+		transparentScale = 0.5f;
+		break;
+	case TRANSPARENT_QUARTER:
+		transparentScale = 0.25f;
+		break;
+	case TRANSPARENT_DYNAMIC:
+		// A few percent per frame at most, so that the scale settles rather than following every spike. Only
+		// the hair gets cheaper with it, which a budget the rest of the frame already exceeds pins to the least.
+		if (uiState.gpuFrameMs > 0.0f) {
+			transparentScale *= std::pow(uiState.transparentBudgetMs / uiState.gpuFrameMs, 0.05f);
+		}
+		break;
+	default:
+		break;
+	}
+	transparentScale = std::clamp(transparentScale, MIN_TRANSPARENT_SCALE, MAX_TRANSPARENT_SCALE);
+	uiState.transparentScale = isReducedTransparencyActive() ? transparentScale : 1.0f;
+}
+
+VkExtent2D Main::getReducedTransparencyExtent() const {
+	return {
+		std::min(static_cast<uint32_t>(std::ceil(swapChainExtent.width * transparentScale)), lowResDepthImage.width),
+		std::min(static_cast<uint32_t>(std::ceil(swapChainExtent.height * transparentScale)), lowResDepthImage.height)
+	};
+}
+
+void Main::createReducedTransparencySetLayouts() {
+	// Both sample the full resolution depth, the upsample the reduced resolution images as well.
+	std::array<VkDescriptorSetLayoutBinding, 4> bindings{};
+	bindings[0].binding = BIND_FULL_DEPTH;
+	bindings[1].binding = BIND_LOW_RES_DEPTH;
+	bindings[2].binding = BIND_LOW_RES_COLOR;
+	bindings[3].binding = BIND_LOW_RES_REVEAL;
+	for (VkDescriptorSetLayoutBinding& binding : bindings) {
+		binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		binding.descriptorCount = 1;
+		binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &transparentDownsampleSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the transparent downsample descriptor set layout!");
+	}
+
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &transparentUpsampleSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the transparent upsample descriptor set layout!");
+	}
+}
+
+void Main::createReducedTransparencyRenderPasses() {
+	const bool resolving = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
+	// Sampled or tested against in the passes after each of them, which the frame graph orders.
+	VkSubpassDependency externalDependency{};
+	externalDependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+	externalDependency.dstSubpass = 0;
+	externalDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	externalDependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	externalDependency.srcAccessMask = 0;
+	externalDependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+	/* Depth downsample render pass */
+	transparentDepthDownsampleRenderPass = RenderPass(&device);
+	// Every texel drawn this frame is written, the rest isn't read.
+	transparentDepthDownsampleRenderPass.addAttachment(
+		lowResDepthImage.format,
+		VK_SAMPLE_COUNT_1_BIT,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		VK_ATTACHMENT_STORE_OP_STORE,
+		VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+		VK_ATTACHMENT_STORE_OP_DONT_CARE,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+	);
+	transparentDepthDownsampleRenderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, { {0, AttachmentType::DEPTH} });
+	transparentDepthDownsampleRenderPass.createRenderPass({ externalDependency });
+
+	/* Low resolution transparent objects render pass */
+	lowResTransparentRenderPass = RenderPass(&device);
+	// Add attachments
+	{
+		// lowResColorAttachment and lowResRevealAttachment, sampled by the upsample.
+		for (VulkanImage* image : { &lowResWeightedColorImage, &lowResWeightedRevealImage }) {
+			lowResTransparentRenderPass.addAttachment(
+				image->format,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_ATTACHMENT_LOAD_OP_CLEAR,
+				VK_ATTACHMENT_STORE_OP_STORE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+			);
+		}
+		// lowResDepthAttachment, tested against only. The upsample samples what the downsample stored.
+		lowResTransparentRenderPass.addAttachment(
+			lowResDepthImage.format,
+			VK_SAMPLE_COUNT_1_BIT,
+			VK_ATTACHMENT_LOAD_OP_LOAD,
+			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		);
+	}
+	lowResTransparentRenderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, {
+		{0, AttachmentType::COLOR},
+		{1, AttachmentType::COLOR},
+		{2, AttachmentType::DEPTH}
+	});
+	lowResTransparentRenderPass.createRenderPass({ externalDependency });
+
+	/* Transparent upsample render pass */
+	transparentUpsampleRenderPass = RenderPass(&device);
+	// Add attachments
+	{
+		// colorAttachment, composited over and resolved as the pass ends.
+		transparentUpsampleRenderPass.addAttachment(
+			offscreenColorImage.format,
+			msaaSamples,
+			VK_ATTACHMENT_LOAD_OP_LOAD,
+			resolving ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+		);
+		if (resolving) {
+			// resolveAttachment
+			transparentUpsampleRenderPass.addAttachment(
+				downsampleImage.format,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_STORE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+			);
+		}
+	}
+	AttachmentUsageMap upsampleUsageMap = { {0, AttachmentType::COLOR} };
+	if (resolving) {
+		upsampleUsageMap.push_back({ 1, AttachmentType::RESOLVE });
+	}
+	transparentUpsampleRenderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, upsampleUsageMap);
+	transparentUpsampleRenderPass.createRenderPass({ externalDependency });
+}
+
+void Main::createReducedTransparencyFramebuffers() {
+	VkFramebufferCreateInfo framebufferInfo = { VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO };
+	framebufferInfo.renderPass = transparentDepthDownsampleRenderPass.renderPass;
+	framebufferInfo.attachmentCount = 1;
+	framebufferInfo.pAttachments = &lowResDepthImage.view;
+	framebufferInfo.width = lowResDepthImage.width;
+	framebufferInfo.height = lowResDepthImage.height;
+	framebufferInfo.layers = 1;
+
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &transparentDepthDownsampleFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transparent depth downsample framebuffer!");
+	}
+
+	std::array<VkImageView, 3> lowResAttachments = { lowResWeightedColorImage.view, lowResWeightedRevealImage.view, lowResDepthImage.view };
+	framebufferInfo.renderPass = lowResTransparentRenderPass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(lowResAttachments.size());
+	framebufferInfo.pAttachments = lowResAttachments.data();
+
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &lowResTransparentFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create low res transparent framebuffer!");
+	}
+
+	std::vector<VkImageView> upsampleAttachments = { offscreenColorImage.view };
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		upsampleAttachments.push_back(downsampleImage.view);
+	}
+	framebufferInfo.renderPass = transparentUpsampleRenderPass.renderPass;
+	framebufferInfo.attachmentCount = static_cast<uint32_t>(upsampleAttachments.size());
+	framebufferInfo.pAttachments = upsampleAttachments.data();
+	framebufferInfo.width = offscreenColorImage.width;
+	framebufferInfo.height = offscreenColorImage.height;
+
+	if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &transparentUpsampleFramebuffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create transparent upsample framebuffer!");
+	}
+}
+
+void Main::recordTransparentDepthDownsamplePass(VkCommandBuffer commandBuffer) {
+	const VkExtent2D extent = getReducedTransparencyExtent();
+
+	VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	renderPassInfo.renderPass = transparentDepthDownsampleRenderPass.renderPass;
+	renderPassInfo.framebuffer = transparentDepthDownsampleFramebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = extent;
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, transparentDepthDownsamplePipeline.pipeline);
+	const VkDescriptorSet downsampleSet = frameDescriptorCaches[currentFrame].getSet(transparentDownsampleSetLayout, {
+		DescriptorWrite::forImage(BIND_FULL_DEPTH, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthImage.view, textureSampler)
+	});
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, transparentDepthDownsamplePipeline.layout, 0, 1, &downsampleSet, 0, nullptr);
+
+	const TransparentScalePushConstants constants{ glm::ivec2(extent.width, extent.height), transparentScale };
+	vkCmdPushConstants(commandBuffer, transparentDepthDownsamplePipeline.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TransparentScalePushConstants), &constants);
+	// Draw a full-screen triangle
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void Main::recordLowResTransparentObjectsRenderPass(VkCommandBuffer commandBuffer) {
+	allocatePassUniforms();
+
+	const VkExtent2D extent = getReducedTransparencyExtent();
+
+	VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	renderPassInfo.renderPass = lowResTransparentRenderPass.renderPass;
+	renderPassInfo.framebuffer = lowResTransparentFramebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = extent;
+	std::array<VkClearValue, 2> clearValues;
+	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 0.0f };
+	clearValues[1].color.float32[0] = 1.0f;
+	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
+	renderPassInfo.pClearValues = clearValues.data();
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	// The whole view, squeezed into the part of the images drawn this frame.
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(extent.width);
+	viewport.height = static_cast<float>(extent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = extent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	// The same weighted sums as the full resolution color subpass.
+	beginHairQuery(commandBuffer, HAIR_QUERY_TRANSPARENT);
+	recordTransparentHairDraw(commandBuffer, lowResWeightedColorPipeline, lowResStrandPipeline, VK_NULL_HANDLE);
+	endHairQuery(commandBuffer, HAIR_QUERY_TRANSPARENT);
+
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void Main::recordTransparentUpsamplePass(VkCommandBuffer commandBuffer) {
+	VkRenderPassBeginInfo renderPassInfo = { VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO };
+	renderPassInfo.renderPass = transparentUpsampleRenderPass.renderPass;
+	renderPassInfo.framebuffer = transparentUpsampleFramebuffer;
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent.width = offscreenColorImage.width;
+	renderPassInfo.renderArea.extent.height = offscreenColorImage.height;
+
+	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = static_cast<float>(swapChainExtent.width);
+	viewport.height = static_cast<float>(swapChainExtent.height);
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = { 0, 0 };
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, transparentUpsamplePipeline.pipeline);
+	const VkDescriptorSet upsampleSet = frameDescriptorCaches[currentFrame].getSet(transparentUpsampleSetLayout, {
+		DescriptorWrite::forImage(BIND_FULL_DEPTH, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, depthImage.view, textureSampler),
+		DescriptorWrite::forImage(BIND_LOW_RES_DEPTH, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, lowResDepthImage.view, textureSampler),
+		DescriptorWrite::forImage(BIND_LOW_RES_COLOR, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, lowResWeightedColorImage.view, textureSampler),
+		DescriptorWrite::forImage(BIND_LOW_RES_REVEAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, lowResWeightedRevealImage.view, textureSampler)
+	});
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, transparentUpsamplePipeline.layout, 0, 1, &upsampleSet, 0, nullptr);
+
+	const VkExtent2D extent = getReducedTransparencyExtent();
+	const TransparentScalePushConstants constants{ glm::ivec2(extent.width, extent.height), transparentScale };
+	vkCmdPushConstants(commandBuffer, transparentUpsamplePipeline.layout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(TransparentScalePushConstants), &constants);
+	// Draw a full-screen triangle
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
+	vkCmdEndRenderPass(commandBuffer);
+}
+
+void Main::recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
+	VkCommandBufferBeginInfo beginInfo{};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = 0; 
+	beginInfo.pInheritanceInfo = nullptr; 
+
+	if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS) {
+		throw std::runtime_error("failed to begin recording command buffer!");
+	}
+
+	// TODO: Draw envmap and everything related
+
+	// Read back after the fence of the frame, before it was recorded again.
+	if (hairStatisticsSupported) {
+		vkCmdResetQueryPool(commandBuffer, hairQueryPool, currentFrame * HAIR_QUERY_COUNT, HAIR_QUERY_COUNT);
+	}
+	if (gpuTimingSupported) {
+		vkCmdResetQueryPool(commandBuffer, timestampQueryPool, currentFrame * 2, 2);
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2);
+	}
+
+	// The passes record their commands only, the frame graph derives the barriers between them.
+	declareFrameGraph(imageIndex, false);
+	frameGraph.compile();
+	if (uiState.dumpFrameGraph) {
+		uiState.dumpFrameGraph = false;
+		frameGraph.dumpSchedule(std::cout);
+	}
+	frameGraph.execute(commandBuffer);
+
+	if (gpuTimingSupported) {
+		vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, currentFrame * 2 + 1);
+	}
+
+	if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to record command buffer!");
+	}
+}
+
+void Main::declareFrameGraph(uint32_t imageIndex, bool planning) {
+	RenderGraph& graph = frameGraph;
+	graph.reset();
+
+	const RenderGraphResource offscreenColor = graph.addTransientImage("offscreen color", &offscreenColorImage);
+	const RenderGraphResource depth = graph.addTransientImage("depth", &depthImage);
+	const RenderGraphResource weightedColor = graph.addTransientImage("weighted color", &weightedColorImage);
+	const RenderGraphResource weightedReveal = graph.addTransientImage("weighted reveal", &weightedRevealImage);
+	// Without MSAA the passes draw the frame into the offscreen color directly.
+	const bool resolving = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+	const RenderGraphResource presentSource = resolving ? graph.addTransientImage("resolved color", &downsampleImage) : offscreenColor;
+	// Acquired with its content undefined. The submit waits for it at the color attachment output stage.
+	const RenderGraphResource swapchain = graph.importImage("swapchain", swapChainImages[imageIndex], VK_IMAGE_ASPECT_COLOR_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+	graph.setOutput(swapchain, ResourceUsage::Present);
+
+	RenderGraphResource hairVertices = 0;
+	RenderGraphResource strandRender = 0;
+	RenderGraphResource strandVisible = 0;
+	RenderGraphResource strandDraw = 0;
+	RenderGraphResource meshDraws = 0;
+	if (!planning) {
+		const RenderGraphResource strandPositions = graph.importBuffer("strand positions", strandPositionBuffer.buffer);
+		const RenderGraphResource strandVelocities = graph.importBuffer("strand velocities", strandVelocityBuffer.buffer);
+		hairVertices = graph.importBuffer("hair vertices", gpuHairVertexBuffer.buffer);
+		strandRender = graph.importBuffer("strand render", strandRenderBuffers[currentFrame].buffer);
+		strandVisible = graph.importBuffer("visible strands", strandVisibleBuffers[currentFrame].buffer);
+		strandDraw = graph.importBuffer("strand draw", strandDrawBuffers[currentFrame].buffer);
+		meshDraws = graph.importBuffer("mesh draws", meshDrawBuffers[currentFrame].buffer);
+
+		// Simulate the hair on the GPU. The strand state is read again next frame.
+		if (gpuSimulationActive) {
+			const RenderGraphPass simulation = graph.addPass("hair simulation", [this](VkCommandBuffer cmd) {
+				recordHairSimulationPass(cmd, gpuSimulationSteps);
+			});
+			graph.read(simulation, strandPositions, ResourceUsage::ComputeStorage);
+			graph.write(simulation, strandPositions, ResourceUsage::ComputeStorage);
+			graph.read(simulation, strandVelocities, ResourceUsage::ComputeStorage);
+			graph.write(simulation, strandVelocities, ResourceUsage::ComputeStorage);
+			graph.write(simulation, hairVertices, ResourceUsage::ComputeStorage);
+			graph.setSideEffects(simulation);
+		}
+
+		// Pick the strands the transparent pass draws. Both passes are culled when it doesn't draw strands.
+		if (uiState.strandRendererOn && hairSimulation.strands.numStrands > 0) {
+			if (gpuSimulationActive) {
+				const RenderGraphPass copy = graph.addPass("strand render copy", [this](VkCommandBuffer cmd) {
+					recordStrandRenderCopy(cmd);
+				});
+				graph.read(copy, strandPositions, ResourceUsage::TransferSource);
+				graph.write(copy, strandRender, ResourceUsage::TransferDestination);
+			}
+
+			const RenderGraphPass strandCull = graph.addPass("strand cull", [this](VkCommandBuffer cmd) {
+				recordStrandCullPass(cmd);
+			});
+			graph.read(strandCull, strandRender, ResourceUsage::ComputeStorage);
+			graph.write(strandCull, strandVisible, ResourceUsage::ComputeStorage);
+			graph.write(strandCull, strandDraw, ResourceUsage::ComputeStorage);
+		}
+
+		// And the clusters of the meshes, culled when the draws don't go through them.
+		if (uiState.gpuCullingOn && (cmdDrawIndexedIndirectCount != nullptr || multiDrawIndirectSupported)) {
+			const RenderGraphPass meshCull = graph.addPass("mesh cull", [this](VkCommandBuffer cmd) {
+				recordMeshCullPass(cmd);
+			});
+			graph.write(meshCull, meshDraws, ResourceUsage::ComputeStorage);
+		}
+	}
+
+	// Draw opaque objects.
+	const RenderGraphPass opaque = graph.addPass("opaque objects", [this](VkCommandBuffer cmd) {
+		recordOpaqueObjectsRenderPass(cmd);
+	});
+	graph.write(opaque, offscreenColor, ResourceUsage::ColorAttachment);
+	graph.write(opaque, depth, ResourceUsage::DepthAttachment);
+	if (resolving && !planning && !uiState.transparencyOn) {
+		graph.write(opaque, presentSource, ResourceUsage::ColorAttachment);
+	}
+	if (!planning) {
+		if (isMeshCullingActive()) {
+			graph.read(opaque, meshDraws, ResourceUsage::IndirectCommand);
+		}
+		if (gpuSimulationActive && (!uiState.transparencyOn || isHairCoreActive())) {
+			graph.read(opaque, hairVertices, ResourceUsage::VertexInput);
+		}
+	}
+
+	// Empty the linked lists. Planned whenever the device can draw them, so that their heads get memory.
+	const bool linkedList = planning ? linkedListOitSupported : isLinkedListOitActive();
+	RenderGraphResource oitHeads = 0;
+	RenderGraphResource oitNodes = 0;
+	RenderGraphResource oitCounters = 0;
+	if (linkedList) {
+		oitHeads = graph.addTransientImage("oit heads", &oitHeadImage);
+		const RenderGraphPass oitClear = graph.addPass("oit clear", [this](VkCommandBuffer cmd) {
+			recordOitClearPass(cmd);
+		});
+		graph.write(oitClear, oitHeads, ResourceUsage::TransferDestination);
+		if (!planning) {
+			oitNodes = graph.importBuffer("oit nodes", oitNodeBuffer.buffer);
+			oitCounters = graph.importBuffer("oit counters", oitCounterBuffers[currentFrame].buffer);
+			graph.write(oitClear, oitCounters, ResourceUsage::TransferDestination);
+			// Read back once the frame's fence signaled.
+			graph.setOutput(oitCounters, ResourceUsage::HostRead);
+		}
+	}
+
+	// What a pass drawing the transparent hair reads of the strands or cards.
+	auto declareHairDraw = [&](RenderGraphPass pass) {
+		if (!planning) {
+			if (isStrandRendererActive()) {
+				graph.read(pass, strandRender, ResourceUsage::VertexShaderStorage);
+				graph.read(pass, strandVisible, ResourceUsage::VertexShaderStorage);
+				graph.read(pass, strandDraw, ResourceUsage::IndirectCommand);
+			}
+			else if (gpuSimulationActive) {
+				graph.read(pass, hairVertices, ResourceUsage::VertexInput);
+			}
+			if (isMeshCullingActive()) {
+				graph.read(pass, meshDraws, ResourceUsage::IndirectCommand);
+			}
+		}
+	};
+	// And what a pass drawing it over the opaque objects at full resolution reads and writes, whichever OIT
+	// mode it draws in.
+	auto declareTransparentHair = [&](RenderGraphPass pass) {
+		graph.read(pass, offscreenColor, ResourceUsage::ColorAttachment);
+		graph.write(pass, offscreenColor, ResourceUsage::ColorAttachment);
+		graph.read(pass, depth, ResourceUsage::DepthAttachment);
+		if (resolving) {
+			graph.write(pass, presentSource, ResourceUsage::ColorAttachment);
+		}
+		declareHairDraw(pass);
+	};
+
+	// Draw transparent objects. Moment OIT and the reduced resolution have render passes of their own, all are
+	// planned so that their attachments, which live in one of them only, can share memory.
+	const bool moments = !planning && isMomentOitActive();
+	const bool reduced = !planning && isReducedTransparencyActive();
+	if (planning || (uiState.transparencyOn && !moments && !reduced)) {
+		const RenderGraphPass transparent = graph.addPass("transparent objects", [this](VkCommandBuffer cmd) {
+			recordTransparentObjectsRenderPass(cmd);
+		});
+		// The lists are appended to in the color subpass and sorted in the composite one.
+		if (linkedList) {
+			graph.read(transparent, oitHeads, ResourceUsage::FragmentShaderStorage);
+			graph.write(transparent, oitHeads, ResourceUsage::FragmentShaderStorage);
+			if (!planning) {
+				graph.write(transparent, oitNodes, ResourceUsage::FragmentShaderStorage);
+				graph.read(transparent, oitNodes, ResourceUsage::FragmentShaderStorage);
+				graph.read(transparent, oitCounters, ResourceUsage::FragmentShaderStorage);
+				graph.write(transparent, oitCounters, ResourceUsage::FragmentShaderStorage);
+			}
+		}
+		// The composite subpass reads the weighted images, the render pass orders that itself.
+		graph.write(transparent, weightedColor, ResourceUsage::ColorAttachment);
+		graph.write(transparent, weightedReveal, ResourceUsage::ColorAttachment);
+		declareTransparentHair(transparent);
+	}
+	if (planning || moments) {
+		const RenderGraphPass momentTransparent = graph.addPass("moment transparent objects", [this](VkCommandBuffer cmd) {
+			recordMomentObjectsRenderPass(cmd);
+		});
+		// Written and read back within the render pass, like the weighted images.
+		graph.write(momentTransparent, graph.addTransientImage("moment zeroth", &momentZerothImage), ResourceUsage::ColorAttachment);
+		graph.write(momentTransparent, graph.addTransientImage("moments", &momentImage), ResourceUsage::ColorAttachment);
+		if (momentCount > 4) {
+			graph.write(momentTransparent, graph.addTransientImage("extra moments", &momentExtraImage), ResourceUsage::ColorAttachment);
+		}
+		graph.write(momentTransparent, graph.addTransientImage("moment accum", &momentAccumImage), ResourceUsage::ColorAttachment);
+		declareTransparentHair(momentTransparent);
+	}
+	if (planning || reduced) {
+		const RenderGraphResource lowResDepth = graph.addTransientImage("low res depth", &lowResDepthImage);
+		const RenderGraphResource lowResColor = graph.addTransientImage("low res weighted color", &lowResWeightedColorImage);
+		const RenderGraphResource lowResReveal = graph.addTransientImage("low res weighted reveal", &lowResWeightedRevealImage);
+
+		const RenderGraphPass downsample = graph.addPass("transparent depth downsample", [this](VkCommandBuffer cmd) {
+			recordTransparentDepthDownsamplePass(cmd);
+		});
+		graph.read(downsample, depth, ResourceUsage::FragmentShaderSampled);
+		graph.write(downsample, lowResDepth, ResourceUsage::DepthAttachment);
+
+		const RenderGraphPass lowResTransparent = graph.addPass("low res transparent objects", [this](VkCommandBuffer cmd) {
+			recordLowResTransparentObjectsRenderPass(cmd);
+		});
+		graph.write(lowResTransparent, lowResColor, ResourceUsage::ColorAttachment);
+		graph.write(lowResTransparent, lowResReveal, ResourceUsage::ColorAttachment);
+		// Tested against only, but stored again for the upsample.
+		graph.read(lowResTransparent, lowResDepth, ResourceUsage::DepthAttachment);
+		graph.write(lowResTransparent, lowResDepth, ResourceUsage::DepthAttachment);
+		declareHairDraw(lowResTransparent);
+
+		const RenderGraphPass upsample = graph.addPass("transparent upsample", [this](VkCommandBuffer cmd) {
+			recordTransparentUpsamplePass(cmd);
+		});
+		graph.read(upsample, depth, ResourceUsage::FragmentShaderSampled);
+		graph.read(upsample, lowResDepth, ResourceUsage::FragmentShaderSampled);
+		graph.read(upsample, lowResColor, ResourceUsage::FragmentShaderSampled);
+		graph.read(upsample, lowResReveal, ResourceUsage::FragmentShaderSampled);
+		graph.read(upsample, offscreenColor, ResourceUsage::ColorAttachment);
+		graph.write(upsample, offscreenColor, ResourceUsage::ColorAttachment);
+		if (resolving) {
+			graph.write(upsample, presentSource, ResourceUsage::ColorAttachment);
+		}
+	}
+
+	// Copy the frame to the swapchain and draw UI over it.
+	const RenderGraphPass ui = graph.addPass("ui", [this, imageIndex](VkCommandBuffer cmd) {
+		recordUIRenderPass(cmd, imageIndex);
+	});
+	graph.read(ui, presentSource, ResourceUsage::FragmentShaderSampled);
+	graph.write(ui, swapchain, ResourceUsage::ColorAttachment);
+}
+
+void Main::createSyncObjects() {
+	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
+	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	retiredSwapChains.resize(MAX_FRAMES_IN_FLIGHT);
+
+	VkSemaphoreCreateInfo semaphoreInfo{};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+	VkFenceCreateInfo fenceInfo{};
+	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
+			vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
+			vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS) {
+
+			throw std::runtime_error("failed to create synchronization objects for a frame!");
+		}
+	}
+}
+
+void Main::drawFrame(ImGuiIO& io) {
+	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+	// The fence covers every submission before it, so what was retired while this frame was the last one
+	// submitted is no longer read by any frame.
+	freeRetiredSwapChain(currentFrame);
+	freeRetiredOitNodeBuffers(currentFrame);
+	if (frameAttachmentsStale[currentFrame]) {
+		updateAttachmentDescriptors(currentFrame);
+	}
+
+	uint32_t imageIndex;
+	VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		// Nothing was submitted this time, the frame before is the last one that may use the old resources.
+		recreateSwapChain((currentFrame + MAX_FRAMES_IN_FLIGHT - 1) % MAX_FRAMES_IN_FLIGHT);
+		return;
+	}
+	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+		throw std::runtime_error("failed to acquire swap chain image!");
+	}
+
+	vkResetFences(device, 1, &inFlightFences[currentFrame]);
+	vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+
+	ui.drawNewFrame(uiState);
+
+	const double now = glfwGetTime();
+	const float frameSeconds = static_cast<float>(now - lastFrameTime);
+	lastFrameTime = now;
+
+	// The worker has finished the steps dispatched last frame, so the simulation is ours until the next dispatch.
+	simulationScheduler.sync();
+
+	if (uiState.checkGpuParity) {
+		uiState.checkGpuParity = false;
+		checkSimulationParity();
+	}
+
+	if (uiState.checkDeterminism) {
+		uiState.checkDeterminism = false;
+		checkSimulationDeterminism();
+	}
+
+	if (uiState.benchmarkCache) {
+		uiState.benchmarkCache = false;
+		benchmarkSimulationCache();
+	}
+
+	updateSimulationLod();
+
+	// Move the strand state to wherever the solver runs now.
+	if (uiState.gpuSimulationOn != gpuSimulationActive) {
+		vkDeviceWaitIdle(device);
+		if (uiState.gpuSimulationOn) {
+			uploadStrandState(hairSimulation.strands);
+		}
+		else {
+			downloadStrandState(hairSimulation.strands);
+			simulationScheduler.resetState();
+		}
+		gpuSimulationActive = uiState.gpuSimulationOn;
+	}
+
+	updateSimulationCache();
+
+	const uint32_t numSteps = simulationScheduler.advanceClock(uiState.simulationOn ? frameSeconds : 0.0f);
+	if (gpuSimulationActive) {
+		gpuSimulationSteps = numSteps;
+	}
+	else if (cacheReader.isOpen()) {
+		// The solver sits idle while a cached shot plays.
+		playSimulationCache(uiState.simulationOn ? frameSeconds : 0.0f);
+		if (isStrandRendererActive()) {
+			updateStrandRenderBuffer(currentFrame);
+		}
+		else {
+			updateHairVertexBuffer(currentFrame);
+		}
+	}
+	else {
+		// The strands are drawn straight from the guides, without deforming the cards.
+		if (isStrandRendererActive()) {
+			updateStrandRenderBuffer(currentFrame);
+		}
+		else {
+			updateHairVertexBuffer(currentFrame);
+		}
+		// The hair shown now was simulated towards the head pose of the last dispatch.
+		renderHeadTransform = headTransform;
+		// The head runs on simulated time, so the roots move exactly as far as the steps about to run.
+		if (uiState.headAnimationOn && numSteps > 0) {
+			updateHeadAnimation(static_cast<float>(numSteps) * simulationScheduler.getFixedDt());
+		}
+		// Overlaps with recording and submitting this frame, the result is shown in the next one.
+		hairSimulation.settings.enableVolume = uiState.hairVolumeOn;
+		hairSimulation.settings.deterministic = uiState.deterministicOn;
+		hairSimulation.settings.forces = uiState.forces;
+		simulationScheduler.dispatch(numSteps);
+	}
+
+	updateCharacterInstanceBuffer(currentFrame);
+	// The fence above was waited on, so the GPU is done with this frame's uniforms.
+	uniformArena.beginFrame(currentFrame);
+	// The cached sets are kept from frame to frame, they are only dropped when what they bind is recreated.
+	frameDescriptorCaches[currentFrame].resetStats();
+	if (isLinkedListOitActive()) {
+		updateOitNodeBuffer();
+	}
+	if (isMomentOitActive() && (uiState.momentCount != momentCount || uiState.momentSinglePrecision != momentSinglePrecision)) {
+		applyMomentOitSettings();
+	}
+	if (uiState.msaaSampleCap != msaaSampleCap) {
+		applyMsaaSettings();
+	}
+	readHairStatistics();
+	readFrameTimestamps(frameSeconds);
+	updateTransparentScale();
+
+	recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+
+	uiState.uniformBytesUsed = static_cast<uint32_t>(uniformArena.getFrameUsage());
+	uiState.uniformBytesPeak = static_cast<uint32_t>(uniformArena.getPeakUsage());
+	updateDescriptorStats();
+
+	VkSubmitInfo submitInfo{};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+	// Each entry in the waitStages array corresponds to the semaphore with the same index in pWaitSemaphores
+	VkSemaphore waitSemaphores[] = { imageAvailableSemaphores[currentFrame] };
+	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
+	submitInfo.waitSemaphoreCount = 1;
+	submitInfo.pWaitSemaphores = waitSemaphores;
+	submitInfo.pWaitDstStageMask = waitStages;
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
+	
+	VkSemaphore signalSemaphores[] = { renderFinishedSemaphores[currentFrame] };
+	submitInfo.signalSemaphoreCount = 1;
+	submitInfo.pSignalSemaphores = signalSemaphores;
+
+	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS) {
+		throw std::runtime_error("failed to submit draw command buffer!");
+	}
+
+	VkPresentInfoKHR presentInfo{};
+	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+	presentInfo.waitSemaphoreCount = 1;
+	presentInfo.pWaitSemaphores = signalSemaphores;
+
+	VkSwapchainKHR swapChains[] = { swapChain };
+	presentInfo.swapchainCount = 1;
+	presentInfo.pSwapchains = swapChains;
+	presentInfo.pImageIndices = &imageIndex;
+	presentInfo.pResults = nullptr;
+
+	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+
+	ui.updateWindows();
+
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || camera->resized) {
+		camera->resized = false;
+		recreateSwapChain(currentFrame);
+	}
+	else if (result != VK_SUCCESS) {
+		throw std::runtime_error("failed to present swap chain image!");
+	}
+
+	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+}
+
+void Main::cleanupSwapChain() {
+	retireSwapChain(currentFrame);
+	for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		freeRetiredSwapChain(i);
+		freeRetiredOitNodeBuffers(i);
+	}
+}
+
+void Main::retireSwapChain(uint32_t frame) {
+	RetiredSwapChain& retired = retiredSwapChains[frame];
+
+	std::vector<VulkanImage*> images = {
+		&offscreenColorImage, &depthImage, &weightedColorImage, &weightedRevealImage,
+		&momentZerothImage, &momentImage, &momentAccumImage,
+		&lowResDepthImage, &lowResWeightedColorImage, &lowResWeightedRevealImage
+	};
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		images.push_back(&downsampleImage);
+	}
+	if (linkedListOitSupported) {
+		images.push_back(&oitHeadImage);
+	}
+	if (momentCount > 4) {
+		images.push_back(&momentExtraImage);
+	}
+	for (VulkanImage* image : images) {
+		retired.images.push_back(*image);
+	}
+	// Sized to the window, the next frame in linked list mode creates it anew.
+	retireOitNodeBuffer(frame);
+	retired.memory.insert(retired.memory.end(), transientImageMemory.begin(), transientImageMemory.end());
+	transientImageMemory.clear();
+
+	retired.framebuffers.insert(retired.framebuffers.end(), uiFramebuffers.begin(), uiFramebuffers.end());
+	uiFramebuffers.clear();
+	retired.framebuffers.push_back(opaqueObjectsFramebuffer);
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		retired.framebuffers.push_back(opaqueResolveFramebuffer);
+	}
+	retired.framebuffers.push_back(transparentObjectsFramebuffer);
+	retired.framebuffers.push_back(momentObjectsFramebuffer);
+	retired.framebuffers.push_back(transparentDepthDownsampleFramebuffer);
+	retired.framebuffers.push_back(lowResTransparentFramebuffer);
+	retired.framebuffers.push_back(transparentUpsampleFramebuffer);
+
+	retired.swapChainViews.insert(retired.swapChainViews.end(), swapChainImageViews.begin(), swapChainImageViews.end());
+	swapChainImageViews.clear();
+
+	// Every frame's sets point at the retired views until the frame is out of flight again.
+	std::fill(frameAttachmentsStale.begin(), frameAttachmentsStale.end(), true);
+}
+
+void Main::freeRetiredSwapChain(uint32_t frame) {
+	RetiredSwapChain& retired = retiredSwapChains[frame];
+	for (VkFramebuffer framebuffer : retired.framebuffers) {
+		vkDestroyFramebuffer(device, framebuffer, nullptr);
+	}
+	for (VulkanImage& view : retired.swapChainViews) {
+		view.destroySwapchainView();
+	}
+	for (VulkanImage& image : retired.images) {
+		image.destroy();
+	}
+	for (VkDeviceMemory memory : retired.memory) {
+		vkFreeMemory(device, memory, nullptr);
+	}
+	for (VkSwapchainKHR retiredSwapChain : retired.swapChains) {
+		vkDestroySwapchainKHR(device, retiredSwapChain, nullptr);
+	}
+	retired = RetiredSwapChain();
+}
+
+void Main::recreateSwapChain(uint32_t retireFrame) {
+	int width = 0, height = 0;
+	glfwGetFramebufferSize(window, &width, &height);
+	while (width == 0 || height == 0) {
+		glfwGetFramebufferSize(window, &width, &height);
+		glfwWaitEvents();
+	}
+
+	// Only what depends on the size is rebuilt. The descriptor sets, pipelines and ImGui stay, which
+	// keeps a live resize from stalling on shader and pool creation. The frames in flight still draw into
+	// the old resources, so they are retired rather than destroyed.
+	retireSwapChain(retireFrame);
+
+	const VkFormat oldFormat = swapChainImageFormat;
+	const uint32_t oldImageCount = imageCount;
+	const VkSwapchainKHR oldSwapChain = swapChain;
+	createSwapChain();
+	retiredSwapChains[retireFrame].swapChains.push_back(oldSwapChain);
+	// The UI render pass, and the pipelines built against it, are made for the old format. Rare enough to
+	// wait for: ImGui destroys its pipeline at once when it is pointed at the new pass.
+	if (swapChainImageFormat != oldFormat) {
+		vkDeviceWaitIdle(device);
+		presentPipeline.destroy();
+		uiRenderPass.destroy();
+		createUIRenderPass();
+		createPresentPipeline();
+		ui.setRenderPass(uiRenderPass.renderPass);
+	}
+	createSwapchainImageViews();
+	createOffscreenImageResources();
+	createFramebuffers();
+	if (imageCount != oldImageCount) {
+		ui.setMinImageCount(imageCount);
+	}
+}
+
+uint32_t Main::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return i;
+		}
+	}
+
+	throw std::runtime_error("Failed to find suitable memory type!");
+}
+
+bool Main::hasMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) {
+	VkPhysicalDeviceMemoryProperties memProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+
+	for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
+		if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Main::copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+	VkBufferCopy copyRegion{};
+	copyRegion.size = size;
+	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+
+	endSingleTimeCommands(commandBuffer);
+}
+
+void Main::writeBuffer(VkBuffer buffer, const void* data, VkDeviceSize size) {
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* mapped;
+	vkMapMemory(device, stagingBufferMemory, 0, size, 0, &mapped);
+	memcpy(mapped, data, (size_t)size);
+	vkUnmapMemory(device, stagingBufferMemory);
+
+	copyBuffer(stagingBuffer, buffer, size);
+
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+void Main::readBuffer(VkBuffer buffer, void* data, VkDeviceSize size) {
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	copyBuffer(buffer, stagingBuffer, size);
+
+	void* mapped;
+	vkMapMemory(device, stagingBufferMemory, 0, size, 0, &mapped);
+	memcpy(data, mapped, (size_t)size);
+	vkUnmapMemory(device, stagingBufferMemory);
+
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	vkFreeMemory(device, stagingBufferMemory, nullptr);
+}
+
+MeshBuffer Main::createStorageBuffer(const void* data, VkDeviceSize size, uint32_t count, VkBufferUsageFlags usage) {
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	createBuffer(size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+	writeBuffer(buffer, data, size);
+
+	return MeshBuffer(buffer, memory, count);
+}
+
+void Main::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+	VkBufferCreateInfo bufferInfo{};
+	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+	bufferInfo.size = size;
+	bufferInfo.usage = usage;
+	bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+	if (vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create buffer!");
+	}
 
 	VkMemoryRequirements memRequirements;
 	vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
@@ -1324,62 +3684,904 @@ MeshBuffer Main::createVertexBuffer(std::vector<Vertex> vertices) {
 	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
 	copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
 
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	vkFreeMemory(device, stagingBufferMemory, nullptr);
+
+	return MeshBuffer(vertexBuffer, vertexBufferMemory, vertices.size());
+}
+
+MeshBuffer Main::createIndexBuffer(std::vector<uint32_t> indices) {
+	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, indices.data(), (size_t)bufferSize);
+	vkUnmapMemory(device, stagingBufferMemory);
+
+	VkBuffer indexBuffer;
+	VkDeviceMemory indexBufferMemory;
+	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+
+	copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+
+	vkDestroyBuffer(device, stagingBuffer, nullptr);
+	vkFreeMemory(device, stagingBufferMemory, nullptr);
+
+	return MeshBuffer(indexBuffer, indexBufferMemory, indices.size());
+}
+
+void Main::createVertexAndIndexBuffers() {
+	for (auto& pair : models) {
+		const auto curVertices = pair.second.first;
+		const auto curIndices = pair.second.second;
+		// The hair vertices live in the per-frame hair vertex buffers.
+		if (pair.first != "hair") {
+			vertices[pair.first] = createVertexBuffer(curVertices);
+		}
+		indices[pair.first] = createIndexBuffer(curIndices);
+	}
+}
+
+void Main::createHairVertexBuffers() {
+	const auto& hairVertices = models.at("hair").first;
+	VkDeviceSize bufferSize = sizeof(Vertex) * hairVertices.size();
+
+	hairVertexBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	hairVertexBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		hairVertexBuffers[i] = MeshBuffer(buffer, memory, static_cast<uint32_t>(hairVertices.size()));
+
+		// Only the positions and normals are rewritten every frame, the other attributes are filled in once here.
+		vkMapMemory(device, memory, 0, bufferSize, 0, &hairVertexBuffersMapped[i]);
+		memcpy(hairVertexBuffersMapped[i], hairVertices.data(), (size_t)bufferSize);
+	}
+}
+
+void Main::updateHairVertexBuffer(uint32_t currentImage) {
+	Vertex* out = static_cast<Vertex*>(hairVertexBuffersMapped[currentImage]);
+	// The hair clusters of the frame follow the same guides as its cards, in world space.
+	PackedMeshCluster* hairClusters = static_cast<PackedMeshCluster*>(meshClusterBuffersMapped[currentImage]) + meshClusterRanges.at("hair").firstCluster;
+	if (cacheReader.isOpen()) {
+		// Caches hold every guide.
+		// They hold no head pose either, the hair plays back as recorded.
+		followHairLods[0].deform(playbackStrands, {}, out, threadPool);
+		if (isMeshCullingActive()) {
+			followHairLods[0].refitClusters(playbackStrands, hairClusters, threadPool);
+		}
+	}
+	else {
+		// The root frames are still those the shown strands were simulated towards, the head animation
+		// moves them on after this.
+		followHairLods[simulationLodLevel].deform(simulationScheduler.renderStrands, rootAttachment.rotations, out, threadPool);
+		if (isMeshCullingActive()) {
+			followHairLods[simulationLodLevel].refitClusters(simulationScheduler.renderStrands, hairClusters, threadPool);
+		}
+	}
+}
+
+VkBuffer Main::getHairVertexBuffer() {
+	return gpuSimulationActive ? gpuHairVertexBuffer.buffer : hairVertexBuffers[currentFrame].buffer;
+}
+
+void Main::createStrandRenderBuffers() {
+	const GuideStrands& strands = hairSimulation.strands;
+	const uint32_t numVertices = std::max(strands.numVertices(), 1u);
+	VkDeviceSize bufferSize = sizeof(glm::vec4) * numVertices;
+
+	strandRenderBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	strandRenderBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		// Written by the CPU, or copied from the GPU solver's positions.
+		createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		strandRenderBuffers[i] = MeshBuffer(buffer, memory, numVertices);
+
+		vkMapMemory(device, memory, 0, bufferSize, 0, &strandRenderBuffersMapped[i]);
+		memset(strandRenderBuffersMapped[i], 0, (size_t)bufferSize);
+	}
+
+	// Rounding the children per guide adds at most half a strand per guide, hence the extra one.
+	const uint32_t maxInstances = std::max(strands.numStrands, 1u) * (MAX_STRANDS_PER_GUIDE + 1);
+	const VkDeviceSize visibleSize = sizeof(glm::uvec2) * maxInstances;
+	strandVisibleBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	strandDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	strandDrawBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		createBuffer(visibleSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer, memory);
+		strandVisibleBuffers[i] = MeshBuffer(buffer, memory, maxInstances);
+
+		// Host visible, so the CPU resets the draw and reads back how many strands were drawn.
+		createBuffer(sizeof(VkDrawIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		strandDrawBuffers[i] = MeshBuffer(buffer, memory, 1);
+
+		vkMapMemory(device, memory, 0, sizeof(VkDrawIndirectCommand), 0, &strandDrawBuffersMapped[i]);
+		memset(strandDrawBuffersMapped[i], 0, sizeof(VkDrawIndirectCommand));
+	}
+
+	// Children spread over the mean distance from a root to its closest neighbour.
+	const uint32_t n = strands.verticesPerStrand;
+	double spacing = 0.0;
+	for (uint32_t s = 0; s < strands.numStrands; s++) {
+		float closest = std::numeric_limits<float>::max();
+		for (uint32_t r = 0; r < strands.numStrands; r++) {
+			if (r != s) {
+				closest = std::min(closest, glm::length(strands.restPositions[r * n] - strands.restPositions[s * n]));
+			}
+		}
+		spacing += strands.numStrands > 1 ? closest : 0.0f;
+	}
+	strandChildRadius = static_cast<float>(spacing / std::max(strands.numStrands, 1u));
+
+	// The cards are coloured by the albedo texture, the strands by its average over the covered texels.
+	// The texture is sampled as sRGB, so it is averaged in linear space.
+	const auto albedo = textures.find("hair_albedo");
+	if (albedo != textures.end() && albedo->second.pixels != nullptr) {
+		const Image& image = albedo->second;
+		double sum[3] = { 0.0, 0.0, 0.0 };
+		double weight = 0.0;
+		for (size_t i = 0; i < static_cast<size_t>(image.width) * image.height; i++) {
+			const stbi_uc* texel = image.pixels + 4 * i;
+			const double alpha = texel[3] / 255.0;
+			for (int c = 0; c < 3; c++) {
+				sum[c] += alpha * std::pow(texel[c] / 255.0, 2.2);
+			}
+			weight += alpha;
+		}
+		if (weight > 0.0) {
+			strandColor = glm::vec3(sum[0] / weight, sum[1] / weight, sum[2] / weight);
+		}
+	}
+}
+
+void Main::updateStrandRenderBuffer(uint32_t currentImage) {
+	glm::vec4* out = static_cast<glm::vec4*>(strandRenderBuffersMapped[currentImage]);
+	const uint32_t n = hairSimulation.strands.verticesPerStrand;
+
+	// Caches hold every guide, the solver only moves the active ones.
+	const GuideStrands& source = cacheReader.isOpen() ? playbackStrands : simulationScheduler.renderStrands;
+	const std::vector<uint32_t>* active = cacheReader.isOpen() ? nullptr : &hairSimulation.getActiveStrands();
+	const uint32_t count = active != nullptr ? static_cast<uint32_t>(active->size()) : source.numStrands;
+
+	threadPool.parallelFor(count, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t k = begin; k < end; k++) {
+			const uint32_t s = active != nullptr ? (*active)[k] : k;
+			for (uint32_t i = 0; i < n; i++) {
+				out[k * n + i] = glm::vec4(source.position(s * n + i), 1.0f);
+			}
+		}
+	});
+	strandRenderGuides = count;
+}
+
+void Main::recordStrandRenderCopy(VkCommandBuffer commandBuffer) {
+	const VkDeviceSize size = sizeof(glm::vec4) * hairSimulation.strands.numVertices();
+	if (size == 0) {
+		return;
+	}
+
+	// The GPU simulates every guide, so the buffer is copied as is.
+	VkBufferCopy region{};
+	region.size = size;
+	vkCmdCopyBuffer(commandBuffer, strandPositionBuffer.buffer, strandRenderBuffers[currentFrame].buffer, 1, &region);
+
+	strandRenderGuides = hairSimulation.strands.numStrands;
+}
+
+bool Main::isStrandRendererActive() const {
+	// The ribbons are drawn in the weighted color subpass, without transparency the cards are used.
+	return uiState.strandRendererOn && uiState.transparencyOn && hairSimulation.strands.numStrands > 0;
+}
+
+StrandPushConstants Main::getStrandPushConstants() {
+	const uint32_t numStrands = hairSimulation.strands.numStrands;
+	const uint32_t guides = std::max(strandRenderGuides, 1u);
+	// Under the simulation LOD fewer guides grow more children each, so the hair stays as dense.
+	const float stride = static_cast<float>(numStrands) / static_cast<float>(guides);
+	const uint32_t maxChildren = strandVisibleBuffers[currentFrame].count / guides;
+
+	StrandPushConstants constants{};
+	constants.color = glm::vec4(strandColor, uiState.strandOpacity);
+	constants.verticesPerStrand = hairSimulation.strands.verticesPerStrand;
+	constants.childrenPerGuide = std::clamp(static_cast<uint32_t>(std::lround(uiState.strandsPerGuide * stride)), 1u, maxChildren);
+	constants.rootWidth = uiState.strandRootWidth;
+	constants.tipWidth = uiState.strandTipWidth;
+	constants.childRadius = strandChildRadius * std::sqrt(stride);
+	// At reduced resolution the ribbons are as wide in pixels of the smaller images.
+	constants.viewportHeight = static_cast<float>(isReducedTransparencyActive() ? getReducedTransparencyExtent().height : swapChainExtent.height);
+
+	return constants;
+}
+
+void Main::createStrandCullDescriptor() {
+	strandCullDescriptor = Descriptor(
+		&device,
+		0, // numUniformBuffers
+		0, // numTextureBuffers
+		0, // numInputBuffers
+		4 // numStorageBuffers
+	);
+
+	std::vector<VkBuffer> strandBuffers, visibleBuffers, drawBuffers, instanceBuffers;
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		strandBuffers.push_back(strandRenderBuffers[i].buffer);
+		visibleBuffers.push_back(strandVisibleBuffers[i].buffer);
+		drawBuffers.push_back(strandDrawBuffers[i].buffer);
+		instanceBuffers.push_back(characterInstanceBuffers[i].buffer);
+	}
+
+	strandCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_CULL_STRAND_POSITIONS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		strandBuffers
+	);
+	strandCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_CULL_VISIBLE_STRANDS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		visibleBuffers
+	);
+	strandCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_CULL_DRAW_COMMAND,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		drawBuffers
+	);
+	strandCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_CULL_CHARACTERS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		instanceBuffers
+	);
+
+	strandCullDescriptor.create(descriptorAllocator);
+}
+
+void Main::recordStrandCullPass(VkCommandBuffer commandBuffer) {
+	const StrandPushConstants strand = getStrandPushConstants();
+
+	// The fence of this frame was waited on, so the draw it recorded last time has finished.
+	// Its instance count is how many strands survived the LOD then.
+	// More than the visible list holds were left out.
+	VkDrawIndirectCommand* draw = static_cast<VkDrawIndirectCommand*>(strandDrawBuffersMapped[currentFrame]);
+	const uint32_t characters = getCharacterCount();
+	uiState.strandsDrawn = std::min(draw->instanceCount, strandVisibleBuffers[currentFrame].count);
+	uiState.strandsDropped = draw->instanceCount - uiState.strandsDrawn;
+	uiState.strandInstances = strandRenderGuides * strand.childrenPerGuide * characters;
+	draw->vertexCount = (strand.verticesPerStrand - 1) * 6;
+	draw->instanceCount = 0;
+	draw->firstVertex = 0;
+	draw->firstInstance = 0;
+
+	StrandCullPushConstants constants{};
+	constants.viewProj = camera->proj * camera->view;
+	constants.verticesPerStrand = strand.verticesPerStrand;
+	constants.childrenPerGuide = strand.childrenPerGuide;
+	constants.numGuides = strandRenderGuides;
+	constants.rootWidth = strand.rootWidth;
+	// proj[1][1] is 1 / zoomFactor under the orthographic zoom and 1 / tan(fov / 2) under a perspective projection.
+	constants.pixelsPerUnit = 0.5f * std::abs(camera->proj[1][1]) * static_cast<float>(swapChainExtent.height);
+	constants.fullDetailPixels = uiState.strandLodPixels;
+	// Without the LOD every strand is kept at its own width.
+	constants.minKeepFraction = uiState.strandLodOn ? uiState.strandLodMinFraction : 1.0f;
+	// Children spread up to the child radius on either axis across the guide, the widest ribbon adds half its width.
+	constants.margin = std::sqrt(2.0f) * strand.childRadius + 0.5f * strand.rootWidth / constants.minKeepFraction;
+
+	// The guides of every character of the crowd, one character per row of workgroups.
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, strandCullPipeline.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, strandCullPipeline.layout, 0, 1, &strandCullDescriptor.descriptorSets[currentFrame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, strandCullPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (constants.numGuides + STRAND_WORKGROUP_SIZE - 1) / STRAND_WORKGROUP_SIZE, characters, 1);
+}
+
+void Main::createMeshClusters() {
+	// The hair clusters are refit around the simulated guides every frame the CPU deforms the cards. While
+	// the GPU simulates, the CPU has no guides to refit to and these stand in: built around the rest pose,
+	// its vertices can't move further from it than twice the longest guide in the frame of the head, the
+	// rest is a margin for roots catching up.
+	const GuideStrands& strands = hairSimulation.strands;
+	float longestGuide = 0.0f;
+	for (uint32_t s = 0; s < strands.numStrands; s++) {
+		float length = 0.0f;
+		for (uint32_t i = 1; i < strands.verticesPerStrand; i++) {
+			length += strands.restLength[s * strands.verticesPerStrand + i];
+		}
+		longestGuide = std::max(longestGuide, length);
+	}
+	const float hairMargin = 2.2f * longestGuide;
+
+	std::vector<PackedMeshCluster> packed;
+	uint32_t slot = 0;
+	for (const std::string name : { "head", "hair" }) {
+		std::vector<MeshCluster> clusters = meshClusters.at(name);
+		if (name == "hair") {
+			for (MeshCluster& cluster : clusters) {
+				cluster.radius += hairMargin;
+				// The cards are simulated and drawn double sided, so their normals say nothing.
+				cluster.coneCutoff = 2.0f;
+			}
+		}
+
+		meshClusterRanges[name] = { static_cast<uint32_t>(packed.size()), static_cast<uint32_t>(clusters.size()), slot++ };
+		for (const MeshCluster& cluster : clusters) {
+			packed.push_back(packMeshCluster(cluster));
+		}
+	}
+
+	for (FollowHair& followHair : followHairLods) {
+		followHair.bindClusters(models.at("hair").second, meshClusters.at("hair"));
+	}
+	const MeshClusterRange& hairRange = meshClusterRanges.at("hair");
+	restHairClusters.assign(packed.begin() + hairRange.firstCluster, packed.begin() + hairRange.firstCluster + hairRange.numClusters);
+
+	const uint32_t numClusters = static_cast<uint32_t>(packed.size());
+	if (packed.empty()) {
+		packed.push_back({});
+	}
+	const VkDeviceSize clusterSize = sizeof(PackedMeshCluster) * packed.size();
+	meshClusterBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	meshClusterBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		// Host visible, the hair clusters are rewritten every frame.
+		createBuffer(clusterSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		meshClusterBuffers[i] = MeshBuffer(buffer, memory, numClusters);
+
+		vkMapMemory(device, memory, 0, clusterSize, 0, &meshClusterBuffersMapped[i]);
+		memcpy(meshClusterBuffersMapped[i], packed.data(), (size_t)clusterSize);
+	}
+
+	// Every cluster may be drawn once for each character of the largest crowd.
+	const uint32_t numDraws = numClusters * MAX_CHARACTER_INSTANCES;
+	const VkDeviceSize drawSize = sizeof(uint32_t) * MAX_CULLED_MESHES + sizeof(VkDrawIndexedIndirectCommand) * std::max(numDraws, 1u);
+	meshDrawBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	meshDrawBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	meshCullViewBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	meshCullViewBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		// Host visible, so the CPU clears the draws and reads back how many clusters were drawn.
+		createBuffer(drawSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		meshDrawBuffers[i] = MeshBuffer(buffer, memory, numDraws);
+
+		vkMapMemory(device, memory, 0, drawSize, 0, &meshDrawBuffersMapped[i]);
+		memset(meshDrawBuffersMapped[i], 0, (size_t)drawSize);
+
+		createBuffer(sizeof(MeshCullView), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		meshCullViewBuffers[i] = MeshBuffer(buffer, memory, 1);
+		vkMapMemory(device, memory, 0, sizeof(MeshCullView), 0, &meshCullViewBuffersMapped[i]);
+	}
+}
+
+void Main::createMeshCullDescriptor() {
+	meshCullDescriptor = Descriptor(
+		&device,
+		0, // numUniformBuffers
+		0, // numTextureBuffers
+		0, // numInputBuffers
+		4 // numStorageBuffers
+	);
+
+	std::vector<VkBuffer> clusterBuffers, drawBuffers, viewBuffers, instanceBuffers;
+	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		clusterBuffers.push_back(meshClusterBuffers[i].buffer);
+		drawBuffers.push_back(meshDrawBuffers[i].buffer);
+		viewBuffers.push_back(meshCullViewBuffers[i].buffer);
+		instanceBuffers.push_back(characterInstanceBuffers[i].buffer);
+	}
+
+	meshCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_MESH_CLUSTERS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		clusterBuffers
+	);
+	meshCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_MESH_DRAWS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		drawBuffers
+	);
+	meshCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_MESH_CULL_VIEW,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		viewBuffers
+	);
+	meshCullDescriptor.addDescriptorSetLayoutBinding(
+		BIND_MESH_CULL_CHARACTERS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		instanceBuffers
+	);
+
+	meshCullDescriptor.create(descriptorAllocator);
+}
+
+bool Main::isMeshCullingActive() const {
+	// Without either, drawing every cluster would need one draw call each. A crowd's draws start at the
+	// instance of their character.
+	return uiState.gpuCullingOn && (cmdDrawIndexedIndirectCount != nullptr || multiDrawIndirectSupported)
+		&& (getCharacterCount() == 1 || drawIndirectFirstInstanceSupported);
+}
+
+void Main::recordMeshCullPass(VkCommandBuffer commandBuffer) {
+	// The fence of this frame was waited on, so the draws recorded with this buffer have finished.
+	uint32_t* counts = static_cast<uint32_t*>(meshDrawBuffersMapped[currentFrame]);
+	const uint32_t characters = getCharacterCount();
+	uiState.clustersDrawn = 0;
+	uiState.clustersTotal = 0;
+	for (const auto& pair : meshClusterRanges) {
+		uiState.clustersDrawn += counts[pair.second.slot];
+		uiState.clustersTotal += pair.second.numClusters * characters;
+	}
+	memset(counts, 0, sizeof(uint32_t) * MAX_CULLED_MESHES);
+	// Without the draw count every draw of the characters is issued, those not kept must draw nothing.
+	if (cmdDrawIndexedIndirectCount == nullptr) {
+		VkDrawIndexedIndirectCommand* draws = reinterpret_cast<VkDrawIndexedIndirectCommand*>(counts + MAX_CULLED_MESHES);
+		for (const auto& pair : meshClusterRanges) {
+			memset(draws + getFirstMeshDraw(pair.second), 0, sizeof(VkDrawIndexedIndirectCommand) * pair.second.numClusters * characters);
+		}
+	}
+
+	// An orthographic projection keeps w at 1.
+	const bool orthographic = camera->proj[3][3] == 1.0f;
+	const std::array<glm::vec4, 6> planes = computeFrustumPlanes(camera->proj * camera->view);
+	MeshCullView* view = static_cast<MeshCullView*>(meshCullViewBuffersMapped[currentFrame]);
+	std::copy(planes.begin(), planes.end(), view->frustumPlanes);
+	view->camera = orthographic
+		? glm::vec4(-glm::vec3(camera->view[0][2], camera->view[1][2], camera->view[2][2]), 0.0f)
+		: glm::vec4(camera->position, 1.0f);
+
+	// Without the guides on the CPU, the hair clusters fall back to those around the rest pose.
+	if (gpuSimulationActive) {
+		PackedMeshCluster* clusters = static_cast<PackedMeshCluster*>(meshClusterBuffersMapped[currentFrame]);
+		std::copy(restHairClusters.begin(), restHairClusters.end(), clusters + meshClusterRanges.at("hair").firstCluster);
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshCullPipeline.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshCullPipeline.layout, 0, 1, &meshCullDescriptor.descriptorSets[currentFrame], 0, nullptr);
+
+	for (const auto& pair : meshClusterRanges) {
+		if (pair.second.numClusters == 0) {
+			continue;
+		}
+
+		MeshCullPushConstants constants{};
+		// The head moves as a whole. The hair clusters were refit where the simulation put the cards,
+		// unless they are the rest pose ones, which move with the head.
+		const bool refitHair = pair.first == "hair" && !gpuSimulationActive;
+		constants.model = refitHair ? glm::mat4(1.0f) : renderHeadTransform;
+		constants.firstCluster = pair.second.firstCluster;
+		constants.numClusters = pair.second.numClusters;
+		constants.firstDraw = getFirstMeshDraw(pair.second);
+		constants.slot = pair.second.slot;
+		constants.flags = MESH_CULL_CONES | (orthographic ? MESH_CULL_ORTHOGRAPHIC : 0);
+
+		// The clusters of every character of the crowd, one character per row of workgroups.
+		vkCmdPushConstants(commandBuffer, meshCullPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		vkCmdDispatch(commandBuffer, (constants.numClusters + STRAND_WORKGROUP_SIZE - 1) / STRAND_WORKGROUP_SIZE, characters, 1);
+	}
+}
+
+uint32_t Main::getFirstMeshDraw(const MeshClusterRange& range) const {
+	return range.firstCluster * MAX_CHARACTER_INSTANCES;
+}
+
+void Main::createSimulationBuffers() {
+	const GuideStrands& strands = hairSimulation.strands;
+	const uint32_t numVertices = std::max(strands.numVertices(), 1u);
+
+	// Positions and velocities are uploaded whenever the GPU takes over the simulation.
+	std::vector<glm::vec4> zeros(numVertices, glm::vec4(0.0f));
+	strandPositionBuffer = createStorageBuffer(zeros.data(), sizeof(glm::vec4) * numVertices, numVertices);
+	strandVelocityBuffer = createStorageBuffer(zeros.data(), sizeof(glm::vec4) * numVertices, numVertices);
+
+	std::vector<glm::vec4> rest(numVertices, glm::vec4(0.0f));
+	for (uint32_t i = 0; i < strands.numVertices(); i++) {
+		rest[i] = glm::vec4(strands.restPositions[i], strands.restLength[i]);
+	}
+	strandRestBuffer = createStorageBuffer(rest.data(), sizeof(glm::vec4) * numVertices, numVertices);
+
+	// The GPU simulates every guide, so it always uses the full detail binding.
+	std::vector<PackedFollowHairBinding> bindings = followHairLods[0].packBindings();
+	if (bindings.empty()) {
+		bindings.push_back({});
+	}
+	followHairBuffer = createStorageBuffer(bindings.data(), sizeof(PackedFollowHairBinding) * bindings.size(), static_cast<uint32_t>(bindings.size()));
+
+	const auto& hairVertices = models.at("hair").first;
+	gpuHairVertexBuffer = createStorageBuffer(hairVertices.data(), sizeof(Vertex) * hairVertices.size(), static_cast<uint32_t>(hairVertices.size()), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+}
+
+void Main::createComputeDescriptor() {
+	computeDescriptor = Descriptor(
+		&device,
+		0, // numUniformBuffers
+		0, // numTextureBuffers
+		0, // numInputBuffers
+		5 // numStorageBuffers
+	);
+
+	computeDescriptor.addDescriptorSetLayoutBinding(
+		BIND_STRAND_POSITIONS,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		{ strandPositionBuffer.buffer }
+	);
+	computeDescriptor.addDescriptorSetLayoutBinding(
+		BIND_STRAND_VELOCITIES,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		{ strandVelocityBuffer.buffer }
+	);
+	computeDescriptor.addDescriptorSetLayoutBinding(
+		BIND_STRAND_REST,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		{ strandRestBuffer.buffer }
+	);
+	computeDescriptor.addDescriptorSetLayoutBinding(
+		BIND_FOLLOW_HAIR,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		{ followHairBuffer.buffer }
+	);
+	computeDescriptor.addDescriptorSetLayoutBinding(
+		BIND_HAIR_VERTICES,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_SHADER_STAGE_COMPUTE_BIT,
+		{ gpuHairVertexBuffer.buffer }
+	);
+
+	computeDescriptor.create(descriptorAllocator);
+}
+
+void Main::createComputePipelines() {
+	strandSimulationPipeline = ComputePipeline(&device);
+	strandSimulationPipeline.createPipelineLayout(&computeDescriptor.descriptorSetLayout, sizeof(SimulationPushConstants));
+	strandSimulationPipeline.createPipeline(shaders["strandSimulationCompShader"]);
+
+	followHairPipeline = ComputePipeline(&device);
+	followHairPipeline.createPipelineLayout(&computeDescriptor.descriptorSetLayout, sizeof(SimulationPushConstants));
+	followHairPipeline.createPipeline(shaders["followHairCompShader"]);
+
+	strandCullPipeline = ComputePipeline(&device);
+	strandCullPipeline.createPipelineLayout(&strandCullDescriptor.descriptorSetLayout, sizeof(StrandCullPushConstants));
+	strandCullPipeline.createPipeline(shaders["strandCullCompShader"]);
+
+	meshCullPipeline = ComputePipeline(&device);
+	meshCullPipeline.createPipelineLayout(&meshCullDescriptor.descriptorSetLayout, sizeof(MeshCullPushConstants));
+	meshCullPipeline.createPipeline(shaders["meshCullCompShader"]);
+}
+
+void Main::uploadStrandState(const GuideStrands& strands) {
+	if (strands.numVertices() == 0) {
+		return;
+	}
+
+	std::vector<glm::vec4> positions(strands.numVertices());
+	std::vector<glm::vec4> velocities(strands.numVertices());
+	for (uint32_t i = 0; i < strands.numVertices(); i++) {
+		positions[i] = glm::vec4(strands.position(i), strands.invMass[i]);
+		velocities[i] = glm::vec4(strands.velX[i], strands.velY[i], strands.velZ[i], 0.0f);
+	}
+
+	writeBuffer(strandPositionBuffer.buffer, positions.data(), sizeof(glm::vec4) * positions.size());
+	writeBuffer(strandVelocityBuffer.buffer, velocities.data(), sizeof(glm::vec4) * velocities.size());
+}
+
+void Main::downloadStrandState(GuideStrands& strands) {
+	if (strands.numVertices() == 0) {
+		return;
+	}
+
+	std::vector<glm::vec4> positions(strands.numVertices());
+	std::vector<glm::vec4> velocities(strands.numVertices());
+	readBuffer(strandPositionBuffer.buffer, positions.data(), sizeof(glm::vec4) * positions.size());
+	readBuffer(strandVelocityBuffer.buffer, velocities.data(), sizeof(glm::vec4) * velocities.size());
+
+	for (uint32_t i = 0; i < strands.numVertices(); i++) {
+		strands.setPosition(i, glm::vec3(positions[i]));
+		strands.velX[i] = velocities[i].x;
+		strands.velY[i] = velocities[i].y;
+		strands.velZ[i] = velocities[i].z;
+	}
+}
+
+SimulationPushConstants Main::getSimulationPushConstants(float dt, uint32_t substeps) {
+	const SimulationSettings& settings = hairSimulation.settings;
+
+	SimulationPushConstants constants{};
+	constants.gravity = glm::vec4(settings.gravity, 1.0f - settings.getSubstepVelocityKeep(substeps));
+	constants.dt = dt;
+	constants.shapeStiffness = settings.getIterationShapeStiffness(substeps);
+	constants.numStrands = hairSimulation.strands.numStrands;
+	constants.verticesPerStrand = hairSimulation.strands.verticesPerStrand;
+	constants.constraintIterations = settings.constraintIterations;
+	constants.numHairVertices = followHairLods[0].size();
+	constants.vertexStride = sizeof(Vertex) / sizeof(float);
+
+	return constants;
+}
+
+void Main::recordHairSimulationPass(VkCommandBuffer commandBuffer, uint32_t numSteps) {
+	// The GPU always runs the most detailed level, substeps included.
+	const uint32_t substeps = std::max(simulationLod.getLevels()[0].substeps, 1u);
+	numSteps *= substeps;
+	const SimulationPushConstants constants = getSimulationPushConstants(simulationScheduler.getFixedDt() / substeps, substeps);
+	if (constants.numStrands == 0 || constants.numHairVertices == 0) {
+		return;
+	}
+
+	// The frame graph ordered the pass after the previous frame's uses of the strand state and hair vertices,
+	// the barriers between its own dispatches are up to it.
+	VkMemoryBarrier computeBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+	computeBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	computeBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+	if (numSteps > 0) {
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, strandSimulationPipeline.pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, strandSimulationPipeline.layout, 0, 1, &computeDescriptor.descriptorSets[currentFrame], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, strandSimulationPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+		for (uint32_t i = 0; i < numSteps; i++) {
+			// Every step reads what the previous one wrote.
+			if (i > 0) {
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &computeBarrier, 0, nullptr, 0, nullptr);
+			}
+			vkCmdDispatch(commandBuffer, (constants.numStrands + STRAND_WORKGROUP_SIZE - 1) / STRAND_WORKGROUP_SIZE, 1, 1);
+		}
+
+		// Follow hair reads the positions the solver just wrote.
+		VkBufferMemoryBarrier positionBarrier{ VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER };
+		positionBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		positionBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		positionBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		positionBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		positionBarrier.buffer = strandPositionBuffer.buffer;
+		positionBarrier.offset = 0;
+		positionBarrier.size = VK_WHOLE_SIZE;
+
+		vkCmdPipelineBarrier(commandBuffer,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			0,
+			0, nullptr,
+			1, &positionBarrier,
+			0, nullptr);
+	}
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, followHairPipeline.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, followHairPipeline.layout, 0, 1, &computeDescriptor.descriptorSets[currentFrame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, followHairPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	vkCmdDispatch(commandBuffer, (constants.numHairVertices + STRAND_WORKGROUP_SIZE - 1) / STRAND_WORKGROUP_SIZE, 1, 1);
+}
+
+void Main::checkSimulationParity() {
+	const uint32_t numSteps = 120;
+	// In the units of the model. The default is a lot smaller than the width of a hair card.
+	const float tolerance = uiState.gpuParityTolerance;
+
+	if (hairSimulation.strands.numStrands == 0) {
+		return;
+	}
+
+	vkDeviceWaitIdle(device);
 
-	return MeshBuffer(vertexBuffer, vertexBufferMemory, vertices.size());
-}
+	// Keep whatever the GPU is simulating right now.
+	GuideStrands current = hairSimulation.strands;
+	if (gpuSimulationActive) {
+		downloadStrandState(current);
+	}
 
-MeshBuffer Main::createIndexBuffer(std::vector<uint32_t> indices) {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	// The GPU solver has neither the hair volume nor the force fields, so the reference runs without them too.
+	HairSimulation reference = hairSimulation;
+	reference.settings.enableVolume = false;
+	reference.settings.forces = ForceFieldSettings();
+	// Compare at the level the GPU runs.
+	const uint32_t substeps = std::max(simulationLod.getLevels()[0].substeps, 1u);
+	reference.settings.substeps = substeps;
+	reference.setActiveStrands(simulationLod.selectStrands(0, reference.strands.numStrands));
+	// Nor does it move or turn the roots: it pins them where they are and keeps the rest shape unrotated. The
+	// reference starts from and stays at the rest frames, whatever pose the head animation left.
+	const uint32_t n = reference.strands.verticesPerStrand;
+	std::vector<glm::vec3> restRoots(reference.strands.numStrands);
+	for (uint32_t s = 0; s < reference.strands.numStrands; s++) {
+		restRoots[s] = reference.strands.restPositions[s * n];
+	}
+	reference.setRootFrames(restRoots, std::vector<glm::mat3>(reference.strands.numStrands, glm::mat3(1.0f)));
+	reference.reset();
+	uploadStrandState(reference.strands);
 
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	const SimulationPushConstants constants = getSimulationPushConstants(SIMULATION_TIMESTEP / substeps, substeps);
+	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, strandSimulationPipeline.pipeline);
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, strandSimulationPipeline.layout, 0, 1, &computeDescriptor.descriptorSets[currentFrame], 0, nullptr);
+	vkCmdPushConstants(commandBuffer, strandSimulationPipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+	for (uint32_t i = 0; i < numSteps * substeps; i++) {
+		VkMemoryBarrier barrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+		barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		vkCmdDispatch(commandBuffer, (constants.numStrands + STRAND_WORKGROUP_SIZE - 1) / STRAND_WORKGROUP_SIZE, 1, 1);
+	}
+	endSingleTimeCommands(commandBuffer);
 
-	void* data;
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
-	vkUnmapMemory(device, stagingBufferMemory);
+	for (uint32_t i = 0; i < numSteps; i++) {
+		reference.step(SIMULATION_TIMESTEP);
+	}
 
-	VkBuffer indexBuffer;
-	VkDeviceMemory indexBufferMemory;
-	createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+	GuideStrands gpuResult = reference.strands;
+	downloadStrandState(gpuResult);
 
-	copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+	float maxError = 0.0f;
+	for (uint32_t i = 0; i < gpuResult.numVertices(); i++) {
+		// A NaN sticks, std::max keeps its first argument when they don't compare.
+		const float error = glm::length(gpuResult.position(i) - reference.strands.position(i));
+		maxError = std::isnan(error) ? error : std::max(maxError, error);
+	}
 
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
+	const bool passed = maxError <= tolerance;
+	uiState.gpuParityChecked = true;
+	uiState.gpuParityPassed = passed;
+	uiState.gpuParityError = maxError;
+	std::cout << "GPU simulation parity after " << numSteps << " steps: max position error " << maxError
+		<< " (tolerance " << tolerance << ") " << (passed ? "PASSED" : "FAILED") << "\n";
 
-	return MeshBuffer(indexBuffer, indexBufferMemory, indices.size());
+	if (gpuSimulationActive) {
+		uploadStrandState(current);
+	}
 }
 
-void Main::createVertexAndIndexBuffers() {
-	for (auto& pair : models) {
-		const auto curVertices = pair.second.first;
-		const auto curIndices = pair.second.second;
-		vertices[pair.first] = createVertexBuffer(curVertices);
-		indices[pair.first] = createIndexBuffer(curIndices);
+void Main::checkSimulationDeterminism() {
+	const uint32_t numSteps = 120;
+	const double maxCost = 0.15;
+	const uint32_t maxThreads = std::max(threadPool.size(), 4u);
+
+	// Full detail with the voxel grid, which is the only stage that reduces across strands.
+	SimulationSettings settings = hairSimulation.settings;
+	settings.enableVolume = true;
+	settings.substeps = simulationLod.getLevels()[0].substeps;
+
+	auto run = [&](uint32_t numThreads, bool deterministic, double& seconds) {
+		ThreadPool pool(numThreads);
+		settings.deterministic = deterministic;
+		HairSimulation simulation(GuideStrands(hairSimulation.strands), &pool, settings);
+		simulation.reset();
+
+		const double start = glfwGetTime();
+		for (uint32_t i = 0; i < numSteps; i++) {
+			simulation.step(SIMULATION_TIMESTEP);
+		}
+		seconds = glfwGetTime() - start;
+		return simulation.strands.hash();
+	};
+
+	std::cout << "Simulation determinism after " << numSteps << " steps:\n" << std::hex;
+	bool identical = true;
+	uint64_t reference = 0;
+	double seconds;
+	for (uint32_t numThreads : { 1u, 2u, 3u, maxThreads }) {
+		const uint64_t hash = run(numThreads, true, seconds);
+		if (numThreads == 1) {
+			reference = hash;
+		}
+		identical = identical && hash == reference;
+		std::cout << "  " << std::dec << numThreads << " threads: " << std::hex << hash << "\n";
 	}
+	std::cout << std::dec;
+
+	// Alternate the modes a few times and keep the fastest run of each, to keep noise out of the cost.
+	double fastSeconds = std::numeric_limits<double>::max();
+	double deterministicSeconds = std::numeric_limits<double>::max();
+	for (uint32_t i = 0; i < 3; i++) {
+		run(threadPool.size(), false, seconds);
+		fastSeconds = std::min(fastSeconds, seconds);
+		run(threadPool.size(), true, seconds);
+		deterministicSeconds = std::min(deterministicSeconds, seconds);
+	}
+	const double cost = deterministicSeconds / std::max(fastSeconds, 1e-9) - 1.0;
+
+	std::cout << "  hashes " << (identical ? "identical" : "DIFFER")
+		<< ", deterministic mode costs " << cost * 100.0 << "% (limit " << maxCost * 100.0 << "%) "
+		<< (identical && cost <= maxCost ? "PASSED" : "FAILED") << "\n";
 }
 
-void Main::createUniformBuffers() {
-	VkDeviceSize bufferSize = sizeof(UniformBufferObject);
+void Main::createUniformArena() {
+	VkPhysicalDeviceProperties properties;
+	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	const VkDeviceSize alignment = std::max<VkDeviceSize>(properties.limits.minUniformBufferOffsetAlignment, 1);
+	const VkDeviceSize frameSize = (UNIFORM_ARENA_FRAME_SIZE + alignment - 1) / alignment * alignment;
+
+	VkBuffer buffer;
+	VkDeviceMemory memory;
+	createBuffer(frameSize * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+	uniformArena = UniformArena(&device, buffer, memory, frameSize, MAX_FRAMES_IN_FLIGHT, alignment);
+}
+
+uint32_t Main::getCharacterCount() const {
+	return std::clamp(static_cast<uint32_t>(std::max(uiState.crowdSize, 1)), 1u, MAX_CHARACTER_INSTANCES);
+}
+
+void Main::createCharacterInstanceBuffers() {
+	const VkDeviceSize bufferSize = sizeof(CharacterInstance) * MAX_CHARACTER_INSTANCES;
 
-	uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-	uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	characterInstanceBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	characterInstanceBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+	// Nothing was laid out yet.
+	characterInstanceSettings.assign(MAX_FRAMES_IN_FLIGHT, { 0, 0.0f });
 
 	for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		createBuffer(bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+		characterInstanceBuffers[i] = MeshBuffer(buffer, memory, MAX_CHARACTER_INSTANCES);
+
+		vkMapMemory(device, memory, 0, bufferSize, 0, &characterInstanceBuffersMapped[i]);
+	}
+}
+
+void Main::updateCharacterInstanceBuffer(uint32_t currentImage) {
+	const uint32_t count = getCharacterCount();
+	const std::pair<uint32_t, float> settings = { count, uiState.crowdSpacing };
+	if (characterInstanceSettings[currentImage] == settings) {
+		return;
+	}
+	characterInstanceSettings[currentImage] = settings;
+
+	// Hair colours the copies are tinted with, from dark to fair.
+	const std::array<glm::vec3, 6> hairColors = {
+		glm::vec3(0.35f, 0.25f, 0.2f),
+		glm::vec3(0.6f, 0.4f, 0.25f),
+		glm::vec3(1.0f, 0.75f, 0.45f),
+		glm::vec3(0.9f, 0.35f, 0.15f),
+		glm::vec3(0.5f, 0.5f, 0.55f),
+		glm::vec3(1.3f, 1.2f, 1.0f)
+	};
 
-		vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+	// A square grid around the simulated character, which keeps the middle cell at the origin. An odd number
+	// of columns puts that cell there, and keeps the far corners within the far plane for a few hundred.
+	const uint32_t columns = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<float>(count)))) | 1u;
+	const uint32_t middle = (columns / 2) * columns + columns / 2;
+	CharacterInstance* instances = static_cast<CharacterInstance*>(characterInstanceBuffersMapped[currentImage]);
+	for (uint32_t i = 0; i < count; i++) {
+		CharacterInstance instance{};
+		instance.model = glm::mat4(1.0f);
+		instance.hairColor = glm::vec4(1.0f);
+		instance.skinColor = glm::vec4(1.0f);
+		instance.materials = glm::uvec4(MATERIAL_HEAD, MATERIAL_HAIR, 0, 0);
+		if (i > 0) {
+			const uint32_t cell = i - 1 < middle ? i - 1 : i;
+			const float x = uiState.crowdSpacing * (static_cast<float>(cell % columns) - static_cast<float>(columns / 2));
+			const float z = uiState.crowdSpacing * (static_cast<float>(cell / columns) - static_cast<float>(columns / 2));
+			// Copies of the same hair look less alike turned a little each.
+			const float yaw = (hashUniform(0, 0, 1, i) - 0.5f) * glm::radians(60.0f);
+			instance.model = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z)), yaw, glm::vec3(0.0f, 1.0f, 0.0f));
+			const glm::vec3 hairColor = hairColors[mixBits(i) % hairColors.size()];
+			instance.hairColor = glm::vec4(hairColor, 1.0f);
+			instance.skinColor = glm::vec4(glm::vec3(0.8f + 0.3f * hashUniform(0, 0, 2, i)), 1.0f);
+		}
+		instances[i] = instance;
 	}
 }
 
-void Main::updateUniformBuffer(uint32_t currentImage) {
+UniformBufferObject Main::getCameraUniforms() const {
 	UniformBufferObject ubo{};
-	ubo.model = glm::mat4(1.0f);
 	ubo.view = camera->view;
 	ubo.proj = camera->proj;
 	// GLM was originally designed for OpenGL, where the Y coordinate of the clip coordinates is inverted. 
@@ -1387,8 +4589,17 @@ void Main::updateUniformBuffer(uint32_t currentImage) {
 	// If you don't do this, then the image will be rendered upside down.
 	ubo.proj[1][1] *= -1;
 	ubo.cameraPos = camera->position;
+	ubo.hairCoreAlpha = uiState.hairCoreAlpha;
+	return ubo;
+}
+
+void Main::allocatePassUniforms() {
+	passUniformOffset = uniformArena.allocate(getCameraUniforms());
+}
 
-	memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+void Main::bindGlobalDescriptorSet(VkCommandBuffer commandBuffer, VkPipelineLayout layout) {
+	const VkDescriptorSet sets[] = { descriptor.descriptorSets[currentFrame], bindlessDescriptor.descriptorSets[currentFrame] };
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, SET_GLOBAL, 2, sets, 1, &passUniformOffset);
 }
 
 void Main::transitionImage(
@@ -1841,6 +5052,8 @@ VkSampleCountFlagBits Main::getMaxUsableSampleCount() {
 	vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
 
 	VkSampleCountFlags counts = physicalDeviceProperties.limits.framebufferColorSampleCounts & physicalDeviceProperties.limits.framebufferDepthSampleCounts;
+	// Sample counts are single bits, so this keeps the ones up to the cap.
+	counts &= (static_cast<VkSampleCountFlags>(std::max(msaaSampleCap, 1)) << 1) - 1;
 	if (counts & VK_SAMPLE_COUNT_64_BIT) { return VK_SAMPLE_COUNT_64_BIT; }
 	if (counts & VK_SAMPLE_COUNT_32_BIT) { return VK_SAMPLE_COUNT_32_BIT; }
 	if (counts & VK_SAMPLE_COUNT_16_BIT) { return VK_SAMPLE_COUNT_16_BIT; }
@@ -1851,11 +5064,11 @@ VkSampleCountFlagBits Main::getMaxUsableSampleCount() {
 	return VK_SAMPLE_COUNT_1_BIT;
 }
 
-void Main::createImageResource(VulkanImage *image, VkFormat format, VkSampleCountFlagBits samples, VkImageUsageFlags usage, VkImageAspectFlags aspectFlags) {
+void Main::createTransientImage(VulkanImage *image, VkFormat format, VkSampleCountFlagBits samples, VkImageUsageFlags usage, VkImageAspectFlags aspectFlags, float scale) {
 	*image = VulkanImage(
 		&device,
-		swapChainExtent.width,
-		swapChainExtent.height,
+		static_cast<uint32_t>(std::ceil(swapChainExtent.width * scale)),
+		static_cast<uint32_t>(std::ceil(swapChainExtent.height * scale)),
 		1,
 		samples,
 		format,
@@ -1863,94 +5076,183 @@ void Main::createImageResource(VulkanImage *image, VkFormat format, VkSampleCoun
 		aspectFlags
 	);
 	image->createImage();
-
-	VkMemoryRequirements memRequirements;
-	vkGetImageMemoryRequirements(device, image->image, &memRequirements);
-	image->bindMemory(memRequirements.size, findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT));
-
-	image->createView();
 }
 
 void Main::createOffscreenImageResources() {
+	// None of them outlives a frame: every frame clears or overwrites them before reading them.
 	//VK_FORMAT_B8G8R8A8_SRGB
-	createImageResource(&offscreenColorImage, VK_FORMAT_R8G8B8A8_SRGB, msaaSamples, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
-	transitionImage(offscreenColorImage, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+	createTransientImage(&offscreenColorImage, VK_FORMAT_R8G8B8A8_SRGB, msaaSamples, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	// Sampled by the depth downsample and the upsample of the reduced resolution transparency.
+	createTransientImage(&depthImage, findDepthFormat(), msaaSamples, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
+	// The weighted images never leave the transparent render pass, so tile based GPUs can keep them on chip
+	// and back them with lazily allocated memory that is never committed.
+	createTransientImage(&weightedColorImage, VK_FORMAT_R16G16B16A16_SFLOAT, msaaSamples, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	createTransientImage(&weightedRevealImage, VK_FORMAT_R16_SFLOAT, msaaSamples, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	if (msaaSamples != VK_SAMPLE_COUNT_1_BIT) {
+		createTransientImage(&downsampleImage, offscreenColorImage.format, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+	// One list per pixel, not per sample: the fragments of the lists cover the whole pixel.
+	if (linkedListOitSupported) {
+		createTransientImage(&oitHeadImage, VK_FORMAT_R32_UINT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+	// The moment attachments, per sample and in the precision picked. Six moments take two channels past
+	// the first four, eight take four.
+	const VkImageUsageFlags momentUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+	const VkFormat momentFormat = momentSinglePrecision ? VK_FORMAT_R32G32B32A32_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+	createTransientImage(&momentZerothImage, momentSinglePrecision ? VK_FORMAT_R32_SFLOAT : VK_FORMAT_R16_SFLOAT, msaaSamples, momentUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+	createTransientImage(&momentImage, momentFormat, msaaSamples, momentUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+	if (momentCount == 6) {
+		createTransientImage(&momentExtraImage, momentSinglePrecision ? VK_FORMAT_R32G32_SFLOAT : VK_FORMAT_R16G16_SFLOAT, msaaSamples, momentUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+	else if (momentCount == 8) {
+		createTransientImage(&momentExtraImage, momentFormat, msaaSamples, momentUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+	createTransientImage(&momentAccumImage, VK_FORMAT_R16G16B16A16_SFLOAT, msaaSamples, momentUsage, VK_IMAGE_ASPECT_COLOR_BIT);
+	// The reduced resolution transparency, a single sample each. The upsample filters them itself.
+	createTransientImage(&lowResDepthImage, findDepthFormat(), VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, MAX_TRANSPARENT_SCALE);
+	createTransientImage(&lowResWeightedColorImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, MAX_TRANSPARENT_SCALE);
+	createTransientImage(&lowResWeightedRevealImage, VK_FORMAT_R16_SFLOAT, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_ASPECT_COLOR_BIT, MAX_TRANSPARENT_SCALE);
 
-	createImageResource(&depthImage, findDepthFormat(), msaaSamples, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT);
-	transitionImage(depthImage, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+	allocateTransientImages();
+}
+
+void Main::allocateTransientImages() {
+	// Frames using the old images may still be in flight, so the graph keeps what it remembers of the
+	// persistent resources and only the transient slots start over.
+	frameGraph.reset();
+	declareFrameGraph(0, true);
+	frameGraph.compile();
+	const TransientMemoryPlan plan = frameGraph.planTransientMemory();
+
+	transientImageMemory.clear();
+	std::vector<bool> isSlotLazy;
+	VkDeviceSize lazySize = 0;
+	for (const TransientMemorySlot& slot : plan.slots) {
+		// Only where the GPU has such memory, mostly tile based ones. Elsewhere it is plain device memory.
+		const VkMemoryPropertyFlags lazyProperties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+		const bool isLazy = slot.isLazilyAllocatable && hasMemoryType(slot.memoryTypeBits, lazyProperties);
+		isSlotLazy.push_back(isLazy);
+		if (isLazy) {
+			lazySize += slot.size;
+		}
 
-	createImageResource(&weightedColorImage, VK_FORMAT_R16G16B16A16_SFLOAT, msaaSamples, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
-	transitionImage(weightedColorImage, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+		VkMemoryAllocateInfo allocInfo{ VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO };
+		allocInfo.allocationSize = slot.size;
+		allocInfo.memoryTypeIndex = findMemoryType(slot.memoryTypeBits, isLazy ? lazyProperties : VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	createImageResource(&weightedRevealImage, VK_FORMAT_R16_SFLOAT, msaaSamples, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
-	transitionImage(weightedRevealImage, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+		VkDeviceMemory memory;
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &memory) != VK_SUCCESS) {
+			throw std::runtime_error("failed to allocate transient image memory!");
+		}
+		transientImageMemory.push_back(memory);
+	}
 
-	createImageResource(&downsampleImage, offscreenColorImage.format, VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_ASPECT_COLOR_BIT);
+	for (const TransientImageBinding& binding : plan.images) {
+		binding.image->bindMemory(transientImageMemory[binding.slot], 0);
+		binding.image->createView();
+	}
+	frameGraph.setTransientSlots(plan);
+
+	uiState.msaaSamples = static_cast<uint32_t>(msaaSamples);
+	uiState.transientImageKiB = static_cast<uint32_t>(plan.aliasedSize / 1024);
+	std::cout << "Transient images at " << msaaSamples << " samples (cap " << msaaSampleCap << "): "
+		<< plan.images.size() << " in " << plan.slots.size() << " allocations, "
+		<< plan.aliasedSize / 1024 << " KiB instead of " << plan.unaliasedSize / 1024 << " KiB, "
+		<< lazySize / 1024 << " KiB of them lazily allocated.\n";
+	for (const TransientImageBinding& binding : plan.images) {
+		std::cout << "  " << binding.name << ": " << binding.image->getSamples() << " samples, " << binding.size << " bytes in allocation "
+			<< binding.slot << (isSlotLazy[binding.slot] ? ", lazily allocated" : "") << "\n";
+	}
 }
 
 void Main::createRenderPasses() {
-	/* Opaque objects render pass */
-	opaqueObjectsRenderPass = RenderPass(&device);
-	// Add attachments
-	{
-		// Color attachment
-		opaqueObjectsRenderPass.addAttachment(
-			offscreenColorImage.format,
-			msaaSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-		);
-		// Depth attachment
-		opaqueObjectsRenderPass.addAttachment(
-			depthImage.format,
-			msaaSamples,
-			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
-		);
-	}
-	
-	// Add subpass
-	{
-		opaqueObjectsRenderPass.addSubpass(
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			{
+	// With MSAA the last pass of a frame resolves the samples into downsampleImage as it ends, so they never
+	// have to be stored. Without it, the offscreen color is the frame.
+	const bool resolving = msaaSamples != VK_SAMPLE_COUNT_1_BIT;
+
+	/* Opaque objects render passes */
+	// Without transparent objects, the opaque pass is the last one.
+	auto createOpaqueObjectsRenderPass = [&](RenderPass& renderPass, bool resolve) {
+		renderPass = RenderPass(&device);
+		// Add attachments
+		{
+			// Color attachment
+			renderPass.addAttachment(
+				offscreenColorImage.format,
+				msaaSamples,
+				VK_ATTACHMENT_LOAD_OP_CLEAR,
+				resolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+			);
+			// Depth attachment
+			renderPass.addAttachment(
+				depthImage.format,
+				msaaSamples,
+				VK_ATTACHMENT_LOAD_OP_CLEAR,
+				resolve ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+			);
+			if (resolve) {
+				// Resolve attachment
+				renderPass.addAttachment(
+					downsampleImage.format,
+					VK_SAMPLE_COUNT_1_BIT,
+					VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+					VK_ATTACHMENT_STORE_OP_STORE,
+					VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+					VK_ATTACHMENT_STORE_OP_DONT_CARE,
+					VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+					VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+				);
+			}
+		}
+
+		// Add subpass
+		{
+			AttachmentUsageMap usageMap = {
 				{0, AttachmentType::COLOR},
 				{1, AttachmentType::DEPTH}
+			};
+			if (resolve) {
+				usageMap.push_back({ 2, AttachmentType::RESOLVE });
 			}
-		);
-	}
-	
-	// Add dependency
-	{
-		VkSubpassDependency selfDependency;
-		selfDependency.srcSubpass = 0;
-		selfDependency.dstSubpass = 0;
-		selfDependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		selfDependency.dstStageMask = selfDependency.srcStageMask;
-		selfDependency.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
-		selfDependency.dstAccessMask = selfDependency.srcAccessMask;
-		selfDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;  // Required, since we use framebuffer-space stages
-		opaqueObjectsRenderPass.createRenderPass({ selfDependency });
+			renderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, usageMap);
+		}
+
+		// Add dependency
+		{
+			VkSubpassDependency selfDependency;
+			selfDependency.srcSubpass = 0;
+			selfDependency.dstSubpass = 0;
+			selfDependency.srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+			selfDependency.dstStageMask = selfDependency.srcStageMask;
+			selfDependency.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			selfDependency.dstAccessMask = selfDependency.srcAccessMask;
+			selfDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;  // Required, since we use framebuffer-space stages
+			renderPass.createRenderPass({ selfDependency });
+		}
+	};
+	createOpaqueObjectsRenderPass(opaqueObjectsRenderPass, false);
+	if (resolving) {
+		createOpaqueObjectsRenderPass(opaqueResolveRenderPass, true);
 	}
 	
 	/* Transparent objects render pass */
 	transparentObjectsRenderPass = RenderPass(&device);
 	// Add attachments
 	{
-		// weightedColorAttachment
+		// weightedColorAttachment, read by the composite subpass only.
 		transparentObjectsRenderPass.addAttachment(
 			weightedColorImage.format,
 			msaaSamples,
 			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
@@ -1961,7 +5263,7 @@ void Main::createRenderPasses() {
 			weightedRevealImage.format,
 			msaaSamples,
 			VK_ATTACHMENT_LOAD_OP_CLEAR,
-			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
@@ -1972,23 +5274,36 @@ void Main::createRenderPasses() {
 			offscreenColorImage.format,
 			msaaSamples,
 			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
+			resolving ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 		);
-		// depthAttachment
+		// depthAttachment, tested against but no longer needed afterwards.
 		transparentObjectsRenderPass.addAttachment(
 			depthImage.format,
 			msaaSamples,
 			VK_ATTACHMENT_LOAD_OP_LOAD,
-			VK_ATTACHMENT_STORE_OP_STORE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			VK_ATTACHMENT_STORE_OP_DONT_CARE,
 			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
 			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
 		);
+		if (resolving) {
+			// resolveAttachment
+			transparentObjectsRenderPass.addAttachment(
+				downsampleImage.format,
+				VK_SAMPLE_COUNT_1_BIT,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_STORE,
+				VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+				VK_ATTACHMENT_STORE_OP_DONT_CARE,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+			);
+		}
 	}
 	
 	// Add subpasses
@@ -2003,15 +5318,16 @@ void Main::createRenderPasses() {
 			}
 		);
 
-		// Subpass 1
-		transparentObjectsRenderPass.addSubpass(
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			{
-				{0, AttachmentType::INPUT},
-				{1, AttachmentType::INPUT},
-				{2, AttachmentType::COLOR}
-			}
-		);
+		// Subpass 1, resolving the composited color as it ends.
+		AttachmentUsageMap compositeUsageMap = {
+			{0, AttachmentType::INPUT},
+			{1, AttachmentType::INPUT},
+			{2, AttachmentType::COLOR}
+		};
+		if (resolving) {
+			compositeUsageMap.push_back({ 4, AttachmentType::RESOLVE });
+		}
+		transparentObjectsRenderPass.addSubpass(VK_PIPELINE_BIND_POINT_GRAPHICS, compositeUsageMap);
 	}
 
 	// Add dependencies
@@ -2024,12 +5340,13 @@ void Main::createRenderPasses() {
 		subpassDependencies[0].srcAccessMask = 0;
 		subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
 
+		// The composite reads the weighted attachments, or the lists the color subpass appended to.
 		subpassDependencies[1].srcSubpass = 0;
 		subpassDependencies[1].dstSubpass = 1;
-		subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		subpassDependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
 		subpassDependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-		subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		subpassDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		subpassDependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		subpassDependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
 		// Finally, we have a dependency at the end to allow the images to transition back to VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 		subpassDependencies[2].srcSubpass = 1;
 		subpassDependencies[2].dstSubpass = VK_SUBPASS_EXTERNAL;
@@ -2040,53 +5357,6 @@ void Main::createRenderPasses() {
 		transparentObjectsRenderPass.createRenderPass(subpassDependencies);
 	}
 
-	/* UI render pass */
-	uiRenderPass = RenderPass(&device);
-	// Add attachment
-	{
-		uiRenderPass.addAttachment(
-			swapChainImageFormat,
-			VK_SAMPLE_COUNT_1_BIT, // UI needn’t be MSAA
-			VK_ATTACHMENT_LOAD_OP_LOAD, // keep the blit result
-			VK_ATTACHMENT_STORE_OP_STORE, // present later
-			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-			VK_ATTACHMENT_STORE_OP_DONT_CARE,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-		);
-	}
-
-	// Add subpass
-	{
-		uiRenderPass.addSubpass(
-			VK_PIPELINE_BIND_POINT_GRAPHICS,
-			{
-				{0, AttachmentType::COLOR}
-			}
-		);
-	}
-
-	// Add dependencies
-	{
-		VkSubpassDependency depIn{};
-		depIn.srcSubpass = VK_SUBPASS_EXTERNAL;
-		depIn.dstSubpass = 0;
-		depIn.srcStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
-		depIn.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		depIn.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		depIn.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
-			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-		VkSubpassDependency depOut{};
-		depOut.srcSubpass = 0;
-		depOut.dstSubpass = VK_SUBPASS_EXTERNAL;
-		depOut.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-		depOut.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-		depOut.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-		depOut.dstAccessMask = 0;
-		uiRenderPass.createRenderPass({ depIn, depOut });
-	}
-
 	/* Opaque hair render pass */
 	opaqueHairRenderPass = RenderPass(&device);
 	// Add attachaments
@@ -2136,7 +5406,69 @@ void Main::createRenderPasses() {
 		selfDependency.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;  // Required, since we use framebuffer-space stages
 		opaqueHairRenderPass.createRenderPass({ selfDependency });
 	}
-	
+
+	createMomentObjectsRenderPass();
+	createReducedTransparencyRenderPasses();
+}
+
+void Main::destroyRenderPasses() {
+	opaqueObjectsRenderPass.destroy();
+	opaqueResolveRenderPass.destroy();
+	opaqueHairRenderPass.destroy();
+	transparentObjectsRenderPass.destroy();
+	momentObjectsRenderPass.destroy();
+	transparentDepthDownsampleRenderPass.destroy();
+	lowResTransparentRenderPass.destroy();
+	transparentUpsampleRenderPass.destroy();
+}
+
+void Main::createUIRenderPass() {
+	uiRenderPass = RenderPass(&device);
+	// Add attachment
+	{
+		uiRenderPass.addAttachment(
+			swapChainImageFormat,
+			VK_SAMPLE_COUNT_1_BIT, // UI needn’t be MSAA
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE, // the present pipeline covers every pixel
+			VK_ATTACHMENT_STORE_OP_STORE, // present later
+			VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+			VK_ATTACHMENT_STORE_OP_DONT_CARE,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+		);
+	}
+
+	// Add subpass
+	{
+		uiRenderPass.addSubpass(
+			VK_PIPELINE_BIND_POINT_GRAPHICS,
+			{
+				{0, AttachmentType::COLOR}
+			}
+		);
+	}
+
+	// Add dependencies
+	{
+		VkSubpassDependency depIn{};
+		depIn.srcSubpass = VK_SUBPASS_EXTERNAL;
+		depIn.dstSubpass = 0;
+		// Waits for the presentation engine to let go of the image.
+		depIn.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		depIn.srcAccessMask = 0;
+		depIn.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		depIn.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT |
+			VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+		VkSubpassDependency depOut{};
+		depOut.srcSubpass = 0;
+		depOut.dstSubpass = VK_SUBPASS_EXTERNAL;
+		depOut.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+		depOut.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+		depOut.dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+		depOut.dstAccessMask = 0;
+		uiRenderPass.createRenderPass({ depIn, depOut });
+	}
 }
 
 void Main::createUIFramebuffers() {
@@ -2161,6 +5493,23 @@ void Main::createUIFramebuffers() {
 	}
 }
 
+void Main::createPresentSetLayout() {
+	VkDescriptorSetLayoutBinding binding{};
+	binding.binding = BIND_PRESENT_SOURCE;
+	binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	binding.descriptorCount = 1;
+	binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo{};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &binding;
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &presentSetLayout) != VK_SUCCESS) {
+		throw std::runtime_error("failed to create the present descriptor set layout!");
+	}
+}
+
 void Main::createUI() {
 	QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 	ui.init(
@@ -2176,37 +5525,36 @@ void Main::createUI() {
 }
 
 void Main::recordUIRenderPass(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
-	cmdImageTransition(
-		commandBuffer,
-		swapChainImages[imageIndex],
-		VK_IMAGE_ASPECT_COLOR_BIT,
-		VK_ACCESS_TRANSFER_WRITE_BIT,
-		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, // TODO: for now this is harded but should be recorded from previous transitions
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
-	);
-
 	VkRenderPassBeginInfo rpBegin{};
 	rpBegin.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
 	rpBegin.renderPass = uiRenderPass.renderPass;
 	rpBegin.framebuffer = uiFramebuffers[imageIndex];
 	rpBegin.renderArea.extent = swapChainExtent;
-	rpBegin.clearValueCount = 0; // we LOAD, so no clears
+	rpBegin.clearValueCount = 0; // nothing is cleared, the copy overwrites it all
 
 	vkCmdBeginRenderPass(commandBuffer, &rpBegin, VK_SUBPASS_CONTENTS_INLINE);
 
+	// Copy the frame with a full-screen triangle.
+	VkViewport viewport{};
+	viewport.width = static_cast<float>(swapChainExtent.width);
+	viewport.height = static_cast<float>(swapChainExtent.height);
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.extent = swapChainExtent;
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, presentPipeline.pipeline);
+	// Taken anew every frame, so that a resize which replaces the source has nothing to rewrite.
+	const VkDescriptorSet presentSet = frameDescriptorCaches[currentFrame].getSet(presentSetLayout, {
+		DescriptorWrite::forImage(BIND_PRESENT_SOURCE, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, getPresentSourceImage().view, textureSampler)
+	});
+	vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, presentPipeline.layout, 0, 1, &presentSet, 0, nullptr);
+	vkCmdDraw(commandBuffer, 3, 1, 0, 0);
+
 	// draw the UI
 	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), commandBuffer);
 
 	vkCmdEndRenderPass(commandBuffer);
-
-	// COLOR_ATTACHMENT_OPTIMAL -> PRESENT_SRC_KHR
-	cmdImageTransition(commandBuffer,
-		swapChainImages[imageIndex],
-		VK_IMAGE_ASPECT_COLOR_BIT,
-		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-		0,
-		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-		VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
-
 }
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include "meshCache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+static const char CACHE_MAGIC[4] = { 'H', 'M', 'S', 'H' };
+static const uint32_t CACHE_VERSION = 1;
+
+static bool getSourceStamp(const std::string& sourcePath, uint64_t& size, int64_t& time) {
+	std::error_code error;
+	size = static_cast<uint64_t>(std::filesystem::file_size(sourcePath, error));
+	if (error) {
+		return false;
+	}
+	const auto writeTime = std::filesystem::last_write_time(sourcePath, error);
+	if (error) {
+		return false;
+	}
+	time = static_cast<int64_t>(writeTime.time_since_epoch().count());
+	return true;
+}
+
+bool readMeshCache(
+	const std::string& path,
+	const std::string& sourcePath,
+	uint32_t maxVertices,
+	uint32_t maxTriangles,
+	ClusteredMesh& mesh) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+
+	MeshCacheHeader header{};
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+		std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+		header.version != CACHE_VERSION ||
+		header.vertexSize != sizeof(Vertex) ||
+		header.clusterSize != sizeof(MeshCluster) ||
+		header.maxVertices != maxVertices ||
+		header.maxTriangles != maxTriangles) {
+		return false;
+	}
+
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	if (!getSourceStamp(sourcePath, sourceSize, sourceTime) || header.sourceSize != sourceSize || header.sourceTime != sourceTime) {
+		return false;
+	}
+
+	// A truncated file would ask for more than it holds.
+	const uint64_t expectedSize = sizeof(header) +
+		uint64_t(header.numVertices) * sizeof(Vertex) +
+		uint64_t(header.numIndices) * sizeof(uint32_t) +
+		uint64_t(header.numClusters) * sizeof(MeshCluster);
+	std::error_code error;
+	if (std::filesystem::file_size(path, error) != expectedSize || error) {
+		return false;
+	}
+
+	ClusteredMesh cached;
+	cached.vertices.resize(header.numVertices);
+	cached.indices.resize(header.numIndices);
+	cached.clusters.resize(header.numClusters);
+	if (!file.read(reinterpret_cast<char*>(cached.vertices.data()), sizeof(Vertex) * cached.vertices.size()) ||
+		!file.read(reinterpret_cast<char*>(cached.indices.data()), sizeof(uint32_t) * cached.indices.size()) ||
+		!file.read(reinterpret_cast<char*>(cached.clusters.data()), sizeof(MeshCluster) * cached.clusters.size())) {
+		return false;
+	}
+
+	for (uint32_t index : cached.indices) {
+		if (index >= header.numVertices) {
+			return false;
+		}
+	}
+	// Back to back over the indices and within the limits, which is what drawing and culling rely on.
+	uint32_t nextIndex = 0;
+	for (const MeshCluster& cluster : cached.clusters) {
+		if (cluster.firstIndex != nextIndex ||
+			cluster.indexCount > header.numIndices - nextIndex ||
+			cluster.indexCount % 3 != 0 ||
+			cluster.indexCount / 3 > maxTriangles ||
+			cluster.vertexCount > maxVertices) {
+			return false;
+		}
+		nextIndex += cluster.indexCount;
+	}
+	if (nextIndex != header.numIndices) {
+		return false;
+	}
+
+	mesh = std::move(cached);
+	return true;
+}
+
+bool writeMeshCache(
+	const std::string& path,
+	const std::string& sourcePath,
+	uint32_t maxVertices,
+	uint32_t maxTriangles,
+	const ClusteredMesh& mesh) {
+	MeshCacheHeader header{};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	if (!getSourceStamp(sourcePath, header.sourceSize, header.sourceTime)) {
+		return false;
+	}
+	header.numVertices = static_cast<uint32_t>(mesh.vertices.size());
+	header.numIndices = static_cast<uint32_t>(mesh.indices.size());
+	header.numClusters = static_cast<uint32_t>(mesh.clusters.size());
+	header.maxVertices = maxVertices;
+	header.maxTriangles = maxTriangles;
+	header.vertexSize = sizeof(Vertex);
+	header.clusterSize = sizeof(MeshCluster);
+
+	// Written next to the cache and renamed over it, so a crash never leaves half a cache behind.
+	const std::string partialPath = path + ".partial";
+	{
+		std::ofstream file(partialPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open()) {
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(mesh.vertices.data()), sizeof(Vertex) * mesh.vertices.size());
+		file.write(reinterpret_cast<const char*>(mesh.indices.data()), sizeof(uint32_t) * mesh.indices.size());
+		file.write(reinterpret_cast<const char*>(mesh.clusters.data()), sizeof(MeshCluster) * mesh.clusters.size());
+		if (!file) {
+			return false;
+		}
+	}
+
+	std::error_code error;
+	std::filesystem::rename(partialPath, path, error);
+	if (error) {
+		std::filesystem::remove(partialPath, error);
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,378 @@
+#include "meshClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+	// Interleaves the low 10 bits of x, y and z, so that sorting by the code walks a Morton curve.
+	uint32_t mortonCode(const glm::vec3& p, const glm::vec3& lower, const glm::vec3& extent) {
+		uint32_t code = 0;
+		const glm::vec3 unit = glm::clamp((p - lower) / glm::max(extent, glm::vec3(1e-12f)), 0.0f, 1.0f);
+		const uint32_t x = static_cast<uint32_t>(unit.x * 1023.0f);
+		const uint32_t y = static_cast<uint32_t>(unit.y * 1023.0f);
+		const uint32_t z = static_cast<uint32_t>(unit.z * 1023.0f);
+		for (uint32_t bit = 0; bit < 10; bit++) {
+			code |= ((x >> bit) & 1u) << (3 * bit + 2);
+			code |= ((y >> bit) & 1u) << (3 * bit + 1);
+			code |= ((z >> bit) & 1u) << (3 * bit);
+		}
+		return code;
+	}
+
+	// The triangle rotated so that its smallest index comes first, which keeps its winding.
+	std::array<uint32_t, 3> triangleKey(uint32_t a, uint32_t b, uint32_t c) {
+		if (b < a && b < c) {
+			return { b, c, a };
+		}
+		if (c < a && c < b) {
+			return { c, a, b };
+		}
+		return { a, b, c };
+	}
+}
+
+ClusteredMesh buildMeshlets(
+	std::vector<Vertex> vertices,
+	const std::vector<uint32_t>& indices,
+	uint32_t maxVertices,
+	uint32_t maxTriangles) {
+	maxVertices = std::max(maxVertices, 3u);
+	maxTriangles = std::max(maxTriangles, 1u);
+	const uint32_t numTriangles = static_cast<uint32_t>(indices.size() / 3);
+	const uint32_t numVertices = static_cast<uint32_t>(vertices.size());
+
+	ClusteredMesh mesh;
+	mesh.vertices = std::move(vertices);
+	if (numTriangles == 0) {
+		return mesh;
+	}
+
+	std::vector<glm::vec3> centroids(numTriangles);
+	glm::vec3 lower(std::numeric_limits<float>::max());
+	glm::vec3 upper(-std::numeric_limits<float>::max());
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		centroids[t] = (glm::vec3(mesh.vertices[indices[3 * t]].pos) +
+			glm::vec3(mesh.vertices[indices[3 * t + 1]].pos) +
+			glm::vec3(mesh.vertices[indices[3 * t + 2]].pos)) / 3.0f;
+		lower = glm::min(lower, centroids[t]);
+		upper = glm::max(upper, centroids[t]);
+	}
+	const glm::vec3 extent = upper - lower;
+
+	std::vector<uint32_t> seedOrder(numTriangles);
+	{
+		std::vector<uint32_t> codes(numTriangles);
+		for (uint32_t t = 0; t < numTriangles; t++) {
+			codes[t] = mortonCode(centroids[t], lower, extent);
+			seedOrder[t] = t;
+		}
+		std::stable_sort(seedOrder.begin(), seedOrder.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+	}
+
+	// Triangles around each vertex, in compressed rows.
+	std::vector<uint32_t> adjacencyOffsets(numVertices + 1, 0);
+	for (uint32_t i = 0; i < 3 * numTriangles; i++) {
+		adjacencyOffsets[indices[i] + 1]++;
+	}
+	for (uint32_t v = 0; v < numVertices; v++) {
+		adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+	}
+	std::vector<uint32_t> adjacency(3 * numTriangles);
+	{
+		std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (uint32_t i = 0; i < 3 * numTriangles; i++) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<bool> emitted(numTriangles, false);
+	// Which meshlet last took each vertex, so membership needs no clearing between meshlets.
+	std::vector<uint32_t> vertexMeshlet(numVertices, ~0u);
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> meshletTriangles;
+	std::vector<std::vector<uint32_t>> meshlets;
+	uint32_t nextSeed = 0;
+
+	while (true) {
+		while (nextSeed < numTriangles && emitted[seedOrder[nextSeed]]) {
+			nextSeed++;
+		}
+		if (nextSeed == numTriangles) {
+			break;
+		}
+
+		const uint32_t meshletId = static_cast<uint32_t>(meshlets.size());
+		uint32_t meshletVertices = 0;
+		glm::vec3 centroidSum(0.0f);
+		meshletTriangles.clear();
+		candidates.clear();
+
+		auto newVertices = [&](uint32_t t) {
+			uint32_t count = 0;
+			for (uint32_t k = 0; k < 3; k++) {
+				count += vertexMeshlet[indices[3 * t + k]] != meshletId ? 1 : 0;
+			}
+			return count;
+		};
+		auto add = [&](uint32_t t) {
+			emitted[t] = true;
+			meshletTriangles.push_back(t);
+			centroidSum += centroids[t];
+			for (uint32_t k = 0; k < 3; k++) {
+				const uint32_t v = indices[3 * t + k];
+				if (vertexMeshlet[v] != meshletId) {
+					vertexMeshlet[v] = meshletId;
+					meshletVertices++;
+				}
+				for (uint32_t a = adjacencyOffsets[v]; a < adjacencyOffsets[v + 1]; a++) {
+					if (!emitted[adjacency[a]]) {
+						candidates.push_back(adjacency[a]);
+					}
+				}
+			}
+		};
+
+		add(seedOrder[nextSeed]);
+		while (meshletTriangles.size() < maxTriangles) {
+			const glm::vec3 centre = centroidSum / static_cast<float>(meshletTriangles.size());
+			uint32_t best = ~0u;
+			uint32_t bestNew = 4;
+			float bestDistance = std::numeric_limits<float>::max();
+			uint32_t kept = 0;
+			for (uint32_t c = 0; c < candidates.size(); c++) {
+				const uint32_t t = candidates[c];
+				if (emitted[t]) {
+					continue;
+				}
+				candidates[kept++] = t;
+				const uint32_t added = newVertices(t);
+				if (meshletVertices + added > maxVertices) {
+					continue;
+				}
+				const glm::vec3 offset = centroids[t] - centre;
+				const float distance = glm::dot(offset, offset);
+				if (added < bestNew || (added == bestNew && distance < bestDistance)) {
+					best = t;
+					bestNew = added;
+					bestDistance = distance;
+				}
+			}
+			candidates.resize(kept);
+
+			// Nothing connected fits, so the meshlet carries on with the next triangle along the curve.
+			// Disconnected cards and islands would otherwise make meshlets of a handful of triangles.
+			if (best == ~0u) {
+				while (nextSeed < numTriangles && emitted[seedOrder[nextSeed]]) {
+					nextSeed++;
+				}
+				if (nextSeed == numTriangles || meshletVertices + newVertices(seedOrder[nextSeed]) > maxVertices) {
+					break;
+				}
+				best = seedOrder[nextSeed];
+			}
+			add(best);
+		}
+		meshlets.push_back(meshletTriangles);
+	}
+
+	// Meshlets in the order of their centres along the curve.
+	std::vector<MeshCluster> unordered;
+	std::vector<uint32_t> meshletIndices;
+	meshletIndices.reserve(3 * numTriangles);
+	for (const std::vector<uint32_t>& triangles : meshlets) {
+		const uint32_t first = static_cast<uint32_t>(meshletIndices.size());
+		for (uint32_t t : triangles) {
+			meshletIndices.insert(meshletIndices.end(), { indices[3 * t], indices[3 * t + 1], indices[3 * t + 2] });
+		}
+		unordered.push_back(computeClusterBounds(mesh.vertices, meshletIndices, first, 3 * static_cast<uint32_t>(triangles.size())));
+	}
+
+	std::vector<uint32_t> order(unordered.size());
+	{
+		std::vector<uint32_t> codes(unordered.size());
+		for (uint32_t m = 0; m < unordered.size(); m++) {
+			codes[m] = mortonCode(unordered[m].centre, lower, extent);
+			order[m] = m;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return codes[a] < codes[b]; });
+	}
+
+	mesh.indices.reserve(meshletIndices.size());
+	mesh.clusters.reserve(unordered.size());
+	for (uint32_t m : order) {
+		MeshCluster cluster = unordered[m];
+		const uint32_t first = static_cast<uint32_t>(mesh.indices.size());
+		mesh.indices.insert(mesh.indices.end(),
+			meshletIndices.begin() + cluster.firstIndex,
+			meshletIndices.begin() + cluster.firstIndex + cluster.indexCount);
+		cluster.firstIndex = first;
+		mesh.clusters.push_back(cluster);
+	}
+	return mesh;
+}
+
+bool checkMeshletCoverage(
+	const std::vector<uint32_t>& sourceIndices,
+	const ClusteredMesh& mesh,
+	uint32_t maxVertices,
+	uint32_t maxTriangles) {
+	if (sourceIndices.size() / 3 * 3 != mesh.indices.size()) {
+		return false;
+	}
+
+	uint32_t nextIndex = 0;
+	std::vector<uint32_t> clusterVertices;
+	for (const MeshCluster& cluster : mesh.clusters) {
+		if (cluster.firstIndex != nextIndex ||
+			cluster.indexCount == 0 || cluster.indexCount % 3 != 0 ||
+			cluster.indexCount > 3 * maxTriangles ||
+			cluster.firstIndex + cluster.indexCount > mesh.indices.size()) {
+			return false;
+		}
+		clusterVertices.assign(mesh.indices.begin() + cluster.firstIndex, mesh.indices.begin() + cluster.firstIndex + cluster.indexCount);
+		std::sort(clusterVertices.begin(), clusterVertices.end());
+		const uint32_t distinct = static_cast<uint32_t>(std::unique(clusterVertices.begin(), clusterVertices.end()) - clusterVertices.begin());
+		if (distinct > maxVertices || distinct != cluster.vertexCount) {
+			return false;
+		}
+		nextIndex += cluster.indexCount;
+	}
+	if (nextIndex != mesh.indices.size()) {
+		return false;
+	}
+
+	// Same triangles on both sides, as many times each.
+	std::vector<std::array<uint32_t, 3>> source;
+	std::vector<std::array<uint32_t, 3>> clustered;
+	source.reserve(sourceIndices.size() / 3);
+	clustered.reserve(mesh.indices.size() / 3);
+	for (size_t i = 0; i + 2 < sourceIndices.size(); i += 3) {
+		source.push_back(triangleKey(sourceIndices[i], sourceIndices[i + 1], sourceIndices[i + 2]));
+		clustered.push_back(triangleKey(mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2]));
+	}
+	std::sort(source.begin(), source.end());
+	std::sort(clustered.begin(), clustered.end());
+	return source == clustered;
+}
+
+MeshCluster computeClusterBounds(
+	const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices,
+	uint32_t firstIndex,
+	uint32_t indexCount) {
+	MeshCluster cluster{};
+	cluster.firstIndex = firstIndex;
+	cluster.indexCount = indexCount;
+	{
+		std::vector<uint32_t> used(indices.begin() + firstIndex, indices.begin() + firstIndex + indexCount);
+		std::sort(used.begin(), used.end());
+		cluster.vertexCount = static_cast<uint32_t>(std::unique(used.begin(), used.end()) - used.begin());
+	}
+	cluster.coneAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+	cluster.coneCutoff = 2.0f;
+	if (indexCount == 0) {
+		return cluster;
+	}
+
+	// Sphere around the centre of the bounding box, a little looser than the smallest one.
+	glm::vec3 lower(std::numeric_limits<float>::max());
+	glm::vec3 upper(-std::numeric_limits<float>::max());
+	for (uint32_t i = firstIndex; i < firstIndex + indexCount; i++) {
+		const glm::vec3 p(vertices[indices[i]].pos);
+		lower = glm::min(lower, p);
+		upper = glm::max(upper, p);
+	}
+	cluster.centre = 0.5f * (lower + upper);
+	for (uint32_t i = firstIndex; i < firstIndex + indexCount; i++) {
+		cluster.radius = std::max(cluster.radius, glm::length(glm::vec3(vertices[indices[i]].pos) - cluster.centre));
+	}
+	cluster.coneApex = cluster.centre;
+
+	// Normal cone as in meshoptimizer: the axis is the mean face normal, the cutoff the sine of the
+	// widest angle to it, and the apex sits far enough behind the centre that every face plane is
+	// in front of it.
+	std::vector<glm::vec3> normals;
+	normals.reserve(indexCount / 3);
+	glm::vec3 axis(0.0f);
+	for (uint32_t i = firstIndex; i + 2 < firstIndex + indexCount; i += 3) {
+		const glm::vec3 a(vertices[indices[i]].pos);
+		const glm::vec3 b(vertices[indices[i + 1]].pos);
+		const glm::vec3 c(vertices[indices[i + 2]].pos);
+		const glm::vec3 n = glm::cross(b - a, c - a);
+		const float area = glm::length(n);
+		// Degenerate triangles are never rasterized, so they don't widen the cone.
+		if (area <= 1e-12f) {
+			normals.push_back(glm::vec3(0.0f));
+			continue;
+		}
+		normals.push_back(n / area);
+		axis += n / area;
+	}
+
+	const float axisLength = glm::length(axis);
+	if (axisLength <= 1e-6f) {
+		return cluster;
+	}
+	axis /= axisLength;
+
+	float minDot = 1.0f;
+	for (const glm::vec3& n : normals) {
+		if (n != glm::vec3(0.0f)) {
+			minDot = std::min(minDot, glm::dot(axis, n));
+		}
+	}
+	// Some normal is 90 degrees or more off the axis, so there is no direction every face turns away from.
+	if (minDot <= 0.0f) {
+		return cluster;
+	}
+
+	float maxT = 0.0f;
+	for (uint32_t k = 0; k < normals.size(); k++) {
+		if (normals[k] == glm::vec3(0.0f)) {
+			continue;
+		}
+		const glm::vec3 p0(vertices[indices[firstIndex + 3 * k]].pos);
+		const float dc = glm::dot(cluster.centre - p0, normals[k]);
+		const float dn = glm::dot(axis, normals[k]);
+		maxT = std::max(maxT, dc / dn);
+	}
+
+	cluster.coneAxis = axis;
+	cluster.coneApex = cluster.centre - axis * maxT;
+	cluster.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	return cluster;
+}
+
+PackedMeshCluster packMeshCluster(const MeshCluster& cluster) {
+	PackedMeshCluster packed{};
+	packed.sphere = glm::vec4(cluster.centre, cluster.radius);
+	packed.coneApex = glm::vec4(cluster.coneApex, cluster.coneCutoff);
+	packed.coneAxis = glm::vec4(cluster.coneAxis, 0.0f);
+	packed.draw = glm::uvec4(cluster.firstIndex, cluster.indexCount, 0, 0);
+	return packed;
+}
+
+std::array<glm::vec4, 6> computeFrustumPlanes(const glm::mat4& clipFromModel) {
+	// Gribb and Hartmann: each plane is a sum or difference of the rows of the matrix.
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(clipFromModel[0][i], clipFromModel[1][i], clipFromModel[2][i], clipFromModel[3][i]);
+	}
+
+	std::array<glm::vec4, 6> planes = {
+		rows[3] + rows[0],
+		rows[3] - rows[0],
+		rows[3] + rows[1],
+		rows[3] - rows[1],
+		rows[2],
+		rows[3] - rows[2]
+	};
+	for (glm::vec4& plane : planes) {
+		const float length = glm::length(glm::vec3(plane));
+		if (length > 0.0f) {
+			plane /= length;
+		}
+	}
+	return planes;
+}
@@ -19,13 +19,18 @@ void Pipeline::destroy() {
 	}
 }
 
-void Pipeline::createPipelineLayout(VkDescriptorSetLayout *descriptorLayout) {
+void Pipeline::createPipelineLayout(const std::vector<VkDescriptorSetLayout>& descriptorLayouts, uint32_t pushConstantSize, VkShaderStageFlags pushConstantStages) {
+	VkPushConstantRange pushConstantRange{};
+	pushConstantRange.stageFlags = pushConstantStages;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = pushConstantSize;
+
 	VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
 	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1;
-	pipelineLayoutInfo.pSetLayouts = descriptorLayout;
-	pipelineLayoutInfo.pushConstantRangeCount = 0;
-	pipelineLayoutInfo.pPushConstantRanges = nullptr;
+	pipelineLayoutInfo.setLayoutCount = static_cast<uint32_t>(descriptorLayouts.size());
+	pipelineLayoutInfo.pSetLayouts = descriptorLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = pushConstantSize > 0 ? 1 : 0;
+	pipelineLayoutInfo.pPushConstantRanges = pushConstantSize > 0 ? &pushConstantRange : nullptr;
 
 	if (vkCreatePipelineLayout(*device, &pipelineLayoutInfo, nullptr, &layout) != VK_SUCCESS) {
 		throw std::runtime_error("failed to create pipeline layout!");
@@ -59,7 +64,8 @@ void Pipeline::createPipeline(
 	VkSampleCountFlagBits msaaSamples,
 	VkPipelineDepthStencilStateCreateInfo depthStencil,
 	std::vector<VkPipelineColorBlendAttachmentState> colorBlendAttachments,
-	uint32_t subpassIndex) {
+	uint32_t subpassIndex,
+	bool sampleShading) {
 	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
 	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
 
@@ -128,7 +134,7 @@ void Pipeline::createPipeline(
 	multisampling.alphaToCoverageEnable = VK_FALSE;
 	multisampling.alphaToOneEnable = VK_FALSE;
 	multisampling.rasterizationSamples = msaaSamples;
-	multisampling.sampleShadingEnable = VK_TRUE; // enable sample shading in the pipeline
+	multisampling.sampleShadingEnable = sampleShading ? VK_TRUE : VK_FALSE; // enable sample shading in the pipeline
 	multisampling.minSampleShading = .2f; // min fraction for sample shading; closer to one is smoother
 
 	const VkColorComponentFlags colorFlags = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
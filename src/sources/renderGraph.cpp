@@ -0,0 +1,633 @@
+#include "renderGraph.h"
+
+#include <algorithm>
+
+namespace {
+	template <typename T>
+	uint64_t handleKey(T handle) {
+		return (uint64_t)handle;
+	}
+
+	VkImageAspectFlags getAspects(VkFormat format) {
+		switch (format) {
+		case VK_FORMAT_D16_UNORM:
+		case VK_FORMAT_X8_D24_UNORM_PACK32:
+		case VK_FORMAT_D32_SFLOAT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT;
+		case VK_FORMAT_D16_UNORM_S8_UINT:
+		case VK_FORMAT_D24_UNORM_S8_UINT:
+		case VK_FORMAT_D32_SFLOAT_S8_UINT:
+			return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+		default:
+			return VK_IMAGE_ASPECT_COLOR_BIT;
+		}
+	}
+
+	const std::pair<uint32_t, const char*> stageNames[] = {
+		{ VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, "top of pipe" },
+		{ VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, "draw indirect" },
+		{ VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, "vertex input" },
+		{ VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, "vertex shader" },
+		{ VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, "fragment shader" },
+		{ VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT, "early fragment tests" },
+		{ VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, "late fragment tests" },
+		{ VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, "color attachment output" },
+		{ VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, "compute shader" },
+		{ VK_PIPELINE_STAGE_TRANSFER_BIT, "transfer" },
+		{ VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, "bottom of pipe" }
+	};
+
+	const std::pair<uint32_t, const char*> accessNames[] = {
+		{ VK_ACCESS_INDIRECT_COMMAND_READ_BIT, "indirect command read" },
+		{ VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, "vertex attribute read" },
+		{ VK_ACCESS_SHADER_READ_BIT, "shader read" },
+		{ VK_ACCESS_SHADER_WRITE_BIT, "shader write" },
+		{ VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, "color attachment read" },
+		{ VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, "color attachment write" },
+		{ VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, "depth read" },
+		{ VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, "depth write" },
+		{ VK_ACCESS_TRANSFER_READ_BIT, "transfer read" },
+		{ VK_ACCESS_TRANSFER_WRITE_BIT, "transfer write" }
+	};
+
+	template <size_t N>
+	std::string describeFlags(uint32_t flags, const std::pair<uint32_t, const char*> (&names)[N]) {
+		std::string text;
+		for (const auto& name : names) {
+			if ((flags & name.first) != 0) {
+				text += text.empty() ? name.second : std::string(" | ") + name.second;
+			}
+		}
+		return text.empty() ? "none" : text;
+	}
+
+	const char* describeLayout(VkImageLayout layout) {
+		switch (layout) {
+		case VK_IMAGE_LAYOUT_UNDEFINED:
+			return "undefined";
+		case VK_IMAGE_LAYOUT_GENERAL:
+			return "general";
+		case VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL:
+			return "color attachment";
+		case VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL:
+			return "depth attachment";
+		case VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL:
+			return "transfer source";
+		case VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL:
+			return "transfer destination";
+		case VK_IMAGE_LAYOUT_PRESENT_SRC_KHR:
+			return "present";
+		default:
+			return "other";
+		}
+	}
+}
+
+RenderGraph::RenderGraph() :
+	device(nullptr),
+	isCompiled(false),
+	finalBarriers{} {}
+
+RenderGraph::RenderGraph(VkDevice* device) :
+	device(device),
+	isCompiled(false),
+	finalBarriers{} {}
+
+RenderGraph::~RenderGraph() {}
+
+RenderGraph::Access RenderGraph::getAccess(ResourceUsage usage, bool isWrite) {
+	Access access{};
+	switch (usage) {
+	case ResourceUsage::ColorAttachment:
+		access = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+		break;
+	case ResourceUsage::DepthAttachment:
+		access = {
+			VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+			VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
+		};
+		break;
+	case ResourceUsage::TransferSource:
+		access = { VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL };
+		break;
+	case ResourceUsage::TransferDestination:
+		access = { VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL };
+		break;
+	case ResourceUsage::ComputeStorage:
+		access = { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		break;
+	case ResourceUsage::VertexShaderStorage:
+		access = { VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		break;
+	case ResourceUsage::VertexInput:
+		access = { VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+		break;
+	case ResourceUsage::IndirectCommand:
+		access = { VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+		break;
+	case ResourceUsage::FragmentShaderSampled:
+		access = { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+		break;
+	case ResourceUsage::FragmentShaderStorage:
+		access = { VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL };
+		break;
+	case ResourceUsage::Present:
+		access = { VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR };
+		break;
+	case ResourceUsage::HostRead:
+		access = { VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED };
+		break;
+	}
+
+	// A use is either a read or a write, the pass declares both when it does both.
+	if (isWrite) {
+		access.reads = 0;
+	}
+	else {
+		access.writes = 0;
+	}
+	return access;
+}
+
+void RenderGraph::reset() {
+	resources.clear();
+	passes.clear();
+	isCompiled = false;
+}
+
+RenderGraphResource RenderGraph::addResource(Resource resource) {
+	resources.push_back(resource);
+	isCompiled = false;
+	return static_cast<RenderGraphResource>(resources.size() - 1);
+}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, VulkanImage* image) {
+	return addResource({ name, true, false, image, image->image, getAspects(image->format), VK_NULL_HANDLE, 0, false, ResourceUsage::Present });
+}
+
+RenderGraphResource RenderGraph::importImage(const std::string& name, VkImage image, VkImageAspectFlags aspects, VkPipelineStageFlags availableStages) {
+	return addResource({ name, true, false, nullptr, image, aspects, VK_NULL_HANDLE, availableStages, false, ResourceUsage::Present });
+}
+
+RenderGraphResource RenderGraph::addTransientImage(const std::string& name, VulkanImage* image) {
+	return addResource({ name, true, true, image, image->image, getAspects(image->format), VK_NULL_HANDLE, 0, false, ResourceUsage::Present });
+}
+
+RenderGraphResource RenderGraph::importBuffer(const std::string& name, VkBuffer buffer) {
+	return addResource({ name, false, false, nullptr, VK_NULL_HANDLE, 0, buffer, 0, false, ResourceUsage::Present });
+}
+
+RenderGraphPass RenderGraph::addPass(const std::string& name, std::function<void(VkCommandBuffer)> record) {
+	passes.push_back({ name, std::move(record), {}, false, false });
+	isCompiled = false;
+	return static_cast<RenderGraphPass>(passes.size() - 1);
+}
+
+void RenderGraph::addUse(RenderGraphPass pass, RenderGraphResource resource, ResourceUsage usage, bool isWrite) {
+	if (pass >= passes.size() || resource >= resources.size()) {
+		throw std::runtime_error("The render graph has no such pass or resource.");
+	}
+	const Access access = getAccess(usage, isWrite);
+	if ((isWrite ? access.writes : access.reads) == 0) {
+		throw std::runtime_error("The pass " + passes[pass].name + " can't " + (isWrite ? "write " : "read ") + resources[resource].name + " that way.");
+	}
+	passes[pass].uses.push_back({ resource, usage, isWrite });
+	isCompiled = false;
+}
+
+void RenderGraph::read(RenderGraphPass pass, RenderGraphResource resource, ResourceUsage usage) {
+	addUse(pass, resource, usage, false);
+}
+
+void RenderGraph::write(RenderGraphPass pass, RenderGraphResource resource, ResourceUsage usage) {
+	addUse(pass, resource, usage, true);
+}
+
+void RenderGraph::setSideEffects(RenderGraphPass pass) {
+	passes.at(pass).hasSideEffects = true;
+	isCompiled = false;
+}
+
+void RenderGraph::setOutput(RenderGraphResource resource, ResourceUsage usage) {
+	resources.at(resource).isOutput = true;
+	resources.at(resource).outputUsage = usage;
+	isCompiled = false;
+}
+
+void RenderGraph::cullPasses() {
+	auto writes = [](const Pass& pass, RenderGraphResource resource) {
+		return std::any_of(pass.uses.begin(), pass.uses.end(), [resource](const Use& use) {
+			return use.isWrite && use.resource == resource;
+		});
+	};
+
+	std::vector<bool> isNeeded(passes.size(), false);
+	for (size_t p = 0; p < passes.size(); p++) {
+		isNeeded[p] = passes[p].hasSideEffects;
+	}
+	// The last pass to write an output.
+	for (RenderGraphResource r = 0; r < resources.size(); r++) {
+		if (!resources[r].isOutput) {
+			continue;
+		}
+		for (size_t p = passes.size(); p-- > 0;) {
+			if (writes(passes[p], r)) {
+				isNeeded[p] = true;
+				break;
+			}
+		}
+	}
+	// Walking backwards, a pass that is needed needs the last writer of everything it reads.
+	for (size_t p = passes.size(); p-- > 0;) {
+		if (!isNeeded[p]) {
+			continue;
+		}
+		for (const Use& use : passes[p].uses) {
+			if (use.isWrite) {
+				continue;
+			}
+			for (size_t q = p; q-- > 0;) {
+				if (writes(passes[q], use.resource)) {
+					isNeeded[q] = true;
+					break;
+				}
+			}
+		}
+	}
+
+	for (size_t p = 0; p < passes.size(); p++) {
+		passes[p].isCulled = !isNeeded[p];
+	}
+}
+
+RenderGraph::ResourceState RenderGraph::getInitialState(const Resource& resource, const std::vector<ResourceState>& slots) const {
+	ResourceState state{ VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0, 0 };
+	const uint64_t key = resource.isImage ? handleKey(resource.vkImage) : handleKey(resource.buffer);
+
+	if (resource.isTransient) {
+		// Waits for whoever used the memory last, this frame or the one before, and throws its content away.
+		const auto slot = transientSlots.find(key);
+		const auto retained = retainedStates.find(key);
+		if (slot != transientSlots.end()) {
+			state = slots[slot->second];
+		}
+		else if (retained != retainedStates.end()) {
+			state = retained->second;
+		}
+		state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		state.visibleStages = 0;
+		state.visibleAccesses = 0;
+	}
+	else if (resource.isImage && resource.image == nullptr) {
+		state.readStages = resource.availableStages;
+	}
+	else {
+		const auto retained = retainedStates.find(key);
+		if (retained != retainedStates.end()) {
+			state = retained->second;
+		}
+		if (resource.image != nullptr) {
+			state.layout = resource.image->currentLayout;
+		}
+	}
+	return state;
+}
+
+void RenderGraph::transition(BarrierBatch& batch, RenderGraphResource r, ResourceState& state, const Access& access) {
+	const Resource& resource = resources[r];
+	const VkImageLayout oldLayout = state.layout;
+	const bool changesLayout = resource.isImage && oldLayout != access.layout;
+	VkPipelineStageFlags srcStages = 0;
+	VkAccessFlags srcAccesses = 0;
+	bool needsBarrier = false;
+
+	if (access.writes != 0 || changesLayout) {
+		// Writes and layout changes wait for every use since the last write, and for the write itself.
+		srcStages = state.writeStages | state.readStages;
+		srcAccesses = state.writeAccesses;
+		needsBarrier = srcStages != 0 || changesLayout;
+
+		if (access.writes != 0) {
+			state.writeStages = access.stages;
+			state.writeAccesses = access.writes;
+			state.visibleStages = 0;
+			state.visibleAccesses = 0;
+		}
+		else {
+			// The layout change writes the image too, before the stages of this pass.
+			state.writeStages = access.stages;
+			state.writeAccesses = 0;
+			state.visibleStages = access.stages;
+			state.visibleAccesses = access.reads;
+		}
+		state.readStages = access.reads != 0 ? access.stages : 0;
+		if (resource.isImage) {
+			state.layout = access.layout;
+		}
+	}
+	else {
+		// Reads only wait for the last write, unless it was made visible to them already.
+		if (state.writeStages != 0 && ((access.stages & ~state.visibleStages) != 0 || (access.reads & ~state.visibleAccesses) != 0)) {
+			srcStages = state.writeStages;
+			srcAccesses = state.writeAccesses;
+			needsBarrier = true;
+			state.visibleStages |= access.stages;
+			state.visibleAccesses |= access.reads;
+		}
+		state.readStages |= access.stages;
+	}
+
+	if (!needsBarrier) {
+		return;
+	}
+
+	batch.srcStages |= srcStages;
+	batch.dstStages |= access.stages;
+	if (resource.isImage) {
+		batch.imageBarriers.push_back(makeImageMemoryBarrier(resource.vkImage, srcAccesses, access.reads | access.writes, oldLayout, state.layout, resource.aspects));
+		batch.images.push_back(r);
+	}
+	else {
+		batch.srcAccesses |= srcAccesses;
+		batch.dstAccesses |= access.reads | access.writes;
+		batch.buffers.push_back(r);
+	}
+}
+
+void RenderGraph::compile() {
+	cullPasses();
+
+	std::vector<ResourceState> states(resources.size());
+	std::vector<ResourceState> slots = slotStates;
+	passBarriers.assign(passes.size(), BarrierBatch{});
+	finalBarriers = BarrierBatch{};
+	lifetimes.assign(resources.size(), { -1, -1 });
+
+	auto start = [&](RenderGraphResource r, int pass) {
+		if (lifetimes[r].first < 0) {
+			states[r] = getInitialState(resources[r], slots);
+			lifetimes[r].first = pass;
+		}
+		lifetimes[r].second = pass;
+	};
+	auto updateSlot = [&](RenderGraphResource r) {
+		const auto slot = transientSlots.find(handleKey(resources[r].vkImage));
+		if (resources[r].isTransient && slot != transientSlots.end()) {
+			slots[slot->second] = states[r];
+		}
+	};
+
+	for (size_t p = 0; p < passes.size(); p++) {
+		if (passes[p].isCulled) {
+			continue;
+		}
+
+		// Uses of the same resource in one pass are merged, images can only be in one layout though.
+		std::vector<std::pair<RenderGraphResource, Access>> accesses;
+		for (const Use& use : passes[p].uses) {
+			const Access access = getAccess(use.usage, use.isWrite);
+			auto merged = std::find_if(accesses.begin(), accesses.end(), [&use](const auto& pair) {
+				return pair.first == use.resource;
+			});
+			if (merged == accesses.end()) {
+				accesses.push_back({ use.resource, access });
+				continue;
+			}
+			if (resources[use.resource].isImage && merged->second.layout != access.layout) {
+				throw std::runtime_error("The pass " + passes[p].name + " uses " + resources[use.resource].name + " in two layouts.");
+			}
+			merged->second.stages |= access.stages;
+			merged->second.reads |= access.reads;
+			merged->second.writes |= access.writes;
+		}
+
+		for (const auto& pair : accesses) {
+			start(pair.first, static_cast<int>(p));
+			transition(passBarriers[p], pair.first, states[pair.first], pair.second);
+			updateSlot(pair.first);
+		}
+	}
+
+	// Outputs end the frame in the layout they are handed on in, visible to whoever reads them next.
+	for (RenderGraphResource r = 0; r < resources.size(); r++) {
+		if (resources[r].isOutput && lifetimes[r].first >= 0) {
+			transition(finalBarriers, r, states[r], getAccess(resources[r].outputUsage, false));
+		}
+	}
+
+	finalStates = states;
+	finalSlotStates = slots;
+	isCompiled = true;
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer commandBuffer, const BarrierBatch& batch) const {
+	if (batch.dstStages == 0) {
+		return;
+	}
+
+	// Waiting only on reads needs no memory barrier, the execution dependency is enough.
+	VkMemoryBarrier memoryBarrier{ VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+	memoryBarrier.srcAccessMask = batch.srcAccesses;
+	memoryBarrier.dstAccessMask = batch.dstAccesses;
+	const uint32_t numMemoryBarriers = batch.srcAccesses != 0 ? 1 : 0;
+	// Nothing to wait for, e.g. the first use of an image this frame.
+	VkPipelineStageFlags srcStages = batch.srcStages;
+	if (srcStages == 0) {
+		srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	}
+
+	vkCmdPipelineBarrier(commandBuffer,
+		srcStages,
+		batch.dstStages,
+		0,
+		numMemoryBarriers, &memoryBarrier,
+		0, nullptr,
+		static_cast<uint32_t>(batch.imageBarriers.size()), batch.imageBarriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer commandBuffer) {
+	if (!isCompiled) {
+		throw std::runtime_error("The render graph has to be compiled before it is executed.");
+	}
+
+	// Images keep their layout up to date as the frame goes, the passes may look at it.
+	auto applyLayouts = [this](const BarrierBatch& batch) {
+		for (size_t i = 0; i < batch.images.size(); i++) {
+			VulkanImage* image = resources[batch.images[i]].image;
+			if (image != nullptr) {
+				image->currentLayout = batch.imageBarriers[i].newLayout;
+				image->currentAccesses = batch.imageBarriers[i].dstAccessMask;
+			}
+		}
+	};
+
+	for (size_t p = 0; p < passes.size(); p++) {
+		if (passes[p].isCulled) {
+			continue;
+		}
+		recordBarriers(commandBuffer, passBarriers[p]);
+		applyLayouts(passBarriers[p]);
+		passes[p].record(commandBuffer);
+	}
+	recordBarriers(commandBuffer, finalBarriers);
+	applyLayouts(finalBarriers);
+
+	for (RenderGraphResource r = 0; r < resources.size(); r++) {
+		const Resource& resource = resources[r];
+		// Images known only by handle start over every frame.
+		if (lifetimes[r].first < 0 || (resource.isImage && resource.image == nullptr)) {
+			continue;
+		}
+		const ResourceState& state = finalStates[r];
+		retainedStates[resource.isImage ? handleKey(resource.vkImage) : handleKey(resource.buffer)] = state;
+		if (resource.image != nullptr) {
+			resource.image->currentLayout = state.layout;
+			resource.image->currentAccesses = state.writeAccesses | state.visibleAccesses;
+		}
+	}
+	slotStates = finalSlotStates;
+}
+
+TransientMemoryPlan RenderGraph::planTransientMemory() const {
+	if (!isCompiled) {
+		throw std::runtime_error("The render graph has to be compiled before its memory is planned.");
+	}
+
+	std::vector<RenderGraphResource> transients;
+	for (RenderGraphResource r = 0; r < resources.size(); r++) {
+		if (resources[r].isTransient) {
+			transients.push_back(r);
+		}
+	}
+	std::stable_sort(transients.begin(), transients.end(), [this](RenderGraphResource a, RenderGraphResource b) {
+		return lifetimes[a].first < lifetimes[b].first;
+	});
+
+	TransientMemoryPlan plan{ {}, {}, 0, 0 };
+	// The lifetimes of the images in each slot.
+	std::vector<std::vector<std::pair<int, int>>> slotLifetimes;
+	for (RenderGraphResource r : transients) {
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(*device, resources[r].vkImage, &requirements);
+		plan.unaliasedSize += requirements.size;
+		const bool isLazilyAllocatable = (resources[r].image->getUsage() & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT) != 0;
+
+		const std::pair<int, int> lifetime = lifetimes[r];
+		uint32_t slot = static_cast<uint32_t>(plan.slots.size());
+		// Nothing is known about when an image no pass uses is used, so it gets memory of its own.
+		if (lifetime.first >= 0) {
+			for (uint32_t s = 0; s < plan.slots.size(); s++) {
+				if ((plan.slots[s].memoryTypeBits & requirements.memoryTypeBits) == 0 || plan.slots[s].isLazilyAllocatable != isLazilyAllocatable) {
+					continue;
+				}
+				const bool overlaps = std::any_of(slotLifetimes[s].begin(), slotLifetimes[s].end(), [&lifetime](const std::pair<int, int>& other) {
+					return other.first < 0 || (other.first <= lifetime.second && lifetime.first <= other.second);
+				});
+				if (!overlaps) {
+					slot = s;
+					break;
+				}
+			}
+		}
+
+		if (slot == plan.slots.size()) {
+			plan.slots.push_back({ requirements.size, requirements.alignment, requirements.memoryTypeBits, isLazilyAllocatable });
+			slotLifetimes.emplace_back();
+		}
+		else {
+			TransientMemorySlot& shared = plan.slots[slot];
+			shared.size = std::max(shared.size, requirements.size);
+			shared.alignment = std::max(shared.alignment, requirements.alignment);
+			shared.memoryTypeBits &= requirements.memoryTypeBits;
+		}
+		slotLifetimes[slot].push_back(lifetime);
+		plan.images.push_back({ resources[r].name, resources[r].image, slot, requirements.size });
+	}
+
+	for (const TransientMemorySlot& slot : plan.slots) {
+		plan.aliasedSize += slot.size;
+	}
+	return plan;
+}
+
+void RenderGraph::setTransientSlots(const TransientMemoryPlan& plan) {
+	transientSlots.clear();
+	for (const TransientImageBinding& binding : plan.images) {
+		transientSlots[handleKey(binding.image->image)] = binding.slot;
+	}
+	// The memory is new, nothing is pending on it.
+	slotStates.assign(plan.slots.size(), ResourceState{ VK_IMAGE_LAYOUT_UNDEFINED, 0, 0, 0, 0, 0 });
+	isCompiled = false;
+}
+
+void RenderGraph::dumpBarriers(std::ostream& out, const BarrierBatch& batch) const {
+	if (batch.dstStages == 0) {
+		return;
+	}
+
+	VkPipelineStageFlags srcStages = batch.srcStages;
+	if (srcStages == 0) {
+		srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	}
+	out << "      barrier: " << describeFlags(srcStages, stageNames) << " -> " << describeFlags(batch.dstStages, stageNames) << "\n";
+	if (!batch.buffers.empty()) {
+		out << "        buffers:";
+		for (size_t i = 0; i < batch.buffers.size(); i++) {
+			out << (i == 0 ? " " : ", ") << resources[batch.buffers[i]].name;
+		}
+		out << " (" << describeFlags(batch.srcAccesses, accessNames) << " -> " << describeFlags(batch.dstAccesses, accessNames) << ")\n";
+	}
+	for (size_t i = 0; i < batch.images.size(); i++) {
+		const VkImageMemoryBarrier& barrier = batch.imageBarriers[i];
+		out << "        image " << resources[batch.images[i]].name << ": "
+			<< describeLayout(barrier.oldLayout) << " -> " << describeLayout(barrier.newLayout)
+			<< " (" << describeFlags(barrier.srcAccessMask, accessNames) << " -> " << describeFlags(barrier.dstAccessMask, accessNames) << ")\n";
+	}
+}
+
+void RenderGraph::dumpSchedule(std::ostream& out) const {
+	if (!isCompiled) {
+		out << "Render graph: not compiled.\n";
+		return;
+	}
+
+	size_t numCulled = 0;
+	size_t numBatches = finalBarriers.dstStages != 0 ? 1 : 0;
+	for (size_t p = 0; p < passes.size(); p++) {
+		numCulled += passes[p].isCulled ? 1 : 0;
+		numBatches += passBarriers[p].dstStages != 0 ? 1 : 0;
+	}
+	out << "Render graph: " << passes.size() << " passes, " << numCulled << " culled, " << numBatches << " barrier batches.\n";
+
+	for (size_t p = 0; p < passes.size(); p++) {
+		if (passes[p].isCulled) {
+			out << "  -  " << passes[p].name << " (culled)\n";
+			continue;
+		}
+		out << "  " << p << "  " << passes[p].name << "\n";
+		dumpBarriers(out, passBarriers[p]);
+	}
+	out << "  end of frame\n";
+	dumpBarriers(out, finalBarriers);
+
+	out << "  Transient images:\n";
+	for (RenderGraphResource r = 0; r < resources.size(); r++) {
+		if (!resources[r].isTransient) {
+			continue;
+		}
+		out << "    " << resources[r].name << ": ";
+		if (lifetimes[r].first < 0) {
+			out << "unused";
+		}
+		else {
+			out << "passes " << lifetimes[r].first << " to " << lifetimes[r].second;
+		}
+		const auto slot = transientSlots.find(handleKey(resources[r].vkImage));
+		if (slot != transientSlots.end()) {
+			out << ", memory slot " << slot->second;
+		}
+		out << "\n";
+	}
+}
@@ -38,6 +38,7 @@ void RenderPass::addSubpass(
 	subpassColorRefs.emplace_back();
 	subpassInputRefs.emplace_back();
 	subpassDepthRefs.emplace_back();
+	subpassResolveRefs.emplace_back();
 	for (auto& pair : usageMap) {
 		switch (pair.second) {
 			case COLOR: {
@@ -61,6 +62,13 @@ void RenderPass::addSubpass(
 				subpassInputRefs.back().push_back(inputAttachment);
 				break;
 			}
+			case RESOLVE: {
+				VkAttachmentReference resolveAttachment = {};
+				resolveAttachment.attachment = pair.first;
+				resolveAttachment.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+				subpassResolveRefs.back().push_back(resolveAttachment);
+				break;
+			}
 			default: {
 				throw std::runtime_error("Unknown attachment type!");
 			}
@@ -72,6 +80,11 @@ void RenderPass::addSubpass(
 	subpass.inputAttachmentCount = static_cast<uint32_t>(subpassInputRefs.back().size());
 	subpass.pInputAttachments = subpassInputRefs.back().empty() ? nullptr : subpassInputRefs.back().data();
 	subpass.pDepthStencilAttachment = subpassDepthRefs.back().empty() ? nullptr : &subpassDepthRefs.back()[0];
+	// Vulkan takes either no resolve attachments or one for every color attachment.
+	if (!subpassResolveRefs.back().empty() && subpassResolveRefs.back().size() != subpassColorRefs.back().size()) {
+		throw std::runtime_error("Every color attachment needs a resolve attachment!");
+	}
+	subpass.pResolveAttachments = subpassResolveRefs.back().empty() ? nullptr : subpassResolveRefs.back().data();
 
 	subpasses.emplace_back(subpass);
 }
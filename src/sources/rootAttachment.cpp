@@ -0,0 +1,194 @@
+#include "rootAttachment.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+// Closest point on triangle abc to p, returned as barycentric coordinates (Ericson, Real-Time Collision Detection 5.1.5).
+static glm::vec3 closestBarycentric(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+	const glm::vec3 ab = b - a;
+	const glm::vec3 ac = c - a;
+	const glm::vec3 ap = p - a;
+	const float d1 = glm::dot(ab, ap);
+	const float d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		return glm::vec3(1.0f, 0.0f, 0.0f);
+	}
+
+	const glm::vec3 bp = p - b;
+	const float d3 = glm::dot(ab, bp);
+	const float d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) {
+		return glm::vec3(0.0f, 1.0f, 0.0f);
+	}
+
+	const float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		const float v = d1 / (d1 - d3);
+		return glm::vec3(1.0f - v, v, 0.0f);
+	}
+
+	const glm::vec3 cp = p - c;
+	const float d5 = glm::dot(ab, cp);
+	const float d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) {
+		return glm::vec3(0.0f, 0.0f, 1.0f);
+	}
+
+	const float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		const float w = d2 / (d2 - d6);
+		return glm::vec3(1.0f - w, 0.0f, w);
+	}
+
+	const float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+		const float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		return glm::vec3(0.0f, 1.0f - w, w);
+	}
+
+	const float denominator = 1.0f / (va + vb + vc);
+	const float v = vb * denominator;
+	const float w = vc * denominator;
+	return glm::vec3(1.0f - v - w, v, w);
+}
+
+// Columns: tangent along the first edge, bitangent, face normal.
+static glm::mat3 triangleFrame(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2) {
+	const glm::vec3 e1 = p1 - p0;
+	const glm::vec3 e2 = p2 - p0;
+	const glm::vec3 n = glm::normalize(glm::cross(e1, e2));
+	const glm::vec3 t = glm::normalize(e1);
+	return glm::mat3(t, glm::cross(n, t), n);
+}
+
+RootAttachment::RootAttachment() {}
+
+RootAttachment::RootAttachment(
+	const std::vector<Vertex>& headVertices,
+	const std::vector<uint32_t>& headIndices,
+	const GuideStrands& strands,
+	ThreadPool& pool) {
+	const uint32_t numTriangles = static_cast<uint32_t>(headIndices.size() / 3);
+	if (numTriangles == 0) {
+		throw std::runtime_error("Hair roots need a head mesh with triangles to attach to.");
+	}
+
+	// Degenerate triangles have no frame, so they can't carry a root.
+	// The others are gathered with a bounding sphere, which lets the search skip most of them.
+	std::vector<glm::vec3> candidateCorners;
+	std::vector<glm::vec4> candidateSpheres;
+	std::vector<uint32_t> candidates;
+	for (uint32_t t = 0; t < numTriangles; t++) {
+		const glm::vec3 a(headVertices[headIndices[3 * t]].pos);
+		const glm::vec3 b(headVertices[headIndices[3 * t + 1]].pos);
+		const glm::vec3 c(headVertices[headIndices[3 * t + 2]].pos);
+		if (glm::length(glm::cross(b - a, c - a)) <= 1e-12f) {
+			continue;
+		}
+		const glm::vec3 centre = (a + b + c) / 3.0f;
+		const float radius = std::max({ glm::length(a - centre), glm::length(b - centre), glm::length(c - centre) });
+		candidates.push_back(t);
+		candidateCorners.push_back(a);
+		candidateCorners.push_back(b);
+		candidateCorners.push_back(c);
+		candidateSpheres.push_back(glm::vec4(centre, radius));
+	}
+	if (candidates.empty()) {
+		throw std::runtime_error("Hair roots need a head mesh with triangles to attach to.");
+	}
+
+	const uint32_t numRoots = strands.numStrands;
+	triangles.resize(numRoots);
+	corners.resize(numRoots);
+	barycentrics.resize(numRoots);
+	localOffsets.resize(numRoots);
+	restCorners.resize(static_cast<size_t>(numRoots) * 3);
+	inverseRestFrames.resize(numRoots);
+	positions.resize(numRoots);
+	rotations.assign(numRoots, glm::mat3(1.0f));
+
+	// Brute force over the triangles. It only runs once at load, for about a thousand roots.
+	pool.parallelFor(numRoots, [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t s = begin; s < end; s++) {
+			const glm::vec3 root = strands.restPositions[s * strands.verticesPerStrand];
+
+			float best = std::numeric_limits<float>::max();
+			uint32_t bestCandidate = 0;
+			for (uint32_t k = 0; k < candidates.size(); k++) {
+				const glm::vec4& sphere = candidateSpheres[k];
+				const float sphereDistance = glm::length(root - glm::vec3(sphere)) - sphere.w;
+				if (sphereDistance > 0.0f && sphereDistance * sphereDistance >= best) {
+					continue;
+				}
+
+				const glm::vec3& a = candidateCorners[3 * k];
+				const glm::vec3& b = candidateCorners[3 * k + 1];
+				const glm::vec3& c = candidateCorners[3 * k + 2];
+				const glm::vec3 uvw = closestBarycentric(root, a, b, c);
+				const glm::vec3 closest = uvw.x * a + uvw.y * b + uvw.z * c;
+				const float d = glm::dot(root - closest, root - closest);
+				if (d < best) {
+					best = d;
+					bestCandidate = k;
+					barycentrics[s] = uvw;
+				}
+			}
+
+			const uint32_t t = candidates[bestCandidate];
+			triangles[s] = t;
+			corners[s] = glm::uvec3(headIndices[3 * t], headIndices[3 * t + 1], headIndices[3 * t + 2]);
+			for (uint32_t k = 0; k < 3; k++) {
+				restCorners[3 * s + k] = candidateCorners[3 * bestCandidate + k];
+			}
+
+			const glm::vec3& a = restCorners[3 * s];
+			const glm::vec3& b = restCorners[3 * s + 1];
+			const glm::vec3& c = restCorners[3 * s + 2];
+			const glm::mat3 frame = triangleFrame(a, b, c);
+			const glm::vec3 surface = barycentrics[s].x * a + barycentrics[s].y * b + barycentrics[s].z * c;
+			// Roots past an edge of their triangle are off to the side as well, so the whole offset is kept.
+			inverseRestFrames[s] = glm::transpose(frame);
+			localOffsets[s] = inverseRestFrames[s] * (root - surface);
+			positions[s] = surface + frame * localOffsets[s];
+		}
+	});
+}
+
+uint32_t RootAttachment::size() const {
+	return static_cast<uint32_t>(triangles.size());
+}
+
+uint32_t RootAttachment::getTriangle(uint32_t root) const {
+	return triangles[root];
+}
+
+glm::vec3 RootAttachment::getBarycentric(uint32_t root) const {
+	return barycentrics[root];
+}
+
+void RootAttachment::evaluate(uint32_t root, const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2) {
+	const glm::mat3 frame = triangleFrame(p0, p1, p2);
+	const glm::vec3& uvw = barycentrics[root];
+	positions[root] = uvw.x * p0 + uvw.y * p1 + uvw.z * p2 + frame * localOffsets[root];
+	rotations[root] = frame * inverseRestFrames[root];
+}
+
+void RootAttachment::update(const glm::mat4& transform, ThreadPool& pool) {
+	pool.parallelFor(size(), [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t s = begin; s < end; s++) {
+			evaluate(s,
+				glm::vec3(transform * glm::vec4(restCorners[3 * s], 1.0f)),
+				glm::vec3(transform * glm::vec4(restCorners[3 * s + 1], 1.0f)),
+				glm::vec3(transform * glm::vec4(restCorners[3 * s + 2], 1.0f)));
+		}
+	});
+}
+
+void RootAttachment::update(const std::vector<glm::vec3>& headPositions, ThreadPool& pool) {
+	pool.parallelFor(size(), [&](uint32_t begin, uint32_t end, uint32_t) {
+		for (uint32_t s = begin; s < end; s++) {
+			evaluate(s, headPositions[corners[s].x], headPositions[corners[s].y], headPositions[corners[s].z]);
+		}
+	});
+}
@@ -0,0 +1,594 @@
+#include "simulationCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const char CACHE_MAGIC[4] = { 'H', 'S', 'C', 'F' };
+static const uint32_t CACHE_VERSION = 1;
+
+// LZ4 block format: a sequence is a token (literal length << 4 | match length - 4), the literals,
+// a 16 bit little endian offset back into the output and the match. Lengths of 15 and more
+// continue in extra bytes. The last sequence only has literals.
+static const uint32_t LZ4_MIN_MATCH = 4;
+// The format wants the last 5 bytes to be literals and no match to start in the last 12.
+static const uint32_t LZ4_LAST_LITERALS = 5;
+static const uint32_t LZ4_MATCH_FIND_LIMIT = 12;
+static const uint32_t LZ4_MAX_OFFSET = 65535;
+static const uint32_t LZ4_HASH_BITS = 12;
+
+static size_t lz4CompressBound(size_t size) {
+	return size + size / 255 + 16;
+}
+
+static uint32_t read32(const uint8_t* p) {
+	uint32_t value;
+	std::memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint8_t* writeLength(uint8_t* out, size_t length) {
+	while (length >= 255) {
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = static_cast<uint8_t>(length);
+	return out;
+}
+
+static uint8_t* writeLiterals(uint8_t* out, const uint8_t* literals, size_t numLiterals, uint8_t matchToken) {
+	uint8_t* token = out++;
+	*token = matchToken;
+	if (numLiterals >= 15) {
+		*token |= 15 << 4;
+		out = writeLength(out, numLiterals - 15);
+	}
+	else {
+		*token |= static_cast<uint8_t>(numLiterals << 4);
+	}
+	std::memcpy(out, literals, numLiterals);
+	return out + numLiterals;
+}
+
+// dst must hold lz4CompressBound(size) bytes. Returns the compressed size.
+static size_t lz4Compress(const uint8_t* src, size_t size, uint8_t* dst) {
+	const uint32_t empty = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> table(size_t(1) << LZ4_HASH_BITS, empty);
+
+	uint8_t* out = dst;
+	size_t anchor = 0;
+	size_t pos = 0;
+
+	if (size > LZ4_MATCH_FIND_LIMIT) {
+		const size_t matchLimit = size - LZ4_LAST_LITERALS;
+		while (pos < size - LZ4_MATCH_FIND_LIMIT) {
+			const uint32_t sequence = read32(src + pos);
+			const uint32_t hash = (sequence * 2654435761u) >> (32 - LZ4_HASH_BITS);
+			const uint32_t candidate = table[hash];
+			table[hash] = static_cast<uint32_t>(pos);
+
+			if (candidate == empty || pos - candidate > LZ4_MAX_OFFSET || read32(src + candidate) != sequence) {
+				pos++;
+				continue;
+			}
+
+			size_t length = LZ4_MIN_MATCH;
+			while (pos + length < matchLimit && src[candidate + length] == src[pos + length]) {
+				length++;
+			}
+
+			const size_t matchLength = length - LZ4_MIN_MATCH;
+			out = writeLiterals(out, src + anchor, pos - anchor, static_cast<uint8_t>(std::min<size_t>(matchLength, 15)));
+			const uint16_t offset = static_cast<uint16_t>(pos - candidate);
+			*out++ = static_cast<uint8_t>(offset & 0xff);
+			*out++ = static_cast<uint8_t>(offset >> 8);
+			if (matchLength >= 15) {
+				out = writeLength(out, matchLength - 15);
+			}
+
+			pos += length;
+			anchor = pos;
+		}
+	}
+
+	out = writeLiterals(out, src + anchor, size - anchor, 0);
+	return static_cast<size_t>(out - dst);
+}
+
+// Returns false if src is not a valid block that decodes to exactly dstSize bytes.
+static bool lz4Decompress(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize) {
+	const uint8_t* in = src;
+	const uint8_t* const inEnd = src + srcSize;
+	uint8_t* out = dst;
+	uint8_t* const outEnd = dst + dstSize;
+
+	auto readLength = [&](size_t& length) {
+		uint8_t byte;
+		do {
+			if (in >= inEnd) {
+				return false;
+			}
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	};
+
+	while (in < inEnd) {
+		const uint8_t token = *in++;
+
+		size_t numLiterals = token >> 4;
+		if (numLiterals == 15 && !readLength(numLiterals)) {
+			return false;
+		}
+		if (numLiterals > static_cast<size_t>(inEnd - in) || numLiterals > static_cast<size_t>(outEnd - out)) {
+			return false;
+		}
+		std::memcpy(out, in, numLiterals);
+		in += numLiterals;
+		out += numLiterals;
+
+		if (in == inEnd) {
+			break;
+		}
+
+		if (inEnd - in < 2) {
+			return false;
+		}
+		const size_t offset = size_t(in[0]) | (size_t(in[1]) << 8);
+		in += 2;
+		if (offset == 0 || offset > static_cast<size_t>(out - dst)) {
+			return false;
+		}
+
+		size_t length = token & 15;
+		if (length == 15 && !readLength(length)) {
+			return false;
+		}
+		length += LZ4_MIN_MATCH;
+		if (length > static_cast<size_t>(outEnd - out)) {
+			return false;
+		}
+
+		const uint8_t* match = out - offset;
+		if (offset >= length) {
+			std::memcpy(out, match, length);
+			out += length;
+		}
+		else {
+			// The match overlaps what it writes, which repeats the last offset bytes.
+			for (size_t i = 0; i < length; i++) {
+				*out++ = *match++;
+			}
+		}
+	}
+
+	return out == outEnd;
+}
+
+// Groups byte b of every element together, which turns the slowly changing high bytes
+// of neighbouring values into runs the compressor can find.
+static void shuffleBytes(const uint8_t* src, uint8_t* dst, size_t numElements, size_t elementSize) {
+	for (size_t i = 0; i < numElements; i++) {
+		for (size_t b = 0; b < elementSize; b++) {
+			dst[b * numElements + i] = src[i * elementSize + b];
+		}
+	}
+}
+
+static void unshuffleBytes(const uint8_t* src, uint8_t* dst, size_t numElements, size_t elementSize) {
+	for (size_t b = 0; b < elementSize; b++) {
+		const uint8_t* plane = src + b * numElements;
+		for (size_t i = 0; i < numElements; i++) {
+			dst[i * elementSize + b] = plane[i];
+		}
+	}
+}
+
+// Neighbouring vertices of a strand move together, so the differences of the quantized values are
+// small and mostly leave the high bytes at 0x00 or 0xff. Wraps around, which decoding undoes.
+static void deltaEncode(uint16_t* values, size_t count) {
+	for (size_t i = count; i-- > 1;) {
+		values[i] = static_cast<uint16_t>(values[i] - values[i - 1]);
+	}
+}
+
+static void deltaDecode(uint16_t* values, size_t count) {
+	for (size_t i = 1; i < count; i++) {
+		values[i] = static_cast<uint16_t>(values[i] + values[i - 1]);
+	}
+}
+
+static size_t elementSizeOf(uint32_t flags) {
+	return (flags & SIMULATION_CACHE_QUANTIZED) ? sizeof(uint16_t) : sizeof(float);
+}
+
+SimulationCacheWriter::SimulationCacheWriter() :
+	header{},
+	offset(0) {}
+
+SimulationCacheWriter::~SimulationCacheWriter() {
+	// Errors can't be reported from here, an unfinished file just fails to open later.
+	try {
+		close();
+	}
+	catch (const std::exception&) {}
+}
+
+void SimulationCacheWriter::open(const std::string& path, const GuideStrands& strands, float frameDt, uint32_t flags) {
+	if (isOpen()) {
+		throw std::runtime_error("The simulation cache writer is already open.");
+	}
+
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open simulation cache " + path + " for writing!");
+	}
+
+	header = {};
+	std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+	header.version = CACHE_VERSION;
+	header.numStrands = strands.numStrands;
+	header.verticesPerStrand = strands.verticesPerStrand;
+	header.flags = flags;
+	header.frameDt = frameDt;
+	index.clear();
+
+	const uint32_t numVertices = strands.numVertices();
+	restPositions.resize(size_t(numVertices) * 3);
+	for (uint32_t i = 0; i < numVertices; i++) {
+		restPositions[i] = strands.restPositions[i].x;
+		restPositions[numVertices + i] = strands.restPositions[i].y;
+		restPositions[2 * size_t(numVertices) + i] = strands.restPositions[i].z;
+	}
+
+	// The header is written again with the frame count and the index offset on close.
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(restPositions.data()), restPositions.size() * sizeof(float));
+	offset = sizeof(header) + restPositions.size() * sizeof(float);
+}
+
+void SimulationCacheWriter::writeFrame(const GuideStrands& strands) {
+	if (!isOpen() || strands.numStrands != header.numStrands || strands.verticesPerStrand != header.verticesPerStrand) {
+		return;
+	}
+
+	const size_t numVertices = strands.numVertices();
+	const size_t numElements = numVertices * 3;
+	const size_t elementSize = elementSizeOf(header.flags);
+	const float* rest[3] = { restPositions.data(), restPositions.data() + numVertices, restPositions.data() + 2 * numVertices };
+	const std::vector<float>* positions[3] = { &strands.posX, &strands.posY, &strands.posZ };
+
+	SimulationCacheFrameHeader frameHeader{};
+	frameHeader.rawSize = static_cast<uint32_t>(numElements * elementSize);
+	raw.resize(frameHeader.rawSize);
+
+	for (int axis = 0; axis < 3; axis++) {
+		float lo = 0.0f;
+		float hi = 0.0f;
+		for (size_t i = 0; i < numVertices; i++) {
+			const float displacement = (*positions[axis])[i] - rest[axis][i];
+			lo = std::min(lo, displacement);
+			hi = std::max(hi, displacement);
+		}
+		frameHeader.boundsMin[axis] = lo;
+		frameHeader.boundsMax[axis] = hi;
+
+		if (header.flags & SIMULATION_CACHE_QUANTIZED) {
+			uint16_t* plane = reinterpret_cast<uint16_t*>(raw.data()) + axis * numVertices;
+			const float scale = hi > lo ? 65535.0f / (hi - lo) : 0.0f;
+			for (size_t i = 0; i < numVertices; i++) {
+				const float displacement = (*positions[axis])[i] - rest[axis][i];
+				plane[i] = static_cast<uint16_t>(std::lround((displacement - lo) * scale));
+			}
+		}
+		else {
+			float* plane = reinterpret_cast<float*>(raw.data()) + axis * numVertices;
+			for (size_t i = 0; i < numVertices; i++) {
+				plane[i] = (*positions[axis])[i] - rest[axis][i];
+			}
+		}
+	}
+
+	const uint8_t* payload = raw.data();
+	frameHeader.storedSize = frameHeader.rawSize;
+	if (header.flags & SIMULATION_CACHE_COMPRESSED) {
+		if (header.flags & SIMULATION_CACHE_QUANTIZED) {
+			deltaEncode(reinterpret_cast<uint16_t*>(raw.data()), numElements);
+		}
+		shuffled.resize(raw.size());
+		shuffleBytes(raw.data(), shuffled.data(), numElements, elementSize);
+		payload = shuffled.data();
+
+		compressed.resize(lz4CompressBound(shuffled.size()));
+		const size_t compressedSize = lz4Compress(shuffled.data(), shuffled.size(), compressed.data());
+		if (compressedSize < shuffled.size()) {
+			payload = compressed.data();
+			frameHeader.storedSize = static_cast<uint32_t>(compressedSize);
+		}
+	}
+
+	file.write(reinterpret_cast<const char*>(&frameHeader), sizeof(frameHeader));
+	file.write(reinterpret_cast<const char*>(payload), frameHeader.storedSize);
+
+	const uint64_t chunkSize = sizeof(frameHeader) + frameHeader.storedSize;
+	index.push_back({ offset, chunkSize });
+	offset += chunkSize;
+}
+
+void SimulationCacheWriter::close() {
+	if (!isOpen()) {
+		return;
+	}
+
+	header.numFrames = static_cast<uint32_t>(index.size());
+	header.indexOffset = offset;
+	file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(SimulationCacheIndexEntry));
+	offset += index.size() * sizeof(SimulationCacheIndexEntry);
+	file.seekp(0);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	const bool failed = !file.good();
+	file.close();
+	index.clear();
+	if (failed) {
+		throw std::runtime_error("failed to write simulation cache!");
+	}
+}
+
+bool SimulationCacheWriter::isOpen() const {
+	return file.is_open();
+}
+
+uint32_t SimulationCacheWriter::getNumFrames() const {
+	return static_cast<uint32_t>(index.size());
+}
+
+uint64_t SimulationCacheWriter::getFileSize() const {
+	return offset;
+}
+
+SimulationCacheReader::SimulationCacheReader() :
+	data(nullptr),
+	size(0),
+#ifdef _WIN32
+	fileHandle(nullptr),
+	mappingHandle(nullptr),
+#else
+	fileDescriptor(-1),
+#endif
+	header{} {}
+
+SimulationCacheReader::~SimulationCacheReader() {
+	close();
+}
+
+void SimulationCacheReader::map(const std::string& path) {
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("failed to open simulation cache " + path + "!");
+	}
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		unmap();
+		throw std::runtime_error("simulation cache " + path + " is empty!");
+	}
+	size = static_cast<uint64_t>(fileSize.QuadPart);
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mappingHandle == nullptr) {
+		unmap();
+		throw std::runtime_error("failed to map simulation cache " + path + "!");
+	}
+	data = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+#else
+	fileDescriptor = ::open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0) {
+		throw std::runtime_error("failed to open simulation cache " + path + "!");
+	}
+
+	struct stat status;
+	if (fstat(fileDescriptor, &status) != 0 || status.st_size == 0) {
+		unmap();
+		throw std::runtime_error("simulation cache " + path + " is empty!");
+	}
+	size = static_cast<uint64_t>(status.st_size);
+
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	data = mapping == MAP_FAILED ? nullptr : static_cast<const uint8_t*>(mapping);
+	if (data != nullptr) {
+		// Playback mostly goes through the frames in order.
+		madvise(mapping, size, MADV_SEQUENTIAL);
+	}
+#endif
+
+	if (data == nullptr) {
+		unmap();
+		throw std::runtime_error("failed to map simulation cache " + path + "!");
+	}
+}
+
+void SimulationCacheReader::unmap() {
+#ifdef _WIN32
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+	}
+	if (mappingHandle != nullptr) {
+		CloseHandle(mappingHandle);
+		mappingHandle = nullptr;
+	}
+	if (fileHandle != nullptr) {
+		CloseHandle(fileHandle);
+		fileHandle = nullptr;
+	}
+#else
+	if (data != nullptr) {
+		munmap(const_cast<uint8_t*>(data), size);
+	}
+	if (fileDescriptor >= 0) {
+		::close(fileDescriptor);
+		fileDescriptor = -1;
+	}
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+void SimulationCacheReader::open(const std::string& path) {
+	if (isOpen()) {
+		throw std::runtime_error("The simulation cache reader is already open.");
+	}
+
+	map(path);
+
+	auto fail = [&](const std::string& reason) {
+		unmap();
+		throw std::runtime_error("simulation cache " + path + " " + reason);
+	};
+
+	if (size < sizeof(header)) {
+		fail("is too small!");
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION) {
+		fail("is not a simulation cache of a supported version!");
+	}
+	if (header.numFrames == 0) {
+		fail("has no frames, it was probably not closed.");
+	}
+
+	const uint64_t numVertices = uint64_t(header.numStrands) * header.verticesPerStrand;
+	const uint64_t restSize = numVertices * 3 * sizeof(float);
+	const uint64_t indexSize = uint64_t(header.numFrames) * sizeof(SimulationCacheIndexEntry);
+	if (sizeof(header) + restSize > size || header.indexOffset > size || indexSize > size - header.indexOffset) {
+		fail("is truncated!");
+	}
+
+	restPositions.resize(numVertices * 3);
+	std::memcpy(restPositions.data(), data + sizeof(header), restSize);
+
+	index.resize(header.numFrames);
+	std::memcpy(index.data(), data + header.indexOffset, indexSize);
+	for (const SimulationCacheIndexEntry& entry : index) {
+		if (entry.offset > header.indexOffset || entry.size > header.indexOffset - entry.offset || entry.size < sizeof(SimulationCacheFrameHeader)) {
+			fail("has a broken index table!");
+		}
+	}
+}
+
+void SimulationCacheReader::close() {
+	unmap();
+	index.clear();
+	restPositions.clear();
+	header = {};
+}
+
+bool SimulationCacheReader::isOpen() const {
+	return data != nullptr;
+}
+
+uint32_t SimulationCacheReader::getNumFrames() const {
+	return header.numFrames;
+}
+
+uint32_t SimulationCacheReader::getNumStrands() const {
+	return header.numStrands;
+}
+
+uint32_t SimulationCacheReader::getVerticesPerStrand() const {
+	return header.verticesPerStrand;
+}
+
+uint32_t SimulationCacheReader::getFlags() const {
+	return header.flags;
+}
+
+float SimulationCacheReader::getFrameDt() const {
+	return header.frameDt;
+}
+
+uint64_t SimulationCacheReader::getFileSize() const {
+	return size;
+}
+
+void SimulationCacheReader::readFrame(uint32_t frame, GuideStrands& strands) {
+	if (!isOpen() || frame >= header.numFrames) {
+		throw std::runtime_error("simulation cache frame out of range!");
+	}
+	if (strands.numStrands != header.numStrands || strands.verticesPerStrand != header.verticesPerStrand) {
+		throw std::runtime_error("simulation cache doesn't match the layout of the guide strands!");
+	}
+
+	const SimulationCacheIndexEntry& entry = index[frame];
+	SimulationCacheFrameHeader frameHeader;
+	std::memcpy(&frameHeader, data + entry.offset, sizeof(frameHeader));
+	const uint8_t* payload = data + entry.offset + sizeof(frameHeader);
+
+	const size_t numVertices = strands.numVertices();
+	const size_t numElements = numVertices * 3;
+	const size_t elementSize = elementSizeOf(header.flags);
+	if (frameHeader.rawSize != numElements * elementSize || frameHeader.storedSize != entry.size - sizeof(frameHeader)) {
+		throw std::runtime_error("simulation cache frame is corrupt!");
+	}
+
+	const uint8_t* decoded = payload;
+	if (header.flags & SIMULATION_CACHE_COMPRESSED) {
+		const uint8_t* shuffledBytes = payload;
+		if (frameHeader.storedSize != frameHeader.rawSize) {
+			shuffled.resize(frameHeader.rawSize);
+			if (!lz4Decompress(payload, frameHeader.storedSize, shuffled.data(), shuffled.size())) {
+				throw std::runtime_error("simulation cache frame is corrupt!");
+			}
+			shuffledBytes = shuffled.data();
+		}
+		raw.resize(frameHeader.rawSize);
+		unshuffleBytes(shuffledBytes, raw.data(), numElements, elementSize);
+		if (header.flags & SIMULATION_CACHE_QUANTIZED) {
+			deltaDecode(reinterpret_cast<uint16_t*>(raw.data()), numElements);
+		}
+		decoded = raw.data();
+	}
+	else if (header.flags & SIMULATION_CACHE_QUANTIZED) {
+		// The mapping gives no alignment guarantees for the payload.
+		raw.assign(payload, payload + frameHeader.rawSize);
+		decoded = raw.data();
+	}
+
+	std::vector<float>* positions[3] = { &strands.posX, &strands.posY, &strands.posZ };
+	for (int axis = 0; axis < 3; axis++) {
+		const float* rest = restPositions.data() + axis * numVertices;
+		float* out = positions[axis]->data();
+
+		if (header.flags & SIMULATION_CACHE_QUANTIZED) {
+			const uint16_t* plane = reinterpret_cast<const uint16_t*>(decoded) + axis * numVertices;
+			const float lo = frameHeader.boundsMin[axis];
+			const float scale = (frameHeader.boundsMax[axis] - lo) / 65535.0f;
+			for (size_t i = 0; i < numVertices; i++) {
+				out[i] = rest[i] + lo + static_cast<float>(plane[i]) * scale;
+			}
+		}
+		else {
+			const uint8_t* plane = decoded + axis * numVertices * sizeof(float);
+			std::memcpy(out, plane, numVertices * sizeof(float));
+			for (size_t i = 0; i < numVertices; i++) {
+				out[i] += rest[i];
+			}
+		}
+	}
+}
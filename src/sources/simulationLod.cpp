@@ -0,0 +1,103 @@
+#include "simulationLod.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+SimulationLod::SimulationLod() :
+	hysteresis(0.0f),
+	currentLevel(0),
+	screenSize(0.0f) {}
+
+SimulationLod::SimulationLod(const std::vector<SimulationLodLevel>& levels, float hysteresis) :
+	levels(levels),
+	hysteresis(hysteresis),
+	currentLevel(0),
+	screenSize(0.0f) {
+	if (levels.empty()) {
+		throw std::runtime_error("The simulation LOD needs at least one level.");
+	}
+	for (size_t i = 1; i < levels.size(); i++) {
+		if (levels[i].minScreenSize >= levels[i - 1].minScreenSize) {
+			throw std::runtime_error("Simulation LOD levels must go from the largest to the smallest screen size.");
+		}
+	}
+}
+
+float SimulationLod::computeScreenSize(const GuideStrands& strands, const glm::mat4& viewProj, glm::vec2 viewportSize) {
+	if (strands.numVertices() == 0) {
+		return 0.0f;
+	}
+
+	glm::vec3 lo(std::numeric_limits<float>::max());
+	glm::vec3 hi(-std::numeric_limits<float>::max());
+	for (uint32_t i = 0; i < strands.numVertices(); i++) {
+		const glm::vec3 p = strands.position(i);
+		lo = glm::min(lo, p);
+		hi = glm::max(hi, p);
+	}
+
+	glm::vec2 ndcMin(std::numeric_limits<float>::max());
+	glm::vec2 ndcMax(-std::numeric_limits<float>::max());
+	for (int corner = 0; corner < 8; corner++) {
+		const glm::vec3 p(
+			(corner & 1) ? hi.x : lo.x,
+			(corner & 2) ? hi.y : lo.y,
+			(corner & 4) ? hi.z : lo.z
+		);
+		const glm::vec4 clip = viewProj * glm::vec4(p, 1.0f);
+		// Corners behind a perspective camera would flip, treat the hair as filling the screen.
+		if (clip.w <= 1e-6f) {
+			return std::max(viewportSize.x, viewportSize.y);
+		}
+		const glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+
+	// Only the part of the bounds inside the viewport counts.
+	ndcMin = glm::clamp(ndcMin, glm::vec2(-1.0f), glm::vec2(1.0f));
+	ndcMax = glm::clamp(ndcMax, glm::vec2(-1.0f), glm::vec2(1.0f));
+	const glm::vec2 pixels = (ndcMax - ndcMin) * 0.5f * viewportSize;
+	return std::max(pixels.x, pixels.y);
+}
+
+uint32_t SimulationLod::update(float screenSize) {
+	this->screenSize = screenSize;
+	if (levels.empty()) {
+		return 0;
+	}
+
+	// Coarser while clearly below the current level, finer while clearly above the next finer one.
+	while (currentLevel + 1 < levels.size() && screenSize < levels[currentLevel].minScreenSize * (1.0f - hysteresis)) {
+		currentLevel++;
+	}
+	while (currentLevel > 0 && screenSize > levels[currentLevel - 1].minScreenSize * (1.0f + hysteresis)) {
+		currentLevel--;
+	}
+
+	return currentLevel;
+}
+
+uint32_t SimulationLod::getLevel() const {
+	return currentLevel;
+}
+
+float SimulationLod::getScreenSize() const {
+	return screenSize;
+}
+
+const std::vector<SimulationLodLevel>& SimulationLod::getLevels() const {
+	return levels;
+}
+
+std::vector<uint32_t> SimulationLod::selectStrands(uint32_t level, uint32_t numStrands) const {
+	const uint32_t stride = std::max(levels.at(level).strandStride, 1u);
+
+	std::vector<uint32_t> strands;
+	strands.reserve(numStrands / stride + 1);
+	for (uint32_t s = 0; s < numStrands; s += stride) {
+		strands.push_back(s);
+	}
+	return strands;
+}
@@ -0,0 +1,182 @@
+#include "simulationScheduler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+
+SimulationScheduler::SimulationScheduler() :
+	simulation(nullptr),
+	fixedDt(1.0f / 60.0f),
+	maxStepsPerFrame(1),
+	accumulator(0.0f),
+	pendingAlpha(0.0f),
+	jobAlpha(0.0f),
+	hasJob(false),
+	stopping(false),
+	jobSteps(0) {}
+
+SimulationScheduler::~SimulationScheduler() {
+	destroy();
+}
+
+void SimulationScheduler::create(HairSimulation* simulation, float fixedDt, uint32_t maxStepsPerFrame) {
+	if (worker.joinable()) {
+		throw std::runtime_error("The simulation scheduler has already been created.");
+	}
+	if (simulation == nullptr || fixedDt <= 0.0f) {
+		throw std::runtime_error("The simulation scheduler needs a simulation and a positive timestep.");
+	}
+
+	this->simulation = simulation;
+	this->fixedDt = fixedDt;
+	this->maxStepsPerFrame = std::max(1u, maxStepsPerFrame);
+	accumulator = 0.0f;
+	pendingAlpha = 0.0f;
+	jobAlpha = 0.0f;
+	hasJob = false;
+	stopping = false;
+	jobError = nullptr;
+
+	renderStrands = simulation->strands;
+	resetState();
+
+	worker = std::thread(&SimulationScheduler::workerLoop, this);
+}
+
+void SimulationScheduler::destroy() {
+	if (!worker.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	jobCondition.notify_all();
+	worker.join();
+}
+
+float SimulationScheduler::getFixedDt() const {
+	return fixedDt;
+}
+
+void SimulationScheduler::setStepCallback(std::function<void(const GuideStrands&)> callback) {
+	stepCallback = std::move(callback);
+}
+
+uint32_t SimulationScheduler::advanceClock(float frameSeconds) {
+	accumulator += std::max(frameSeconds, 0.0f);
+
+	uint32_t steps = static_cast<uint32_t>(accumulator / fixedDt);
+	if (steps > maxStepsPerFrame) {
+		// Too far behind to catch up, so drop the backlog but keep the phase.
+		steps = maxStepsPerFrame;
+		accumulator = std::fmod(accumulator, fixedDt);
+	}
+	else {
+		accumulator -= static_cast<float>(steps) * fixedDt;
+	}
+
+	pendingAlpha = glm::clamp(accumulator / fixedDt, 0.0f, 1.0f);
+	return steps;
+}
+
+void SimulationScheduler::dispatch(uint32_t steps) {
+	if (!worker.joinable()) {
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobSteps = steps;
+		jobAlpha = pendingAlpha;
+		hasJob = true;
+	}
+	jobCondition.notify_one();
+}
+
+void SimulationScheduler::sync() {
+	if (!worker.joinable()) {
+		return;
+	}
+
+	float alpha;
+	std::exception_ptr error;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		doneCondition.wait(lock, [this] { return !hasJob; });
+		alpha = jobAlpha;
+		std::swap(error, jobError);
+	}
+	if (error) {
+		std::rethrow_exception(error);
+	}
+
+	const uint32_t numVertices = renderStrands.numVertices();
+	for (uint32_t i = 0; i < numVertices; i++) {
+		renderStrands.posX[i] = previousX[i] + (currentX[i] - previousX[i]) * alpha;
+		renderStrands.posY[i] = previousY[i] + (currentY[i] - previousY[i]) * alpha;
+		renderStrands.posZ[i] = previousZ[i] + (currentZ[i] - previousZ[i]) * alpha;
+	}
+}
+
+void SimulationScheduler::resetState() {
+	snapshot(previousX, previousY, previousZ);
+	snapshot(currentX, currentY, currentZ);
+	renderStrands.posX = currentX;
+	renderStrands.posY = currentY;
+	renderStrands.posZ = currentZ;
+}
+
+void SimulationScheduler::snapshot(std::vector<float>& x, std::vector<float>& y, std::vector<float>& z) const {
+	x = simulation->strands.posX;
+	y = simulation->strands.posY;
+	z = simulation->strands.posZ;
+}
+
+void SimulationScheduler::workerLoop() {
+	while (true) {
+		uint32_t steps;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			jobCondition.wait(lock, [this] { return hasJob || stopping; });
+			if (stopping) {
+				return;
+			}
+			steps = jobSteps;
+		}
+
+		runJob(steps);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			hasJob = false;
+		}
+		doneCondition.notify_all();
+	}
+}
+
+void SimulationScheduler::runJob(uint32_t steps) {
+	try {
+		for (uint32_t i = 0; i < steps; i++) {
+			// Only the last two states are needed for interpolation.
+			if (i + 1 == steps) {
+				snapshot(previousX, previousY, previousZ);
+			}
+			simulation->step(fixedDt);
+			if (stepCallback) {
+				stepCallback(simulation->strands);
+			}
+		}
+
+		if (steps > 0) {
+			snapshot(currentX, currentY, currentZ);
+		}
+	}
+	catch (...) {
+		// Escaping the worker would terminate the program, and sync() would wait for the job forever.
+		std::lock_guard<std::mutex> lock(mutex);
+		jobError = std::current_exception();
+	}
+}
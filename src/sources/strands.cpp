@@ -0,0 +1,222 @@
+#include "strands.h"
+
+#include <algorithm>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+GuideStrands::GuideStrands() :
+	numStrands(0),
+	verticesPerStrand(0) {}
+
+GuideStrands::GuideStrands(uint32_t numStrands, uint32_t verticesPerStrand) :
+	numStrands(numStrands),
+	verticesPerStrand(verticesPerStrand) {
+	const size_t count = static_cast<size_t>(numStrands) * verticesPerStrand;
+	posX.resize(count);
+	posY.resize(count);
+	posZ.resize(count);
+	velX.assign(count, 0.0f);
+	velY.assign(count, 0.0f);
+	velZ.assign(count, 0.0f);
+	invMass.assign(count, 1.0f);
+	restLength.assign(count, 0.0f);
+	restPositions.resize(count);
+}
+
+uint32_t GuideStrands::numVertices() const {
+	return numStrands * verticesPerStrand;
+}
+
+glm::vec3 GuideStrands::position(uint32_t index) const {
+	return glm::vec3(posX[index], posY[index], posZ[index]);
+}
+
+void GuideStrands::setPosition(uint32_t index, const glm::vec3& position) {
+	posX[index] = position.x;
+	posY[index] = position.y;
+	posZ[index] = position.z;
+}
+
+uint64_t GuideStrands::hash() const {
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (const std::vector<float>* values : { &posX, &posY, &posZ, &velX, &velY, &velZ }) {
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(values->data());
+		const size_t size = values->size() * sizeof(float);
+		for (size_t i = 0; i < size; i++) {
+			h ^= bytes[i];
+			h *= 0x100000001b3ull;
+		}
+	}
+	return h;
+}
+
+static uint32_t findRoot(std::vector<uint32_t>& parents, uint32_t i) {
+	while (parents[i] != i) {
+		// Path halving keeps the trees flat without recursion.
+		parents[i] = parents[parents[i]];
+		i = parents[i];
+	}
+	return i;
+}
+
+GuideStrands buildGuideStrands(
+	const std::vector<Vertex>& vertices,
+	const std::vector<uint32_t>& indices,
+	const glm::vec3& rootAnchor,
+	uint32_t verticesPerStrand,
+	CardVertexInfo* cardInfo
+) {
+	if (verticesPerStrand < 2) {
+		throw std::runtime_error("A guide strand needs at least 2 vertices.");
+	}
+
+	/* Find the cards (connected components of the triangle mesh). */
+	std::vector<uint32_t> parents(vertices.size());
+	std::iota(parents.begin(), parents.end(), 0);
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		const uint32_t a = findRoot(parents, indices[i]);
+		const uint32_t b = findRoot(parents, indices[i + 1]);
+		const uint32_t c = findRoot(parents, indices[i + 2]);
+		parents[b] = a;
+		parents[c] = a;
+	}
+
+	std::unordered_map<uint32_t, std::vector<uint32_t>> cards;
+	for (uint32_t i = 0; i < vertices.size(); i++) {
+		cards[findRoot(parents, i)].push_back(i);
+	}
+
+	// Sort by the first vertex so that the strand order doesn't depend on the hash map.
+	std::vector<const std::vector<uint32_t>*> sortedCards;
+	sortedCards.reserve(cards.size());
+	for (const auto& pair : cards) {
+		sortedCards.push_back(&pair.second);
+	}
+	std::sort(sortedCards.begin(), sortedCards.end(), [](const auto* a, const auto* b) {
+		return a->front() < b->front();
+	});
+
+	if (cardInfo) {
+		cardInfo->strand.assign(vertices.size(), -1);
+		cardInfo->parameter.assign(vertices.size(), 0.0f);
+	}
+
+	/* Resample every card into a polyline with a fixed number of vertices. */
+	std::vector<std::vector<glm::vec3>> polylines;
+	std::vector<glm::vec3> samples;
+	const float lastSample = static_cast<float>(verticesPerStrand - 1);
+
+	for (const auto* card : sortedCards) {
+		if (card->size() < 4) {
+			continue;
+		}
+
+		float vMin = std::numeric_limits<float>::max();
+		float vMax = -std::numeric_limits<float>::max();
+		for (uint32_t i : *card) {
+			vMin = std::min(vMin, vertices[i].texCoord.y);
+			vMax = std::max(vMax, vertices[i].texCoord.y);
+		}
+		if (vMax - vMin < 1e-4f) {
+			continue;
+		}
+
+		// Decide which end of the card is the root.
+		glm::vec3 lowEnd(0.0f), highEnd(0.0f);
+		float lowCount = 0.0f, highCount = 0.0f;
+		for (uint32_t i : *card) {
+			const float t = (vertices[i].texCoord.y - vMin) / (vMax - vMin);
+			if (t < 0.25f) {
+				lowEnd += glm::vec3(vertices[i].pos);
+				lowCount += 1.0f;
+			}
+			else if (t > 0.75f) {
+				highEnd += glm::vec3(vertices[i].pos);
+				highCount += 1.0f;
+			}
+		}
+		if (lowCount == 0.0f || highCount == 0.0f) {
+			continue;
+		}
+		const bool flip = glm::length(highEnd / highCount - rootAnchor) < glm::length(lowEnd / lowCount - rootAnchor);
+
+		// Tent-filter the card vertices into the samples.
+		std::vector<glm::vec3> sums(verticesPerStrand, glm::vec3(0.0f));
+		std::vector<float> weights(verticesPerStrand, 0.0f);
+		for (uint32_t i : *card) {
+			float t = (vertices[i].texCoord.y - vMin) / (vMax - vMin);
+			if (flip) {
+				t = 1.0f - t;
+			}
+			const float x = t * lastSample;
+			const uint32_t s0 = std::min(static_cast<uint32_t>(x), verticesPerStrand - 2);
+			const float f = x - static_cast<float>(s0);
+			sums[s0] += glm::vec3(vertices[i].pos) * (1.0f - f);
+			weights[s0] += 1.0f - f;
+			sums[s0 + 1] += glm::vec3(vertices[i].pos) * f;
+			weights[s0 + 1] += f;
+		}
+
+		// Fill samples no vertex landed on by interpolating their filled neighbours.
+		samples.assign(verticesPerStrand, glm::vec3(0.0f));
+		std::vector<int32_t> filled;
+		for (uint32_t s = 0; s < verticesPerStrand; s++) {
+			if (weights[s] > 1e-6f) {
+				samples[s] = sums[s] / weights[s];
+				filled.push_back(static_cast<int32_t>(s));
+			}
+		}
+		if (filled.size() < 2) {
+			continue;
+		}
+		for (int32_t s = 0; s < static_cast<int32_t>(verticesPerStrand); s++) {
+			if (weights[s] > 1e-6f) {
+				continue;
+			}
+			auto next = std::lower_bound(filled.begin(), filled.end(), s);
+			if (next == filled.begin()) {
+				samples[s] = samples[*next];
+			}
+			else if (next == filled.end()) {
+				samples[s] = samples[filled.back()];
+			}
+			else {
+				const int32_t a = *(next - 1);
+				const int32_t b = *next;
+				samples[s] = glm::mix(samples[a], samples[b], static_cast<float>(s - a) / static_cast<float>(b - a));
+			}
+		}
+
+		// Cards whose samples collapse onto one point give nothing to simulate.
+		if (glm::length(samples.back() - samples.front()) < 1e-5f) {
+			continue;
+		}
+
+		if (cardInfo) {
+			const int32_t strand = static_cast<int32_t>(polylines.size());
+			for (uint32_t i : *card) {
+				const float t = (vertices[i].texCoord.y - vMin) / (vMax - vMin);
+				cardInfo->strand[i] = strand;
+				cardInfo->parameter[i] = flip ? 1.0f - t : t;
+			}
+		}
+
+		polylines.push_back(samples);
+	}
+
+	GuideStrands strands(static_cast<uint32_t>(polylines.size()), verticesPerStrand);
+	for (uint32_t s = 0; s < strands.numStrands; s++) {
+		for (uint32_t i = 0; i < verticesPerStrand; i++) {
+			const uint32_t index = s * verticesPerStrand + i;
+			const glm::vec3& p = polylines[s][i];
+			strands.setPosition(index, p);
+			strands.restPositions[index] = p;
+			strands.invMass[index] = (i == 0) ? 0.0f : 1.0f;
+			strands.restLength[index] = (i == 0) ? 0.0f : glm::length(p - polylines[s][i - 1]);
+		}
+	}
+
+	return strands;
+}
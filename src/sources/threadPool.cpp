@@ -0,0 +1,109 @@
+#include "threadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool() : ThreadPool(std::thread::hardware_concurrency()) {}
+
+ThreadPool::ThreadPool(uint32_t numThreads) :
+	generation(0),
+	pendingWorkers(0),
+	stopping(false),
+	job(nullptr),
+	numChunks(0),
+	nextChunk(0) {
+	numThreads = std::max(1u, numThreads);
+
+	// The calling thread is the first worker, so we only spawn the remaining ones.
+	for (uint32_t i = 1; i < numThreads; i++) {
+		workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wakeCondition.notify_all();
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+uint32_t ThreadPool::size() const {
+	return static_cast<uint32_t>(workers.size()) + 1;
+}
+
+void ThreadPool::run(uint32_t numChunks, const std::function<void(uint32_t)>& fn) {
+	if (numChunks == 0) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> runLock(runMutex);
+
+	if (workers.empty() || numChunks == 1) {
+		for (uint32_t chunk = 0; chunk < numChunks; chunk++) {
+			fn(chunk);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		job = &fn;
+		this->numChunks = numChunks;
+		nextChunk.store(0);
+		pendingWorkers = static_cast<uint32_t>(workers.size());
+		generation++;
+	}
+	wakeCondition.notify_all();
+
+	runChunks();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [this] { return pendingWorkers == 0; });
+	job = nullptr;
+}
+
+void ThreadPool::parallelFor(uint32_t count, const std::function<void(uint32_t, uint32_t, uint32_t)>& fn) {
+	parallelFor(count, size(), fn);
+}
+
+void ThreadPool::parallelFor(uint32_t count, uint32_t numPartitions, const std::function<void(uint32_t, uint32_t, uint32_t)>& fn) {
+	run(numPartitions, [&](uint32_t partition) {
+		const uint32_t begin = static_cast<uint32_t>(static_cast<uint64_t>(count) * partition / numPartitions);
+		const uint32_t end = static_cast<uint32_t>(static_cast<uint64_t>(count) * (partition + 1) / numPartitions);
+		fn(begin, end, partition);
+	});
+}
+
+void ThreadPool::workerLoop() {
+	uint64_t seenGeneration = 0;
+
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&] { return stopping || generation != seenGeneration; });
+			if (stopping) {
+				return;
+			}
+			seenGeneration = generation;
+		}
+
+		runChunks();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--pendingWorkers == 0) {
+				doneCondition.notify_one();
+			}
+		}
+	}
+}
+
+void ThreadPool::runChunks() {
+	for (uint32_t chunk = nextChunk.fetch_add(1); chunk < numChunks; chunk = nextChunk.fetch_add(1)) {
+		(*job)(chunk);
+	}
+}
@@ -1,10 +1,12 @@
 ﻿#include "ui.h"
 
 UI::UI() :
-	device(nullptr) {}
+	device(nullptr),
+	initInfo{} {}
 
 UI::UI(VkDevice* device) :
-	device(device) {
+	device(device),
+	initInfo{} {
 	// ImGui context + style.
 	IMGUI_CHECKVERSION();
 	ImGui::CreateContext();
@@ -45,7 +47,7 @@ void UI::init(
 		throw std::runtime_error("failed to create ImGui descriptor pool");
 
 	// Vulkan backend init‑info.
-	ImGui_ImplVulkan_InitInfo initInfo{};
+	initInfo = {};
 	initInfo.Instance = instance;
 	initInfo.PhysicalDevice = physicalDevice;
 	initInfo.Device = *device;
@@ -88,6 +90,17 @@ void UI::destroy() {
 	}
 }
 
+void UI::setMinImageCount(uint32_t minImageCount) {
+	ImGui_ImplVulkan_SetMinImageCount(minImageCount);
+	initInfo.MinImageCount = minImageCount;
+}
+
+void UI::setRenderPass(VkRenderPass renderPass) {
+	ImGui_ImplVulkan_Shutdown();
+	initInfo.RenderPass = renderPass;
+	ImGui_ImplVulkan_Init(&initInfo);
+}
+
 ImGuiIO& UI::getIO() {
 	return ImGui::GetIO();
 }
@@ -103,10 +116,208 @@ void UI::drawNewFrame(UIState &state) {
 
 		ImGui::Text("Application Average: %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
 
-		ImGui::Text("Description: Currently the pipeline is using WBOIT for transparency rendering.");
+		// Up to what the GPU offers, the attachments get fewer samples if it offers less.
+		ImGui::Text("MSAA Cap ");
+		ImGui::SameLine();
+		ImGui::RadioButton("Off##MsaaCap", &state.msaaSampleCap, 1);
+		ImGui::SameLine();
+		ImGui::RadioButton("2x##MsaaCap", &state.msaaSampleCap, 2);
+		ImGui::SameLine();
+		ImGui::RadioButton("4x##MsaaCap", &state.msaaSampleCap, 4);
+		ImGui::SameLine();
+		ImGui::RadioButton("8x##MsaaCap", &state.msaaSampleCap, 8);
+		ImGui::Text("Offscreen attachments: %u samples, %u KiB", state.msaaSamples, state.transientImageKiB);
+
+		ImGui::Text("Description: Transparent hair is composited with the OIT mode picked below.");
 		ImGui::Text("Transparency On ");
 		ImGui::SameLine();
 		ImGui::Checkbox("##Transparency", &state.transparencyOn);
+		if (state.transparencyOn) {
+			// Switches between the approximate and the sorted composite from one frame to the next.
+			ImGui::RadioButton("WBOIT", &state.oitMode, OIT_WEIGHTED_BLENDED);
+			if (state.linkedListOitSupported) {
+				ImGui::SameLine();
+				ImGui::RadioButton("Linked Lists", &state.oitMode, OIT_LINKED_LIST);
+			}
+			ImGui::SameLine();
+			ImGui::RadioButton("Moments", &state.oitMode, OIT_MOMENTS);
+			if (state.oitMode == OIT_LINKED_LIST) {
+				ImGui::SliderInt("Nodes per Pixel", &state.oitNodesPerPixel, 1, MAX_OIT_NODES_PER_PIXEL);
+				state.oitNodesPerPixelEditing = ImGui::IsItemActive();
+				ImGui::Text("OIT nodes: %u of %u used, %u dropped", state.oitNodesUsed, state.oitNodeCapacity, state.oitNodesDropped);
+				ImGui::Text("Fragments past the sort limit: %u", state.oitFragmentsTruncated);
+			}
+			else if (state.oitMode == OIT_MOMENTS) {
+				// More moments and wider floats cost memory and bandwidth for every sample, and give less
+				// light leaking through the hair in return.
+				ImGui::Text("Moments ");
+				ImGui::SameLine();
+				ImGui::RadioButton("4", &state.momentCount, 4);
+				ImGui::SameLine();
+				ImGui::RadioButton("6", &state.momentCount, 6);
+				ImGui::SameLine();
+				ImGui::RadioButton("8", &state.momentCount, 8);
+				if (state.momentSinglePrecisionSupported) {
+					ImGui::Text("Precision ");
+					ImGui::SameLine();
+					if (ImGui::RadioButton("16 bit", !state.momentSinglePrecision)) {
+						state.momentSinglePrecision = false;
+					}
+					ImGui::SameLine();
+					if (ImGui::RadioButton("32 bit", state.momentSinglePrecision)) {
+						state.momentSinglePrecision = true;
+					}
+				}
+				ImGui::Text("Moment attachments: %u bytes per pixel", state.momentBytesPerPixel);
+			}
+			else {
+				// The hair is drawn into smaller images and composited at full resolution, guided by the depth.
+				ImGui::Text("Resolution ");
+				ImGui::SameLine();
+				ImGui::RadioButton("Full", &state.transparentResolution, TRANSPARENT_FULL);
+				ImGui::SameLine();
+				ImGui::RadioButton("Half", &state.transparentResolution, TRANSPARENT_HALF);
+				ImGui::SameLine();
+				ImGui::RadioButton("Quarter", &state.transparentResolution, TRANSPARENT_QUARTER);
+				ImGui::SameLine();
+				ImGui::RadioButton("Dynamic", &state.transparentResolution, TRANSPARENT_DYNAMIC);
+				if (state.transparentResolution == TRANSPARENT_DYNAMIC) {
+					ImGui::SliderFloat("GPU Budget (ms)", &state.transparentBudgetMs, 2.0f, 33.0f);
+				}
+				ImGui::Text("GPU frame: %.2f ms, transparent scale %.2f", state.gpuFrameMs, state.transparentScale);
+			}
+			// Cards opaque enough are drawn in the opaque pass, the OIT pass shades only what is left in front.
+			ImGui::Text("Opaque Hair Core ");
+			ImGui::SameLine();
+			ImGui::Checkbox("##HairCore", &state.hairOpaqueCoreOn);
+			if (state.hairOpaqueCoreOn) {
+				ImGui::SliderFloat("Core Alpha", &state.hairCoreAlpha, 0.5f, 1.0f);
+			}
+			if (state.hairStatisticsSupported) {
+				ImGui::Text("Hair fragments: prepass %u, core %u, OIT %u", state.hairPrepassFragments, state.hairCoreFragments, state.hairTransparentFragments);
+				ImGui::Text("Hair fragments in the OIT pass without the core: %u", state.hairUnsplitFragments);
+			}
+		}
+		ImGui::Text("Strand Renderer ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##StrandRenderer", &state.strandRendererOn);
+		if (state.strandRendererOn) {
+			ImGui::SliderInt("Strands per Guide", &state.strandsPerGuide, 1, MAX_STRANDS_PER_GUIDE);
+			ImGui::SliderFloat("Root Width", &state.strandRootWidth, 0.0f, 0.003f, "%.5f");
+			ImGui::SliderFloat("Tip Width", &state.strandTipWidth, 0.0f, 0.003f, "%.5f");
+			ImGui::SliderFloat("Strand Opacity", &state.strandOpacity, 0.0f, 1.0f);
+			ImGui::Text("Strand LOD ");
+			ImGui::SameLine();
+			ImGui::Checkbox("##StrandLod", &state.strandLodOn);
+			if (state.strandLodOn) {
+				ImGui::SliderFloat("Full Detail Width (px)", &state.strandLodPixels, 0.1f, 4.0f);
+				ImGui::SliderFloat("Min Strand Fraction", &state.strandLodMinFraction, 0.02f, 1.0f);
+			}
+			ImGui::Text("Strands drawn: %u of %u", state.strandsDrawn, state.strandInstances);
+			if (state.strandsDropped > 0) {
+				ImGui::Text("Strands past the visible list: %u", state.strandsDropped);
+			}
+		}
+
+		ImGui::Text("GPU Culling ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##GpuCulling", &state.gpuCullingOn);
+		ImGui::Text("Clusters drawn: %u of %u", state.clustersDrawn, state.clustersTotal);
+
+		// One instanced draw per mesh however many there are, or the clusters each character keeps with the culling.
+		ImGui::SliderInt("Crowd Size", &state.crowdSize, 1, MAX_CHARACTER_INSTANCES);
+		if (state.crowdSize > 1) {
+			ImGui::SliderFloat("Crowd Spacing", &state.crowdSpacing, 0.3f, 2.0f);
+		}
+		if (ImGui::Button("Crowd Test")) {
+			state.crowdSize = 144;
+		}
+		ImGui::Text("Uniforms: %u bytes this frame, %u at most", state.uniformBytesUsed, state.uniformBytesPeak);
+		ImGui::Text("Descriptors: %u sets, %u of %u descriptors in %u pools", state.descriptorSets, state.descriptorsUsed, state.descriptorsReserved, state.descriptorPools);
+		ImGui::Text("Descriptor cache: %u hits, %u sets written (%u descriptors) this frame", state.descriptorCacheHits, state.descriptorCacheMisses, state.descriptorWrites);
+		if (ImGui::Button("Dump Frame Graph")) {
+			state.dumpFrameGraph = true;
+		}
+
+		ImGui::Text("Wind ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##Wind", &state.forces.windOn);
+		if (state.forces.windOn) {
+			ImGui::DragFloat3("Wind Direction", &state.forces.windDirection.x, 0.01f, -1.0f, 1.0f);
+			ImGui::SliderFloat("Wind Speed", &state.forces.windSpeed, 0.0f, 10.0f);
+			ImGui::SliderFloat("Turbulence", &state.forces.turbulence, 0.0f, 2.0f);
+			ImGui::SliderFloat("Turbulence Frequency", &state.forces.turbulenceFrequency, 0.5f, 20.0f);
+			ImGui::SliderFloat("Turbulence Speed", &state.forces.turbulenceSpeed, 0.0f, 5.0f);
+			ImGui::SliderFloat("Gust Jitter", &state.forces.gustJitter, 0.0f, 1.0f);
+		}
+		ImGui::Text("Air Drag ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##Drag", &state.forces.dragOn);
+		ImGui::SliderFloat("Drag", &state.forces.drag, 0.0f, 10.0f);
+		for (uint32_t i = 0; i < MAX_POINT_ATTRACTORS; i++) {
+			PointAttractor& attractor = state.forces.attractors[i];
+			ImGui::PushID(static_cast<int>(i));
+			ImGui::Text("Attractor %u ", i);
+			ImGui::SameLine();
+			ImGui::Checkbox("##Attractor", &attractor.enabled);
+			if (attractor.enabled) {
+				ImGui::DragFloat3("Position", &attractor.position.x, 0.01f);
+				ImGui::SliderFloat("Strength", &attractor.strength, -10.0f, 10.0f);
+				ImGui::SliderFloat("Radius", &attractor.radius, 0.01f, 1.0f);
+			}
+			ImGui::PopID();
+		}
+
+		ImGui::Text("Animate Head ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##HeadAnimation", &state.headAnimationOn);
+
+		ImGui::Text("Simulation On ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##Simulation", &state.simulationOn);
+		ImGui::Text("Hair Volume ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##HairVolume", &state.hairVolumeOn);
+		ImGui::Text("GPU Simulation ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##GpuSimulation", &state.gpuSimulationOn);
+		ImGui::SliderFloat("Parity Tolerance", &state.gpuParityTolerance, 1e-5f, 1e-2f, "%.5f", ImGuiSliderFlags_Logarithmic);
+		if (ImGui::Button("Check GPU Parity")) {
+			state.checkGpuParity = true;
+		}
+		if (state.gpuParityChecked) {
+			ImGui::SameLine();
+			ImGui::TextColored(state.gpuParityPassed ? ImVec4(0.4f, 1.0f, 0.4f, 1.0f) : ImVec4(1.0f, 0.3f, 0.3f, 1.0f),
+				"%s, max error %.2e", state.gpuParityPassed ? "PASSED" : "FAILED", state.gpuParityError);
+		}
+		ImGui::Text("Simulation LOD ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##SimulationLod", &state.simulationLodOn);
+		ImGui::Text("LOD level: %u (hair covers %.0f px)", state.simulationLodLevel, state.hairScreenSize);
+
+		ImGui::Text("Record Cache ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##RecordCache", &state.recordCacheOn);
+		ImGui::Text("Play Cache ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##PlayCache", &state.playCacheOn);
+		ImGui::Text("Quantize Cache ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##QuantizeCache", &state.cacheQuantizeOn);
+		ImGui::Text("Compress Cache ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##CompressCache", &state.cacheCompressOn);
+		ImGui::Text("Cached frames: %u", state.cachedFrames);
+		if (ImGui::Button("Benchmark Cache")) {
+			state.benchmarkCache = true;
+		}
+
+		ImGui::Text("Deterministic ");
+		ImGui::SameLine();
+		ImGui::Checkbox("##Deterministic", &state.deterministicOn);
+		if (ImGui::Button("Check Determinism")) {
+			state.checkDeterminism = true;
+		}
 		
 		ImGui::End();
 	}
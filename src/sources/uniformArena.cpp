@@ -0,0 +1,92 @@
+#include "uniformArena.h"
+
+#include <algorithm>
+#include <cstring>
+
+UniformArena::UniformArena() :
+	device(nullptr),
+	memory(VK_NULL_HANDLE),
+	mapped(nullptr),
+	frameSize(0),
+	numFrames(0),
+	alignment(1),
+	cursor(0),
+	frameBegin(0),
+	frameEnd(0),
+	peakUsage(0),
+	buffer(VK_NULL_HANDLE) {}
+
+UniformArena::UniformArena(
+	VkDevice* device,
+	VkBuffer buffer,
+	VkDeviceMemory memory,
+	VkDeviceSize frameSize,
+	uint32_t numFrames,
+	VkDeviceSize alignment
+) :
+	device(device),
+	memory(memory),
+	mapped(nullptr),
+	frameSize(frameSize),
+	numFrames(numFrames),
+	alignment(std::max<VkDeviceSize>(alignment, 1)),
+	cursor(0),
+	frameBegin(0),
+	frameEnd(frameSize),
+	peakUsage(0),
+	buffer(buffer) {
+	if (frameSize % this->alignment != 0) {
+		throw std::runtime_error("The uniform arena slices must start on the offset alignment.");
+	}
+
+	void* data;
+	if (vkMapMemory(*device, memory, 0, frameSize * numFrames, 0, &data) != VK_SUCCESS) {
+		throw std::runtime_error("failed to map the uniform arena!");
+	}
+	mapped = static_cast<uint8_t*>(data);
+}
+
+UniformArena::~UniformArena() {}
+
+void UniformArena::destroy() {
+	if (device == nullptr || buffer == VK_NULL_HANDLE) {
+		return;
+	}
+
+	vkUnmapMemory(*device, memory);
+	vkDestroyBuffer(*device, buffer, nullptr);
+	vkFreeMemory(*device, memory, nullptr);
+	mapped = nullptr;
+	buffer = VK_NULL_HANDLE;
+	memory = VK_NULL_HANDLE;
+}
+
+void UniformArena::beginFrame(uint32_t frame) {
+	frameBegin = frameSize * (frame % std::max(numFrames, 1u));
+	frameEnd = frameBegin + frameSize;
+	cursor = frameBegin;
+}
+
+uint32_t UniformArena::allocate(const void* data, VkDeviceSize size) {
+	const VkDeviceSize offset = (cursor + alignment - 1) / alignment * alignment;
+	if (offset + size > frameEnd) {
+		throw std::runtime_error("The uniform arena ran out of space for this frame.");
+	}
+
+	std::memcpy(mapped + offset, data, static_cast<size_t>(size));
+	cursor = offset + size;
+	peakUsage = std::max(peakUsage, cursor - frameBegin);
+	return static_cast<uint32_t>(offset);
+}
+
+VkDeviceSize UniformArena::getFrameUsage() const {
+	return cursor - frameBegin;
+}
+
+VkDeviceSize UniformArena::getPeakUsage() const {
+	return peakUsage;
+}
+
+VkDeviceSize UniformArena::getFrameSize() const {
+	return frameSize;
+}
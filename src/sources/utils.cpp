@@ -1,4 +1,5 @@
 ﻿#include "utils.h"
+#include "meshCache.h"
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
@@ -50,7 +51,7 @@ void writeSPVToFile(const std::vector<uint32_t>& spirvCode, const std::string& o
 	outFile.close();
 }
 
-std::string compileShader(const std::string path, const std::string shaderName, const Shader type) {
+std::string compileShader(const std::string path, const std::string shaderName, const Shader type, const std::vector<std::string>& defines) {
 	/* Define the output path. */
 	// Handles both '/' and '\' (cross-platform)
 	size_t lastSlash = path.find_last_of("/\\");
@@ -65,14 +66,29 @@ std::string compileShader(const std::string path, const std::string shaderName,
 	std::string bindings = readShaderFile("headers/bindings.inc");
 	std::string body = readShaderFile(path);
 
+	// shaderc is given no includer, so the files of #include "name" lines are pasted in here, found next to
+	// the shader.
+	for (size_t include = body.find("#include \""); include != std::string::npos; include = body.find("#include \"", include)) {
+		const size_t nameStart = include + std::string("#include \"").size();
+		const size_t nameEnd = body.find('"', nameStart);
+		if (nameEnd == std::string::npos) {
+			throw std::runtime_error("Unterminated #include in " + path + ".");
+		}
+		body.replace(include, nameEnd + 1 - include, readShaderFile(shaderPath + body.substr(nameStart, nameEnd - nameStart)));
+	}
+
 	// Find the position after the #version line
 	size_t versionEnd = body.find('\n');
 	if (versionEnd == std::string::npos) {
 		throw std::runtime_error("Shader file missing #version directive.");
 	}
 
-	// Insert bindings after the #version line
-	std::string fullCode = body.substr(0, versionEnd + 1) + bindings + "\n" + body.substr(versionEnd + 1);
+	// Insert bindings and defines after the #version line
+	std::string fullCode = body.substr(0, versionEnd + 1) + bindings + "\n";
+	for (const std::string& define : defines) {
+		fullCode += "#define " + define + "\n";
+	}
+	fullCode += body.substr(versionEnd + 1);
 	std::vector<uint32_t> SPIRV;
 
 	// Uncomment the code below to dump the full shader code to a file for debugging.
@@ -93,6 +109,9 @@ std::string compileShader(const std::string path, const std::string shaderName,
 	case Shader::FRAGMENT:
 		SPIRV = compileShaderToSPV(fullCode, shaderc_glsl_fragment_shader);
 		break;
+	case Shader::COMPUTE:
+		SPIRV = compileShaderToSPV(fullCode, shaderc_glsl_compute_shader);
+		break;
 	default:
 		throw std::runtime_error("Shader type not supported.");
 		break;
@@ -368,4 +387,45 @@ std::pair<std::vector<Vertex>, std::vector<uint32_t>> loadModel(const std::strin
 	}
 
 	return std::pair<std::vector<Vertex>, std::vector<uint32_t>>();
+}
+
+std::vector<ClusteredMesh> loadClusteredModels(const std::vector<std::string>& modelPaths, ThreadPool& pool) {
+	std::vector<ClusteredMesh> meshes(modelPaths.size());
+	std::vector<std::exception_ptr> errors(modelPaths.size());
+	std::vector<std::string> reports(modelPaths.size());
+
+	pool.run(static_cast<uint32_t>(modelPaths.size()), [&](uint32_t m) {
+		try {
+			const std::string& modelPath = modelPaths[m];
+			const std::string cachePath = modelPath + MESH_CACHE_EXTENSION;
+			ClusteredMesh& mesh = meshes[m];
+
+			// A cache that doesn't match the model or the limits is rebuilt. The builder itself is checked by
+			// tests/meshClustersTest.cpp rather than on every start.
+			const bool cached = readMeshCache(cachePath, modelPath, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, mesh);
+			if (!cached) {
+				auto model = loadModel(modelPath);
+				mesh = buildMeshlets(std::move(model.first), model.second, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+			}
+			reports[m] = "Meshlets of " + modelPath + (cached ? " (cached): " : ": ") +
+				std::to_string(mesh.clusters.size()) + " for " + std::to_string(mesh.indices.size() / 3) + " triangles.\n";
+
+			if (!cached && !writeMeshCache(cachePath, modelPath, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, mesh)) {
+				reports[m] += "Couldn't write the mesh cache " + cachePath + ".\n";
+			}
+		}
+		catch (...) {
+			errors[m] = std::current_exception();
+		}
+	});
+
+	for (size_t m = 0; m < modelPaths.size(); m++) {
+		std::cout << reports[m];
+	}
+	for (const std::exception_ptr& error : errors) {
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+	return meshes;
 }
\ No newline at end of file
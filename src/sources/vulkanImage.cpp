@@ -123,6 +123,20 @@ void VulkanImage::bindMemory(const VkDeviceSize allocationSize, const uint32_t m
 	vkBindImageMemory(*device, image, memory, 0);
 }
 
+void VulkanImage::bindMemory(VkDeviceMemory sharedMemory, const VkDeviceSize offset) {
+	if (vkBindImageMemory(*device, image, sharedMemory, offset) != VK_SUCCESS) {
+		throw std::runtime_error("Failed to bind image memory!");
+	}
+}
+
+VkImageUsageFlags VulkanImage::getUsage() const {
+	return usage;
+}
+
+VkSampleCountFlagBits VulkanImage::getSamples() const {
+	return samples;
+}
+
 void VulkanImage::createView() {
 	VkImageViewCreateInfo viewInfo{};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -0,0 +1,198 @@
+// Headless checks of the meshlet builder on synthetic meshes, without a window or a device. Needs only
+// this file, sources/meshClusters.cpp and the headers it includes (glm, and the Vulkan types of vertex.h):
+//     g++ -std=c++17 -O2 -Iheaders tests/meshClustersTest.cpp sources/meshClusters.cpp -o meshClustersTest
+// from src, with the glm and GLFW include directories added as for the app. Exits with 1 if a check failed.
+#include "meshClusters.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+	// As MESHLET_MAX_VERTICES and MESHLET_MAX_TRIANGLES in utils.h, which pulls in the whole renderer.
+	const uint32_t MAX_VERTICES = 64;
+	const uint32_t MAX_TRIANGLES = 124;
+
+	struct SyntheticMesh {
+		std::vector<Vertex> vertices;
+		std::vector<uint32_t> indices;
+	};
+
+	Vertex makeVertex(const glm::vec3& position) {
+		Vertex vertex{};
+		vertex.pos = glm::vec4(position, 1.0f);
+		vertex.normal = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+		vertex.color = glm::vec4(1.0f);
+		return vertex;
+	}
+
+	// A closed fan of rimVertices triangles around one centre vertex, which every triangle shares.
+	SyntheticMesh makeFan(uint32_t rimVertices) {
+		SyntheticMesh mesh;
+		mesh.vertices.push_back(makeVertex(glm::vec3(0.0f)));
+		for (uint32_t i = 0; i < rimVertices; i++) {
+			const float angle = 6.2831853f * static_cast<float>(i) / static_cast<float>(rimVertices);
+			mesh.vertices.push_back(makeVertex(glm::vec3(std::cos(angle), std::sin(angle), 0.0f)));
+		}
+		for (uint32_t i = 0; i < rimVertices; i++) {
+			mesh.indices.insert(mesh.indices.end(), { 0, 1 + i, 1 + (i + 1) % rimVertices });
+		}
+		return mesh;
+	}
+
+	// A flat grid of cells x cells quads, two triangles each.
+	SyntheticMesh makeGrid(uint32_t cells) {
+		SyntheticMesh mesh;
+		for (uint32_t y = 0; y <= cells; y++) {
+			for (uint32_t x = 0; x <= cells; x++) {
+				mesh.vertices.push_back(makeVertex(glm::vec3(static_cast<float>(x), static_cast<float>(y), 0.0f)));
+			}
+		}
+		for (uint32_t y = 0; y < cells; y++) {
+			for (uint32_t x = 0; x < cells; x++) {
+				const uint32_t v = y * (cells + 1) + x;
+				mesh.indices.insert(mesh.indices.end(), { v, v + 1, v + cells + 2 });
+				mesh.indices.insert(mesh.indices.end(), { v, v + cells + 2, v + cells + 1 });
+			}
+		}
+		return mesh;
+	}
+
+	// A small grid with triangles that repeat a vertex, use one vertex three times, or have three in a line.
+	SyntheticMesh makeDegenerate() {
+		SyntheticMesh mesh = makeGrid(6);
+		const uint32_t row = 7;
+		for (uint32_t i = 0; i < 20; i++) {
+			const uint32_t v = (i * 5) % (row * row - row - 1);
+			mesh.indices.insert(mesh.indices.end(), { v, v, v + 1 });
+			mesh.indices.insert(mesh.indices.end(), { v, v, v });
+			// Along a row of the grid.
+			const uint32_t x = v % row;
+			if (x + 2 < row) {
+				mesh.indices.insert(mesh.indices.end(), { v, v + 1, v + 2 });
+			}
+		}
+		return mesh;
+	}
+
+	// Quads that share no vertex, like the hair cards.
+	SyntheticMesh makeCards(uint32_t cards) {
+		SyntheticMesh mesh;
+		for (uint32_t c = 0; c < cards; c++) {
+			const glm::vec3 origin(static_cast<float>(c % 16) * 2.0f, 0.0f, static_cast<float>(c / 16) * 2.0f);
+			const uint32_t v = static_cast<uint32_t>(mesh.vertices.size());
+			mesh.vertices.push_back(makeVertex(origin));
+			mesh.vertices.push_back(makeVertex(origin + glm::vec3(0.2f, 0.0f, 0.0f)));
+			mesh.vertices.push_back(makeVertex(origin + glm::vec3(0.2f, 1.0f, 0.1f)));
+			mesh.vertices.push_back(makeVertex(origin + glm::vec3(0.0f, 1.0f, 0.1f)));
+			mesh.indices.insert(mesh.indices.end(), { v, v + 1, v + 2, v, v + 2, v + 3 });
+		}
+		return mesh;
+	}
+
+	// The triangle rotated so that its smallest index comes first, which keeps its winding.
+	std::array<uint32_t, 3> triangleKey(const std::vector<uint32_t>& indices, size_t i) {
+		std::array<uint32_t, 3> key = { indices[i], indices[i + 1], indices[i + 2] };
+		std::rotate(key.begin(), std::min_element(key.begin(), key.end()), key.end());
+		return key;
+	}
+
+	// Checks the meshlets without checkMeshletCoverage, then that it agrees. Returns what failed, if anything.
+	std::string checkMeshlets(const SyntheticMesh& source, const ClusteredMesh& mesh, uint32_t maxVertices, uint32_t maxTriangles) {
+		if (mesh.vertices.size() != source.vertices.size() ||
+			!std::equal(mesh.vertices.begin(), mesh.vertices.end(), source.vertices.begin())) {
+			return "the vertices changed";
+		}
+		if (mesh.indices.size() != source.indices.size()) {
+			return "the index count changed";
+		}
+
+		uint32_t nextIndex = 0;
+		for (const MeshCluster& cluster : mesh.clusters) {
+			if (cluster.firstIndex != nextIndex) {
+				return "the meshlets are not back to back";
+			}
+			if (cluster.indexCount == 0 || cluster.indexCount % 3 != 0 || cluster.firstIndex + cluster.indexCount > mesh.indices.size()) {
+				return "a meshlet has a broken index range";
+			}
+			if (cluster.indexCount / 3 > maxTriangles) {
+				return "a meshlet has " + std::to_string(cluster.indexCount / 3) + " triangles";
+			}
+
+			std::vector<uint32_t> used(mesh.indices.begin() + cluster.firstIndex, mesh.indices.begin() + cluster.firstIndex + cluster.indexCount);
+			std::sort(used.begin(), used.end());
+			used.erase(std::unique(used.begin(), used.end()), used.end());
+			if (used.size() > maxVertices) {
+				return "a meshlet has " + std::to_string(used.size()) + " vertices";
+			}
+			if (used.size() != cluster.vertexCount) {
+				return "a meshlet miscounts its vertices";
+			}
+
+			// The culling relies on the sphere holding every vertex.
+			if (!std::isfinite(cluster.radius)) {
+				return "a meshlet has no finite bounds";
+			}
+			for (uint32_t v : used) {
+				if (glm::length(glm::vec3(mesh.vertices[v].pos) - cluster.centre) > cluster.radius * 1.0001f + 1e-6f) {
+					return "a vertex lies outside its meshlet's sphere";
+				}
+			}
+			nextIndex += cluster.indexCount;
+		}
+		if (nextIndex != mesh.indices.size()) {
+			return "the meshlets leave indices out";
+		}
+
+		std::vector<std::array<uint32_t, 3>> sourceTriangles;
+		std::vector<std::array<uint32_t, 3>> meshletTriangles;
+		for (size_t i = 0; i + 2 < source.indices.size(); i += 3) {
+			sourceTriangles.push_back(triangleKey(source.indices, i));
+			meshletTriangles.push_back(triangleKey(mesh.indices, i));
+		}
+		std::sort(sourceTriangles.begin(), sourceTriangles.end());
+		std::sort(meshletTriangles.begin(), meshletTriangles.end());
+		if (sourceTriangles != meshletTriangles) {
+			return "a triangle is missing, repeated or turned over";
+		}
+
+		if (!checkMeshletCoverage(source.indices, mesh, maxVertices, maxTriangles)) {
+			return "checkMeshletCoverage rejects good meshlets";
+		}
+		// And it has to notice a triangle turned over.
+		if (!mesh.indices.empty()) {
+			ClusteredMesh flipped = mesh;
+			std::swap(flipped.indices[1], flipped.indices[2]);
+			if (flipped.indices[1] != flipped.indices[2] && flipped.indices[0] != flipped.indices[1] &&
+				checkMeshletCoverage(source.indices, flipped, maxVertices, maxTriangles)) {
+				return "checkMeshletCoverage accepts a turned over triangle";
+			}
+		}
+		return "";
+	}
+
+	bool runCase(const std::string& name, const SyntheticMesh& source, uint32_t maxVertices = MAX_VERTICES, uint32_t maxTriangles = MAX_TRIANGLES) {
+		const ClusteredMesh mesh = buildMeshlets(source.vertices, source.indices, maxVertices, maxTriangles);
+		const std::string failure = checkMeshlets(source, mesh, maxVertices, maxTriangles);
+		std::cout << name << ": " << mesh.clusters.size() << " meshlets for " << source.indices.size() / 3 << " triangles, "
+			<< (failure.empty() ? "PASSED" : "FAILED, " + failure) << ".\n";
+		return failure.empty();
+	}
+}
+
+int main() {
+	bool passed = true;
+	passed &= runCase("Fan of 100", makeFan(100));
+	passed &= runCase("Fan of 300", makeFan(300));
+	passed &= runCase("Grid of 800", makeGrid(20));
+	passed &= runCase("Degenerate triangles", makeDegenerate());
+	passed &= runCase("Disjoint cards", makeCards(200));
+	passed &= runCase("Empty mesh", SyntheticMesh{});
+	// A meshlet per triangle.
+	passed &= runCase("Grid at the smallest limits", makeGrid(4), 3, 1);
+
+	std::cout << (passed ? "All meshlet checks PASSED.\n" : "Some meshlet checks FAILED.\n");
+	return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
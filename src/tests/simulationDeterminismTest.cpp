@@ -0,0 +1,105 @@
+// Headless check that the guide strand solver in deterministic mode gives bit-identical results for any number
+// of threads, without a window or a device. Needs only this file, the solver's sources and the headers they
+// include (glm, and the Vulkan types of vertex.h):
+//     g++ -std=c++17 -O2 -pthread -Iheaders tests/simulationDeterminismTest.cpp sources/hairSimulation.cpp
+//         sources/hairVolume.cpp sources/forceField.cpp sources/strands.cpp sources/threadPool.cpp
+//         -o simulationDeterminismTest
+// from src, with the glm and GLFW include directories added as for the app. Exits with 1 if a hash differs.
+#include "hairSimulation.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+namespace {
+	// As SIMULATION_TIMESTEP in utils.h, which pulls in the whole renderer.
+	const float TIMESTEP = 1.0f / 60.0f;
+	const uint32_t NUM_STEPS = 120;
+
+	// Strands hanging from the upper half of a sphere, like a head of hair. Neighbouring strands overlap in
+	// the voxel grid, which is the only stage that reduces across strands.
+	GuideStrands makeStrands(uint32_t rings, uint32_t perRing, uint32_t verticesPerStrand) {
+		GuideStrands strands(rings * perRing, verticesPerStrand);
+		const float segment = 0.02f;
+		for (uint32_t r = 0; r < rings; r++) {
+			const float polar = 0.2f + 1.2f * static_cast<float>(r) / static_cast<float>(rings);
+			for (uint32_t p = 0; p < perRing; p++) {
+				const float azimuth = 6.2831853f * static_cast<float>(p) / static_cast<float>(perRing);
+				const glm::vec3 normal(std::sin(polar) * std::cos(azimuth), std::sin(polar) * std::sin(azimuth), std::cos(polar));
+				const glm::vec3 root = 0.1f * normal;
+				const uint32_t s = r * perRing + p;
+				for (uint32_t i = 0; i < verticesPerStrand; i++) {
+					const uint32_t v = s * verticesPerStrand + i;
+					// Out of the scalp first, then bending down.
+					const glm::vec3 position = root + segment * static_cast<float>(i) * glm::normalize(normal + glm::vec3(0.0f, 0.0f, -0.1f * i));
+					strands.setPosition(v, position);
+					strands.restPositions[v] = position;
+					strands.invMass[v] = i == 0 ? 0.0f : 1.0f;
+					strands.restLength[v] = i == 0 ? 0.0f : glm::length(position - strands.restPositions[v - 1]);
+				}
+			}
+		}
+		return strands;
+	}
+
+	// Every stochastic and reducing stage: the voxel grid, the wind with its turbulence and gust jitter, and
+	// an attractor.
+	SimulationSettings makeSettings() {
+		SimulationSettings settings;
+		settings.deterministic = true;
+		settings.enableVolume = true;
+		settings.volumeResolution = glm::ivec3(16);
+		settings.forces.windOn = true;
+		settings.forces.dragOn = true;
+		settings.forces.attractors[0].enabled = true;
+		settings.forces.attractors[0].position = glm::vec3(0.2f, 0.0f, -0.1f);
+		return settings;
+	}
+
+	// The roots follow a head turning around z, so the rest shape is rotated too.
+	void moveRoots(HairSimulation& simulation, const GuideStrands& rest, float time) {
+		const float angle = 0.5f * std::sin(2.0f * time);
+		const glm::mat3 rotation(
+			glm::vec3(std::cos(angle), std::sin(angle), 0.0f),
+			glm::vec3(-std::sin(angle), std::cos(angle), 0.0f),
+			glm::vec3(0.0f, 0.0f, 1.0f));
+		std::vector<glm::vec3> positions(rest.numStrands);
+		std::vector<glm::mat3> rotations(rest.numStrands, rotation);
+		for (uint32_t s = 0; s < rest.numStrands; s++) {
+			positions[s] = rotation * rest.restPositions[s * rest.verticesPerStrand];
+		}
+		simulation.setRootFrames(positions, rotations);
+	}
+
+	uint64_t run(const GuideStrands& strands, uint32_t numThreads) {
+		ThreadPool pool(numThreads);
+		HairSimulation simulation(GuideStrands(strands), &pool, makeSettings());
+		simulation.reset();
+		for (uint32_t i = 0; i < NUM_STEPS; i++) {
+			moveRoots(simulation, strands, static_cast<float>(i) * TIMESTEP);
+			simulation.step(TIMESTEP);
+		}
+		return simulation.strands.hash();
+	}
+}
+
+int main() {
+	const GuideStrands strands = makeStrands(12, 40, 16);
+
+	std::cout << "Simulation determinism of " << strands.numStrands << " strands after " << NUM_STEPS << " steps:\n";
+	bool identical = true;
+	uint64_t reference = 0;
+	for (uint32_t numThreads : { 1u, 2u, 3u, 5u, 8u }) {
+		const uint64_t hash = run(strands, numThreads);
+		if (numThreads == 1) {
+			reference = hash;
+		}
+		identical = identical && hash == reference;
+		std::cout << "  " << std::dec << numThreads << " threads: " << std::hex << hash << std::dec
+			<< (hash == reference ? "" : ", DIFFERS") << "\n";
+	}
+
+	std::cout << (identical ? "All hashes identical, PASSED.\n" : "The hashes differ, FAILED.\n");
+	return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}